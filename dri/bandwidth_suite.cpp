@@ -0,0 +1,227 @@
+#include "bandwidth_suite.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+typedef chrono::steady_clock clock_type;
+
+double seconds(clock_type::time_point start)
+{
+    return chrono::duration<double>(clock_type::now() - start).count();
+}
+
+/// Where the sums of the reads go.
+volatile uint64_t sink;
+
+const char* const method_names[] = {
+    "map-write", "map-read", "pwrite", "pread", "rat-write", "vertex-fetch"
+};
+
+/// Read a buffer a cache line at a time, so that the sum cannot be
+/// optimized away.
+uint64_t read_words(uint64_t const* p, size_t n)
+{
+    uint64_t a = 0, b = 0, c = 0, d = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        a += p[i] + p[i + 4];
+        b += p[i + 1] + p[i + 5];
+        c += p[i + 2] + p[i + 6];
+        d += p[i + 3] + p[i + 7];
+    }
+    for (; i < n; ++i)
+        a += p[i];
+    return a + b + c + d;
+}
+
+/// Print a size with a binary suffix.
+string format_size(uint64_t size)
+{
+    static const char suffixes[] = "KMGT";
+    unsigned k = 0;
+    while (size >= 1024 && size % 1024 == 0 && k < 4)
+        size /= 1024, ++k;
+    string s = to_string(size);
+    if (k)
+        s += suffixes[k - 1];
+    return s;
+}
+
+/// This class is a buffer in memory.
+class software_buffer : public bandwidth_buffer {
+public:
+    explicit software_buffer(uint64_t size) : _size(size), _data(0)
+    {
+        if (posix_memalign(&_data, 4096, size ? size : 1) != 0)
+            throw bad_alloc();
+    }
+    ~software_buffer() { free(_data); }
+
+    uint64_t size() const { return _size; }
+    void* map() { return _data; }
+    void pread(uint64_t offset, uint64_t size, void* ptr)
+    {
+        check(offset, size);
+        memcpy(ptr, static_cast<char*>(_data) + offset, size);
+    }
+    void pwrite(uint64_t offset, uint64_t size, const void* ptr)
+    {
+        check(offset, size);
+        memcpy(static_cast<char*>(_data) + offset, ptr, size);
+    }
+
+private:
+    software_buffer(software_buffer const&);
+    software_buffer& operator = (software_buffer const&);
+
+    void check(uint64_t offset, uint64_t size) const
+    {
+        if (offset > _size || size > _size - offset)
+            throw out_of_range("software_buffer");
+    }
+
+    uint64_t _size;
+    void* _data;
+};
+
+}
+
+const char* bandwidth_suite::name(method m)
+{
+    return m < NUM_METHODS ? method_names[m] : "unknown";
+}
+
+const char* bandwidth_suite::name(bandwidth_device::domain d)
+{
+    return d == bandwidth_device::VRAM ? "vram" : "gtt";
+}
+
+bandwidth_suite::method bandwidth_suite::find_method(string const& name)
+{
+    for (unsigned m = 0; m < NUM_METHODS; ++m)
+        if (name == method_names[m])
+            return method(m);
+    throw runtime_error("unknown method " + name);
+}
+
+bandwidth_device::domain bandwidth_suite::find_domain(string const& name)
+{
+    if (name == "vram")
+        return bandwidth_device::VRAM;
+    if (name == "gtt")
+        return bandwidth_device::GTT;
+    throw runtime_error("unknown domain " + name);
+}
+
+void bandwidth_suite::run(vector<bandwidth_device::domain> const& domains,
+        vector<method> const& methods, vector<uint64_t> const& sizes, unsigned repeats)
+{
+    for (size_t d = 0; d < domains.size(); ++d)
+        for (size_t s = 0; s < sizes.size(); ++s) {
+            unique_ptr<bandwidth_buffer> buffer = _device.create(sizes[s], domains[d]);
+            for (size_t m = 0; m < methods.size(); ++m)
+                if (!gpu(methods[m]) || _device.has_kernels())
+                    _results.push_back(measure(*buffer, domains[d], methods[m], repeats));
+        }
+}
+
+bandwidth_suite::result bandwidth_suite::measure(bandwidth_buffer& b,
+        bandwidth_device::domain d, method m, unsigned repeats)
+{
+    result r = { d, m, b.size(), b.size(), repeats, 0, 0 };
+
+    // Host memory for pread and pwrite, touched so it is not faulted in
+    // while being timed.
+    vector<char> memory(m == PREAD || m == PWRITE ? b.size() : 0, 1);
+
+    double total = 0;
+    for (unsigned i = 0; i < repeats; ++i) {
+        clock_type::time_point start = clock_type::now();
+        switch (m) {
+        case MAP_WRITE:
+            memset(b.map(), int(i), b.size());
+            break;
+        case MAP_READ:
+            sink = read_words(static_cast<uint64_t const*>(b.map()), b.size() / 8);
+            break;
+        case PWRITE:
+            b.pwrite(0, b.size(), &memory[0]);
+            break;
+        case PREAD:
+            b.pread(0, b.size(), &memory[0]);
+            break;
+        case RAT_WRITE:
+            r.bytes = _device.run(bandwidth_device::RAT_WRITE, b);
+            break;
+        case VERTEX_FETCH:
+            r.bytes = _device.run(bandwidth_device::VERTEX_FETCH, b);
+            break;
+        default:
+            throw runtime_error("unknown method");
+        }
+        double t = seconds(start);
+        total += t;
+        r.best = i == 0 ? t : min(r.best, t);
+    }
+    r.mean = repeats ? total / repeats : 0;
+    return r;
+}
+
+void bandwidth_suite::write_table(ostream& os) const
+{
+    os << left << setw(7) << "domain" << setw(14) << "method"
+       << right << setw(8) << "size" << setw(12) << "best GB/s" << setw(12) << "mean GB/s"
+       << setw(12) << "best us" << '\n';
+    ios_base::fmtflags flags = os.flags(ios_base::fixed);
+    streamsize precision = os.precision(3);
+    for (size_t i = 0; i < _results.size(); ++i) {
+        result const& r = _results[i];
+        os << left << setw(7) << name(r.domain) << setw(14) << name(r.access)
+           << right << setw(8) << format_size(r.size)
+           << setw(12) << (r.best > 0 ? r.bytes / r.best / 1e9 : 0)
+           << setw(12) << (r.mean > 0 ? r.bytes / r.mean / 1e9 : 0)
+           << setw(12) << r.best * 1e6 << '\n';
+    }
+    os.flags(flags);
+    os.precision(precision);
+}
+
+void bandwidth_suite::write_json(ostream& os) const
+{
+    os << "{\n"
+       << "  \"device\": \"" << _device.name() << "\",\n"
+       << "  \"results\": [";
+    for (size_t i = 0; i < _results.size(); ++i) {
+        result const& r = _results[i];
+        os << (i ? ",\n" : "\n")
+           << "    { \"domain\": \"" << name(r.domain) << "\""
+           << ", \"method\": \"" << name(r.access) << "\""
+           << ", \"size\": " << r.size
+           << ", \"bytes\": " << r.bytes
+           << ", \"repeats\": " << r.repeats
+           << ", \"best_s\": " << r.best
+           << ", \"mean_s\": " << r.mean
+           << ", \"best_gbps\": " << (r.best > 0 ? r.bytes / r.best / 1e9 : 0)
+           << ", \"mean_gbps\": " << (r.mean > 0 ? r.bytes / r.mean / 1e9 : 0)
+           << " }";
+    }
+    os << "\n  ]\n}" << endl;
+}
+
+unique_ptr<bandwidth_buffer> software_bandwidth_device::create(uint64_t size, domain)
+{
+    return unique_ptr<bandwidth_buffer>(new software_buffer(size));
+}
+
+uint64_t software_bandwidth_device::run(kernel, bandwidth_buffer&)
+{
+    throw runtime_error("the software device runs no kernels");
+}
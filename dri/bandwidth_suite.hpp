@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/// This class is the interface of the bandwidth suite to a buffer object.
+class bandwidth_buffer {
+public:
+    virtual ~bandwidth_buffer() {}
+
+    /// Get the size of the buffer in bytes.
+    virtual std::uint64_t size() const = 0;
+    /// Map the whole buffer, if it is not mapped yet.
+    /// \returns The address at which the buffer is mapped.
+    virtual void* map() = 0;
+    /// Read from the buffer into memory, as radeon_buffer_object::pread.
+    virtual void pread(std::uint64_t offset, std::uint64_t size, void* ptr) = 0;
+    /// Write memory into the buffer, as radeon_buffer_object::pwrite.
+    virtual void pwrite(std::uint64_t offset, std::uint64_t size, const void* ptr) = 0;
+};
+
+/// This class is the interface of the bandwidth suite to a device, which
+/// creates buffers in a memory domain and may run the GPU-side kernels.
+class bandwidth_device {
+public:
+    /// Enumeration of the memory domains.
+    typedef enum {
+        VRAM,   ///< Video memory, mapped through the visible aperture.
+        GTT     ///< System memory, mapped through the GART.
+    } domain;
+
+    /// Enumeration of the GPU-side kernels.
+    typedef enum {
+        RAT_WRITE,      ///< Write the buffer, 16 bytes per item.
+        VERTEX_FETCH    ///< Fetch the buffer, 64 bytes per item.
+    } kernel;
+
+    virtual ~bandwidth_device() {}
+
+    /// Get the name of the device (its family).
+    virtual std::string name() const = 0;
+    /// Create a buffer.
+    /// \param size The size in bytes.
+    /// \param d The domain.
+    virtual std::unique_ptr<bandwidth_buffer> create(std::uint64_t size, domain d) = 0;
+    /// Determine whether the device runs the GPU-side kernels.
+    virtual bool has_kernels() const = 0;
+    /// Run a kernel over a buffer and wait until it is done.
+    /// It throws std::runtime_error if the device runs no kernels.
+    /// \param k The kernel.
+    /// \param b The buffer, created by this device.
+    /// \returns The number of bytes of the buffer the kernel went through.
+    virtual std::uint64_t run(kernel k, bandwidth_buffer& b) = 0;
+};
+
+/// This class runs the host-side and GPU-side accesses to buffers of a
+/// device for a range of sizes and domains, and reports their bandwidth.
+///
+/// Every measurement is repeated on the same buffer, which is mapped the
+/// first time it is needed: the first repetition pays for the page faults
+/// and the best one shows the steady state.
+class bandwidth_suite {
+public:
+    /// Enumeration of the access methods.
+    typedef enum {
+        MAP_WRITE,      ///< CPU writes through a mapping.
+        MAP_READ,       ///< CPU reads through a mapping.
+        PWRITE,         ///< pwrite from memory.
+        PREAD,          ///< pread into memory.
+        RAT_WRITE,      ///< GPU writes through a RAT.
+        VERTEX_FETCH,   ///< GPU reads through vertex fetches.
+        NUM_METHODS
+    } method;
+
+    /// This structure holds a measurement.
+    struct result {
+        bandwidth_device::domain domain;
+        method access;
+        std::uint64_t size;     ///< Size of the buffer.
+        std::uint64_t bytes;    ///< Bytes moved per repetition.
+        unsigned repeats;
+        double best;            ///< Shortest repetition, in seconds.
+        double mean;            ///< Mean repetition, in seconds.
+    };
+
+    /// Get the name of a method ("map-write").
+    static const char* name(method m);
+    /// Get the name of a domain ("vram").
+    static const char* name(bandwidth_device::domain d);
+    /// Find a method by name.
+    /// It throws std::runtime_error if there is none.
+    static method find_method(std::string const& name);
+    /// Find a domain by name.
+    /// It throws std::runtime_error if there is none.
+    static bandwidth_device::domain find_domain(std::string const& name);
+    /// Determine whether a method runs on the GPU.
+    static bool gpu(method m) { return m == RAT_WRITE || m == VERTEX_FETCH; }
+
+    /// This constructor associates the suite with a device.
+    explicit bandwidth_suite(bandwidth_device& device) : _device(device) {}
+
+    /// Measure every method in every domain for every size. The GPU-side
+    /// methods are skipped if the device runs no kernels.
+    /// \param domains The domains.
+    /// \param methods The methods.
+    /// \param sizes The sizes of the buffers in bytes.
+    /// \param repeats Repetitions of each measurement.
+    void run(std::vector<bandwidth_device::domain> const& domains,
+        std::vector<method> const& methods,
+        std::vector<std::uint64_t> const& sizes,
+        unsigned repeats);
+
+    /// Access the measurements.
+    std::vector<result> const& results() const { return _results; }
+
+    /// Write the measurements as a table, one line per measurement.
+    void write_table(std::ostream& os) const;
+    /// Write the measurements as JSON.
+    void write_json(std::ostream& os) const;
+
+private:
+    result measure(bandwidth_buffer& b, bandwidth_device::domain d, method m, unsigned repeats);
+
+    bandwidth_device& _device;
+    std::vector<result> _results;
+};
+
+/// This class is a software stand-in for a device: buffers in memory, no
+/// kernels. It runs the host-side paths of the suite without a GPU.
+class software_bandwidth_device : public bandwidth_device {
+public:
+    std::string name() const { return "software"; }
+    std::unique_ptr<bandwidth_buffer> create(std::uint64_t size, domain d);
+    bool has_kernels() const { return false; }
+    std::uint64_t run(kernel k, bandwidth_buffer& b);
+};
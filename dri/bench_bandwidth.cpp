@@ -0,0 +1,296 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "bandwidth_suite.hpp"
+#include "constant_ring.hpp"
+#include "cs_recording.hpp"
+#include "evergreen_command_stream.hpp"
+#include "radeon_buffer_object.hpp"
+#include "radeon_device.hpp"
+
+using namespace std;
+
+namespace {
+
+/// Items per group of the kernels.
+const unsigned group_items = 256;
+
+/// This class is a buffer object of a radeon device.
+class radeon_bandwidth_buffer : public bandwidth_buffer {
+public:
+    radeon_bandwidth_buffer(radeon_device const& device, uint64_t size, uint32_t domain)
+        : _bo(device, size, domain, 4096), _domain(domain), _ptr(0) {}
+
+    uint64_t size() const { return _bo.size(); }
+    void* map()
+    {
+        if (!_ptr)
+            _ptr = _bo.mmap();
+        return _ptr;
+    }
+    void pread(uint64_t offset, uint64_t size, void* ptr) { _bo.pread(offset, size, ptr); }
+    void pwrite(uint64_t offset, uint64_t size, const void* ptr) { _bo.pwrite(offset, size, ptr); }
+
+    radeon_buffer_object& bo() { return _bo; }
+    uint32_t domain() const { return _domain; }
+
+private:
+    radeon_buffer_object _bo;
+    uint32_t _domain;
+    void* _ptr;
+};
+
+/// This class runs the suite on a radeon device, the GPU-side kernels being
+/// samples/bandwidth_write.bin and samples/bandwidth_fetch.bin.
+///
+/// A kernel is timed from before its command stream is emitted to when its
+/// output is idle, so the time includes the submission.
+class radeon_bandwidth_device : public bandwidth_device {
+public:
+    /// \param path The device node.
+    /// \param kernels The directory of the kernels.
+    /// \param recordings The prefix of the recordings of the submissions
+    /// (prefix-n.rcs, for replay_cs), or empty for none.
+    radeon_bandwidth_device(const char* path, string const& kernels, string const& recordings)
+        : _device(path, false),
+          _constants(_device, 64 * 1024),
+          _recordings(recordings),
+          _recorded()
+    {
+        if (!kernels.empty()) {
+            _write.reset(load(kernels + "/bandwidth_write.bin"));
+            _fetch.reset(load(kernels + "/bandwidth_fetch.bin"));
+        }
+    }
+
+    string name() const { return _device.family_name(); }
+
+    unique_ptr<bandwidth_buffer> create(uint64_t size, domain d)
+    {
+        return unique_ptr<bandwidth_buffer>(new radeon_bandwidth_buffer(_device, size,
+            d == VRAM ? RADEON_GEM_DOMAIN_VRAM : RADEON_GEM_DOMAIN_GTT));
+    }
+
+    bool has_kernels() const { return _write && _fetch; }
+
+    uint64_t run(kernel k, bandwidth_buffer& b)
+    {
+        if (!has_kernels())
+            throw runtime_error("no kernels loaded");
+        radeon_bandwidth_buffer& buffer = static_cast<radeon_bandwidth_buffer&>(b);
+
+        // The write kernel stores 16 bytes per item, the fetch kernel reads
+        // 64 bytes and stores 4 bytes per item.
+        const uint32_t item_bytes = k == RAT_WRITE ? 16 : 64;
+        uint32_t items = buffer.size() / item_bytes;
+        uint32_t group = min(group_items, items), groups = group ? items / group : 0;
+        if (groups == 0)
+            throw runtime_error("the buffer is smaller than a work-item");
+
+        // The fetch kernel writes into a buffer of its own.
+        unique_ptr<radeon_buffer_object> output;
+        if (k == VERTEX_FETCH)
+            output.reset(new radeon_buffer_object(_device, uint64_t(groups) * group * 4,
+                RADEON_GEM_DOMAIN_VRAM, 4096));
+
+        compute_pipeline::desc d;
+        d.handle = k == RAT_WRITE ? _write->handle() : _fetch->handle();
+        d.num_gprs = k == RAT_WRITE ? 2 : 6;
+        d.temp_gprs = 4;    // as mesa reserves them
+        d.group[0] = group;
+        compute_pipeline pipeline(_device, d);
+
+        evergreen_command_stream cs(_device);
+        if (!_recordings.empty())
+            cs.set_recorder([&](cs_recording const& submission) {
+                // The kernel and the constants are needed to replay, the
+                // buffers only need their sizes.
+                cs_recording r = submission;
+                r.snapshot(k == RAT_WRITE ? *_write : *_fetch);
+                r.snapshot(_constants.bo());
+                r.snapshot(buffer.bo(), false);
+                if (output)
+                    r.snapshot(*output, false);
+                r.write(_recordings + '-' + to_string(_recorded++) + ".rcs");
+            });
+        cs.start_3d();
+        const uint32_t constants[8] = { group, 1, 1, 0, groups, 1, 1, 0 };
+        cs.set_constants(0, _constants, constants, sizeof(constants));
+        if (k == RAT_WRITE)
+            cs.set_rat(0, buffer.bo().handle(), 0, buffer.size(), buffer.domain());
+        else {
+            cs.set_rat(0, output->handle(), 0, output->size());
+            cs.set_vertex_buffer(1, buffer.bo().handle(), 0, buffer.size(), 4, buffer.domain());
+        }
+        cs.dispatch(pipeline, { groups, 1, 1 });
+        _constants.fence(cs);
+        cs.emit();
+
+        if (output)
+            output->wait_idle();
+        else
+            buffer.bo().wait_idle();
+        return uint64_t(groups) * group * item_bytes;
+    }
+
+private:
+    /// Load a kernel binary into video memory.
+    radeon_buffer_object* load(string const& path)
+    {
+        ifstream file(path.c_str(), ios::in | ios::binary);
+        if (!file)
+            throw system_error(error_code(errno, system_category()), path);
+        vector<char> code((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        if (code.empty())
+            throw runtime_error(path + " is empty");
+
+        unique_ptr<radeon_buffer_object> bo(new radeon_buffer_object(_device,
+            (code.size() + 255) & ~size_t(255), RADEON_GEM_DOMAIN_VRAM, 256));
+        bo->pwrite(0, code.size(), &code[0]);
+        return bo.release();
+    }
+
+    radeon_device _device;
+    constant_ring _constants;
+    unique_ptr<radeon_buffer_object> _write, _fetch;
+    string _recordings;
+    unsigned _recorded;
+};
+
+/// Parse a size with an optional K, M or G suffix.
+uint64_t parse_size(const char* s)
+{
+    char* end;
+    uint64_t n = strtoull(s, &end, 0);
+    switch (*end) {
+    case 'G': case 'g': n <<= 10;
+    case 'M': case 'm': n <<= 10;
+    case 'K': case 'k': n <<= 10; ++end;
+    }
+    if (*end != 0 || end == s)
+        throw runtime_error(string("invalid size ") + s);
+    return n;
+}
+
+vector<string> split(const char* s)
+{
+    vector<string> fields;
+    istringstream is(s);
+    for (string field; getline(is, field, ','); )
+        if (!field.empty())
+            fields.push_back(field);
+    return fields;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    const char* card = "/dev/dri/card0";
+    const char* kernels = "../samples";
+    const char* domains = "vram,gtt";
+    const char* methods = "map-write,map-read,pwrite,pread,rat-write,vertex-fetch";
+    const char* min_size = "4K";
+    const char* max_size = "64M";
+    const char* json = 0;
+    const char* recordings = "";
+    unsigned factor = 4, repeats = 5;
+    bool software = false;
+
+    for (int opt = 0; (opt = getopt(argc, argv, "c:nk:d:a:m:M:f:r:j:R:")) != -1; )
+        switch (opt) {
+            case 'c': card = optarg; break;
+            case 'n': software = true; break;
+            case 'k': kernels = optarg; break;
+            case 'd': domains = optarg; break;
+            case 'a': methods = optarg; break;
+            case 'm': min_size = optarg; break;
+            case 'M': max_size = optarg; break;
+            case 'f': factor = atoi(optarg); break;
+            case 'r': repeats = atoi(optarg); break;
+            case 'j': json = optarg; break;
+            case 'R': recordings = optarg; break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    if (optind != argc) {
+        cerr << "Usage: " << argv[0] << " [-c<card>] [-n] [-k<dir>] [-d<domains>] [-a<methods>]"
+            " [-m<size>] [-M<size>] [-f<n>] [-r<n>] [-j<file>] [-R<prefix>]\n\n"
+            "\tMeasure the bandwidth of the host and the GPU to buffer objects.\n\n"
+            "\t-c <s>\tdevice node (/dev/dri/card0)\n"
+            "\t-n\tuse buffers in memory instead of a device, host methods only\n"
+            "\t-k <s>\tdirectory of bandwidth_write.bin and bandwidth_fetch.bin (../samples),\n"
+            "\t\tempty for the host methods only\n"
+            "\t-d <s>\tdomains: vram,gtt\n"
+            "\t-a <s>\tmethods: map-write,map-read,pwrite,pread,rat-write,vertex-fetch\n"
+            "\t-m <n>\tsmallest buffer, with a K, M or G suffix (4K)\n"
+            "\t-M <n>\tlargest buffer (64M)\n"
+            "\t-f <n>\tfactor from a size to the next (4)\n"
+            "\t-r <n>\trepetitions of each measurement (5)\n"
+            "\t-j <s>\twrite the results as JSON into a file\n"
+            "\t-R <s>\trecord every submission of the kernels into <s>-<n>.rcs (replay_cs)\n" << endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        vector<bandwidth_device::domain> d;
+        vector<string> names = split(domains);
+        for (size_t i = 0; i < names.size(); ++i)
+            d.push_back(bandwidth_suite::find_domain(names[i]));
+        vector<bandwidth_suite::method> m;
+        names = split(methods);
+        for (size_t i = 0; i < names.size(); ++i)
+            m.push_back(bandwidth_suite::find_method(names[i]));
+
+        uint64_t first = parse_size(min_size), last = parse_size(max_size);
+        if (first == 0 || factor < 2 || repeats < 1)
+            throw runtime_error("invalid sizes or repetitions");
+        vector<uint64_t> sizes;
+        for (uint64_t size = first; size <= last; size *= factor)
+            sizes.push_back(size);
+
+        unique_ptr<bandwidth_device> device;
+        if (software)
+            device.reset(new software_bandwidth_device);
+        else
+            device.reset(new radeon_bandwidth_device(card, kernels, recordings));
+
+        bandwidth_suite suite(*device);
+        suite.run(d, m, sizes, repeats);
+        cout << device->name() << '\n';
+        suite.write_table(cout);
+
+        if (json) {
+            ofstream file(json);
+            if (!file)
+                throw system_error(error_code(errno, system_category()), json);
+            suite.write_json(file);
+        }
+    }
+    catch (system_error& e) {
+        cerr
+            << e.what()
+            << " : "
+            << e.code().message()
+            << endl;
+        return EXIT_FAILURE;
+    }
+    catch (runtime_error& e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,113 @@
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include "constant_ring.hpp"
+#include "evergreen_command_stream.hpp"
+#include "radeon_buffer_object.hpp"
+#include "radeon_device.hpp"
+
+using namespace std;
+
+namespace {
+
+typedef chrono::steady_clock clock_type;
+
+double seconds(clock_type::time_point start)
+{
+    return chrono::duration<double>(clock_type::now() - start).count();
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    const char* card = "/dev/dri/card0";
+    unsigned long updates = 1 << 14;
+    unsigned batch = 64, size = 64, inline_limit = 0;
+
+    for (int opt = 0; (opt = getopt(argc, argv, "c:n:b:s:i:")) != -1; )
+        switch (opt) {
+            case 'c': card = optarg; break;
+            case 'n': updates = strtoul(optarg, 0, 0); break;
+            case 'b': batch = strtoul(optarg, 0, 0); break;
+            case 's': size = strtoul(optarg, 0, 0); break;
+            case 'i': inline_limit = strtoul(optarg, 0, 0); break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    if (optind != argc || updates == 0 || batch == 0 || size == 0 || size > 64 * 1024) {
+        cerr << "Usage: " << argv[0] << " [-c<card>] [-n<n>] [-b<n>] [-s<n>] [-i<n>]\n\n"
+            "\tCompare the time to set the constants of a dispatch with a new\n"
+            "\tbuffer object each time (created, mapped, written, unmapped and\n"
+            "\tclosed) and with a slice of a constant ring. The command streams,\n"
+            "\twhich bind the constants, are emitted and waited for in batches.\n\n"
+            "\t-c <s>\tdevice node (/dev/dri/card0)\n"
+            "\t-n <n>\tconstant updates (16K)\n"
+            "\t-b <n>\tupdates per command stream (64)\n"
+            "\t-s <n>\tbytes of constants (64)\n"
+            "\t-i <n>\twrite constants of at most n bytes with MEM_WRITE (0)\n" << endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        radeon_device device(card, false);
+        vector<uint32_t> constants((size + 3) / 4);
+        for (size_t i = 0; i < constants.size(); ++i)
+            constants[i] = i;
+
+        clock_type::time_point start = clock_type::now();
+        for (unsigned long done = 0; done < updates; ) {
+            evergreen_command_stream cs(device);
+            vector<unique_ptr<radeon_buffer_object> > bos;
+            for (unsigned i = 0; i < batch && done < updates; ++i, ++done) {
+                bos.push_back(unique_ptr<radeon_buffer_object>(new radeon_buffer_object(
+                    device, (size + 255) & ~255u, RADEON_GEM_DOMAIN_GTT, 256)));
+                memcpy(bos.back()->mmap(), &constants[0], size);
+                bos.back()->munmap();
+                cs.set_constant_buffer(i % 16, bos.back()->handle(), 0, size, RADEON_GEM_DOMAIN_GTT);
+            }
+            cs.emit();
+            bos.back()->wait_idle();
+        }
+        double before = seconds(start);
+
+        constant_ring ring(device, 1 << 20, RADEON_GEM_DOMAIN_GTT, inline_limit);
+        start = clock_type::now();
+        for (unsigned long done = 0; done < updates; ) {
+            evergreen_command_stream cs(device);
+            for (unsigned i = 0; i < batch && done < updates; ++i, ++done)
+                cs.set_constants(i % 16, ring, &constants[0], size);
+            ring.fence(cs);
+            cs.emit();
+        }
+        double after = seconds(start);
+
+        cout << "buffer objects\t" << before / updates * 1e6 << " us/update\n"
+             << "constant ring\t" << after / updates * 1e6 << " us/update, "
+             << ring.waits() << " waits\n"
+             << "speedup\t\t" << before / after << "x\n" << flush;
+    }
+    catch (system_error& e) {
+        cerr
+            << e.what()
+            << " : "
+            << e.code().message()
+            << endl;
+        return EXIT_FAILURE;
+    }
+    catch (runtime_error& e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "hex_dump.hpp"
+
+namespace {
+
+/// The former hex_dump, which formats every element through the stream.
+template < typename T >
+class stream_hex_dump {
+public:
+    stream_hex_dump(T const* ptr, std::size_t n, std::size_t c = 1, std::size_t a = 0)
+        : base(ptr), size(n), cols(c), addr(a) {}
+
+    friend std::ostream& operator << (std::ostream& os, stream_hex_dump const& hd)
+    {
+        std::ios_base::fmtflags
+            previous_flags = os.flags(std::ios_base::right | std::ios_base::hex);
+        char previous_fill = os.fill('0');
+
+        T const* p = hd.base;
+        for (std::size_t i = 0; i != hd.size; ++i, ++p)
+        {
+            if (i % hd.cols == 0) {
+                if (i != 0) os << '\n';
+                if (hd.addr != 0) {
+                    os.width(hd.addr);
+                    os << i << ':' << '\t' << std::flush;
+                }
+            }
+            else os << '\t';
+            os.width(std::numeric_limits<T>::digits / 4);
+            os << *p;
+        }
+
+        os.flags(previous_flags);
+        os.fill(previous_fill);
+        return os;
+    }
+
+private:
+    T const* base;
+    std::size_t size;
+    std::size_t cols;
+    std::size_t addr;
+};
+
+/// The float loop of the vector and lds samples.
+void stream_float_dump(std::ostream& os, float const* p, std::size_t size, std::size_t cols, std::size_t addr)
+{
+    for (std::size_t i = 0; i != size; ++i, ++p)
+    {
+        if (i % cols == 0) {
+            if (i != 0) os << '\n';
+            if (addr != 0) {
+                os.width(addr);
+                os << i << ':' << '\t' << std::flush;
+            }
+        }
+        else os << '\t';
+        os.width(8);
+        os << *p;
+    }
+}
+
+typedef std::chrono::steady_clock clock_type;
+
+double milliseconds(clock_type::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t size = 32792, repeat = 10;
+    const char* path = "/dev/null";
+
+    for (int opt = 0; (opt = getopt(argc, argv, "n:r:o:")) != -1; )
+        switch (opt) {
+            case 'n': size = std::strtoul(optarg, 0, 0); break;
+            case 'r': repeat = std::strtoul(optarg, 0, 0); break;
+            case 'o': path = optarg; break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    if (optind != argc || size == 0 || repeat == 0) {
+        std::cerr << "Usage: " << argv[0] << " [-n<n>] [-r<n>] [-o<file>]\n\n"
+            "\tCompare the time to format a buffer with iostreams and with hex_dump.\n\n"
+            "\t-n <n>\tdouble words in the buffer (32792, vectornormalize-1024-8)\n"
+            "\t-r <n>\trepetitions (10)\n"
+            "\t-o <f>\tfile written to (/dev/null)\n" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::uint32_t> words(size);
+    std::vector<float> floats(size);
+    std::uint32_t seed = 1;
+    for (std::size_t i = 0; i < size; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        words[i] = seed;
+        floats[i] = (static_cast<int>(seed >> 8) - (1 << 23)) / 1048576.0f;
+    }
+
+    // The formats are compared in memory and timed on a file, where the
+    // flushes of the former hex_dump cost a write each.
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << path << " : " << std::strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::string result[4];
+    double elapsed[4] = {};
+    for (unsigned k = 0; k < 4; ++k)
+        for (std::size_t r = 0; r <= repeat; ++r) {
+            std::ostringstream text;
+            std::ostream& os = r == 0 ? static_cast<std::ostream&>(text) : file;
+            clock_type::time_point start = clock_type::now();
+            switch (k) {
+            case 0: os << stream_hex_dump<std::uint32_t>(&words[0], size, 4, 6); break;
+            case 1: os << hex_dump<std::uint32_t>(&words[0], size, 4, 6); break;
+            case 2: stream_float_dump(os, &floats[0], size, 4, 6); break;
+            case 3: os << float_dump<float>(&floats[0], size, 4, 6); break;
+            }
+            os << std::endl;
+            if (r == 0)
+                result[k] = text.str();
+            else
+                elapsed[k] += milliseconds(start);
+        }
+
+    clock_type::time_point start = clock_type::now();
+    for (std::size_t r = 0; r < repeat; ++r)
+        file << npy_dump<float>(&floats[0], size, 4) << std::flush;
+    double npy_elapsed = milliseconds(start);
+
+    static const char* const names[] = { "iostream hex", "hex_dump", "iostream float", "float_dump" };
+    for (unsigned k = 0; k < 4; ++k)
+        std::cout << names[k] << ": " << elapsed[k] / repeat << " ms, "
+                  << result[k].size() << " bytes\n";
+    std::cout << "npy_dump: " << npy_elapsed / repeat << " ms\n"
+              << "Speedup: hex " << elapsed[0] / elapsed[1] << "x, float " << elapsed[2] / elapsed[3] << "x"
+              << std::endl;
+
+    if (result[0] != result[1] || result[2] != result[3]) {
+        std::cerr << "The outputs differ" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,146 @@
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <initializer_list>
+#include <iostream>
+#include <vector>
+
+#include "ib_buffer.hpp"
+
+namespace {
+
+/// The PM4 header of SET_CONTEXT_REG, as evergreen_command_stream writes it.
+const std::uint32_t set_context_reg = 0xc0006900;
+const std::uint32_t context_reg_start = 0x28000;
+
+/// The register settings of a dispatch as evergreen_command_stream writes
+/// them: the lengths of the packets, in registers.
+const unsigned dispatch_packets[] = { 1, 3, 1, 3, 1, 1, 1, 3, 1, 8, 1, 2 };
+const unsigned packets_per_dispatch = sizeof(dispatch_packets) / sizeof(dispatch_packets[0]);
+
+/// The former command stream, which checks the capacity of its vector for
+/// every double word and starts from an empty vector.
+class vector_stream {
+public:
+    std::size_t size() const { return _ib.size(); }
+    void reserve(std::size_t n) { _ib.reserve((n + 01777u) & ~01777u); }
+    void write(std::uint32_t x)
+    {
+        reserve(size() + 1);
+        _ib.push_back(x);
+    }
+    void write(std::initializer_list<std::uint32_t> x)
+    {
+        reserve(size() + x.size());
+        _ib.insert(_ib.end(), x.begin(), x.end());
+    }
+    void write_set_reg(std::uint32_t start, std::uint32_t n)
+    {
+        reserve(size() + 2 + n);
+        write({ set_context_reg | n << 16, (start - context_reg_start) >> 2 });
+    }
+    std::vector<std::uint32_t> const& ib() const { return _ib; }
+
+private:
+    std::vector<std::uint32_t> _ib;
+};
+
+/// The values of a packet.
+inline std::uint32_t value(std::uint32_t packet, unsigned i)
+{
+    return packet * 16 + i;
+}
+
+std::vector<std::uint32_t> run_vector(unsigned packets)
+{
+    vector_stream cs;
+    for (unsigned p = 0; p < packets; ++p) {
+        unsigned n = dispatch_packets[p % packets_per_dispatch];
+        std::uint32_t start = context_reg_start + 4 * (p % 256);
+        // The register_setter: a header, then the values one at a time (a
+        // single value) or as a list.
+        cs.write_set_reg(start, n);
+        if (n == 1)
+            cs.write(value(p, 0));
+        else if (n == 2)
+            cs.write({ value(p, 0), value(p, 1) });
+        else if (n == 3)
+            cs.write({ value(p, 0), value(p, 1), value(p, 2) });
+        else
+            cs.write({ value(p, 0), value(p, 1), value(p, 2), value(p, 3),
+                       value(p, 4), value(p, 5), value(p, 6), value(p, 7) });
+    }
+    return cs.ib();
+}
+
+std::vector<std::uint32_t> run_buffer(unsigned packets, bool keep)
+{
+    ib_buffer ib;
+    for (unsigned p = 0; p < packets; ++p) {
+        unsigned n = dispatch_packets[p % packets_per_dispatch];
+        std::uint32_t start = context_reg_start + 4 * (p % 256);
+        // write_set_reg_packet: one check for the header and the values.
+        std::uint32_t* q = ib.append(2 + n);
+        q[0] = set_context_reg | n << 16;
+        q[1] = (start - context_reg_start) >> 2;
+        for (unsigned i = 0; i < n; ++i)
+            q[2 + i] = value(p, i);
+    }
+    return keep ? std::vector<std::uint32_t>(ib.data(), ib.data() + ib.size()) : std::vector<std::uint32_t>();
+}
+
+typedef std::chrono::steady_clock clock_type;
+
+double seconds(clock_type::time_point start)
+{
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned packets = 4096, batches = 2000;
+
+    for (int opt = 0; (opt = getopt(argc, argv, "n:b:")) != -1; )
+        switch (opt) {
+            case 'n': packets = std::strtoul(optarg, 0, 0); break;
+            case 'b': batches = std::strtoul(optarg, 0, 0); break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    if (optind != argc || packets == 0 || batches == 0) {
+        std::cerr << "Usage: " << argv[0] << " [-n<n>] [-b<n>]\n\n"
+            "\tCompare the packets per second written into a new command stream by\n"
+            "\tthe former vector IB and by ib_buffer, without a GPU.\n\n"
+            "\t-n <n>\tregister packets per command stream (4096)\n"
+            "\t-b <n>\tcommand streams (2000)\n" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (run_vector(packets) != run_buffer(packets, true)) {
+        std::cerr << "The instruction buffers differ" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::size_t sink = 0;
+    clock_type::time_point start = clock_type::now();
+    for (unsigned b = 0; b < batches; ++b)
+        sink += run_vector(packets).size();
+    double before = seconds(start);
+
+    start = clock_type::now();
+    for (unsigned b = 0; b < batches; ++b)
+        sink += run_buffer(packets, false).size();
+    double after = seconds(start);
+
+    double total = double(packets) * batches;
+    std::cout << "vector IB: " << total / before / 1e6 << " M packets/s\n"
+              << "ib_buffer: " << total / after / 1e6 << " M packets/s\n"
+              << "Speedup: " << before / after << "x ("
+              << ib_buffer::arena_size() << " buffers in the arena)" << std::endl;
+    return sink == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
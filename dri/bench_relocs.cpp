@@ -0,0 +1,141 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "reloc_table.hpp"
+
+namespace {
+
+/// The former relocations of a command stream: a vector and a hash map
+/// from handle to index, which is never cleared.
+class map_relocs {
+public:
+    std::uint32_t insert(std::uint32_t handle, std::uint32_t read_domains,
+        std::uint32_t write_domain, std::uint32_t flags)
+    {
+        std::unordered_map<std::uint32_t, std::uint32_t>::iterator p = _map.find(handle);
+        if (p == _map.end()) {
+            p = _map.insert(std::make_pair(handle, std::uint32_t(_relocs.size()))).first;
+            drm_radeon_cs_reloc reloc;
+            reloc.handle = handle;
+            reloc.read_domains = read_domains;
+            reloc.write_domain = write_domain;
+            reloc.flags = flags;
+            _relocs.push_back(reloc);
+        }
+        else {
+            _relocs[p->second].read_domains |= read_domains;
+            _relocs[p->second].write_domain |= write_domain;
+            _relocs[p->second].flags |= flags;
+        }
+        return p->second;
+    }
+
+private:
+    std::vector<drm_radeon_cs_reloc> _relocs;
+    std::unordered_map<std::uint32_t, std::uint32_t> _map;
+};
+
+/// The references of a command stream to its buffer objects: every buffer
+/// is referenced a number of times, in a pseudo-random order.
+std::vector<std::uint32_t> make_references(unsigned buffers, unsigned repeats, bool large)
+{
+    std::vector<std::uint32_t> handles(buffers);
+    std::uint32_t seed = 1;
+    for (unsigned i = 0; i < buffers; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        handles[i] = large ? (seed | reloc_table::direct_handles) : i + 1;
+    }
+    std::vector<std::uint32_t> refs;
+    for (unsigned r = 0; r < repeats; ++r)
+        for (unsigned i = 0; i < buffers; ++i) {
+            seed = seed * 1664525 + 1013904223;
+            refs.push_back(handles[(i + (r ? seed % buffers : 0)) % buffers]);
+        }
+    return refs;
+}
+
+typedef std::chrono::steady_clock clock_type;
+
+double seconds(clock_type::time_point start)
+{
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned repeats = 8;
+    unsigned long references = 1 << 22;
+    bool large = false;
+
+    for (int opt = 0; (opt = getopt(argc, argv, "r:n:l")) != -1; )
+        switch (opt) {
+            case 'r': repeats = std::strtoul(optarg, 0, 0); break;
+            case 'n': references = std::strtoul(optarg, 0, 0); break;
+            case 'l': large = true; break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    if (optind != argc || repeats == 0 || references == 0) {
+        std::cerr << "Usage: " << argv[0] << " [-r<n>] [-n<n>] [-l]\n\n"
+            "\tCompare the time to build the relocations of command streams with\n"
+            "\t10, 1000 and 10000 distinct buffer objects, with the former hash map\n"
+            "\t(a new one per stream) and with reloc_table (cleared and reused).\n\n"
+            "\t-r <n>\treferences to each buffer object per stream (8)\n"
+            "\t-n <n>\treferences in all, over the streams (4M)\n"
+            "\t-l\tlarge handles, above the directly indexed ones\n" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    static const unsigned counts[] = { 10, 1000, 10000 };
+    std::uint64_t sink = 0;
+    std::cout << "BOs\tstreams\tmap ns/ref\ttable ns/ref\tspeedup\n";
+    for (unsigned c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+        std::vector<std::uint32_t> refs = make_references(counts[c], repeats, large);
+        unsigned long streams = std::max(references / refs.size(), 1ul);
+
+        // Both give the same indices.
+        {
+            map_relocs m;
+            reloc_table t;
+            for (std::size_t i = 0; i < refs.size(); ++i)
+                if (m.insert(refs[i], 4, 0, 0) != t.insert(refs[i], 4, 0, 0)) {
+                    std::cerr << "The relocation indices differ" << std::endl;
+                    return EXIT_FAILURE;
+                }
+        }
+
+        clock_type::time_point start = clock_type::now();
+        for (unsigned long s = 0; s < streams; ++s) {
+            map_relocs m;
+            for (std::size_t i = 0; i < refs.size(); ++i)
+                sink += m.insert(refs[i], 4, i & 4, 0);
+        }
+        double before = seconds(start);
+
+        start = clock_type::now();
+        reloc_table t;
+        for (unsigned long s = 0; s < streams; ++s) {
+            t.clear();
+            for (std::size_t i = 0; i < refs.size(); ++i)
+                sink += t.insert(refs[i], 4, i & 4, 0);
+        }
+        double after = seconds(start);
+
+        double total = double(streams) * refs.size();
+        std::cout << counts[c] << '\t' << streams << '\t' << before / total * 1e9 << "\t\t"
+                  << after / total * 1e9 << "\t\t" << before / after << "x\n";
+    }
+    std::cout << std::flush;
+    return sink == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
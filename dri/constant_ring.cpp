@@ -0,0 +1,109 @@
+#include "constant_ring.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+constant_ring::constant_ring(radeon_device const& device, uint32_t size,
+        uint32_t domain, uint32_t inline_limit)
+    : _bo(device, size, domain, alignment), _domain(domain), _inline_limit(inline_limit),
+      _map(), _begin(alignment), _head(alignment), _tail(alignment),
+      _end(size & ~(alignment - 1)), _taken(), _freed(), _seq(), _waits()
+{
+    if (_end < 2 * alignment)
+        throw invalid_argument("a constant ring holds a fence and a slice");
+
+    _map = static_cast<unsigned char*>(_bo.mmap());
+    *reinterpret_cast<volatile uint32_t*>(_map) = _seq;
+}
+
+bool constant_ring::fits(uint32_t n, uint32_t& at)
+{
+    if (used() == 0)
+        _head = _tail = _begin;
+
+    // The slices in use are [tail, head) or, when the ring has wrapped,
+    // [tail, end) and [begin, head).
+    if (used() == 0 || _head > _tail) {
+        if (_head + n <= _end)
+            at = _head;
+        else if (_begin + n <= _tail)
+            at = _begin;
+        else
+            return false;
+        return true;
+    }
+    at = _head;
+    return _head + n <= _tail;
+}
+
+constant_ring::slice constant_ring::allocate(uint32_t size)
+{
+    if (size > _end - _begin)
+        throw invalid_argument("the constants exceed the constant ring");
+    const uint32_t n = max(alignment, (size + alignment - 1) & ~(alignment - 1));
+
+    uint32_t at;
+    if (!fits(n, at)) {
+        retire();
+        if (!fits(n, at) && !_pending.empty()) {
+            ++_waits;
+            _bo.wait_idle();
+            retire();
+        }
+        if (!fits(n, at))
+            throw runtime_error("the constant ring is full of slices without a fence");
+    }
+
+    // The bytes skipped at the end of the ring are in use until the slice
+    // after them is reclaimed.
+    _taken += (at == _head ? 0 : _end - _head) + n;
+    _head = at + n;
+    slice s = { at, _map + at };
+    return s;
+}
+
+uint32_t constant_ring::write(radeon_command_stream& cs, const void* data, uint32_t size)
+{
+    slice s = allocate(size);
+    if (size > _inline_limit) {
+        memcpy(s.data, data, size);
+        return s.offset;
+    }
+
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (uint32_t i = 0; i < size; i += 8) {
+        uint64_t value = 0;
+        memcpy(&value, p + i, min(8u, size - i));
+        cs.make_room(pm4::mem_write::size + 2);
+        cs.write(pm4::mem_write{ s.offset + i, value });
+        cs.write_reloc(handle(), 0, _domain);
+    }
+    return s.offset;
+}
+
+void constant_ring::fence(radeon_command_stream& cs)
+{
+    // Nothing has been taken since the last fence.
+    if (_taken == (_pending.empty() ? _freed : _pending.back().taken))
+        return;
+
+    cs.make_room(pm4::event_write_eop::size + 2);
+    cs.write(pm4::event_write_eop{
+        pm4::cache_flush_and_inv_ts_event, 0, pm4::data_32, pm4::int_none, ++_seq });
+    cs.write_reloc(handle(), 0, _domain);
+    pending p = { _seq, _head, _taken };
+    _pending.push_back(p);
+}
+
+void constant_ring::retire()
+{
+    const uint32_t seq = *reinterpret_cast<volatile uint32_t*>(_map);
+    while (!_pending.empty() && int32_t(seq - _pending.front().seq) >= 0) {
+        _tail = _pending.front().head;
+        _freed = _pending.front().taken;
+        _pending.pop_front();
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "radeon_buffer_object.hpp"
+#include "radeon_command_stream.hpp"
+#include "radeon_device.hpp"
+
+#include <cstdint>
+#include <deque>
+
+/// This class is a ring of constants for the dispatches: a buffer object,
+/// mapped once, from which each dispatch takes a slice aligned for the
+/// constant cache, so that setting its constants costs a copy instead of
+/// creating, mapping and closing a buffer object.
+///
+/// A slice is in use until the GPU has run the command stream which
+/// references it. \c fence appends to the command stream the write of a
+/// sequence number into the ring at the end of the pipe, and the slices
+/// taken before it are reclaimed once the GPU has written it. The kernel
+/// invalidates the constant cache at the end of every IB, and a slice is
+/// not reused before the IB which used it has ended, so the cache does not
+/// keep stale constants.
+///
+/// Constants of at most \c inline_limit bytes are written by the CP instead,
+/// with MEM_WRITE packets in the IB: they need no access to the mapping and
+/// a recording of the command stream (cs_recording) holds them.
+class constant_ring {
+public:
+    /// The alignment of the slices, that of the constant buffers.
+    static const std::uint32_t alignment = 256;
+
+    /// Create the ring and map it.
+    /// \param device The device.
+    /// \param size The size of the ring in bytes, of which the first
+    /// \c alignment bytes hold the fence.
+    /// \param domain The domain of the ring.
+    /// \param inline_limit The largest constants in bytes to write with
+    /// MEM_WRITE packets, or 0 for none.
+    constant_ring(radeon_device const& device, std::uint32_t size = 1 << 20,
+        std::uint32_t domain = RADEON_GEM_DOMAIN_GTT, std::uint32_t inline_limit = 0);
+
+    /// Get the handle of the buffer object of the ring.
+    std::uint32_t handle() const { return _bo.handle(); }
+    /// Access the buffer object of the ring.
+    radeon_buffer_object const& bo() const { return _bo; }
+    /// Get the domain of the ring.
+    std::uint32_t domain() const { return _domain; }
+    /// Get the largest constants written with MEM_WRITE packets.
+    std::uint32_t inline_limit() const { return _inline_limit; }
+
+    /// This structure is a slice of the ring.
+    struct slice {
+        std::uint32_t offset;   ///< The offset in the ring, a multiple of \c alignment.
+        void* data;             ///< The address of the slice in the mapping.
+    };
+    /// Take a slice from the ring. If the ring is full, the slices whose
+    /// fences have been written are reclaimed, waiting for the ring to be
+    /// idle if need be.
+    /// It throws std::invalid_argument if the size exceeds the ring, and
+    /// std::runtime_error if the ring is full of slices which no fence
+    /// follows.
+    /// \param size The size in bytes.
+    slice allocate(std::uint32_t size);
+    /// Take a slice and write constants into it, by copying them into the
+    /// mapping or, if they are small enough, with MEM_WRITE packets.
+    /// \param cs The command stream which will use the constants.
+    /// \param data The constants.
+    /// \param size The size of the constants in bytes.
+    /// \returns The offset of the slice.
+    std::uint32_t write(radeon_command_stream& cs, const void* data, std::uint32_t size);
+
+    /// Append the fence of the slices taken since the last fence to a
+    /// command stream, as the last packet before it is emitted. The slices
+    /// of a command stream which has been flushed are reclaimed with those
+    /// of the IB that the fence ends.
+    /// \param cs The command stream.
+    void fence(radeon_command_stream& cs);
+    /// Reclaim the slices whose fences have been written.
+    void retire();
+
+    /// Get the bytes in use, those of the slices and those skipped at the
+    /// end of the ring when it wraps.
+    std::uint64_t used() const { return _taken - _freed; }
+    /// Get the number of times that a slice had to wait for the ring to be
+    /// idle.
+    unsigned waits() const { return _waits; }
+
+private:
+    /// Whether a slice of n bytes fits at the head, and where. An empty ring
+    /// starts again from its first slice.
+    bool fits(std::uint32_t n, std::uint32_t& at);
+
+    radeon_buffer_object _bo;
+    std::uint32_t _domain;
+    std::uint32_t _inline_limit;
+    /// The mapping, whose first double word is the fence.
+    unsigned char* _map;
+    /// The offsets of the first slice, of the next one and of the oldest in
+    /// use, and the end of the ring.
+    std::uint32_t _begin, _head, _tail, _end;
+    /// The bytes taken and reclaimed since the ring was created.
+    std::uint64_t _taken, _freed;
+    /// The sequence number of the last fence.
+    std::uint32_t _seq;
+    unsigned _waits;
+
+    /// A fence which has not been written yet: its sequence number, the
+    /// head and the bytes taken when it was appended.
+    struct pending {
+        std::uint32_t seq, head;
+        std::uint64_t taken;
+    };
+    std::deque<pending> _pending;
+};
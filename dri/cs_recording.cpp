@@ -0,0 +1,156 @@
+#include "cs_recording.hpp"
+
+#include <cerrno>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+using namespace std;
+
+namespace {
+
+/// The magic number of the files, "RCS1" in little endian.
+const uint32_t magic = 0x31534352;
+const uint32_t version = 1;
+/// The header of a relocation packet and the size in double words of a
+/// relocation, whose offset the second double word holds.
+const uint32_t reloc_packet = 0xc0001000;
+const uint32_t reloc_size = sizeof(drm_radeon_cs_reloc) / sizeof(uint32_t);
+
+template <typename T>
+void put(ofstream& file, T const* p, size_t n)
+{
+    if (n)
+        file.write(reinterpret_cast<const char*>(p), n * sizeof(T));
+}
+
+template <typename T>
+void get(ifstream& file, string const& path, T* p, size_t n)
+{
+    if (n && !file.read(reinterpret_cast<char*>(p), n * sizeof(T)))
+        throw runtime_error(path + ": truncated recording");
+}
+
+}
+
+void cs_recording::snapshot(radeon_buffer_object const& bo, bool contents)
+{
+    buffers.resize(relocs.size());
+    for (size_t i = 0; i < relocs.size(); ++i)
+        if (relocs[i].handle == bo.handle()) {
+            buffers[i].size = bo.size();
+            buffers[i].contents.clear();
+            if (contents && bo.size()) {
+                buffers[i].contents.resize(bo.size());
+                bo.pread(0, bo.size(), &buffers[i].contents[0]);
+            }
+            return;
+        }
+    throw invalid_argument("the buffer object is not referenced");
+}
+
+radeon_command_stream::ib_block cs_recording::block(vector<uint32_t> const& handles) const
+{
+    if (handles.size() != relocs.size())
+        throw invalid_argument("a handle per relocation");
+
+    radeon_command_stream::ib_block b;
+    b.dwords = ib;
+    for (size_t i = 0; i < reloc_offsets.size(); ++i) {
+        drm_radeon_cs_reloc reloc = relocs[ib[reloc_offsets[i] + 1] / reloc_size];
+        reloc.handle = handles[ib[reloc_offsets[i] + 1] / reloc_size];
+        b.relocs.push_back(make_pair(size_t(reloc_offsets[i]), reloc));
+    }
+    return b;
+}
+
+void cs_recording::write(string const& path) const
+{
+    ofstream file(path.c_str(), ios::out | ios::binary | ios::trunc);
+    if (!file)
+        throw system_error(error_code(errno, system_category()), path);
+
+    const uint32_t header[10] = {
+        magic, version, family, flags[0], flags[1],
+        uint32_t(ib.size()), uint32_t(relocs.size()), uint32_t(reloc_offsets.size()),
+        uint32_t(buffers.size()), 0
+    };
+    put(file, header, 10);
+    put(file, ib.data(), ib.size());
+    put(file, relocs.data(), relocs.size());
+    put(file, reloc_offsets.data(), reloc_offsets.size());
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        const uint64_t sizes[2] = { buffers[i].size, buffers[i].contents.size() };
+        put(file, sizes, 2);
+        put(file, buffers[i].contents.data(), buffers[i].contents.size());
+    }
+    if (!file.flush())
+        throw system_error(error_code(errno, system_category()), path);
+}
+
+cs_recording cs_recording::read(string const& path)
+{
+    ifstream file(path.c_str(), ios::in | ios::binary);
+    if (!file)
+        throw system_error(error_code(errno, system_category()), path);
+
+    uint32_t header[10];
+    get(file, path, header, 10);
+    if (header[0] != magic)
+        throw runtime_error(path + ": not a command stream recording");
+    if (header[1] != version)
+        throw runtime_error(path + ": unknown recording version");
+
+    // Check the counts against what is left of the file before allocating
+    // anything, so that a corrupt header fails here.
+    streamoff here = file.tellg();
+    file.seekg(0, ios::end);
+    uint64_t left = uint64_t(file.tellg() - here);
+    file.seekg(here);
+    if (!file)
+        throw system_error(error_code(errno, system_category()), path);
+    uint64_t needed = 4 * uint64_t(header[5]) + uint64_t(header[6]) * sizeof(drm_radeon_cs_reloc) +
+        4 * uint64_t(header[7]) + 16 * uint64_t(header[8]);
+    if (needed > left)
+        throw runtime_error(path + ": truncated recording");
+    left -= needed;
+
+    cs_recording r;
+    r.family = header[2];
+    r.flags[0] = header[3];
+    r.flags[1] = header[4];
+    r.ib.resize(header[5]);
+    r.relocs.resize(header[6]);
+    r.reloc_offsets.resize(header[7]);
+    if (header[8] != 0 && header[8] != header[6])
+        throw runtime_error(path + ": the buffers do not match the relocations");
+    r.buffers.resize(header[8]);
+
+    get(file, path, r.ib.data(), r.ib.size());
+    get(file, path, r.relocs.data(), r.relocs.size());
+    get(file, path, r.reloc_offsets.data(), r.reloc_offsets.size());
+    for (size_t i = 0; i < r.buffers.size(); ++i) {
+        uint64_t sizes[2];
+        get(file, path, sizes, 2);
+        if (sizes[1] > sizes[0])
+            throw runtime_error(path + ": the contents of a buffer exceed its size");
+        if (sizes[1] > left)
+            throw runtime_error(path + ": truncated recording");
+        left -= sizes[1];
+        r.buffers[i].size = sizes[0];
+        r.buffers[i].contents.resize(sizes[1]);
+        get(file, path, r.buffers[i].contents.data(), r.buffers[i].contents.size());
+    }
+
+    // The relocation packets must be where the offsets say and refer to
+    // the relocations, for block() to rewrite them.
+    for (size_t i = 0; i < r.reloc_offsets.size(); ++i) {
+        uint32_t offset = r.reloc_offsets[i];
+        if (size_t(offset) + 1 >= r.ib.size() || r.ib[offset] != reloc_packet ||
+            r.ib[offset + 1] % reloc_size != 0 || r.ib[offset + 1] / reloc_size >= r.relocs.size())
+            throw runtime_error(path + ": invalid relocation packet");
+    }
+    if (r.buffers.empty())
+        r.buffers.resize(r.relocs.size());
+    return r;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <drm.h>
+#include <radeon_drm.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "radeon_buffer_object.hpp"
+#include "radeon_command_stream.hpp"
+
+/// This structure holds a submission of a command stream: its chunks and,
+/// optionally, the contents of the buffer objects which it references, so
+/// that it can be saved to a file once and submitted again any number of
+/// times (replay_cs).
+///
+/// The file is in the byte order of the host: a header of ten double words
+/// (the magic number, the version, the family, the flags chunk and the
+/// number of IB double words, relocations, relocation packets and buffers),
+/// then the IB, the relocations, the offsets of the relocation packets and
+/// the buffers, each a 64-bit size, a 64-bit number of bytes of contents and
+/// the contents.
+struct cs_recording {
+    /// A buffer object, the one of the relocation of the same index.
+    struct buffer {
+        /// The size in bytes, 0 if it is unknown.
+        std::uint64_t size;
+        /// A snapshot of its contents, or empty.
+        std::vector<std::uint8_t> contents;
+
+        buffer() : size() {}
+    };
+
+    /// The family of the device for which the command stream was written,
+    /// a radeon_device::family.
+    std::uint32_t family;
+    /// The flags chunk: the flags and the ring
+    /// (radeon_command_stream::set_flags), which a replay submits.
+    std::uint32_t flags[2];
+    /// The instruction buffer.
+    std::vector<std::uint32_t> ib;
+    /// The relocations, with the handles at the time of the recording.
+    std::vector<drm_radeon_cs_reloc> relocs;
+    /// The offsets of the relocation packets in the IB.
+    std::vector<std::uint32_t> reloc_offsets;
+    /// The buffer objects, one per relocation.
+    std::vector<buffer> buffers;
+
+    cs_recording() : family() { flags[0] = flags[1] = 0; }
+
+    /// Record the size of a buffer object which the command stream
+    /// references and, optionally, its contents.
+    /// It throws std::invalid_argument if the buffer object is not referenced.
+    /// \param bo The buffer object.
+    /// \param contents Whether to read its contents.
+    void snapshot(radeon_buffer_object const& bo, bool contents = true);
+
+    /// Get the IB and its relocations for the buffer objects of a replay.
+    /// \param handles The handles of the buffer objects, by relocation.
+    /// \returns A block to write into a command stream.
+    radeon_command_stream::ib_block block(std::vector<std::uint32_t> const& handles) const;
+
+    /// Write the recording into a file.
+    /// It may throw a std::system_error exception.
+    /// \param path The path of the file.
+    void write(std::string const& path) const;
+    /// Read a recording from a file.
+    /// It may throw a std::system_error exception, or std::runtime_error if
+    /// the file is not a valid recording.
+    /// \param path The path of the file.
+    static cs_recording read(std::string const& path);
+};
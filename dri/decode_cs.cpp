@@ -0,0 +1,120 @@
+#include <strings.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "cs_recording.hpp"
+#include "pm4_decoder.hpp"
+#include "radeon_device.hpp"
+
+using namespace std;
+
+namespace {
+
+/// Find a chip family by name, as radeon_device names them.
+radeon_device::radeon_family find_family(const char* name)
+{
+    for (int f = radeon_device::CHIP_UNKNOWN; f != radeon_device::CHIP_LAST; ++f)
+        if (strcasecmp(name, radeon_device::get_family_name(radeon_device::radeon_family(f))) == 0)
+            return radeon_device::radeon_family(f);
+    throw runtime_error(string("unknown family ") + name);
+}
+
+/// Read an IB of double words in the byte order of the host.
+vector<uint32_t> read_raw(const char* path)
+{
+    ifstream file(path, ios::in | ios::binary);
+    if (!file)
+        throw system_error(error_code(errno, system_category()), path);
+    vector<char> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    if (bytes.size() % 4)
+        throw runtime_error(string(path) + " is not made of double words");
+    vector<uint32_t> ib(bytes.size() / 4);
+    if (!ib.empty())
+        copy(bytes.begin(), bytes.end(), reinterpret_cast<char*>(&ib[0]));
+    return ib;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    const char* family = 0;
+    unsigned top = 10;
+    bool raw = false, dump = false, stats = true;
+
+    for (int opt = 0; (opt = getopt(argc, argv, "f:rdnt:")) != -1; )
+        switch (opt) {
+            case 'f': family = optarg; break;
+            case 'r': raw = true; break;
+            case 'd': dump = true; break;
+            case 'n': stats = false; break;
+            case 't': top = atoi(optarg); break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    if (optind >= argc || (raw && !family)) {
+        cerr << "Usage: " << argv[0] << " [-f<family>] [-r] [-d] [-n] [-t<n>] <file>...\n\n"
+            "\tDecode the PM4 packets of command stream recordings (replay_cs) and\n"
+            "\treport the double words by packet and by register class, the\n"
+            "\trelocations and the redundant register writes, over all the files.\n\n"
+            "\t-f <s>\tchip family, such as REDWOOD (that of the recording)\n"
+            "\t-r\tthe files are raw IBs of double words, which need -f\n"
+            "\t-d\twrite the packets with their registers and values\n"
+            "\t-n\tno statistics\n"
+            "\t-t <n>\tregisters with the most redundant writes to list (10)\n" << endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        vector<vector<uint32_t> > ibs;
+        radeon_device::radeon_family f = radeon_device::CHIP_UNKNOWN;
+        for (int i = optind; i < argc; ++i)
+            if (raw)
+                ibs.push_back(read_raw(argv[i]));
+            else {
+                cs_recording r = cs_recording::read(argv[i]);
+                f = radeon_device::radeon_family(r.family);
+                ibs.push_back(r.ib);
+            }
+        if (family)
+            f = find_family(family);
+
+        pm4_decoder decoder(f);
+        pm4_stats s(decoder);
+        for (size_t i = 0; i < ibs.size(); ++i) {
+            uint32_t const* ib = ibs[i].empty() ? 0 : &ibs[i][0];
+            if (dump) {
+                cout << argv[optind + i] << ":\n";
+                decoder.write(cout, ib, ibs[i].size());
+                cout << '\n';
+            }
+            s.add(ib, ibs[i].size());
+        }
+        if (stats)
+            s.write_table(cout, top);
+        cout << flush;
+    }
+    catch (system_error& e) {
+        cerr
+            << e.what()
+            << " : "
+            << e.code().message()
+            << endl;
+        return EXIT_FAILURE;
+    }
+    catch (runtime_error& e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -14,6 +14,9 @@ public:
     int descriptor() const { return _fd; }
 
 protected:
+    /// This constructor creates a device without a node, for stand-ins.
+    dri_device() : _fd(-1) {}
+
     /// Open a DRI device node given its pathname.
     /// \param path Pathname to the device node.
     void open(const char* path);
@@ -1,5 +1,7 @@
 #include "evergreen_command_stream.hpp"
+#include "scratch_ring.hpp"
 
+#include <algorithm>
 #include <stdexcept>
 
 using namespace std;
@@ -47,89 +49,370 @@ using namespace std;
 
 #define SX_MEMORY_EXPORT_SIZE           0x9014
 
+#define WAIT_UNTIL                      0x8040
+#define         WAIT_3D_IDLE                    (1 << 15)
+
+#define         S_008C04_NUM_CLAUSE_TEMP_GPRS(x) (((x) & 0xF) << 28)
+#define         S_008C0C_NUM_LS_GPRS(x)         (((x) & 0xFF) << 16)
+
+#define         S_0288D4_NUM_GPRS(x)            (((x) & 0xFF) << 0)
+#define         S_0288D4_STACK_SIZE(x)          (((x) & 0xFF) << 8)
+
+#define CB_TARGET_MASK                  0x28238
+#define CB_COLOR0_PITCH                 0x28c64
+#define CB_COLOR0_INFO                  0x28c70
+#define CB_COLOR0_ATTRIB                0x28c74
+#define CB_COLOR0_DIM                   0x28c78
+#define CB_COLOR_STRIDE                 0x3c
+#define         S_028C70_FORMAT(x)              (((x) & 0x3F) << 2)
+#define         S_028C70_ARRAY_MODE(x)          (((x) & 0xF) << 8)
+#define         S_028C70_NUMBER_TYPE(x)         (((x) & 0x7) << 12)
+#define         S_028C70_RAT(x)                 (((x) & 0x1) << 26)
+#define         V_028C70_COLOR_32               0x04
+#define         V_028C70_ARRAY_LINEAR_ALIGNED   0x1
+#define         V_028C70_NUMBER_UINT            0x4
+#define         S_028C74_NON_DISP_TILING_ORDER(x) (((x) & 0x1) << 4)
+
+#define SQ_FETCH_RESOURCE_CS            816
+#define         S_030008_STRIDE(x)              (((x) & 0x7FF) << 8)
+#define         S_030008_DATA_FORMAT(x)         (((x) & 0x3F) << 20)
+#define         V_030008_FMT_32_32_32_32        0x22
+#define         S_03000C_DST_SEL_X(x)           (((x) & 0x7) << 0)
+#define         S_03000C_DST_SEL_Y(x)           (((x) & 0x7) << 3)
+#define         S_03000C_DST_SEL_Z(x)           (((x) & 0x7) << 6)
+#define         S_03000C_DST_SEL_W(x)           (((x) & 0x7) << 9)
+#define         SQ_TEX_VTX_VALID_BUFFER         (3u << 30)
+
+/// Room for the longest state setting (a RAT) and for a dispatch.
+const std::size_t state_room = 64;
+const std::size_t dispatch_room = 64;
+
 evergreen_command_stream::evergreen_command_stream(radeon_device const& device)
-    : radeon_command_stream(device)
+    : radeon_command_stream(device),
+      _target_mask(), _scratch(), _scratch_handle(), _scratch_size(), _scratch_item()
 {
     if (device.family() < radeon_device::CHIP_CEDAR ||
         device.family() >= radeon_device::CHIP_CAYMAN)
         throw runtime_error(device.family_name());
 }
 
+namespace {
+
+/// Work-items per wavefront.
+const unsigned int items_per_wave = 64; // fix, see mesa evergreen_compute.c
+
+/// Append a packet that sets registers to a fragment.
+template <std::uint32_t Reg, typename... T>
+void append_set(std::vector<std::uint32_t>& fragment, T... values)
+{
+    typedef pm4::set_reg<pm4::evergreen, Reg, sizeof...(T)> packet;
+    const std::uint32_t v[] = { pm4::dword(values)... };
+    std::size_t n = fragment.size();
+    fragment.resize(n + packet::size);
+    std::copy(v, v + sizeof...(T), packet::store_header(&fragment[n]));
+}
+
+}
+
+compute_pipeline::compute_pipeline(radeon_device const& device, desc const& d)
+    : _desc(d)
+{
+    if (device.family() < radeon_device::CHIP_CEDAR ||
+        device.family() >= radeon_device::CHIP_CAYMAN)
+        throw runtime_error(device.family_name());
+
+    /// The limits are those of the fields of the registers and those of a
+    /// SIMD: the wavefronts of a group run on one SIMD, so their GPRs, less
+    /// the clause temporaries, and their LDS have to fit in it.
+    if (d.offset % 256)
+        throw runtime_error("the shader offset is not a multiple of 256");
+    if (d.num_gprs == 0 || d.num_gprs > 0xff || d.temp_gprs > 0xf || d.stack_size > 0xff)
+        throw runtime_error("invalid GPRs or stack size");
+    if (group_items() == 0 || group_items() > max_group_items)
+        throw runtime_error("invalid group size");
+    if (group_waves() * d.num_gprs > ls_gprs())
+        throw runtime_error("the GPRs of a group exceed those of a SIMD");
+    if (d.lds_dwords > simd_lds)
+        throw runtime_error("the LDS of a group exceeds that of a SIMD");
+    if (d.scratch_dwords > 0x7fff)
+        throw runtime_error("invalid scratch size");
+    if (d.gds_offset % 4 || d.gds_size % 4)
+        throw runtime_error("the GDS range is not of double words");
+
+    /// The static state is that of mesa's evergreen_init_atom_start_compute_cs:
+    /// the compute mode, then the GPRs of a SIMD, all of them to the LS
+    /// stage but the clause temporaries, which are reserved twice. The
+    /// item size of the scratch ring is only set by pipelines which spill,
+    /// after the command stream has bound a ring large enough.
+    /// The shader comes last, so that its relocation follows the fragment.
+    append_set<VGT_GS_MODE>(_fragment, COMPUTE_MODE | PARTIAL_THD_AT_EOI);
+    append_set<SPI_COMPUTE_INPUT_CNTL>(_fragment, TID_IN_GROUP_ENA | TGID_ENA | DISABLE_INDEX_PACK);
+    append_set<SQ_GPR_RESOURCE_MGMT_1>(_fragment,
+        S_008C04_NUM_CLAUSE_TEMP_GPRS(d.temp_gprs),
+        0u,     // SQ_GPR_RESOURCE_MGMT_2
+        S_008C0C_NUM_LS_GPRS(ls_gprs())
+    );
+    append_set<GDS_ADDR_BASE>(_fragment, d.gds_offset, d.gds_size, 1u);
+    if (d.scratch_dwords)
+        append_set<SQ_LSTMP_RING_ITEMSIZE>(_fragment, d.scratch_dwords);
+    append_set<VGT_NUM_INDICES>(_fragment, group_items());
+    append_set<VGT_COMPUTE_THREAD_GROUP_SIZE>(_fragment, group_items());
+    append_set<SPI_COMPUTE_NUM_THREAD_X>(_fragment, d.group[0], d.group[1], d.group[2]);
+    append_set<SQ_LDS_RESOURCE_MGMT>(_fragment, NUM_LS_LDS(d.lds_dwords));
+    append_set<SQ_LDS_ALLOC>(_fragment, SQ_LDS_ALLOC_SIZE(d.lds_dwords) | SQ_LDS_ALLOC_HS_NUM_WAVES(group_waves()));
+    append_set<SQ_PGM_RESOURCES_LS>(_fragment,
+        S_0288D4_NUM_GPRS(d.num_gprs) | S_0288D4_STACK_SIZE(d.stack_size),
+        0u  // SQ_PGM_RESOURCES_2_LS
+    );
+    append_set<SQ_PGM_START_LS>(_fragment, d.offset >> 8);
+}
+
+unsigned compute_pipeline::ls_gprs() const
+{
+    /// NUM_LS_GPRS is an 8-bit field, so without clause temporaries one GPR
+    /// of the SIMD is left out.
+    return std::min(simd_gprs - 2 * _desc.temp_gprs, 0xffu);
+}
+
+unsigned compute_pipeline::group_waves() const
+{
+    return (group_items() + items_per_wave - 1) / items_per_wave;
+}
+
 void evergreen_command_stream::write_set_reg(std::uint32_t start, std::uint32_t n)
 {
-    reserve(size() + 2 + n);
-
-    /// This function will select the appropriate PM4 packet, either a type-3
-    /// or a type-0 packet for setting the register, as different sets of
-    /// registers require a slightly different command.
-
-    if (start >= PACKET3_SET_CONFIG_REG_START && start < PACKET3_SET_CONFIG_REG_END)
-        write({
-            PACKET3(PACKET3_SET_CONFIG_REG, n),
-            (start - PACKET3_SET_CONFIG_REG_START) >> 2
-        });
-    else if (start >= PACKET3_SET_CONTEXT_REG_START && start < PACKET3_SET_CONTEXT_REG_END)
-        write({
-            PACKET3(PACKET3_SET_CONTEXT_REG, n),
-            (start - PACKET3_SET_CONTEXT_REG_START) >> 2
-        });
-    else if (start >= PACKET3_SET_BOOL_CONST_START && start < PACKET3_SET_BOOL_CONST_END)
-        write({
-            PACKET3(PACKET3_SET_BOOL_CONST, n),
-            (start - PACKET3_SET_BOOL_CONST_START) >> 2
-        });
-    else if (start >= PACKET3_SET_LOOP_CONST_START && start < PACKET3_SET_LOOP_CONST_END)
-        write({
-            PACKET3(PACKET3_SET_LOOP_CONST, n),
-            (start - PACKET3_SET_LOOP_CONST_START) >> 2
-        });
-    else if (start >= PACKET3_SET_RESOURCE_START && start < PACKET3_SET_RESOURCE_END)
-        write({
-            PACKET3(PACKET3_SET_RESOURCE, n),
-            (start - PACKET3_SET_RESOURCE_START) >> 2
-        });
-    else if (start >= PACKET3_SET_SAMPLER_START && start < PACKET3_SET_SAMPLER_END)
-        write({
-            PACKET3(PACKET3_SET_SAMPLER, n),
-            (start - PACKET3_SET_SAMPLER_START) >> 2
-        });
-    else if (start >= PACKET3_SET_CTL_CONST_START && start < PACKET3_SET_CTL_CONST_END)
-        write({
-            PACKET3(PACKET3_SET_CTL_CONST, n),
-            (start - PACKET3_SET_CTL_CONST_START) >> 2
-        });
-    else
-        write({
-            PACKET0(start, (n - 1))
-        });
+    /// The packet is selected at run time with the ranges of pm4::evergreen,
+    /// as \c set does at compile time.
+    std::uint32_t header[2];
+    unsigned k = pm4::set_reg_header<pm4::evergreen>(start, n, header);
+    std::copy(header, header + k, write_packet(k));
+}
+
+std::uint32_t* evergreen_command_stream::write_set_reg_packet(std::uint32_t start, std::uint32_t n)
+{
+    // One check of the capacity for the whole packet.
+    std::uint32_t header[2];
+    unsigned k = pm4::set_reg_header<pm4::evergreen>(start, n, header);
+    std::uint32_t* p = write_packet(k + n);
+    std::copy(header, header + k, p);
+    return p + k;
+}
+
+void evergreen_command_stream::clear()
+{
+    /// The scratch ring is bound again by the next dispatch which needs it.
+    radeon_command_stream::clear();
+    _state.clear();
+    _target_mask = 0;
+    _scratch_handle = _scratch_size = _scratch_item = 0;
 }
 
 void evergreen_command_stream::start_3d()
 {
-    write({
-        PACKET3(PACKET3_CONTEXT_CONTROL, 1),
-        0x80000000,
-        0x80000000 });
+    std::size_t begin = begin_state();
+    write(pm4::context_control{ 0x80000000, 0x80000000 });
+    end_state(0, begin);
+}
+
+void evergreen_command_stream::set_scratch_ring(scratch_ring* ring)
+{
+    _scratch = ring;
+    _scratch_handle = _scratch_size = _scratch_item = 0;
+}
+
+void evergreen_command_stream::set_scratch(std::uint32_t handle, std::uint32_t se_size,
+        std::uint32_t item_dwords, std::uint32_t domain)
+{
+    /// The ring is changed after the shaders which use it have run, as mesa
+    /// does, and the kernel expects a relocation after its base.
+    std::size_t begin = begin_state();
+    set<WAIT_UNTIL>(WAIT_3D_IDLE);
+    if (handle) {
+        set<SQ_LSTMP_RING_BASE>(0u);
+        write_reloc(handle, domain, domain);
+    }
+    set<SQ_LSTMP_RING_SIZE>(se_size >> 8);
+    set<SQ_LSTMP_RING_ITEMSIZE>(item_dwords);
+    end_state(SQ_LSTMP_RING_SIZE, begin);
+
+    _scratch_handle = handle;
+    _scratch_size = se_size;
+    _scratch_item = item_dwords;
 }
 
 void evergreen_command_stream::set_gds(std::uint32_t addr, std::uint32_t size)
 {
-    (*this)[GDS_ADDR_BASE] = {
+    std::size_t begin = begin_state();
+    set<GDS_ADDR_BASE>(
         addr,
         size,
-        1
-    };
+        1u);
+    end_state(GDS_ADDR_BASE, begin);
+}
+
+void evergreen_command_stream::fill_gds(std::uint32_t addr, std::uint32_t size, std::uint32_t value)
+{
+    if (addr % 4 || size % 4)
+        throw invalid_argument("GDS copies are of double words");
+    make_room(pm4::cp_dma::size);
+    write(pm4::cp_dma{ value, pm4::dma_data, addr, pm4::dma_gds, size });
+}
+
+void evergreen_command_stream::copy_to_gds(std::uint32_t addr, std::uint32_t size,
+        std::uint32_t handle, std::uint32_t offset, std::uint32_t domain)
+{
+    if (addr % 4 || size % 4)
+        throw invalid_argument("GDS copies are of double words");
+    make_room(pm4::cp_dma::size + 2);
+    write(pm4::cp_dma{ offset, pm4::dma_memory, addr, pm4::dma_gds, size });
+    write_reloc(handle, domain, 0);
+}
+
+void evergreen_command_stream::copy_from_gds(std::uint32_t addr, std::uint32_t size,
+        std::uint32_t handle, std::uint32_t offset, std::uint32_t domain)
+{
+    if (addr % 4 || size % 4)
+        throw invalid_argument("GDS copies are of double words");
+    make_room(pm4::set_reg<pm4::evergreen, WAIT_UNTIL, 1>::size + pm4::cp_dma::size + 2);
+    set<WAIT_UNTIL>(WAIT_3D_IDLE);
+    write(pm4::cp_dma{ addr, pm4::dma_gds, offset, pm4::dma_memory, size });
+    write_reloc(handle, 0, domain);
 }
 
 void evergreen_command_stream::set_export(std::uint32_t handle, std::uint32_t offset, std::uint32_t size)
 {
+    std::size_t begin = begin_state();
     if (size)
     {
-        (*this)[SX_MEMORY_EXPORT_BASE] = offset;
+        set<SX_MEMORY_EXPORT_BASE>(offset);
         write_reloc(handle, 0, RADEON_GEM_DOMAIN_VRAM);
     }
 
-    (*this)[SX_MEMORY_EXPORT_SIZE] = size;
+    set<SX_MEMORY_EXPORT_SIZE>(size);
+    end_state(SX_MEMORY_EXPORT_SIZE, begin);
+}
+
+void evergreen_command_stream::set_shader(std::uint32_t handle, std::uint32_t offset,
+        unsigned num_gprs, unsigned stack_size, std::uint32_t domain)
+{
+    /// Compute shaders run as LS shaders, as in mesa's evergreen_compute.c.
+    std::size_t begin = begin_state();
+    set<SQ_PGM_START_LS>(offset >> 8);
+    write_reloc(handle, domain, 0);
+
+    set<SQ_PGM_RESOURCES_LS>(
+        S_0288D4_NUM_GPRS(num_gprs) | S_0288D4_STACK_SIZE(stack_size),
+        0u  // SQ_PGM_RESOURCES_2_LS
+    );
+    end_state(SQ_PGM_START_LS, begin);
+}
+
+void evergreen_command_stream::set_constant_buffer(unsigned id, std::uint32_t handle,
+        std::uint32_t offset, std::uint32_t size, std::uint32_t domain)
+{
+    if (id >= 16)
+        throw out_of_range("constant buffer");
+
+    // The size is in units of 256 bytes.
+    std::size_t begin = begin_state();
+    set_indexed<SQ_ALU_CONST_BUFFER_SIZE_LS_0, 4, 16>(id, (size + 255) >> 8);
+    set_indexed<SQ_ALU_CONST_CACHE_LS_0, 4, 16>(id, offset >> 8);
+    write_reloc(handle, domain, 0);
+    end_state(SQ_ALU_CONST_CACHE_LS_0 + 4 * id, begin);
+}
+
+void evergreen_command_stream::set_constants(unsigned id, constant_ring& ring,
+        const void* data, std::uint32_t size)
+{
+    if (id >= 16)
+        throw out_of_range("constant buffer");
+
+    std::uint32_t offset = ring.write(*this, data, size);
+    set_constant_buffer(id, ring.handle(), offset, size, ring.domain());
+}
+
+void evergreen_command_stream::set_rat(unsigned id, std::uint32_t handle,
+        std::uint32_t offset, std::uint32_t size, std::uint32_t domain)
+{
+    if (id >= 8)
+        throw out_of_range("RAT");
+
+    /// A RAT is a color buffer with the RAT bit set, linear and of 32-bit
+    /// elements, as mesa's evergreen_init_color_surface_rat sets it up.
+    /// The kernel expects a relocation after the base, the info and the
+    /// attributes.
+    const std::uint32_t cb = id * CB_COLOR_STRIDE;
+    const std::uint32_t elements = size / 4, pitch = (elements + 63) & ~63u;
+
+    std::size_t begin = begin_state();
+    set_indexed<CB_COLOR0_PITCH, CB_COLOR_STRIDE, 8>(id,
+        pitch / 8 - 1,  // CB_COLOR0_PITCH
+        0u,             // CB_COLOR0_SLICE
+        0u              // CB_COLOR0_VIEW
+    );
+    set_indexed<CB_COLOR0_INFO, CB_COLOR_STRIDE, 8>(id,
+        S_028C70_FORMAT(V_028C70_COLOR_32) |
+        S_028C70_ARRAY_MODE(V_028C70_ARRAY_LINEAR_ALIGNED) |
+        S_028C70_NUMBER_TYPE(V_028C70_NUMBER_UINT) |
+        S_028C70_RAT(1u));
+    write_reloc(handle, 0, domain);
+    set_indexed<CB_COLOR0_ATTRIB, CB_COLOR_STRIDE, 8>(id, S_028C74_NON_DISP_TILING_ORDER(1u));
+    write_reloc(handle, 0, domain);
+    set_indexed<CB_COLOR0_DIM, CB_COLOR_STRIDE, 8>(id, elements);
+    set_indexed<CB_COLOR0_BASE, CB_COLOR_STRIDE, 8>(id, offset >> 8);
+    write_reloc(handle, 0, domain);
+    end_state(CB_COLOR0_PITCH + cb, begin);
+
+    /// The target mask enables the RATs bound so far, a state of its own.
+    _target_mask |= 0xfu << (4 * id);
+    begin = begin_state();
+    set<CB_TARGET_MASK>(_target_mask);
+    end_state(CB_TARGET_MASK, begin);
+}
+
+void evergreen_command_stream::set_vertex_buffer(unsigned id, std::uint32_t handle,
+        std::uint32_t offset, std::uint32_t size, std::uint32_t stride,
+        std::uint32_t domain)
+{
+    /// The fetch resources of compute shaders start at 816, after those of
+    /// the other stages, up to the end of the 1024; each takes 8 double
+    /// words.
+    const std::uint32_t resource = PACKET3_SET_RESOURCE_START + SQ_FETCH_RESOURCE_CS * 32;
+    std::size_t begin = begin_state();
+    set_indexed<resource, 32, 1024 - SQ_FETCH_RESOURCE_CS>(id,
+        offset,         // WORD0: base address
+        size - 1,       // WORD1: last byte
+        S_030008_STRIDE(stride) | S_030008_DATA_FORMAT(V_030008_FMT_32_32_32_32),
+        S_03000C_DST_SEL_X(0) | S_03000C_DST_SEL_Y(1) | S_03000C_DST_SEL_Z(2) | S_03000C_DST_SEL_W(3),
+        0u,
+        0u,
+        0u,
+        SQ_TEX_VTX_VALID_BUFFER
+    );
+    write_reloc(handle, domain, 0);
+    end_state(resource + id * 32, begin);
+}
+
+std::size_t evergreen_command_stream::begin_state()
+{
+    make_room(state_room);
+    return size();
+}
+
+void evergreen_command_stream::end_state(std::uint32_t key, std::size_t begin)
+{
+    for (std::size_t i = 0; i < _state.size(); ++i)
+        if (_state[i].first == key) {
+            _state[i].second = copy(begin);
+            return;
+        }
+    _state.push_back(std::make_pair(key, copy(begin)));
+}
+
+void evergreen_command_stream::restore()
+{
+    for (std::size_t i = 0; i < _state.size(); ++i)
+        write(_state[i].second);
 }
 
 //void evergreen_command_stream::set_loop_consts(std::vector<loop_const> const& v)
@@ -138,10 +421,20 @@ void evergreen_command_stream::set_export(std::uint32_t handle, std::uint32_t of
 
 void evergreen_command_stream::dispatch_direct(
         std::vector< unsigned int > group_dims, std::vector< unsigned int > grid_dims)
+{
+    dispatch_direct(group_dims, grid_dims, { 0, 0, 0 });
+}
+
+void evergreen_command_stream::dispatch_direct(
+        std::vector< unsigned int > group_dims, std::vector< unsigned int > grid_dims,
+        std::vector< unsigned int > start)
 {
     // Iterator type for the work group and grid dimensions.
     typedef std::vector< unsigned int >::const_iterator dims_iterator;
 
+    // A dispatch is not split over two IBs.
+    make_room(dispatch_room);
+
     // Compute the total number of work items in a work group.
     unsigned int group_size = 1;
     for (dims_iterator p = group_dims.begin(); p != group_dims.end(); ++p)
@@ -153,36 +446,112 @@ void evergreen_command_stream::dispatch_direct(
         grid_size *= *p;
 
     // Compute the number of wavefronts per work group.
-    const unsigned int items_per_wave = 64; // fix, see mesa evergreen_compute.c
     const unsigned int waves_per_group =
         (group_size + items_per_wave - 1) / items_per_wave;
 
     // This follows evergreen_emit_direct_dispatch almost exactly.
-    (*this)[VGT_NUM_INDICES] = group_size;
-
-    (*this)[VGT_COMPUTE_START_X] = {
-        0,  // X
-        0,  // Y
-        0   // Z
-    };
-
-    (*this)[VGT_COMPUTE_THREAD_GROUP_SIZE] = group_size;
+    set<VGT_NUM_INDICES>(group_size);
+    set<VGT_COMPUTE_THREAD_GROUP_SIZE>(group_size);
 
-    (*this)[SPI_COMPUTE_NUM_THREAD_X] = {
+    set<SPI_COMPUTE_NUM_THREAD_X>(
         group_dims.size() >= 1 ? group_dims[0] : 1,
         group_dims.size() >= 2 ? group_dims[1] : 1,
         group_dims.size() >= 3 ? group_dims[2] : 1
-    };
+    );
 
+    // The shader set by set_shader uses no LDS; a compute_pipeline sets it.
     unsigned int lds_dwords = 0, lds_size = 0;
-    (*this)[SQ_LDS_RESOURCE_MGMT] = NUM_LS_LDS(lds_dwords);
-    (*this)[SQ_LDS_ALLOC] = SQ_LDS_ALLOC_SIZE(lds_size) | SQ_LDS_ALLOC_HS_NUM_WAVES(waves_per_group);
+    set<SQ_LDS_RESOURCE_MGMT>(NUM_LS_LDS(lds_dwords));
+    set<SQ_LDS_ALLOC>(SQ_LDS_ALLOC_SIZE(lds_size) | SQ_LDS_ALLOC_HS_NUM_WAVES(waves_per_group));
+
+    write_dispatch(grid_dims, start);
+}
+
+void evergreen_command_stream::dispatch(compute_pipeline const& pipeline,
+        std::vector< unsigned int > grid_dims, std::vector< unsigned int > start)
+{
+    if (_scratch && pipeline.description().scratch_dwords) {
+        _scratch->reserve(pipeline);
+        std::uint32_t se_size = _scratch->se_size(pipeline);
+        if (_scratch->handle() != _scratch_handle || se_size != _scratch_size ||
+                pipeline.description().scratch_dwords != _scratch_item)
+            set_scratch(_scratch->handle(), se_size, pipeline.description().scratch_dwords,
+                _scratch->domain());
+    }
+
+    std::vector<std::uint32_t> const& f = pipeline.fragment();
+    make_room(f.size() + dispatch_room);
+
+    std::copy(f.begin(), f.end(), write_packet(f.size()));
+    write_reloc(pipeline.description().handle, pipeline.description().domain, 0);
+    write_dispatch(grid_dims, start);
+}
+
+void evergreen_command_stream::write_dispatch(std::vector< unsigned int > const& grid_dims,
+        std::vector< unsigned int > const& start)
+{
+    set<VGT_COMPUTE_START_X>(
+        start.size() >= 1 ? start[0] : 0,   // X
+        start.size() >= 2 ? start[1] : 0,   // Y
+        start.size() >= 3 ? start[2] : 0    // Z
+    );
 
-    write({
-        PACKET3(PACKET3_DISPATCH_DIRECT, 3),
+    write(pm4::dispatch_direct{
         grid_dims.size() >= 1 ? grid_dims[0] : 1,
         grid_dims.size() >= 2 ? grid_dims[1] : 1,
-        grid_dims.size() >= 3 ? grid_dims[2] : 1,
-        1 // VGT_DISPATCH_INITIATOR = COMPUTE_SHADER_EN
-        });
+        grid_dims.size() >= 3 ? grid_dims[2] : 1
+    });
+}
+
+unsigned int evergreen_command_stream::dispatch_split(
+        std::vector< unsigned int > group_dims, std::vector< unsigned int > grid_dims,
+        dispatch_limits const& limits, std::function<void(evergreen_command_stream&)> const& flush)
+{
+    return split(grid_dims, limits, flush,
+        [&](std::vector< unsigned int > const& grid, std::vector< unsigned int > const& start)
+            { dispatch_direct(group_dims, grid, start); });
+}
+
+unsigned int evergreen_command_stream::dispatch_split(compute_pipeline const& pipeline,
+        std::vector< unsigned int > grid_dims, dispatch_limits const& limits,
+        std::function<void(evergreen_command_stream&)> const& flush)
+{
+    return split(grid_dims, limits, flush,
+        [&](std::vector< unsigned int > const& grid, std::vector< unsigned int > const& start)
+            { dispatch(pipeline, grid, start); });
+}
+
+unsigned int evergreen_command_stream::split(std::vector< unsigned int > grid_dims,
+        dispatch_limits const& limits, std::function<void(evergreen_command_stream&)> const& flush,
+        std::function<void(std::vector< unsigned int > const&, std::vector< unsigned int > const&)> const& dispatch)
+{
+    grid_dims.resize(3, 1);
+    for (unsigned int i = 0; i < 3; ++i)
+        if (grid_dims[i] == 0)
+            return 0;
+    if (limits.max_dim == 0)
+        throw out_of_range("dispatch limits");
+
+    // The shape of a dispatch: whole rows of X first, then Y, then Z, as
+    // far as the limits allow.
+    unsigned int max_groups = limits.max_groups ? limits.max_groups : ~0u;
+    unsigned int chunk[3];
+    for (unsigned int i = 0, groups = 1; i < 3; ++i) {
+        chunk[i] = std::min(std::min(grid_dims[i], limits.max_dim), std::max(max_groups / groups, 1u));
+        groups *= chunk[i];
+    }
+
+    unsigned int n = 0;
+    for (unsigned int z = 0; z < grid_dims[2]; z += chunk[2])
+        for (unsigned int y = 0; y < grid_dims[1]; y += chunk[1])
+            for (unsigned int x = 0; x < grid_dims[0]; x += chunk[0]) {
+                if (n++ && flush)
+                    flush(*this);
+                dispatch({
+                        std::min(chunk[0], grid_dims[0] - x),
+                        std::min(chunk[1], grid_dims[1] - y),
+                        std::min(chunk[2], grid_dims[2] - z)
+                    }, { x, y, z });
+            }
+    return n;
 }
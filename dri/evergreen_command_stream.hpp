@@ -1,12 +1,100 @@
 #pragma once
 
+#include "constant_ring.hpp"
 #include "radeon_command_stream.hpp"
 #include "radeon_device.hpp"
 
+#include <algorithm>
 #include <cstdint>
+#include <functional>
 #include <initializer_list>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/// This class is a compute pipeline for Evergreen: a shader with its GPR,
+/// stack and LDS configuration and the group shape, with the registers
+/// which they set. It is immutable: it is validated once against the
+/// device when it is created and encoded once into a fragment of PM4
+/// packets, which evergreen_command_stream::dispatch appends to the IB with
+/// a single copy, followed by the relocation of the shader.
+///
+/// The fragment holds the whole static state of a dispatch: the compute
+/// mode, the partition of the GPRs between the shader and its clause
+/// temporaries, the GDS range and the item size of the scratch ring. Only
+/// the buffers and the scratch ring itself are bound by the command stream.
+class compute_pipeline {
+public:
+    /// This structure describes a pipeline.
+    struct desc {
+        std::uint32_t handle;   ///< Handle of the BO which holds the shader.
+        std::uint32_t offset;   ///< Offset of the shader in the BO, a multiple of 256.
+        std::uint32_t domain;   ///< Domain of the BO.
+        unsigned num_gprs;      ///< GPRs per work-item.
+        unsigned temp_gprs;     ///< Clause temporaries, reserved twice per SIMD, up to 15.
+        unsigned stack_size;    ///< Stack entries per wavefront.
+        unsigned lds_dwords;    ///< LDS double words per group.
+        unsigned scratch_dwords;    ///< Scratch double words per work-item (scratch_ring).
+        std::uint32_t gds_offset;   ///< Offset of the GDS range of the shader in bytes.
+        std::uint32_t gds_size;     ///< Size of the GDS range in bytes, 0 for none.
+        unsigned group[3];      ///< Work-items per group in X, Y and Z.
+
+        desc() : handle(), offset(), domain(RADEON_GEM_DOMAIN_VRAM),
+            num_gprs(), temp_gprs(), stack_size(), lds_dwords(), scratch_dwords(),
+            gds_offset(), gds_size()
+            { group[0] = group[1] = group[2] = 1; }
+    };
+
+    /// The most work-items of a group, GPRs of a SIMD and LDS double words
+    /// of a SIMD. They are the same for every Evergreen, so they are not
+    /// taken from the device: the kernel's evergreen_gpu_init gives all the
+    /// families 256 GPRs per SIMD, the SIMDs of all of them have 32K of LDS,
+    /// and 256 work-items is the group limit of the SPI. The families
+    /// differ in their SIMDs and wavefront slots, which scratch_ring takes
+    /// into account. isa/kernel_tuner has the same limits.
+    static const unsigned max_group_items = 256;
+    static const unsigned simd_gprs = 256;
+    static const unsigned simd_lds = 8192;
+
+    /// Validate and encode a pipeline.
+    /// It throws std::runtime_error if the device is not an Evergreen or
+    /// the configuration does not fit it, such as a group whose wavefronts
+    /// need more GPRs than a SIMD has.
+    /// \param device The device on which the pipeline runs.
+    /// \param d The description.
+    compute_pipeline(radeon_device const& device, desc const& d);
+
+    /// Get the description.
+    desc const& description() const { return _desc; }
+    /// Get the work-items per group.
+    unsigned group_items() const { return _desc.group[0] * _desc.group[1] * _desc.group[2]; }
+    /// Get the wavefronts per group.
+    unsigned group_waves() const;
+    /// Get the GPRs of a SIMD which the shaders have (NUM_LS_GPRS): those
+    /// which the clause temporaries leave, up to 255.
+    unsigned ls_gprs() const;
+    /// Get the fragment, without the relocation of the shader which follows
+    /// it.
+    std::vector<std::uint32_t> const& fragment() const { return _fragment; }
+
+private:
+    desc _desc;
+    std::vector<std::uint32_t> _fragment;
+};
+
+class scratch_ring;
 
 /// This class wraps an in-memory command stream for an R600.
+///
+/// The command stream keeps a copy of the compute state set by its member
+/// functions (start_3d, the shader, the constant buffers, the RATs, the
+/// fetch resources, the scratch ring, GDS and the export buffer), the last
+/// setting of each.
+/// When a dispatch or a state setting does not fit in the IB under its
+/// limit, the command stream is flushed and the copy is written at the start
+/// of the new IB, so that batches of any size can be written in one go.
+/// Registers set through \c operator[] are not kept. \c clear and \c reset
+/// drop the copy, so that the next IB starts afresh.
 class evergreen_command_stream : public radeon_command_stream {
 public:
     /// This constructor creates a command stream for a radeon device.
@@ -20,6 +108,13 @@ public:
     /// \param start The first register in the series.
     /// \param n Number of registers to set.
     void write_set_reg(std::uint32_t start, std::uint32_t n);
+    /// Append a PM4 packet for setting a number of registers starting at
+    /// the given register offset, whose values the caller writes.
+    /// \param start The first register in the series.
+    /// \param n Number of registers to set.
+    /// \returns The address of the values in the IB, valid until the next
+    /// write.
+    std::uint32_t* write_set_reg_packet(std::uint32_t start, std::uint32_t n);
 
     /// The structure of the proxy object which is used for conveniently
     /// setting a series of registers.
@@ -33,13 +128,14 @@ public:
         evergreen_command_stream& cs;   ///< Command stream for which to proxy.
         std::uint32_t start;            ///< First register in the series.
         /// Set the register at \c start to the given double word.
-        void operator = (std::uint32_t x) { cs.write_set_reg(start, 1); cs.write(x); }
+        void operator = (std::uint32_t x) { *cs.write_set_reg_packet(start, 1) = x; }
         /// Set the register at \c start to the given float number.
-        void operator = (float x) { cs.write_set_reg(start, 1); cs.write(x); }
+        void operator = (float x)
+            { *cs.write_set_reg_packet(start, 1) = *reinterpret_cast<std::uint32_t*>(&x); }
         /// Set registers starting at \c start to the given values.
         /// \param x Double words in an initializer list.
         void operator = (std::initializer_list<std::uint32_t> x)
-            { cs.write_set_reg(start, x.size()); cs.write(x); }
+            { std::copy(x.begin(), x.end(), cs.write_set_reg_packet(start, x.size())); }
     };
     /// Append a PM4 packet to the instruction buffer that sets a series of
     /// consecutive hardware registers starting at the given register offset.
@@ -52,13 +148,226 @@ public:
     register_setter operator [] (std::uint32_t start)
         { return { *this, start }; }
 
+    /// Append a PM4 packet that sets a series of registers starting at a
+    /// register offset known at compile time, whose packet and header are
+    /// selected and checked by the compiler (pm4::set_reg).
+    /// \tparam Reg The first register in the series.
+    /// \param values The values of the registers, double words or floats.
+    template <std::uint32_t Reg, typename... T>
+    void set(T... values)
+    {
+        typedef pm4::set_reg<pm4::evergreen, Reg, sizeof...(T)> packet;
+        const std::uint32_t v[] = { pm4::dword(values)... };
+        std::copy(v, v + sizeof...(T), packet::store_header(write_packet(packet::size)));
+    }
+    /// Append a PM4 packet that sets registers of one of \c Items like sets
+    /// of registers, \c Stride bytes apart (pm4::set_reg_array).
+    /// It throws std::out_of_range if the set is not less than \c Items.
+    /// \tparam Base The first register of the first set.
+    /// \param i The set.
+    /// \param values The values of the registers.
+    template <std::uint32_t Base, std::uint32_t Stride, unsigned Items, typename... T>
+    void set_indexed(unsigned i, T... values)
+    {
+        typedef pm4::set_reg_array<pm4::evergreen, Base, Stride, Items, sizeof...(T)> packet;
+        if (i >= Items)
+            throw std::out_of_range("register array");
+        const std::uint32_t v[] = { pm4::dword(values)... };
+        std::copy(v, v + sizeof...(T), packet::store_header(write_packet(packet::size), i));
+    }
+
+    /// Empty the command stream and drop the copy of the compute state.
+    void clear();
+
     /// Initialize a command stream.
     void start_3d();
 
     /// Compute shader dispatch.
     void dispatch_direct(std::vector<unsigned int> group_dims,
         std::vector<unsigned int> grid_dims);
+    /// Compute shader dispatch of part of a grid.
+    /// \param group_dims Work-items per group.
+    /// \param grid_dims Groups to dispatch.
+    /// \param start The group id of the first group (VGT_COMPUTE_START).
+    void dispatch_direct(std::vector<unsigned int> group_dims,
+        std::vector<unsigned int> grid_dims, std::vector<unsigned int> start);
 
+    /// Compute shader dispatch with a pipeline, whose fragment is copied
+    /// into the IB. If the pipeline spills registers, the scratch ring of
+    /// the command stream is made large enough for it and bound first.
+    /// \param pipeline The pipeline, on the device of the command stream.
+    /// \param grid_dims Groups to dispatch.
+    /// \param start The group id of the first group (VGT_COMPUTE_START).
+    void dispatch(compute_pipeline const& pipeline, std::vector<unsigned int> grid_dims,
+        std::vector<unsigned int> start = std::vector<unsigned int>());
+
+    /// This structure limits the dispatches into which a grid is split.
+    struct dispatch_limits {
+        /// Groups per dimension of a dispatch, 65535 as mesa reports for
+        /// Evergreen.
+        unsigned int max_dim;
+        /// Groups per dispatch, 0 for no limit.
+        unsigned int max_groups;
+
+        dispatch_limits() : max_dim(65535), max_groups(0) {}
+
+        /// Limit the groups per dispatch to those that run in a given time.
+        /// \param budget Time of a dispatch.
+        /// \param group_time Time of a group, in the same unit, measured or
+        /// estimated (isa/model_kernel).
+        void set_time(double budget, double group_time)
+            { max_groups = group_time > 0 && budget > group_time ? budget / group_time : 1; }
+    };
+    /// Dispatch a grid in as many dispatches as the limits require, each
+    /// one a box of the grid whose first group id is set with
+    /// VGT_COMPUTE_START, so that the kernels see the group ids of the whole
+    /// grid.
+    ///
+    /// Splitting in one command stream keeps within the limits of the
+    /// hardware. For the dispatches to be submitted separately, so that
+    /// none of them runs long enough for the GPU to be taken for locked up
+    /// and other clients get their turns, \c flush may call
+    /// radeon_command_stream::flush, which restores the state.
+    ///
+    /// \param group_dims Work-items per group.
+    /// \param grid_dims Groups in the grid.
+    /// \param limits The limits of a dispatch.
+    /// \param flush Called between dispatches with this command stream, or
+    /// empty.
+    /// \returns The number of dispatches.
+    unsigned int dispatch_split(std::vector<unsigned int> group_dims,
+        std::vector<unsigned int> grid_dims, dispatch_limits const& limits,
+        std::function<void(evergreen_command_stream&)> const& flush =
+            std::function<void(evergreen_command_stream&)>());
+
+    /// Dispatch a grid with a pipeline in as many dispatches as the limits
+    /// require, as the other \c dispatch_split does.
+    unsigned int dispatch_split(compute_pipeline const& pipeline,
+        std::vector<unsigned int> grid_dims, dispatch_limits const& limits,
+        std::function<void(evergreen_command_stream&)> const& flush =
+            std::function<void(evergreen_command_stream&)>());
+
+    /// Set the scratch ring which the dispatches with pipelines that spill
+    /// registers bind, or none. It is bound again by the next dispatch
+    /// which needs it, as it has to be after \c clear.
+    /// \param ring The ring, or 0.
+    void set_scratch_ring(scratch_ring* ring);
+    /// Bind a buffer as the scratch ring of the compute shaders, after the
+    /// shaders which use the previous one have run.
+    /// \param handle Handle of the BO, or 0 for none.
+    /// \param se_size Bytes of the ring per shader engine, a multiple of 256.
+    /// \param item_dwords Double words per work-item.
+    /// \param domain Domain of the BO.
+    void set_scratch(std::uint32_t handle, std::uint32_t se_size,
+        std::uint32_t item_dwords, std::uint32_t domain = RADEON_GEM_DOMAIN_VRAM);
+
+    /// Set the range of the GDS which the shaders of \c dispatch_direct
+    /// address. A pipeline sets its own range.
+    /// \param addr Offset of the range in the GDS, in bytes.
+    /// \param size Size of the range in bytes, 0 for none.
     void set_gds(std::uint32_t addr, std::uint32_t size);
+    /// Fill a part of the GDS with a double word (CP_DMA).
+    /// \param addr Offset in the GDS, a multiple of 4.
+    /// \param size Bytes to fill, a multiple of 4.
+    /// \param value The double word.
+    void fill_gds(std::uint32_t addr, std::uint32_t size, std::uint32_t value);
+    /// Copy a part of a buffer into the GDS (CP_DMA).
+    /// \param addr Offset in the GDS, a multiple of 4.
+    /// \param size Bytes to copy, a multiple of 4.
+    /// \param handle Handle of the BO.
+    /// \param offset Offset in the BO.
+    /// \param domain Domain of the BO.
+    void copy_to_gds(std::uint32_t addr, std::uint32_t size,
+        std::uint32_t handle, std::uint32_t offset,
+        std::uint32_t domain = RADEON_GEM_DOMAIN_GTT);
+    /// Copy a part of the GDS into a buffer (CP_DMA), once the shaders
+    /// dispatched before have run.
+    /// \param addr Offset in the GDS, a multiple of 4.
+    /// \param size Bytes to copy, a multiple of 4.
+    /// \param handle Handle of the BO.
+    /// \param offset Offset in the BO.
+    /// \param domain Domain of the BO.
+    void copy_from_gds(std::uint32_t addr, std::uint32_t size,
+        std::uint32_t handle, std::uint32_t offset,
+        std::uint32_t domain = RADEON_GEM_DOMAIN_GTT);
     void set_export(std::uint32_t handle, std::uint32_t offset, std::uint32_t size);
+
+    /// Set the shader which the dispatches run.
+    /// \param handle Handle of the BO which holds the shader.
+    /// \param offset Offset of the shader in the BO, a multiple of 256.
+    /// \param num_gprs GPRs per work-item.
+    /// \param stack_size Stack entries per wavefront.
+    /// \param domain Domain of the BO.
+    void set_shader(std::uint32_t handle, std::uint32_t offset,
+        unsigned num_gprs, unsigned stack_size,
+        std::uint32_t domain = RADEON_GEM_DOMAIN_VRAM);
+    /// Bind a buffer to a constant cache (KCACHE bank).
+    /// \param id The constant buffer, 0 to 15.
+    /// \param handle Handle of the BO.
+    /// \param offset Offset of the constants in the BO, a multiple of 256.
+    /// \param size Size of the constants in bytes.
+    /// \param domain Domain of the BO.
+    void set_constant_buffer(unsigned id, std::uint32_t handle,
+        std::uint32_t offset, std::uint32_t size,
+        std::uint32_t domain = RADEON_GEM_DOMAIN_VRAM);
+    /// Write constants into a slice of a constant ring and bind it to a
+    /// constant cache (KCACHE bank). The ring must be fenced
+    /// (constant_ring::fence) before the command stream is emitted.
+    /// \param id The constant buffer, 0 to 15.
+    /// \param ring The constant ring.
+    /// \param data The constants.
+    /// \param size Size of the constants in bytes.
+    void set_constants(unsigned id, constant_ring& ring,
+        const void* data, std::uint32_t size);
+    /// Bind a buffer to a RAT as a linear array of double words. The RATs
+    /// bound before stay enabled, until \c clear.
+    /// \param id The RAT, 0 to 7.
+    /// \param handle Handle of the BO.
+    /// \param offset Offset of the array in the BO, a multiple of 256.
+    /// \param size Size of the array in bytes.
+    /// \param domain Domain of the BO.
+    void set_rat(unsigned id, std::uint32_t handle,
+        std::uint32_t offset, std::uint32_t size,
+        std::uint32_t domain = RADEON_GEM_DOMAIN_VRAM);
+    /// Bind a buffer to a vertex fetch resource of four 32-bit components.
+    /// \param id The BUFFER_ID of the fetch instructions.
+    /// \param handle Handle of the BO.
+    /// \param offset Offset of the first element in the BO.
+    /// \param size Size of the buffer in bytes.
+    /// \param stride Bytes from an index to the next.
+    /// \param domain Domain of the BO.
+    void set_vertex_buffer(unsigned id, std::uint32_t handle,
+        std::uint32_t offset, std::uint32_t size, std::uint32_t stride,
+        std::uint32_t domain = RADEON_GEM_DOMAIN_VRAM);
+
+protected:
+    /// Write the copy of the compute state.
+    void restore();
+
+private:
+    /// Append the start of a dispatch and DISPATCH_DIRECT.
+    void write_dispatch(std::vector<unsigned int> const& grid_dims,
+        std::vector<unsigned int> const& start);
+    /// Split a grid into dispatches, each made by \c dispatch.
+    unsigned int split(std::vector<unsigned int> grid_dims, dispatch_limits const& limits,
+        std::function<void(evergreen_command_stream&)> const& flush,
+        std::function<void(std::vector<unsigned int> const&, std::vector<unsigned int> const&)> const& dispatch);
+
+    /// Make room for a state setting.
+    /// \returns The offset of the setting in the IB.
+    std::size_t begin_state();
+    /// Keep a copy of a state setting, replacing the previous setting of
+    /// the same state.
+    /// \param key The state, the first register of the setting.
+    /// \param begin The offset of the setting in the IB.
+    void end_state(std::uint32_t key, std::size_t begin);
+
+    /// The copies of the state settings, in the order of their first setting.
+    std::vector<std::pair<std::uint32_t, ib_block> > _state;
+    /// The CB_TARGET_MASK of the RATs bound so far.
+    std::uint32_t _target_mask;
+    /// The scratch ring, and its handle, size per shader engine and item
+    /// size as they were last bound.
+    scratch_ring* _scratch;
+    std::uint32_t _scratch_handle, _scratch_size, _scratch_item;
 };
@@ -0,0 +1,106 @@
+#include "gds_counters.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+gds_heap::gds_heap(uint32_t size)
+{
+    if (size >= 4)
+        _free[0] = size & ~3u;
+}
+
+gds_range gds_heap::allocate(uint32_t size)
+{
+    size = max(4u, (size + 3) & ~3u);
+    for (map<uint32_t, uint32_t>::iterator i = _free.begin(); i != _free.end(); ++i)
+        if (i->second >= size) {
+            gds_range r = { i->first, size };
+            if (i->second > size)
+                _free[i->first + size] = i->second - size;
+            _free.erase(i);
+            return r;
+        }
+    throw runtime_error("the GDS is full");
+}
+
+void gds_heap::release(gds_range r)
+{
+    map<uint32_t, uint32_t>::iterator i = _free.insert(make_pair(r.offset, r.size)).first;
+
+    // Merge with the free ranges on either side.
+    map<uint32_t, uint32_t>::iterator next = i;
+    if (++next != _free.end() && i->first + i->second == next->first) {
+        i->second += next->second;
+        _free.erase(next);
+    }
+    if (i != _free.begin()) {
+        map<uint32_t, uint32_t>::iterator prev = i;
+        if ((--prev)->first + prev->second == i->first) {
+            prev->second += i->second;
+            _free.erase(i);
+        }
+    }
+}
+
+uint32_t gds_heap::available() const
+{
+    uint32_t n = 0;
+    for (map<uint32_t, uint32_t>::const_iterator i = _free.begin(); i != _free.end(); ++i)
+        n += i->second;
+    return n;
+}
+
+gds_counters::gds_counters(radeon_device const& device, gds_heap& heap, unsigned count)
+    : _heap(heap), _range(heap.allocate(count * 4)),
+      _bo(device, 2 * _range.size, RADEON_GEM_DOMAIN_GTT, 4096), _reset()
+{
+    try {
+        _values = static_cast<volatile uint32_t*>(_bo.mmap());
+    }
+    catch (...) {
+        _heap.release(_range);
+        throw;
+    }
+    for (unsigned i = 0; i < 2 * this->count(); ++i)
+        _values[i] = 0;
+}
+
+gds_counters::~gds_counters()
+{
+    _heap.release(_range);
+}
+
+void gds_counters::reset(evergreen_command_stream& cs, uint32_t value)
+{
+    cs.fill_gds(_range.offset, _range.size, value);
+}
+
+void gds_counters::reset(evergreen_command_stream& cs, vector<uint32_t> const& values)
+{
+    if (values.size() != count())
+        throw invalid_argument("a value per counter");
+    // The values of a previous reset may not have been copied yet.
+    if (_reset)
+        throw runtime_error("the counters were reset since the last wait");
+
+    _bo.wait_idle();
+    for (unsigned i = 0; i < count(); ++i)
+        _values[i] = values[i];
+    cs.copy_to_gds(_range.offset, _range.size, _bo.handle(), 0);
+    _reset = true;
+}
+
+void gds_counters::read_back(evergreen_command_stream& cs)
+{
+    cs.copy_from_gds(_range.offset, _range.size, _bo.handle(), _range.size);
+}
+
+uint32_t gds_counters::combined(reduction op) const
+{
+    uint32_t r = identity(op);
+    for (unsigned i = 0; i < count(); ++i)
+        r = apply(op, r, (*this)[i]);
+    return r;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "evergreen_command_stream.hpp"
+#include "radeon_buffer_object.hpp"
+#include "radeon_device.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+/// A range of the Global Data Share (GDS), in bytes.
+struct gds_range {
+    std::uint32_t offset;   ///< Offset in the GDS, a multiple of 4.
+    std::uint32_t size;     ///< Size in bytes, a multiple of 4.
+};
+
+/// This class allocates ranges of the GDS, the on-chip memory which all the
+/// work-groups of a dispatch share, first fit. The kernel does not manage
+/// the GDS of an Evergreen, so the ranges are only apart from those of the
+/// same heap.
+class gds_heap {
+public:
+    /// The GDS of an Evergreen, 64K.
+    static const std::uint32_t default_size = 64 * 1024;
+
+    /// Create a heap of the whole GDS or of a part of it.
+    /// \param size The bytes of the GDS.
+    gds_heap(std::uint32_t size = default_size);
+
+    /// Allocate a range.
+    /// It throws std::runtime_error if no free range is large enough.
+    /// \param size The size in bytes, rounded up to a multiple of 4.
+    gds_range allocate(std::uint32_t size);
+    /// Give a range back to the heap.
+    void release(gds_range r);
+    /// Get the bytes which are free.
+    std::uint32_t available() const;
+
+private:
+    /// The free ranges, their sizes by offset.
+    std::map<std::uint32_t, std::uint32_t> _free;
+};
+
+/// This class is a set of 32-bit counters in the GDS: append counters,
+/// which the work-items increment to take slots, and cross-work-group
+/// reductions, which the groups combine their partial results into with
+/// GDS atomics, instead of atomics in VRAM and a second pass.
+///
+/// The command stream sets the counters (\c reset), binds them to the
+/// dispatches which use them (\c bind) and copies them into a buffer of
+/// the host (\c read_back), all with packets. Their values are those of
+/// the last command stream read back, once it has run (\c wait).
+///
+/// A reduction may be spread over several counters, so that fewer groups
+/// contend for each of them (the group id modulo the counters, say), and
+/// \c combined gives its result. The shaders combine their results with
+/// GDS instructions of their own.
+class gds_counters {
+public:
+    /// The operations of the reductions, whose identity the counters are
+    /// reset to.
+    enum reduction { add, min_uint, max_uint };
+
+    /// Allocate counters from a heap, with a buffer for their values.
+    /// \param device The device.
+    /// \param heap The heap.
+    /// \param count The number of counters.
+    gds_counters(radeon_device const& device, gds_heap& heap, unsigned count);
+    /// Give the range of the counters back to the heap.
+    ~gds_counters();
+
+    /// Get the number of counters.
+    unsigned count() const { return _range.size / 4; }
+    /// Get the range of the counters in the GDS.
+    gds_range range() const { return _range; }
+
+    /// Set all the counters to a value.
+    /// \param cs The command stream.
+    /// \param value The value.
+    void reset(evergreen_command_stream& cs, std::uint32_t value = 0);
+    /// Set all the counters to the identity of a reduction.
+    /// \param cs The command stream.
+    /// \param op The reduction.
+    void reset(evergreen_command_stream& cs, reduction op) { reset(cs, identity(op)); }
+    /// Set each counter to a value. It waits until the buffer of the
+    /// counters is idle, to write the values into it, which the command
+    /// stream copies when it runs: there is one set of values per command
+    /// stream, until \c wait once it has been emitted.
+    /// It throws std::invalid_argument if the values are not one per
+    /// counter, and std::runtime_error if values were set since the last
+    /// \c wait.
+    /// \param cs The command stream.
+    /// \param values The values.
+    void reset(evergreen_command_stream& cs, std::vector<std::uint32_t> const& values);
+    /// Bind the counters to the dispatches which follow, as the GDS range
+    /// of the shaders, the first counter at 0.
+    /// \param cs The command stream.
+    void bind(evergreen_command_stream& cs) const { cs.set_gds(_range.offset, _range.size); }
+    /// Bind the counters to the pipelines created with a description, as
+    /// the GDS range of their shaders, the first counter at 0.
+    /// \param d The description.
+    void bind(compute_pipeline::desc& d) const { d.gds_offset = _range.offset; d.gds_size = _range.size; }
+    /// Copy the counters into the buffer, once the dispatches before have
+    /// run.
+    /// \param cs The command stream.
+    void read_back(evergreen_command_stream& cs);
+    /// Wait until the command streams which reset the counters or read them
+    /// back have run.
+    void wait() { _bo.wait_idle(); _reset = false; }
+    /// Get the value of a counter, as last read back.
+    /// \param i The counter.
+    std::uint32_t operator[](unsigned i) const { return _values[count() + i]; }
+    /// Get the result of a reduction spread over all the counters, as last
+    /// read back.
+    /// \param op The reduction.
+    std::uint32_t combined(reduction op) const;
+
+    /// Get the identity of a reduction.
+    static std::uint32_t identity(reduction op) { return op == min_uint ? ~0u : 0u; }
+    /// Combine two values as a reduction does.
+    static std::uint32_t apply(reduction op, std::uint32_t a, std::uint32_t b)
+        { return op == add ? a + b : op == min_uint ? std::min(a, b) : std::max(a, b); }
+
+private:
+    gds_counters(gds_counters const&);
+    gds_counters& operator = (gds_counters const&);
+
+    gds_heap& _heap;
+    gds_range _range;
+    /// The buffer: the values to reset the counters to, then the values
+    /// read back.
+    radeon_buffer_object _bo;
+    volatile std::uint32_t* _values;
+    /// Whether values were set since the last wait.
+    bool _reset;
+};
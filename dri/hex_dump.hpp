@@ -1,8 +1,118 @@
 #pragma once
 
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <limits>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <type_traits>
 
+namespace dump_detail {
+
+/// This class collects formatted text and writes it to a stream in large
+/// blocks, so that the stream is not involved in every element.
+class text_buffer {
+public:
+    explicit text_buffer(std::ostream& os) : _os(os), _size(0) {}
+    ~text_buffer() { flush(); }
+
+    /// Get room for n characters, to be followed by commit().
+    char* reserve(std::size_t n)
+    {
+        if (_size + n > sizeof(_data))
+            flush();
+        return _data + _size;
+    }
+    void commit(std::size_t n) { _size += n; }
+    void put(char c) { *reserve(1) = c; commit(1); }
+
+    /// Write the pending text to the stream.
+    void flush()
+    {
+        _os.write(_data, _size);
+        _size = 0;
+    }
+
+private:
+    text_buffer(text_buffer const&);
+    text_buffer& operator = (text_buffer const&);
+
+    std::ostream& _os;
+    std::size_t _size;
+    char _data[1 << 16];
+};
+
+/// Write an unsigned value in hexadecimal, padded with zeros to width.
+inline void put_hex(text_buffer& out, unsigned long long v, std::size_t width)
+{
+    static const char digits[] = "0123456789abcdef";
+    char tmp[16];
+    std::size_t n = 0;
+    do {
+        tmp[n++] = digits[v & 0xf];
+        v >>= 4;
+    } while (v != 0);
+    char* p = out.reserve(width > n ? width : n);
+    std::size_t k = 0;
+    for (; k + n < width; ++k)
+        p[k] = '0';
+    while (n != 0)
+        p[k++] = tmp[--n];
+    out.commit(k);
+}
+
+/// Write an unsigned value in decimal, padded with spaces to width.
+inline void put_dec(text_buffer& out, unsigned long long v, std::size_t width)
+{
+    char tmp[20];
+    std::size_t n = 0;
+    do {
+        tmp[n++] = char('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+    char* p = out.reserve(width > n ? width : n);
+    std::size_t k = 0;
+    for (; k + n < width; ++k)
+        p[k] = ' ';
+    while (n != 0)
+        p[k++] = tmp[--n];
+    out.commit(k);
+}
+
+/// Write the separator before element i: a new line and the address at
+/// the start of a row, a tab otherwise.
+inline void put_separator(text_buffer& out, std::size_t i, std::size_t cols, std::size_t addr, bool hex)
+{
+    if (i % cols == 0) {
+        if (i != 0)
+            out.put('\n');
+        if (addr != 0) {
+            if (hex)
+                put_hex(out, i, addr);
+            else
+                put_dec(out, i, addr);
+            out.put(':');
+            out.put('\t');
+        }
+    }
+    else
+        out.put('\t');
+}
+
+}
+
+/// This class prints an array of unsigned integers in hexadecimal, cols per
+/// row, each row starting with the index of its first element in addr
+/// hexadecimal digits (no address if addr is 0). Rows are separated by new
+/// lines, there is none after the last one.
+///
+/// The text is formatted into a buffer and written to the stream in large
+/// blocks.
 template < typename T >
 class hex_dump {
 public:
@@ -11,27 +121,46 @@ public:
 
     friend std::ostream& operator << (std::ostream& os, hex_dump const& hd)
     {
-        std::ios_base::fmtflags
-            previous_flags = os.flags(std::ios_base::right | std::ios_base::hex);
-        char previous_fill = os.fill('0');
-
+        // Signed values are written as the stream writes them, through the
+        // unsigned type of their size, in the width which it was given.
+        typedef typename std::make_unsigned<T>::type unsigned_type;
+        const std::size_t digits = std::numeric_limits<T>::digits / 4;
+        dump_detail::text_buffer out(os);
         T const* p = hd.base;
-        for (std::size_t i = 0; i != hd.size; ++i, ++p)
-        {
-            if (i % hd.cols == 0) {
-                if (i != 0) os << '\n';
-                if (hd.addr != 0) {
-                    os.width(hd.addr);
-                    os << i << ':' << '\t' << std::flush;
-                }
-            }
-            else os << '\t';
-            os.width(std::numeric_limits<T>::digits / 4);
-            os << *p;
+        for (std::size_t i = 0; i != hd.size; ++i, ++p) {
+            dump_detail::put_separator(out, i, hd.cols, hd.addr, true);
+            dump_detail::put_hex(out, static_cast<unsigned_type>(*p), digits);
         }
+        return os;
+    }
+
+private:
+    T const* base;
+    std::size_t size;
+    std::size_t cols;
+    std::size_t addr;
+};
+
+/// This class prints an array of floats as the sample hosts always have
+/// with iostreams (default precision, width 8), cols per row, each row
+/// starting with the index of its first element in addr decimal digits.
+template < typename T >
+class float_dump {
+public:
+    float_dump(T const* ptr, std::size_t n, std::size_t c = 1, std::size_t a = 0)
+        : base(ptr), size(n), cols(c), addr(a) {}
 
-        os.flags(previous_flags);
-        os.fill(previous_fill);
+    friend std::ostream& operator << (std::ostream& os, float_dump const& fd)
+    {
+        dump_detail::text_buffer out(os);
+        T const* p = fd.base;
+        for (std::size_t i = 0; i != fd.size; ++i, ++p) {
+            dump_detail::put_separator(out, i, fd.cols, fd.addr, false);
+            // The same conversion as the stream's, without its locale and state.
+            char* q = out.reserve(32);
+            int n = std::snprintf(q, 32, "%8g", static_cast<double>(*p));
+            out.commit(n > 0 && n < 32 ? n : 0);
+        }
         return os;
     }
 
@@ -41,3 +170,77 @@ private:
     std::size_t cols;
     std::size_t addr;
 };
+
+/// This class writes an array as raw bytes in host order.
+template < typename T >
+class raw_dump {
+public:
+    raw_dump(T const* ptr, std::size_t n) : base(ptr), size(n) {}
+
+    friend std::ostream& operator << (std::ostream& os, raw_dump const& rd)
+    {
+        return os.write(reinterpret_cast<char const*>(rd.base), rd.size * sizeof(T));
+    }
+
+private:
+    T const* base;
+    std::size_t size;
+};
+
+/// This class writes an array in the NumPy .npy format (version 1.0): a
+/// header with the type and shape, rows of cols elements if the size is a
+/// multiple of cols and a flat array otherwise, followed by the raw data.
+/// The host is assumed to be little endian.
+template < typename T >
+class npy_dump {
+public:
+    npy_dump(T const* ptr, std::size_t n, std::size_t c = 1) : base(ptr), size(n), cols(c) {}
+
+    friend std::ostream& operator << (std::ostream& os, npy_dump const& nd)
+    {
+        std::ostringstream header;
+        header << "{'descr': '<"
+               << (std::is_floating_point<T>::value ? 'f' : std::numeric_limits<T>::is_signed ? 'i' : 'u')
+               << sizeof(T) << "', 'fortran_order': False, 'shape': (";
+        if (nd.cols > 1 && nd.size % nd.cols == 0)
+            header << nd.size / nd.cols << ", " << nd.cols << "), }";
+        else
+            header << nd.size << ",), }";
+
+        // Pad with spaces and a new line so the data is 64-byte aligned.
+        std::string h = header.str();
+        const std::size_t preamble = 10;
+        h.append(63 - (preamble + h.size()) % 64, ' ');
+        h += '\n';
+
+        const unsigned char magic[] = { 0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+            static_cast<unsigned char>(h.size() & 0xff), static_cast<unsigned char>(h.size() >> 8) };
+        os.write(reinterpret_cast<char const*>(magic), sizeof(magic));
+        os.write(h.data(), h.size());
+        return os << raw_dump<T>(nd.base, nd.size);
+    }
+
+private:
+    T const* base;
+    std::size_t size;
+    std::size_t cols;
+};
+
+/// Write an array to a file, in the .npy format if the pathname ends with
+/// .npy and as raw bytes otherwise.
+/// It throws std::system_error if the file cannot be written.
+template < typename T >
+void write_dump(char const* path, T const* ptr, std::size_t n, std::size_t cols = 1)
+{
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file)
+        throw std::system_error(std::error_code(errno, std::system_category()), path);
+    std::size_t length = std::strlen(path);
+    if (length >= 4 && std::strcmp(path + length - 4, ".npy") == 0)
+        file << npy_dump<T>(ptr, n, cols);
+    else
+        file << raw_dump<T>(ptr, n);
+    file.close();
+    if (!file)
+        throw std::system_error(std::error_code(errno, std::system_category()), path);
+}
@@ -0,0 +1,56 @@
+#include "ib_buffer.hpp"
+
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+/// The smallest storage, 4 KiB.
+const size_t min_capacity = 1024;
+/// The most buffers an arena keeps.
+const size_t max_arena = 16;
+
+/// The released storage of a thread.
+thread_local vector<vector<uint32_t> > arena;
+
+}
+
+void ib_buffer::grow(size_t n)
+{
+    n = max(n, max(min_capacity, 2 * _storage.size()));
+
+    // Take the smallest buffer of the arena that is large enough.
+    size_t best = arena.size();
+    for (size_t i = 0; i < arena.size(); ++i)
+        if (arena[i].size() >= n && (best == arena.size() || arena[i].size() < arena[best].size()))
+            best = i;
+
+    vector<uint32_t> storage;
+    if (best != arena.size()) {
+        storage.swap(arena[best]);
+        arena.erase(arena.begin() + best);
+    }
+    else
+        storage.resize(n);
+    copy(_storage.begin(), _storage.begin() + _size, storage.begin());
+    storage.swap(_storage);
+    if (!storage.empty() && arena.size() < max_arena)
+        arena.push_back(move(storage));
+}
+
+void ib_buffer::release()
+{
+    _size = 0;
+    if (_storage.empty())
+        return;
+    if (arena.size() < max_arena)
+        arena.push_back(move(_storage));
+    _storage = vector<uint32_t>();
+}
+
+size_t ib_buffer::arena_size()
+{
+    return arena.size();
+}
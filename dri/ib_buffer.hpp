@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// This class is the storage of an instruction buffer: an array of double
+/// words which grows geometrically and is written either a double word at a
+/// time or a packet at a time through a raw cursor.
+///
+/// The storage comes from a per-thread arena of released buffers, so that a
+/// new command stream, or one that has been reset, does not allocate again
+/// the storage its predecessors already had.
+class ib_buffer {
+public:
+    /// This constructor creates an empty buffer, without storage.
+    ib_buffer() : _size() {}
+    /// The destructor gives the storage back to the arena.
+    ~ib_buffer() { release(); }
+
+    /// Get the number of double words in the buffer.
+    std::size_t size() const { return _size; }
+    /// Get the number of double words the buffer holds without growing.
+    std::size_t capacity() const { return _storage.size(); }
+    /// Determine whether the buffer is empty.
+    bool empty() const { return _size == 0; }
+    /// Access the double words.
+    std::uint32_t* data() { return _storage.empty() ? 0 : &_storage[0]; }
+    std::uint32_t const* data() const { return _storage.empty() ? 0 : &_storage[0]; }
+    std::uint32_t& operator [] (std::size_t i) { return _storage[i]; }
+    std::uint32_t operator [] (std::size_t i) const { return _storage[i]; }
+
+    /// Make room for at least n double words.
+    void reserve(std::size_t n)
+    {
+        if (n > _storage.size())
+            grow(n);
+    }
+    /// Append a double word.
+    void push_back(std::uint32_t x)
+    {
+        if (_size == _storage.size())
+            grow(_size + 1);
+        _storage[_size++] = x;
+    }
+    /// Append n double words, which the caller then writes through the
+    /// returned cursor without further checks.
+    /// \param n The number of double words.
+    /// \returns The address of the first of them, valid until the buffer
+    /// grows again.
+    std::uint32_t* append(std::size_t n)
+    {
+        if (_size + n > _storage.size())
+            grow(_size + n);
+        std::uint32_t* p = _storage.data() + _size;
+        _size += n;
+        return p;
+    }
+    /// Append a range of double words.
+    void append(std::uint32_t const* first, std::uint32_t const* last)
+    {
+        std::uint32_t* p = append(last - first);
+        while (first != last)
+            *p++ = *first++;
+    }
+
+    /// Empty the buffer, keeping its storage.
+    void clear() { _size = 0; }
+    /// Empty the buffer and give its storage back to the arena.
+    void release();
+
+    /// Get the number of buffers in the arena of the calling thread.
+    static std::size_t arena_size();
+
+private:
+    ib_buffer(ib_buffer const&);
+    ib_buffer& operator = (ib_buffer const&);
+
+    /// Grow the storage to at least n double words, from the arena if it has
+    /// a large enough buffer.
+    void grow(std::size_t n);
+
+    std::vector<std::uint32_t> _storage;
+    std::size_t _size;
+};
@@ -0,0 +1,333 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+/// PM4 packets and registers as types, for R600 and Evergreen.
+///
+/// The headers of the packets are computed by constexpr functions, so that
+/// a register whose offset is known at compile time is written with the
+/// packet of its range selected, and its header computed, by the compiler:
+/// what remains are stores into the IB. That the registers are within their
+/// range is checked with static_assert.
+///
+/// The names are lowercase, as the register headers (radeon/r600d.h and
+/// radeon/evergreend.h) define the uppercase ones as macros, and those of
+/// the two families conflict, so this header does not include either.
+namespace pm4 {
+
+/// Opcodes of the type-3 packets.
+namespace op {
+const std::uint32_t nop = 0x10;
+const std::uint32_t dispatch_direct = 0x15;
+const std::uint32_t start_3d_cmdbuf = 0x24;
+const std::uint32_t context_control = 0x28;
+const std::uint32_t mem_write = 0x3d;
+const std::uint32_t cp_dma = 0x41;
+const std::uint32_t surface_sync = 0x43;
+const std::uint32_t event_write = 0x46;
+const std::uint32_t event_write_eop = 0x47;
+const std::uint32_t set_config_reg = 0x68;
+const std::uint32_t set_context_reg = 0x69;
+const std::uint32_t set_alu_const = 0x6a;
+const std::uint32_t set_bool_const = 0x6b;
+const std::uint32_t set_loop_const = 0x6c;
+const std::uint32_t set_resource = 0x6d;
+const std::uint32_t set_sampler = 0x6e;
+const std::uint32_t set_ctl_const = 0x6f;
+}
+
+/// The header of a type-0 packet, which sets registers from \c reg on.
+/// \param reg The offset of the first register.
+/// \param n The number of registers, 1 or more.
+constexpr std::uint32_t type0(std::uint32_t reg, std::uint32_t n)
+{
+    return ((reg >> 2) & 0xffff) | ((n - 1) & 0x3fff) << 16;
+}
+
+/// The header of a type-3 packet.
+/// \param opcode The opcode.
+/// \param n The number of double words after the header.
+constexpr std::uint32_t type3(std::uint32_t opcode, std::uint32_t n)
+{
+    return 3u << 30 | (opcode & 0xff) << 8 | ((n - 1) & 0x3fff) << 16;
+}
+
+/// The registers that a type-3 SET_* packet sets, [start, end).
+struct reg_range {
+    std::uint32_t opcode, start, end;
+};
+
+/// The register ranges of the R600 family (R600 to R700).
+struct r600 {
+    static constexpr unsigned num_ranges = 8;
+    static constexpr reg_range range(unsigned i)
+    {
+        return
+            i == 0 ? reg_range{ op::set_config_reg, 0x08000, 0x0ac00 } :
+            i == 1 ? reg_range{ op::set_context_reg, 0x28000, 0x29000 } :
+            i == 2 ? reg_range{ op::set_alu_const, 0x30000, 0x32000 } :
+            i == 3 ? reg_range{ op::set_bool_const, 0x3e380, 0x40000 } :
+            i == 4 ? reg_range{ op::set_loop_const, 0x3e200, 0x3e280 } :
+            i == 5 ? reg_range{ op::set_resource, 0x38000, 0x3c000 } :
+            i == 6 ? reg_range{ op::set_sampler, 0x3c000, 0x3cff0 } :
+                     reg_range{ op::set_ctl_const, 0x3cff0, 0x3e200 };
+    }
+};
+
+/// The register ranges of the Evergreen family (Cedar to Hemlock), whose
+/// ALU constants are in constant buffers.
+struct evergreen {
+    static constexpr unsigned num_ranges = 7;
+    static constexpr reg_range range(unsigned i)
+    {
+        return
+            i == 0 ? reg_range{ op::set_config_reg, 0x08000, 0x0ac00 } :
+            i == 1 ? reg_range{ op::set_context_reg, 0x28000, 0x29000 } :
+            i == 2 ? reg_range{ op::set_bool_const, 0x3a500, 0x3a518 } :
+            i == 3 ? reg_range{ op::set_loop_const, 0x3a200, 0x3a500 } :
+            i == 4 ? reg_range{ op::set_resource, 0x30000, 0x38000 } :
+            i == 5 ? reg_range{ op::set_sampler, 0x3c000, 0x3c600 } :
+                     reg_range{ op::set_ctl_const, 0x3cff0, 0x3ff0c };
+    }
+};
+
+/// Find the range of a register.
+/// \returns The index of the range, or \c Family::num_ranges if the
+/// register is set with a type-0 packet.
+template <typename Family>
+constexpr unsigned find_range(std::uint32_t reg, unsigned i = 0)
+{
+    return i == Family::num_ranges ||
+        (reg >= Family::range(i).start && reg < Family::range(i).end) ?
+        i : find_range<Family>(reg, i + 1);
+}
+
+/// The packet that sets \c Count registers from \c Reg on, selected and
+/// checked at compile time.
+template <typename Family, std::uint32_t Reg, unsigned Count = 1>
+struct set_reg {
+    static_assert(Reg % 4 == 0, "register offsets are multiples of 4");
+    static_assert(Count >= 1 && Count <= 0x3fff, "registers per packet");
+
+    /// The range of the register, \c Family::num_ranges for type-0.
+    static constexpr unsigned range_index = find_range<Family>(Reg);
+    /// Whether the packet is a type-3 SET_* packet.
+    static constexpr bool is_type3 = range_index < Family::num_ranges;
+
+    static_assert(!is_type3 || Reg + 4 * Count <= Family::range(range_index).end,
+        "the registers run past the end of their range");
+    static_assert(is_type3 || Reg + 4 * Count <= 0x40000,
+        "the registers run past the type-0 register space");
+
+    /// The double words of the header, 1 or 2.
+    static constexpr unsigned header_size = is_type3 ? 2 : 1;
+    /// The double words of the packet.
+    static constexpr unsigned size = header_size + Count;
+    static constexpr std::uint32_t header0 = is_type3 ?
+        type3(Family::range(range_index).opcode, Count + 1) : type0(Reg, Count);
+    static constexpr std::uint32_t header1 = is_type3 ?
+        (Reg - Family::range(range_index).start) >> 2 : 0;
+
+    /// Store the header.
+    /// \returns The address of the values.
+    static std::uint32_t* store_header(std::uint32_t* p)
+    {
+        p[0] = header0;
+        if (is_type3)
+            p[1] = header1;
+        return p + header_size;
+    }
+};
+
+/// The packet that sets \c Count registers of one of \c Items like sets of
+/// registers, \c Stride bytes apart, such as the color buffers or the fetch
+/// resources. The whole array is checked to be in one range, so that only
+/// the offset of the set is added at run time.
+template <typename Family, std::uint32_t Base, std::uint32_t Stride, unsigned Items,
+    unsigned Count = 1>
+struct set_reg_array {
+    typedef set_reg<Family, Base, Count> first;
+    typedef set_reg<Family, Base + Stride * (Items - 1), Count> last;
+
+    static_assert(Stride % 4 == 0 && Items >= 1, "register arrays");
+    static_assert(first::range_index == last::range_index,
+        "the register array is in one range");
+
+    static constexpr unsigned header_size = first::header_size;
+    static constexpr unsigned size = first::size;
+
+    /// Store the header of the packet for a set.
+    /// \param i The set, less than \c Items.
+    /// \returns The address of the values.
+    static std::uint32_t* store_header(std::uint32_t* p, unsigned i)
+    {
+        // The register offset, in double words, is in the first double
+        // word of a type-0 header and the second of a type-3 one.
+        p[0] = first::header0;
+        if (first::is_type3)
+            p[1] = first::header1 + i * (Stride >> 2);
+        else
+            p[0] += i * (Stride >> 2);
+        return p + header_size;
+    }
+};
+
+/// The header of the packet that sets registers from a register offset
+/// known at run time, found with the same ranges.
+/// \param header Set to the header.
+/// \returns The number of double words of the header, 1 or 2.
+template <typename Family>
+unsigned set_reg_header(std::uint32_t reg, std::uint32_t n, std::uint32_t* header)
+{
+    unsigned i = find_range<Family>(reg);
+    if (i == Family::num_ranges) {
+        header[0] = type0(reg, n);
+        return 1;
+    }
+    header[0] = type3(Family::range(i).opcode, n + 1);
+    header[1] = (reg - Family::range(i).start) >> 2;
+    return 2;
+}
+
+/// The bits of a register value.
+inline std::uint32_t dword(std::uint32_t x) { return x; }
+inline std::uint32_t dword(int x) { return x; }
+inline std::uint32_t dword(float x)
+{
+    std::uint32_t y;
+    std::memcpy(&y, &x, sizeof(y));
+    return y;
+}
+
+/// A field of \c Width bits at bit \c Shift of a double word.
+template <unsigned Shift, unsigned Width>
+constexpr std::uint32_t field(std::uint32_t x)
+{
+    static_assert(Shift + Width <= 32, "fields are within a double word");
+    return (x & ((Width == 32 ? 0u : 1u << Width) - 1)) << Shift;
+}
+
+/// CONTEXT_CONTROL, which selects the state to load and to shadow.
+struct context_control {
+    static constexpr unsigned size = 3;
+    std::uint32_t load, shadow;
+
+    void store(std::uint32_t* p) const
+    {
+        p[0] = type3(op::context_control, 2);
+        p[1] = load;
+        p[2] = shadow;
+    }
+};
+
+/// DISPATCH_DIRECT of a grid of groups on Evergreen.
+struct dispatch_direct {
+    static constexpr unsigned size = 5;
+    std::uint32_t x, y, z;
+
+    void store(std::uint32_t* p) const
+    {
+        p[0] = type3(op::dispatch_direct, 4);
+        p[1] = x;
+        p[2] = y;
+        p[3] = z;
+        p[4] = 1;   // VGT_DISPATCH_INITIATOR = COMPUTE_SHADER_EN
+    }
+};
+
+/// MEM_WRITE, with which the CP writes 64 bits to a qword-aligned 40-bit
+/// address that the relocation after it adds to.
+struct mem_write {
+    static constexpr unsigned size = 5;
+    std::uint64_t address;
+    std::uint64_t value;
+
+    void store(std::uint32_t* p) const
+    {
+        p[0] = type3(op::mem_write, 4);
+        p[1] = std::uint32_t(address) & ~7u;
+        p[2] = field<0, 8>(address >> 32);
+        p[3] = std::uint32_t(value);
+        p[4] = std::uint32_t(value >> 32);
+    }
+};
+
+/// The source and the destination of CP_DMA.
+enum dma_sel : std::uint32_t {
+    dma_memory = 0,     ///< A 40-bit address that a relocation adds to.
+    dma_gds = 1,        ///< An offset in the GDS.
+    dma_data = 2        ///< A double word to fill with, as the source.
+};
+
+/// CP_DMA on Evergreen, with which the CP copies bytes between memory and
+/// the GDS, or fills them with a double word. A relocation follows it for
+/// each side in memory, that of the source first. The CP waits for the
+/// copy to end before the next packet (CP_SYNC). A side in the GDS sets
+/// its address space bit of the command (SAS for the source, DAS for the
+/// destination), so that its address is taken as an offset in the GDS.
+struct cp_dma {
+    static constexpr unsigned size = 6;
+    std::uint64_t src;
+    dma_sel src_sel;
+    std::uint64_t dst;
+    dma_sel dst_sel;
+    std::uint32_t bytes;
+
+    void store(std::uint32_t* p) const
+    {
+        p[0] = type3(op::cp_dma, 5);
+        p[1] = std::uint32_t(src);
+        p[2] = field<0, 8>(src >> 32) | field<20, 2>(dst_sel) | field<29, 2>(src_sel) | 1u << 31;
+        p[3] = std::uint32_t(dst);
+        p[4] = field<0, 8>(dst >> 32);
+        p[5] = field<0, 21>(bytes) |
+            std::uint32_t(src_sel == dma_gds) << 26 |   // SAS
+            std::uint32_t(dst_sel == dma_gds) << 27;    // DAS
+    }
+};
+
+/// Events of EVENT_WRITE and EVENT_WRITE_EOP.
+enum event_type : std::uint32_t {
+    cache_flush_and_inv_ts_event = 0x14,
+    cache_flush_and_inv_event = 0x16
+};
+
+/// What EVENT_WRITE_EOP writes (DATA_SEL).
+enum data_sel : std::uint32_t {
+    data_none = 0,
+    data_32 = 1,        ///< The low 32 bits of \c data.
+    data_64 = 2,        ///< \c data.
+    data_timestamp = 3  ///< The GPU clock counter.
+};
+
+/// What EVENT_WRITE_EOP interrupts (INT_SEL).
+enum int_sel : std::uint32_t {
+    int_none = 0,
+    int_send = 1,           ///< When the write is sent.
+    int_confirmed = 2       ///< When the write is confirmed.
+};
+
+/// EVENT_WRITE_EOP, which writes data or a timestamp at the end of the
+/// pipe, to a 40-bit address that the relocation after it adds to.
+struct event_write_eop {
+    static constexpr unsigned size = 6;
+    event_type event;
+    std::uint64_t address;
+    data_sel data;
+    int_sel interrupt;
+    std::uint64_t value;
+
+    void store(std::uint32_t* p) const
+    {
+        // End of pipe events take EVENT_INDEX 5.
+        p[0] = type3(op::event_write_eop, 5);
+        p[1] = field<0, 6>(event) | field<8, 4>(5);
+        p[2] = std::uint32_t(address) & ~3u;
+        p[3] = field<0, 8>(address >> 32) | field<24, 2>(interrupt) | field<29, 3>(data);
+        p[4] = std::uint32_t(value);
+        p[5] = std::uint32_t(value >> 32);
+    }
+};
+
+}
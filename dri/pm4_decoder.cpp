@@ -0,0 +1,379 @@
+#include "pm4_decoder.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#include "pm4.hpp"
+
+using namespace std;
+
+namespace {
+
+/// The header of a relocation packet, and the double words of a
+/// relocation (drm_radeon_cs_reloc), whose offset it holds.
+const uint32_t reloc_packet = 0xc0001000;
+const uint32_t reloc_size = 4;
+
+/// Registers, or arrays of registers or of structures of registers.
+struct reg_entry {
+    uint32_t offset;
+    unsigned items;     ///< Number of registers or structures.
+    unsigned stride;    ///< Bytes from an item to the next.
+    unsigned words;     ///< Double words of a structure, 1 for registers.
+    const char* name;
+};
+
+/// The registers of the Evergreen family which the command streams set.
+const reg_entry evergreen_regs[] = {
+    { 0x8970, 1, 4, 1, "VGT_NUM_INDICES" },
+    { 0x899c, 1, 4, 1, "VGT_COMPUTE_START_X" },
+    { 0x89a0, 1, 4, 1, "VGT_COMPUTE_START_Y" },
+    { 0x89a4, 1, 4, 1, "VGT_COMPUTE_START_Z" },
+    { 0x89ac, 1, 4, 1, "VGT_COMPUTE_THREAD_GROUP_SIZE" },
+    { 0x8c00, 1, 4, 1, "SQ_CONFIG" },
+    { 0x8c04, 3, 4, 1, "SQ_GPR_RESOURCE_MGMT" },
+    { 0x8c18, 2, 4, 1, "SQ_THREAD_RESOURCE_MGMT" },
+    { 0x8c20, 3, 4, 1, "SQ_STACK_RESOURCE_MGMT" },
+    { 0x8d8c, 1, 4, 1, "SQ_DYN_GPR_CNTL_PS_FLUSH_REQ" },
+    { 0x8e10, 1, 4, 1, "SQ_LSTMP_RING_BASE" },
+    { 0x8e14, 1, 4, 1, "SQ_LSTMP_RING_SIZE" },
+    { 0x8e2c, 1, 4, 1, "SQ_LDS_RESOURCE_MGMT" },
+    { 0x9010, 1, 4, 1, "SX_MEMORY_EXPORT_BASE" },
+    { 0x9014, 1, 4, 1, "SX_MEMORY_EXPORT_SIZE" },
+    { 0x28238, 1, 4, 1, "CB_TARGET_MASK" },
+    { 0x286c8, 1, 4, 1, "SPI_THREAD_GROUPING" },
+    { 0x286e8, 1, 4, 1, "SPI_COMPUTE_INPUT_CNTL" },
+    { 0x286ec, 1, 4, 1, "SPI_COMPUTE_NUM_THREAD_X" },
+    { 0x286f0, 1, 4, 1, "SPI_COMPUTE_NUM_THREAD_Y" },
+    { 0x286f4, 1, 4, 1, "SPI_COMPUTE_NUM_THREAD_Z" },
+    { 0x28720, 1, 4, 1, "GDS_ADDR_BASE" },
+    { 0x28724, 1, 4, 1, "GDS_ADDR_SIZE" },
+    { 0x28728, 1, 4, 1, "GDS_ORDERED_WAVE_PER_SE" },
+    { 0x28830, 1, 4, 1, "SQ_LSTMP_RING_ITEMSIZE" },
+    { 0x288d0, 1, 4, 1, "SQ_PGM_START_LS" },
+    { 0x288d4, 1, 4, 1, "SQ_PGM_RESOURCES_LS" },
+    { 0x288d8, 1, 4, 1, "SQ_PGM_RESOURCES_2_LS" },
+    { 0x288e8, 1, 4, 1, "SQ_LDS_ALLOC" },
+    { 0x28a40, 1, 4, 1, "VGT_GS_MODE" },
+    { 0x28b74, 1, 4, 1, "VGT_DISPATCH_INITIATOR" },
+    { 0x28c60, 8, 0x3c, 1, "CB_COLOR_BASE" },
+    { 0x28c64, 8, 0x3c, 1, "CB_COLOR_PITCH" },
+    { 0x28c68, 8, 0x3c, 1, "CB_COLOR_SLICE" },
+    { 0x28c6c, 8, 0x3c, 1, "CB_COLOR_VIEW" },
+    { 0x28c70, 8, 0x3c, 1, "CB_COLOR_INFO" },
+    { 0x28c74, 8, 0x3c, 1, "CB_COLOR_ATTRIB" },
+    { 0x28c78, 8, 0x3c, 1, "CB_COLOR_DIM" },
+    { 0x28f40, 16, 4, 1, "SQ_ALU_CONST_CACHE_LS" },
+    { 0x28fc0, 16, 4, 1, "SQ_ALU_CONST_BUFFER_SIZE_LS" },
+    { 0x30000, 1024, 32, 8, "SQ_FETCH_RESOURCE" },
+    { 0x3a200, 192, 4, 1, "SQ_LOOP_CONST" },
+    { 0x3a500, 6, 4, 1, "SQ_BOOL_CONST" },
+    { 0x3c000, 128, 12, 3, "SQ_TEX_SAMPLER" }
+};
+
+/// The registers of the R600 family.
+const reg_entry r600_regs[] = {
+    { 0x8958, 1, 4, 1, "VGT_PRIMITIVE_TYPE" },
+    { 0x8970, 1, 4, 1, "VGT_NUM_INDICES" },
+    { 0x8c00, 1, 4, 1, "SQ_CONFIG" },
+    { 0x8c04, 2, 4, 1, "SQ_GPR_RESOURCE_MGMT" },
+    { 0x8c0c, 1, 4, 1, "SQ_THREAD_RESOURCE_MGMT" },
+    { 0x8c10, 2, 4, 1, "SQ_STACK_RESOURCE_MGMT" },
+    { 0x9010, 1, 4, 1, "SX_MEMORY_EXPORT_BASE" },
+    { 0x9014, 1, 4, 1, "SX_MEMORY_EXPORT_SIZE" },
+    { 0x28040, 8, 4, 1, "CB_COLOR_BASE" },
+    { 0x28060, 8, 4, 1, "CB_COLOR_SIZE" },
+    { 0x28080, 8, 4, 1, "CB_COLOR_VIEW" },
+    { 0x280a0, 8, 4, 1, "CB_COLOR_INFO" },
+    { 0x28238, 1, 4, 1, "CB_TARGET_MASK" },
+    { 0x2823c, 1, 4, 1, "CB_SHADER_MASK" },
+    { 0x28840, 1, 4, 1, "SQ_PGM_START_PS" },
+    { 0x28850, 1, 4, 1, "SQ_PGM_RESOURCES_PS" },
+    { 0x28858, 1, 4, 1, "SQ_PGM_START_VS" },
+    { 0x28868, 1, 4, 1, "SQ_PGM_RESOURCES_VS" },
+    { 0x30000, 512, 16, 4, "SQ_ALU_CONSTANT" },
+    { 0x38000, 585, 28, 7, "SQ_RESOURCE" },
+    { 0x3c000, 340, 12, 3, "SQ_TEX_SAMPLER" },
+    { 0x3e200, 32, 4, 1, "SQ_LOOP_CONST" },
+    { 0x3e380, 3, 4, 1, "SQ_BOOL_CONST" }
+};
+
+const struct {
+    uint32_t opcode;
+    const char* name;
+} opcodes[] = {
+    { 0x10, "NOP" },
+    { 0x11, "SET_BASE" },
+    { 0x12, "CLEAR_STATE" },
+    { 0x15, "DISPATCH_DIRECT" },
+    { 0x16, "DISPATCH_INDIRECT" },
+    { 0x24, "START_3D_CMDBUF" },
+    { 0x28, "CONTEXT_CONTROL" },
+    { 0x32, "INDIRECT_BUFFER" },
+    { 0x3c, "WAIT_REG_MEM" },
+    { 0x3d, "MEM_WRITE" },
+    { 0x41, "CP_DMA" },
+    { 0x43, "SURFACE_SYNC" },
+    { 0x46, "EVENT_WRITE" },
+    { 0x47, "EVENT_WRITE_EOP" },
+    { 0x48, "EVENT_WRITE_EOS" },
+    { 0x68, "SET_CONFIG_REG" },
+    { 0x69, "SET_CONTEXT_REG" },
+    { 0x6a, "SET_ALU_CONST" },
+    { 0x6b, "SET_BOOL_CONST" },
+    { 0x6c, "SET_LOOP_CONST" },
+    { 0x6d, "SET_RESOURCE" },
+    { 0x6e, "SET_SAMPLER" },
+    { 0x6f, "SET_CTL_CONST" },
+    { 0x75, "SET_APPEND_CNT" }
+};
+
+/// Find the range which a SET_* opcode sets.
+template <typename Family>
+bool find_set_range(uint32_t opcode, pm4::reg_range& range)
+{
+    for (unsigned i = 0; i < Family::num_ranges; ++i)
+        if (Family::range(i).opcode == opcode) {
+            range = Family::range(i);
+            return true;
+        }
+    return false;
+}
+
+string hex(uint32_t x, int width = 8)
+{
+    ostringstream os;
+    os << "0x" << std::hex << setfill('0') << setw(width) << x;
+    return os.str();
+}
+
+}
+
+pm4_decoder::pm4_decoder(radeon_device::radeon_family family)
+{
+    if (family >= radeon_device::CHIP_R600 && family < radeon_device::CHIP_CEDAR)
+        _evergreen = false;
+    else if (family >= radeon_device::CHIP_CEDAR && family < radeon_device::CHIP_CAYMAN)
+        _evergreen = true;
+    else
+        throw runtime_error(radeon_device::get_family_name(family));
+}
+
+vector<pm4_packet> pm4_decoder::decode(uint32_t const* ib, size_t n) const
+{
+    vector<pm4_packet> packets;
+    for (size_t i = 0; i < n; i += packets.back().size) {
+        uint32_t header = ib[i];
+        pm4_packet p = pm4_packet();
+        p.offset = i;
+        p.type = header >> 30;
+        switch (p.type) {
+        case 0:
+            p.regs = ((header >> 16) & 0x3fff) + 1;
+            p.size = p.regs + 1;
+            p.reg = (header & 0x7fff) << 2;
+            p.one_reg = (header & 0x8000) != 0;
+            break;
+        case 2:
+            p.size = 1;
+            break;
+        case 3:
+            p.opcode = (header >> 8) & 0xff;
+            p.size = ((header >> 16) & 0x3fff) + 2;
+            p.reloc = header == reloc_packet;
+            if (i + p.size <= n) {
+                pm4::reg_range range;
+                if (_evergreen ? find_set_range<pm4::evergreen>(p.opcode, range) :
+                        find_set_range<pm4::r600>(p.opcode, range)) {
+                    p.reg = range.start + (ib[i + 1] << 2);
+                    p.regs = p.size - 2;
+                }
+            }
+            break;
+        default:
+            throw runtime_error("type-1 packet at " + hex(i, 4));
+        }
+        if (i + p.size > n)
+            throw runtime_error("truncated packet at " + hex(i, 4));
+        packets.push_back(p);
+    }
+    return packets;
+}
+
+string pm4_decoder::register_name(uint32_t reg) const
+{
+    reg_entry const* begin = _evergreen ? evergreen_regs : r600_regs;
+    reg_entry const* end = _evergreen ?
+        evergreen_regs + sizeof(evergreen_regs) / sizeof(evergreen_regs[0]) :
+        r600_regs + sizeof(r600_regs) / sizeof(r600_regs[0]);
+
+    for (reg_entry const* e = begin; e != end; ++e) {
+        if (reg < e->offset || reg >= e->offset + e->items * e->stride)
+            continue;
+        unsigned item = (reg - e->offset) / e->stride, word = (reg - e->offset) % e->stride / 4;
+        if ((reg - e->offset) % 4 || word >= e->words)
+            continue;
+        ostringstream os;
+        os << e->name;
+        if (e->items > 1)
+            os << '[' << item << ']';
+        if (e->words > 1)
+            os << '.' << word;
+        return os.str();
+    }
+    return hex(reg, 5);
+}
+
+const char* pm4_decoder::register_class(uint32_t reg) const
+{
+    if (_evergreen) {
+        unsigned i = pm4::find_range<pm4::evergreen>(reg);
+        return i < pm4::evergreen::num_ranges ? opcode_name(pm4::evergreen::range(i).opcode) : "type-0";
+    }
+    unsigned i = pm4::find_range<pm4::r600>(reg);
+    return i < pm4::r600::num_ranges ? opcode_name(pm4::r600::range(i).opcode) : "type-0";
+}
+
+const char* pm4_decoder::opcode_name(uint32_t opcode)
+{
+    for (size_t i = 0; i < sizeof(opcodes) / sizeof(opcodes[0]); ++i)
+        if (opcodes[i].opcode == opcode)
+            return opcodes[i].name;
+    return 0;
+}
+
+string pm4_decoder::packet_name(pm4_packet const& p) const
+{
+    if (p.type == 0)
+        return "type-0";
+    if (p.type == 2)
+        return "type-2";
+    if (p.reloc)
+        return "reloc";
+    const char* name = opcode_name(p.opcode);
+    return name ? name : "type-3 " + hex(p.opcode, 2);
+}
+
+void pm4_decoder::write(ostream& os, uint32_t const* ib, size_t n) const
+{
+    vector<pm4_packet> packets = decode(ib, n);
+    for (size_t i = 0; i < packets.size(); ++i) {
+        pm4_packet const& p = packets[i];
+        os << hex(p.offset, 4) << "  " << packet_name(p);
+        if (p.reloc)
+            os << ' ' << ib[p.offset + 1] / reloc_size << '\n';
+        else if (p.regs) {
+            os << '\n';
+            uint32_t const* values = ib + p.offset + p.size - p.regs;
+            for (uint32_t k = 0; k < p.regs; ++k)
+                os << "        " << register_name(p.one_reg ? p.reg : p.reg + 4 * k)
+                   << " = " << hex(values[k]) << '\n';
+        }
+        else {
+            for (uint32_t k = 1; k < p.size; ++k)
+                os << ' ' << hex(ib[p.offset + k]);
+            os << '\n';
+        }
+    }
+}
+
+pm4_stats::pm4_stats(pm4_decoder const& decoder)
+    : _decoder(decoder), _dwords(), _relocs(), _distinct_relocs(),
+      _redundant_packets(), _redundant_dwords()
+{
+}
+
+void pm4_stats::add(uint32_t const* ib, size_t n)
+{
+    vector<pm4_packet> packets = _decoder.decode(ib, n);
+    _dwords += n;
+
+    // The relocations are by IB, so values with a relocation are unknown
+    // in the next one.
+    for (map<uint32_t, pair<uint32_t, uint32_t> >::iterator p = _values.begin(); p != _values.end(); )
+        if (p->second.second)
+            _values.erase(p++);
+        else
+            ++p;
+
+    set<uint32_t> relocs;
+    for (size_t i = 0; i < packets.size(); ++i) {
+        pm4_packet const& p = packets[i];
+        count& c = _packets[_decoder.packet_name(p)];
+        ++c.packets;
+        c.dwords += p.size;
+
+        if (p.reloc) {
+            ++_relocs;
+            relocs.insert(ib[p.offset + 1]);
+            continue;
+        }
+        if (p.regs == 0)
+            continue;
+
+        // The relocation which patches the last register, plus one.
+        bool patched = i + 1 < packets.size() && packets[i + 1].reloc;
+        uint32_t reloc = patched ? ib[packets[i + 1].offset + 1] / reloc_size + 1 : 0;
+
+        count& k = _classes[_decoder.register_class(p.reg)];
+        ++k.packets;
+        k.dwords += p.size;
+        k.regs += p.regs;
+
+        uint32_t const* values = ib + p.offset + p.size - p.regs;
+        unsigned redundant = 0;
+        for (uint32_t j = 0; j < p.regs; ++j) {
+            uint32_t reg = p.one_reg ? p.reg : p.reg + 4 * j;
+            pair<uint32_t, uint32_t> value(values[j], j + 1 == p.regs ? reloc : 0);
+            map<uint32_t, pair<uint32_t, uint32_t> >::iterator last = _values.find(reg);
+            if (last != _values.end() && last->second == value) {
+                ++redundant;
+                ++_redundant[reg];
+            }
+            else
+                _values[reg] = value;
+        }
+        k.redundant += redundant;
+        if (redundant == p.regs) {
+            ++_redundant_packets;
+            _redundant_dwords += p.size + (patched ? packets[i + 1].size : 0);
+        }
+    }
+    _distinct_relocs += relocs.size();
+}
+
+void pm4_stats::write_table(ostream& os, unsigned top) const
+{
+    os << left << setw(24) << "packet" << right << setw(10) << "count" << setw(10) << "dwords"
+       << setw(8) << "%" << '\n';
+    for (map<string, count>::const_iterator p = _packets.begin(); p != _packets.end(); ++p)
+        os << left << setw(24) << p->first << right << setw(10) << p->second.packets
+           << setw(10) << p->second.dwords << setw(8) << fixed << setprecision(1)
+           << (_dwords ? 100.0 * p->second.dwords / _dwords : 0.0) << '\n';
+    os << left << setw(24) << "total" << right << setw(10) << "" << setw(10) << _dwords << "\n\n";
+
+    os << left << setw(24) << "register class" << right << setw(10) << "packets" << setw(10) << "dwords"
+       << setw(10) << "regs" << setw(11) << "redundant" << '\n';
+    for (map<string, count>::const_iterator p = _classes.begin(); p != _classes.end(); ++p)
+        os << left << setw(24) << p->first << right << setw(10) << p->second.packets
+           << setw(10) << p->second.dwords << setw(10) << p->second.regs
+           << setw(11) << p->second.redundant << '\n';
+
+    os << "\nrelocation packets: " << _relocs << ", distinct relocations: " << _distinct_relocs
+       << "\nredundant packets: " << _redundant_packets << ", " << _redundant_dwords << " dwords ("
+       << setprecision(1) << (_dwords ? 100.0 * _redundant_dwords / _dwords : 0.0) << "%)\n";
+
+    vector<pair<unsigned long, uint32_t> > regs;
+    for (map<uint32_t, unsigned long>::const_iterator p = _redundant.begin(); p != _redundant.end(); ++p)
+        regs.push_back(make_pair(p->second, p->first));
+    sort(regs.rbegin(), regs.rend());
+    if (!regs.empty() && top)
+        os << "\nredundant writes by register:\n";
+    for (size_t i = 0; i < regs.size() && i < top; ++i)
+        os << "    " << left << setw(32) << _decoder.register_name(regs[i].second) << right
+           << setw(10) << regs[i].first << '\n';
+    os << flush;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "radeon_device.hpp"
+
+/// A PM4 packet of an instruction buffer, as pm4_decoder finds it.
+struct pm4_packet {
+    /// The offset of the header in the IB, in double words.
+    std::size_t offset;
+    /// The packet type, 0, 2 or 3.
+    unsigned type;
+    /// The opcode of a type-3 packet.
+    std::uint32_t opcode;
+    /// The double words of the packet, the header included.
+    std::uint32_t size;
+    /// The first register which the packet sets, or 0.
+    std::uint32_t reg;
+    /// The number of registers which the packet sets.
+    std::uint32_t regs;
+    /// Whether all the registers are the same one (type-0 ONE_REG_WR).
+    bool one_reg;
+    /// Whether the packet is a relocation (a NOP whose operand is the
+    /// offset of a relocation).
+    bool reloc;
+};
+
+/// This class decodes the PM4 packets of an instruction buffer and names
+/// its registers, from the tables of an R600 or Evergreen family.
+class pm4_decoder {
+public:
+    /// Create a decoder for a chip family.
+    /// It throws std::runtime_error if the family is not an R600 (R600 to
+    /// R700) or an Evergreen one.
+    /// \param family The chip family.
+    pm4_decoder(radeon_device::radeon_family family);
+
+    /// Whether the decoder is for the Evergreen family.
+    bool evergreen() const { return _evergreen; }
+
+    /// Decode the packets of an instruction buffer.
+    /// It throws std::runtime_error if a packet is truncated or of type 1.
+    /// \param ib The instruction buffer.
+    /// \param n The number of double words.
+    std::vector<pm4_packet> decode(std::uint32_t const* ib, std::size_t n) const;
+
+    /// Name a register, as NAME, NAME[i] for one of an array of registers or
+    /// NAME[i].k for a double word of an array of structures, or by its
+    /// offset if it is unknown.
+    std::string register_name(std::uint32_t reg) const;
+    /// Name the class of a register, the SET_* packet of its range or
+    /// "type-0" for the others.
+    const char* register_class(std::uint32_t reg) const;
+    /// Name a type-3 opcode, or return 0 if it is unknown.
+    static const char* opcode_name(std::uint32_t opcode);
+    /// Name the kind of a packet: "type-0", "type-2", "reloc" or the name
+    /// of its opcode.
+    std::string packet_name(pm4_packet const& p) const;
+
+    /// Write the packets of an instruction buffer, one per line, with the
+    /// registers which they set and their values.
+    /// \param os The output stream.
+    /// \param ib The instruction buffer.
+    /// \param n The number of double words.
+    void write(std::ostream& os, std::uint32_t const* ib, std::size_t n) const;
+
+private:
+    bool _evergreen;
+};
+
+/// This class gathers the statistics of the PM4 packets of instruction
+/// buffers: the double words by kind of packet and by class of register,
+/// the relocations, and the register writes which set a register to the
+/// value which it already had.
+///
+/// A register write followed by a relocation packet is given the value and
+/// the relocation, since the kernel patches the value with the address of
+/// the buffer object.
+class pm4_stats {
+public:
+    pm4_stats(pm4_decoder const& decoder);
+
+    /// Add the packets of an instruction buffer. The register values are
+    /// kept from an IB to the next, as the GPU keeps them.
+    /// \param ib The instruction buffer.
+    /// \param n The number of double words.
+    void add(std::uint32_t const* ib, std::size_t n);
+
+    /// Write the statistics as tables.
+    /// \param os The output stream.
+    /// \param top The number of registers with the most redundant writes to
+    /// list.
+    void write_table(std::ostream& os, unsigned top = 10) const;
+
+private:
+    struct count {
+        unsigned long packets, dwords, regs, redundant;
+        count() : packets(), dwords(), regs(), redundant() {}
+    };
+
+    pm4_decoder const& _decoder;
+    /// The double words, total.
+    unsigned long _dwords;
+    /// The counts by kind of packet and by class of register.
+    std::map<std::string, count> _packets, _classes;
+    /// The relocation packets and the distinct relocations by IB.
+    unsigned long _relocs, _distinct_relocs;
+    /// Packets whose registers all had their values already, and their
+    /// double words with those of their relocations.
+    unsigned long _redundant_packets, _redundant_dwords;
+    /// The last value of each register, and its relocation plus one or 0.
+    std::map<std::uint32_t, std::pair<std::uint32_t, std::uint32_t> > _values;
+    /// The redundant writes by register.
+    std::map<std::uint32_t, unsigned long> _redundant;
+};
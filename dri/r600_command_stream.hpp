@@ -3,6 +3,7 @@
 #include "radeon_command_stream.hpp"
 #include "radeon_device.hpp"
 
+#include <algorithm>
 #include <cstdint>
 #include <initializer_list>
 
@@ -51,4 +52,17 @@ public:
     /// \returns Proxy \c register_setter object.
     register_setter operator [] (std::uint32_t offset)
         { return { *this, offset }; }
+
+    /// Append a PM4 packet that sets a series of registers starting at a
+    /// register offset known at compile time, whose packet and header are
+    /// selected and checked by the compiler (pm4::set_reg).
+    /// \tparam Reg Register offset of the first register in the series.
+    /// \param values The values of the registers, double words or floats.
+    template <std::uint32_t Reg, typename... T>
+    void set(T... values)
+    {
+        typedef pm4::set_reg<pm4::r600, Reg, sizeof...(T)> packet;
+        const std::uint32_t v[] = { pm4::dword(values)... };
+        std::copy(v, v + sizeof...(T), packet::store_header(write_packet(packet::size)));
+    }
 };
@@ -1,6 +1,9 @@
 #include "radeon_command_stream.hpp"
+#include "cs_recording.hpp"
 
+#include <algorithm>
 #include <cstring>
+#include <stdexcept>
 #include <system_error>
 
 #include <sys/ioctl.h>
@@ -34,7 +37,7 @@ void radeon_command_stream::release_id(uint32_t id)
 }
 
 radeon_command_stream::radeon_command_stream(radeon_device const& device)
-    : _device(device), _id(new_id())
+    : _device(device), _limit(default_limit), _restored(), _flushes(), _submit(true), _id(new_id())
 {
     _flags[0] = _flags[1] = 0;
 }
@@ -46,15 +49,20 @@ radeon_command_stream::~radeon_command_stream()
 
 void radeon_command_stream::emit() const
 {
+    if (_recorder)
+        _recorder(record());
+    if (!_submit)
+        return;
+
     // Three chunks: instruction buffer, relocations and flags.
     drm_radeon_cs_chunk chunks[3];
 
     chunks[0].chunk_id = RADEON_CHUNK_ID_IB;
     chunks[0].length_dw = _ib.size();
-    chunks[0].chunk_data = _ib.empty() ? 0 : reinterpret_cast<uintptr_t>(&_ib.front());
+    chunks[0].chunk_data = reinterpret_cast<uintptr_t>(_ib.data());
     chunks[1].chunk_id = RADEON_CHUNK_ID_RELOCS;
     chunks[1].length_dw = _relocs.size() * reloc_size;
-    chunks[1].chunk_data = _relocs.empty() ? 0 : reinterpret_cast<uintptr_t>(&_relocs.front());
+    chunks[1].chunk_data = reinterpret_cast<uintptr_t>(_relocs.data());
     chunks[2].chunk_id = RADEON_CHUNK_ID_FLAGS;
     chunks[2].length_dw = 2;
     chunks[2].chunk_data = reinterpret_cast<uintptr_t>(&_flags[0]);
@@ -87,6 +95,83 @@ void radeon_command_stream::emit() const
         throw system_error(error_code(errno, system_category()), "DRM_IOCTL_RADEON_CS");
 }
 
+void radeon_command_stream::clear()
+{
+    _ib.clear();
+    _relocs.clear();
+    _reloc_offsets.clear();
+    _restored = 0;
+}
+
+void radeon_command_stream::reset()
+{
+    clear();
+    _ib.release();
+}
+
+void radeon_command_stream::make_room(std::size_t n)
+{
+    /// The state restored by a flush is not worth a flush of its own: if
+    /// nothing was written after it, the double words cannot fit at all.
+    if (size() + n <= _limit)
+        return;
+    if (size() > _restored)
+        flush();
+    if (size() + n > _limit)
+        throw length_error("the command stream does not fit in an IB");
+}
+
+void radeon_command_stream::flush()
+{
+    // The state of a derived class is kept, to be restored.
+    emit();
+    radeon_command_stream::clear();
+    ++_flushes;
+    restore();
+    _restored = size();
+}
+
+radeon_command_stream::ib_block radeon_command_stream::copy(std::size_t begin) const
+{
+    ib_block block;
+    block.dwords.assign(_ib.data() + begin, _ib.data() + _ib.size());
+    std::vector<std::size_t>::const_iterator p =
+        std::lower_bound(_reloc_offsets.begin(), _reloc_offsets.end(), begin);
+    for (; p != _reloc_offsets.end(); ++p)
+        block.relocs.push_back(make_pair(*p - begin, _relocs[_ib[*p + 1] / reloc_size]));
+    return block;
+}
+
+void radeon_command_stream::write(ib_block const& block)
+{
+    if (block.dwords.empty())
+        return;
+    reserve(size() + block.dwords.size());
+    std::uint32_t const* dwords = &block.dwords[0];
+    std::size_t done = 0;
+    for (std::size_t i = 0; i < block.relocs.size(); ++i) {
+        std::size_t offset = block.relocs[i].first;
+        drm_radeon_cs_reloc const& r = block.relocs[i].second;
+        _ib.append(dwords + done, dwords + offset);
+        write_reloc(r.handle, r.read_domains, r.write_domain, r.flags);
+        done = offset + 2;
+    }
+    _ib.append(dwords + done, dwords + block.dwords.size());
+}
+
+cs_recording radeon_command_stream::record() const
+{
+    cs_recording r;
+    r.family = device().family();
+    r.flags[0] = _flags[0];
+    r.flags[1] = _flags[1];
+    r.ib.assign(_ib.data(), _ib.data() + _ib.size());
+    r.relocs.assign(_relocs.data(), _relocs.data() + _relocs.size());
+    r.reloc_offsets.assign(_reloc_offsets.begin(), _reloc_offsets.end());
+    r.buffers.resize(_relocs.size());
+    return r;
+}
+
 void radeon_command_stream::write_reloc(
         std::uint32_t handle,
         std::uint32_t read_domains,
@@ -95,25 +180,8 @@ void radeon_command_stream::write_reloc(
 {
     /// This function will make sure that a single relocation record is
     /// sent to the kernel for each distinct buffer object.
-    std::unordered_map<uint32_t, uint32_t>::iterator
-        p = _reloc_map.find(handle);
-
-    if (p == _reloc_map.end())
-    {
-        p = _reloc_map.insert(make_pair(handle, uint32_t(_relocs.size()))).first;
-        drm_radeon_cs_reloc reloc;
-        reloc.handle = handle;
-        reloc.read_domains = read_domains;
-        reloc.write_domain = write_domain;
-        reloc.flags = flags;
-        _relocs.push_back(reloc);
-    }
-    else
-    {
-        _relocs[p->second].read_domains |= read_domains;
-        _relocs[p->second].write_domain |= write_domain;
-        _relocs[p->second].flags |= flags;
-    }
+    std::uint32_t index = _relocs.insert(handle, read_domains, write_domain, flags);
 
-    write({ 0xc0001000, p->second * reloc_size });
+    _reloc_offsets.push_back(size());
+    write({ 0xc0001000, index * reloc_size });
 }
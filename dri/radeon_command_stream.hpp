@@ -3,14 +3,20 @@
 #include "gem_command_stream.hpp"
 #include "radeon_device.hpp"
 #include "hex_dump.hpp"
+#include "ib_buffer.hpp"
+#include "reloc_table.hpp"
+#include "pm4.hpp"
 
 #include <cstdint>
 #include <atomic>
+#include <functional>
 #include <initializer_list>
 #include <iostream>
-#include <unordered_map>
+#include <utility>
 #include <vector>
 
+struct cs_recording;
+
 /// This class wraps an in-memory GEM command stream.
 class radeon_command_stream : public gem_command_stream {
 public:
@@ -20,7 +26,7 @@ public:
     /// \param device The DRI device on which to create the object.
     radeon_command_stream(radeon_device const& device);
     /// The destructure releases resources associated with the command stream.
-    ~radeon_command_stream();
+    virtual ~radeon_command_stream();
 
     /// This function returns the DRI device on which this object exists.
     radeon_device const& device() const { return _device; }
@@ -28,8 +34,38 @@ public:
     /// Access the id associated with this command stream.
     std::uint32_t id() const { return _id; }
 
-    /// Emit the command stream for execution.
+    /// Emit the command stream for execution. If a recorder is set, it
+    /// receives the recording of the submission first.
     void emit() const;
+    /// Empty the instruction buffer and the relocations, so that the command
+    /// stream can be filled again after being emitted. A derived class also
+    /// drops the state which it restores.
+    virtual void clear();
+
+    /// The default limit of the instruction buffer, the largest IB the
+    /// radeon kernel driver parses (16K double words).
+    static const std::size_t default_limit = 16 * 1024;
+    /// Get the limit of the instruction buffer in double words.
+    std::size_t limit() const { return _limit; }
+    /// Set the limit of the instruction buffer in double words.
+    void set_limit(std::size_t n) { _limit = n; }
+    /// Make room for a number of double words, which will be written without
+    /// a flush between them. If they do not fit under the limit, the command
+    /// stream is flushed first.
+    /// It throws std::length_error if they do not fit even then.
+    /// \param n The number of double words.
+    void make_room(std::size_t n);
+    /// Emit the command stream, clear it and write the state which a derived
+    /// class restores (\c restore) into it, so that it can go on.
+    void flush();
+    /// Get the number of times the command stream has been flushed.
+    unsigned flushes() const { return _flushes; }
+
+    /// Set the flags chunk which \c emit submits with the IB.
+    /// \param flags Flags of the submission (RADEON_CS_KEEP_TILING_FLAGS...).
+    /// \param ring The ring (RADEON_CS_RING_GFX...).
+    void set_flags(std::uint32_t flags, std::uint32_t ring = RADEON_CS_RING_GFX)
+        { _flags[0] = flags; _flags[1] = ring; }
 
     /// Get the current capacity of the instruction buffer.
     /// \returns The capacity in number of double words of the IB.
@@ -40,26 +76,41 @@ public:
     /// Reserve storage in the instruction buffer.
     /// Calling this function is unnecessary, it is an optimization.
     /// \param n The least number of double words for which to reserve storage.
-    void reserve(std::size_t n) { _ib.reserve((n + 01777u) & ~01777u); }
+    void reserve(std::size_t n) { _ib.reserve(n); }
+    /// Empty the command stream and give the storage of its instruction
+    /// buffer back to the per-thread arena, from which the next command
+    /// stream to grow takes it.
+    void reset();
 
     /// Append a double word to the end of the instruction buffer.
     /// \param x The double word to append.
-    void write(std::uint32_t x)
-    {
-        reserve(size() + 1);
-        _ib.push_back(x);
-    }
+    void write(std::uint32_t x) { _ib.push_back(x); }
     /// Append a float number to the end of the instruction buffer.
     /// \param x The float number to append.
     void write(float x) { write(*reinterpret_cast<std::uint32_t*>(&x)); }
     /// Append a list of double words from an initializer list to the end of
     /// the instruction buffer.
     /// \param x The list of double words to append.
-    void write(std::initializer_list<std::uint32_t> x)
-    {
-        reserve(size() + x.size());
-        _ib.insert(_ib.end(), x.begin(), x.end());
-    }
+    void write(std::initializer_list<std::uint32_t> x) { _ib.append(x.begin(), x.end()); }
+    /// Append a packet of n double words, which the caller writes through
+    /// the returned cursor. This checks the capacity once per packet.
+    /// \param n The number of double words.
+    /// \returns The address of the first double word, valid until the next
+    /// write.
+    std::uint32_t* write_packet(std::size_t n) { return _ib.append(n); }
+    /// Append a typed packet (pm4.hpp), which stores its \c size double
+    /// words.
+    /// \param packet The packet.
+    template <typename Packet>
+    auto write(Packet const& packet) -> decltype(packet.store(0))
+        { packet.store(write_packet(Packet::size)); }
+
+    /// Reserve storage for the relocations of a number of distinct buffer
+    /// objects.
+    /// Calling this function is unnecessary, it is an optimization.
+    void reserve_relocs(std::size_t n) { _relocs.reserve(n); }
+    /// Get the number of relocations, one per distinct buffer object.
+    std::size_t relocs() const { return _relocs.size(); }
 
     /// Append a relocation packet to the end of the instruction buffer.
     /// \param handle Handle of the buffer object on which the datum is found.
@@ -72,16 +123,53 @@ public:
         std::uint32_t write_domain = 0,
         std::uint32_t flags = 0);
 
+    /// This structure holds a copy of a part of the instruction buffer with
+    /// its relocations, which can be written again after the command stream
+    /// has been cleared.
+    struct ib_block {
+        /// The double words, relocation packets included.
+        std::vector<std::uint32_t> dwords;
+        /// The relocations by offset of their packet in the block.
+        std::vector<std::pair<std::size_t, drm_radeon_cs_reloc> > relocs;
+    };
+    /// Copy the instruction buffer from a given offset to its end.
+    /// \param begin The offset in double words.
+    ib_block copy(std::size_t begin) const;
+    /// Append a copy of a part of an instruction buffer, with new
+    /// relocation packets.
+    /// \param block The copy.
+    void write(ib_block const& block);
+
+    /// Record the submission which \c emit would make, to be saved into a
+    /// file and replayed (cs_recording). The contents of the buffer objects
+    /// are not recorded; cs_recording::snapshot adds them.
+    cs_recording record() const;
+
+    /// This type receives the recording of every submission of a command
+    /// stream, the flushes included.
+    typedef std::function<void(cs_recording const&)> recorder;
+    /// Set the function which receives the recording of every IB which
+    /// \c emit submits, or an empty function for none.
+    /// \param r The recorder.
+    /// \param submit Whether to submit the IBs too; without submission a
+    /// command stream can be recorded and checked without a GPU.
+    void set_recorder(recorder r, bool submit = true) { _recorder = r; _submit = submit; }
+
     /// Dump the CS to an output stream.
     /// \param os Output stream.
     /// \param cs The CS object.
     /// \returns The same output stream passed as \c os.
     friend std::ostream& operator << (std::ostream& os, radeon_command_stream const& cs)
     {
-        os << hex_dump<std::uint32_t>(&cs._ib[0], cs._ib.size());
+        os << hex_dump<std::uint32_t>(cs._ib.data(), cs._ib.size());
         return os;
     }
 
+protected:
+    /// Write the state which must be set again at the start of the
+    /// instruction buffer after a flush. It does nothing by default.
+    virtual void restore() {}
+
 private:
     /// The size in double words of the relocation structure.
     static const std::uint32_t reloc_size =
@@ -97,13 +185,22 @@ private:
     /// A const reference to the DRI device wrapper.
     radeon_device const& _device;
     /// The instruction buffer chunk.
-    std::vector<std::uint32_t> _ib;
+    ib_buffer _ib;
     /// The relocations chunk.
-    std::vector<drm_radeon_cs_reloc> _relocs;
+    reloc_table _relocs;
     /// The flags chunk.
     std::uint32_t _flags[2];
-    /// Maps an buffer object handle to an index in the relocations chunk.
-    std::unordered_map<std::uint32_t,std::uint32_t> _reloc_map;
+    /// The offsets of the relocation packets in the IB.
+    std::vector<std::size_t> _reloc_offsets;
+    /// The limit of the IB in double words.
+    std::size_t _limit;
+    /// The size of the IB after the state was restored by the last flush.
+    std::size_t _restored;
+    /// The number of flushes.
+    unsigned _flushes;
+    /// The recorder of the submissions, and whether they are submitted.
+    recorder _recorder;
+    bool _submit;
     /// The unique id of this command stream.
     const std::uint32_t _id;
 };
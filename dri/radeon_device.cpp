@@ -15,6 +15,11 @@ radeon_device::radeon_device(const char* path, bool exclusive)
     _family = get_family(_device_id);
 }
 
+radeon_device::radeon_device(radeon_family family)
+    : _gem_info(), _device_id(), _family(family)
+{
+}
+
 drm_radeon_gem_info radeon_device::get_gem_info() const
 {
     /// This member function uses DRM_IOCTL_RADEON_GEM_INFO.
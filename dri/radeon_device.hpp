@@ -83,10 +83,22 @@ public:
         CHIP_LAST
     } radeon_family;
 
+    /// This constructor creates a stand-in for a device of a family, without
+    /// a node. Command streams can be written for it and recorded without
+    /// being submitted (radeon_command_stream::set_recorder), but no buffer
+    /// object can be created.
+    /// \param family The chip family.
+    explicit radeon_device(radeon_family family);
+
     /// Get the chip family to which this device belongs.
     radeon_family family() const { return _family; }
     /// Get the device family identification string.
     const char* family_name() const { return get_family_name(_family); }
+    /// Get a pointer to an internal string containing the name of the
+    /// given device family.
+    /// \param family Chip family.
+    /// \returns The radeon device family name.
+    static const char* get_family_name(radeon_family family);
 
 protected:
     /// Obtain information related to the Graphics Execution Manager (GEM).
@@ -103,11 +115,6 @@ protected:
     /// \param device_id PCI device ID.
     /// \returns The radeon device family.
     static radeon_family get_family(std::uint32_t device_id);
-    /// Get a pointer to an internal string containing the name of the
-    /// given device family.
-    /// \param family Chip family.
-    /// \returns The radeon device family name.
-    static const char* get_family_name(radeon_family family);
 
 private:
     /// Information related to the Graphics Execution Manager (GEM).
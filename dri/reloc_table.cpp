@@ -0,0 +1,100 @@
+#include "reloc_table.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+/// Entries of the hash table when it is first needed.
+const size_t min_hash_entries = 64;
+
+/// Fibonacci hashing of a handle into a table of 2^bits entries: the high
+/// bits of the product, which depend on every bit of the handle.
+inline size_t hash_index(uint32_t handle, unsigned bits)
+{
+    return uint32_t(handle * 2654435769u) >> (32 - bits);
+}
+
+}
+
+uint32_t* reloc_table::hashed_slot(uint32_t handle)
+{
+    // Keep the table at most half full.
+    if (2 * (_hashed + 1) > _hash.size() / 2)
+        grow_hashed();
+
+    size_t mask = _hash.size() / 2 - 1;
+    for (size_t i = hash_index(handle, _hash_bits); ; i = (i + 1) & mask) {
+        uint32_t* entry = &_hash[2 * i];
+        if (entry[0] == handle)
+            return entry + 1;
+        if (entry[0] == 0) {
+            entry[0] = handle;
+            ++_hashed;
+            return entry + 1;
+        }
+    }
+}
+
+void reloc_table::grow_direct(uint32_t handle)
+{
+    size_t n = max(size_t(handle) + 1, max(size_t(256), 2 * _direct.size()));
+    _direct.resize(min(n, size_t(direct_handles)), 0);
+}
+
+void reloc_table::grow_hashed()
+{
+    vector<uint32_t> old;
+    old.swap(_hash);
+    _hash.assign(max(2 * min_hash_entries, 2 * old.size()), 0);
+    _hashed = 0;
+    for (_hash_bits = 0; size_t(2) << _hash_bits < _hash.size(); ++_hash_bits)
+        ;
+
+    size_t mask = _hash.size() / 2 - 1;
+    for (size_t j = 0; j < old.size(); j += 2)
+        if (old[j] != 0) {
+            size_t i = hash_index(old[j], _hash_bits);
+            while (_hash[2 * i] != 0)
+                i = (i + 1) & mask;
+            _hash[2 * i] = old[j];
+            _hash[2 * i + 1] = old[j + 1];
+            ++_hashed;
+        }
+}
+
+void reloc_table::reserve(size_t n)
+{
+    _relocs.reserve(n);
+    // Only streams which already reference large handles reserve for them.
+    while (!_hash.empty() && 2 * n > _hash.size() / 2)
+        grow_hashed();
+}
+
+void reloc_table::clear()
+{
+    for (size_t i = 0; i < _relocs.size(); ++i)
+        if (_relocs[i].handle < direct_handles)
+            _direct[_relocs[i].handle] = 0;
+
+    if (_hashed) {
+        // Find the entries of the large handles before freeing any of
+        // them, since a free entry would end the probes of those after it.
+        size_t mask = _hash.size() / 2 - 1;
+        _cleared.clear();
+        for (size_t r = 0; r < _relocs.size(); ++r) {
+            uint32_t handle = _relocs[r].handle;
+            if (handle < direct_handles)
+                continue;
+            size_t i = hash_index(handle, _hash_bits);
+            while (_hash[2 * i] != handle)
+                i = (i + 1) & mask;
+            _cleared.push_back(i);
+        }
+        for (size_t k = 0; k < _cleared.size(); ++k)
+            _hash[2 * _cleared[k]] = _hash[2 * _cleared[k] + 1] = 0;
+        _hashed = 0;
+    }
+    _relocs.clear();
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <drm.h>
+#include <radeon_drm.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// This class holds the relocations of a command stream, one per distinct
+/// buffer object, and finds the relocation of a GEM handle.
+///
+/// GEM handles are small integers which the kernel hands out from 1 up, so
+/// handles below \c direct_handles index an array of relocation indices;
+/// larger ones go to an open-addressed hash table. Clearing the table costs
+/// as much as the relocations it holds, not as much as its arrays, so that
+/// a command stream can be reused.
+class reloc_table {
+public:
+    /// Handles which are looked up by direct indexing.
+    static const std::uint32_t direct_handles = 1 << 16;
+
+    reloc_table() : _hashed(), _hash_bits() {}
+
+    /// Get the number of relocations.
+    std::size_t size() const { return _relocs.size(); }
+    /// Determine whether there are no relocations.
+    bool empty() const { return _relocs.empty(); }
+    /// Access the relocations.
+    drm_radeon_cs_reloc const* data() const { return _relocs.empty() ? 0 : &_relocs[0]; }
+    drm_radeon_cs_reloc const& operator [] (std::size_t i) const { return _relocs[i]; }
+
+    /// Add the domains and flags of a reference to a buffer object to its
+    /// relocation, adding the relocation if it is the first reference.
+    /// \param handle Handle of the buffer object.
+    /// \param read_domains Read domains.
+    /// \param write_domain Write domain.
+    /// \param flags Flags.
+    /// \returns The index of the relocation.
+    std::uint32_t insert(std::uint32_t handle, std::uint32_t read_domains,
+        std::uint32_t write_domain, std::uint32_t flags)
+    {
+        std::uint32_t* slot = handle < direct_handles ? direct_slot(handle) : hashed_slot(handle);
+        if (*slot == 0) {
+            drm_radeon_cs_reloc reloc;
+            reloc.handle = handle;
+            reloc.read_domains = read_domains;
+            reloc.write_domain = write_domain;
+            reloc.flags = flags;
+            _relocs.push_back(reloc);
+            *slot = _relocs.size();
+        }
+        else {
+            drm_radeon_cs_reloc& reloc = _relocs[*slot - 1];
+            reloc.read_domains |= read_domains;
+            reloc.write_domain |= write_domain;
+            reloc.flags |= flags;
+        }
+        return *slot - 1;
+    }
+
+    /// Make room for a number of distinct buffer objects.
+    void reserve(std::size_t n);
+    /// Remove the relocations, keeping the storage.
+    void clear();
+
+private:
+    /// Get the slot of a small handle, which holds its index plus one or 0.
+    std::uint32_t* direct_slot(std::uint32_t handle)
+    {
+        if (handle >= _direct.size())
+            grow_direct(handle);
+        return &_direct[handle];
+    }
+    /// Get the slot of a large handle in the hash table.
+    std::uint32_t* hashed_slot(std::uint32_t handle);
+
+    void grow_direct(std::uint32_t handle);
+    void grow_hashed();
+
+    /// The relocations, by index.
+    std::vector<drm_radeon_cs_reloc> _relocs;
+    /// The index plus one of the relocation of each small handle, or 0.
+    std::vector<std::uint32_t> _direct;
+    /// The hash table of the large handles: pairs of a handle (0 if the
+    /// entry is free) and an index plus one.
+    std::vector<std::uint32_t> _hash;
+    /// The number of large handles.
+    std::size_t _hashed;
+    /// The log2 of the number of entries of the hash table.
+    unsigned _hash_bits;
+    /// The entries of the hash table which clear() frees.
+    std::vector<std::size_t> _cleared;
+};
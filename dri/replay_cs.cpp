@@ -0,0 +1,294 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "cs_recording.hpp"
+#include "radeon_buffer_object.hpp"
+#include "radeon_command_stream.hpp"
+#include "radeon_device.hpp"
+#include "reloc_table.hpp"
+
+using namespace std;
+
+namespace {
+
+/// This class is where a recording is replayed: a device or a stand-in.
+class replay_target {
+public:
+    virtual ~replay_target() {}
+
+    /// Get the name of the target.
+    virtual string name() const = 0;
+    /// Create the buffer objects of a recording and upload their snapshots.
+    /// \param r The recording.
+    /// \param default_size The size of the buffers of unknown size.
+    virtual void load(cs_recording const& r, uint64_t default_size) = 0;
+    /// Upload the snapshots again.
+    virtual void upload() = 0;
+    /// Build the command stream of the recording.
+    virtual void build() = 0;
+    /// Submit the command stream and wait until it has run.
+    virtual void submit() = 0;
+};
+
+/// This class replays on a radeon device.
+class radeon_replay_target : public replay_target {
+public:
+    radeon_replay_target(const char* path) : _device(path, false), _cs(_device) {}
+
+    string name() const { return _device.family_name(); }
+
+    void load(cs_recording const& r, uint64_t default_size)
+    {
+        if (r.family != uint32_t(_device.family()))
+            cerr << "The recording is for "
+                 << radeon_device::get_family_name(radeon_device::radeon_family(r.family))
+                 << ", replaying on " << _device.family_name() << endl;
+
+        _r = &r;
+        vector<uint32_t> handles;
+        for (size_t i = 0; i < r.relocs.size(); ++i) {
+            uint32_t domain = r.relocs[i].read_domains | r.relocs[i].write_domain;
+            _bos.push_back(unique_ptr<radeon_buffer_object>(new radeon_buffer_object(_device,
+                r.buffers[i].size ? r.buffers[i].size : default_size,
+                domain ? domain : uint32_t(RADEON_GEM_DOMAIN_VRAM), 4096)));
+            handles.push_back(_bos.back()->handle());
+        }
+        _block = r.block(handles);
+        _cs.set_flags(r.flags[0], r.flags[1]);
+        upload();
+    }
+
+    void upload()
+    {
+        for (size_t i = 0; i < _bos.size(); ++i)
+            if (!_r->buffers[i].contents.empty())
+                _bos[i]->pwrite(0, _r->buffers[i].contents.size(), &_r->buffers[i].contents[0]);
+    }
+
+    void build()
+    {
+        _cs.clear();
+        _cs.write(_block);
+    }
+
+    void submit()
+    {
+        _cs.emit();
+        for (size_t i = 0; i < _bos.size(); ++i)
+            _bos[i]->wait_idle();
+    }
+
+private:
+    radeon_device _device;
+    radeon_command_stream _cs;
+    cs_recording const* _r;
+    vector<unique_ptr<radeon_buffer_object> > _bos;
+    radeon_command_stream::ib_block _block;
+};
+
+/// This class replays without a device: it builds the chunks as
+/// radeon_command_stream does and submits them to a stand-in for the
+/// kernel, which copies them and parses the packets of the IB, checking
+/// the relocation packets.
+class software_replay_target : public replay_target {
+public:
+    software_replay_target() : _packets() {}
+
+    string name() const { return "software"; }
+
+    void load(cs_recording const& r, uint64_t default_size)
+    {
+        _r = &r;
+        vector<uint32_t> handles;
+        for (size_t i = 0; i < r.relocs.size(); ++i) {
+            _bos.push_back(vector<uint8_t>(r.buffers[i].size ? r.buffers[i].size : default_size));
+            handles.push_back(i + 1);
+        }
+        _block = r.block(handles);
+        upload();
+    }
+
+    void upload()
+    {
+        for (size_t i = 0; i < _bos.size(); ++i)
+            copy(_r->buffers[i].contents.begin(), _r->buffers[i].contents.end(), _bos[i].begin());
+    }
+
+    void build()
+    {
+        _ib.clear();
+        _relocs.clear();
+        size_t done = 0;
+        for (size_t i = 0; i < _block.relocs.size(); ++i) {
+            size_t offset = _block.relocs[i].first;
+            drm_radeon_cs_reloc const& r = _block.relocs[i].second;
+            _ib.insert(_ib.end(), _block.dwords.begin() + done, _block.dwords.begin() + offset);
+            _ib.push_back(0xc0001000);
+            _ib.push_back(_relocs.insert(r.handle, r.read_domains, r.write_domain, r.flags) * reloc_size);
+            done = offset + 2;
+        }
+        _ib.insert(_ib.end(), _block.dwords.begin() + done, _block.dwords.end());
+    }
+
+    void submit()
+    {
+        // The kernel copies the chunks and checks the ring, then parses the
+        // IB.
+        _kernel_ib.assign(_ib.begin(), _ib.end());
+        _kernel_relocs.assign(_relocs.data(), _relocs.data() + _relocs.size());
+        _kernel_flags.assign(_r->flags, _r->flags + 2);
+        if (_kernel_flags[1] > RADEON_CS_RING_UVD)
+            throw runtime_error("invalid ring");
+
+        for (size_t i = 0; i < _kernel_ib.size(); ++_packets) {
+            uint32_t header = _kernel_ib[i];
+            uint32_t count = (header >> 16) & 0x3fff;
+            switch (header >> 30) {
+            case 0:
+                i += count + 2;
+                break;
+            case 2:
+                i += 1;
+                break;
+            case 3:
+                if (header == 0xc0001000 && (i + 1 >= _kernel_ib.size() ||
+                        _kernel_ib[i + 1] / reloc_size >= _kernel_relocs.size()))
+                    throw runtime_error("invalid relocation packet");
+                i += count + 2;
+                break;
+            default:
+                throw runtime_error("invalid packet type");
+            }
+        }
+    }
+
+private:
+    static const uint32_t reloc_size = sizeof(drm_radeon_cs_reloc) / sizeof(uint32_t);
+
+    cs_recording const* _r;
+    vector<vector<uint8_t> > _bos;
+    radeon_command_stream::ib_block _block;
+    vector<uint32_t> _ib;
+    reloc_table _relocs;
+    vector<uint32_t> _kernel_ib;
+    vector<drm_radeon_cs_reloc> _kernel_relocs;
+    vector<uint32_t> _kernel_flags;
+    unsigned long _packets;
+};
+
+typedef chrono::steady_clock clock_type;
+
+double microseconds(clock_type::time_point start, clock_type::time_point end)
+{
+    return chrono::duration<double, micro>(end - start).count();
+}
+
+/// Write the minimum, mean and maximum of the times of a step.
+void write_times(ostream& os, const char* step, vector<double> const& t)
+{
+    double sum = 0;
+    for (size_t i = 0; i < t.size(); ++i)
+        sum += t[i];
+    os << step << fixed << setprecision(1)
+       << '\t' << *min_element(t.begin(), t.end())
+       << '\t' << sum / t.size()
+       << '\t' << *max_element(t.begin(), t.end()) << '\n';
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    const char* card = "/dev/dri/card0";
+    unsigned repeats = 100;
+    uint64_t default_size = 1 << 20;
+    bool software = false, upload = false;
+
+    for (int opt = 0; (opt = getopt(argc, argv, "c:nr:b:u")) != -1; )
+        switch (opt) {
+            case 'c': card = optarg; break;
+            case 'n': software = true; break;
+            case 'r': repeats = atoi(optarg); break;
+            case 'b': default_size = strtoull(optarg, 0, 0); break;
+            case 'u': upload = true; break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    if (optind + 1 != argc || repeats < 1 || default_size == 0) {
+        cerr << "Usage: " << argv[0] << " [-c<card>] [-n] [-r<n>] [-b<n>] [-u] <recording>\n\n"
+            "\tSubmit a recorded command stream a number of times and report the\n"
+            "\ttimes to build it and to submit it, until it has run.\n\n"
+            "\t-c <s>\tdevice node (/dev/dri/card0)\n"
+            "\t-n\tsubmit to a software stand-in for the device, which copies\n"
+            "\t\tthe chunks and parses the IB\n"
+            "\t-r <n>\tsubmissions (100)\n"
+            "\t-b <n>\tsize in bytes of the buffers recorded without one (1M)\n"
+            "\t-u\tupload the recorded buffer contents again before each submission\n" << endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        cs_recording r = cs_recording::read(argv[optind]);
+
+        unique_ptr<replay_target> target;
+        if (software)
+            target.reset(new software_replay_target);
+        else
+            target.reset(new radeon_replay_target(card));
+        target->load(r, default_size);
+
+        unsigned snapshots = 0;
+        for (size_t i = 0; i < r.buffers.size(); ++i)
+            snapshots += !r.buffers[i].contents.empty();
+
+        vector<double> build, submit;
+        for (unsigned i = 0; i < repeats; ++i) {
+            if (upload && i)
+                target->upload();
+            clock_type::time_point t0 = clock_type::now();
+            target->build();
+            clock_type::time_point t1 = clock_type::now();
+            target->submit();
+            clock_type::time_point t2 = clock_type::now();
+            build.push_back(microseconds(t0, t1));
+            submit.push_back(microseconds(t1, t2));
+        }
+
+        cout << target->name() << ": " << r.ib.size() << " IB double words, "
+             << r.relocs.size() << " relocations, " << snapshots << " snapshots, "
+             << repeats << " submissions\n"
+             << "us\tmin\tmean\tmax\n";
+        write_times(cout, "build", build);
+        write_times(cout, "submit", submit);
+        cout << flush;
+    }
+    catch (system_error& e) {
+        cerr
+            << e.what()
+            << " : "
+            << e.code().message()
+            << endl;
+        return EXIT_FAILURE;
+    }
+    catch (runtime_error& e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    catch (invalid_argument& e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
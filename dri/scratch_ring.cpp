@@ -0,0 +1,75 @@
+#include "scratch_ring.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+/// Work-items per wavefront.
+const unsigned items_per_wave = 64;
+
+/// The shader engines, SIMDs and wavefront slots per shader engine of the
+/// Evergreen families, as the kernel's evergreen_gpu_init has them. SUMO
+/// has 2 to 5 SIMDs, depending on the part; the ring is sized for 5.
+struct family_shape {
+    radeon_device::radeon_family family;
+    unsigned ses, simds, se_waves;
+};
+
+const family_shape shapes[] = {
+    { radeon_device::CHIP_CEDAR, 1, 2, 192 },
+    { radeon_device::CHIP_REDWOOD, 1, 5, 248 },
+    { radeon_device::CHIP_JUNIPER, 1, 10, 248 },
+    { radeon_device::CHIP_CYPRESS, 2, 20, 248 },
+    { radeon_device::CHIP_HEMLOCK, 2, 20, 248 },
+    { radeon_device::CHIP_PALM, 1, 2, 192 },
+    { radeon_device::CHIP_SUMO, 1, 5, 248 },
+    { radeon_device::CHIP_SUMO2, 1, 2, 248 },
+    { radeon_device::CHIP_BARTS, 2, 14, 248 },
+    { radeon_device::CHIP_TURKS, 1, 6, 248 },
+    { radeon_device::CHIP_CAICOS, 1, 2, 192 },
+};
+
+}
+
+scratch_ring::scratch_ring(radeon_device const& device)
+    : _device(device), _ses(), _simds(), _se_waves()
+{
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); ++i)
+        if (shapes[i].family == device.family()) {
+            _ses = shapes[i].ses;
+            _simds = shapes[i].simds;
+            _se_waves = shapes[i].se_waves;
+            return;
+        }
+    throw runtime_error(device.family_name());
+}
+
+unsigned scratch_ring::waves(compute_pipeline const& pipeline) const
+{
+    compute_pipeline::desc const& d = pipeline.description();
+    unsigned simd_waves = pipeline.ls_gprs() / d.num_gprs;
+    return min(_se_waves, simd_waves * (_simds / _ses));
+}
+
+uint32_t scratch_ring::se_size(compute_pipeline const& pipeline) const
+{
+    uint64_t bytes = uint64_t(waves(pipeline)) * items_per_wave *
+        pipeline.description().scratch_dwords * 4;
+    return (bytes + 255) & ~uint64_t(255);
+}
+
+bool scratch_ring::reserve(compute_pipeline const& pipeline)
+{
+    uint64_t needed = uint64_t(_ses) * se_size(pipeline);
+    if (needed <= size())
+        return false;
+
+    if (_bo)
+        _replaced.push_back(std::move(_bo));
+    _bo.reset(new radeon_buffer_object(_device, max(needed, 2 * size()),
+        RADEON_GEM_DOMAIN_VRAM, 256));
+    return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "evergreen_command_stream.hpp"
+#include "radeon_buffer_object.hpp"
+#include "radeon_device.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/// This class is the scratch (temporary) ring of the compute shaders of an
+/// Evergreen, in which the shaders spill the registers that do not fit in
+/// their GPRs, so that a kernel can take fewer GPRs and have more
+/// wavefronts in flight.
+///
+/// The ring holds \c scratch_dwords double words for each work-item of the
+/// wavefronts that can be in flight on each shader engine (SE): those that
+/// the GPRs of the pipeline let a SIMD hold, up to the wavefront slots of
+/// the SE. It is created when a pipeline first needs it and grows, at
+/// least twice as large, when another one needs more, so that it is
+/// allocated a few times and reused by the dispatches.
+///
+/// evergreen_command_stream binds the ring before a dispatch with a
+/// pipeline that needs it (evergreen_command_stream::set_scratch_ring).
+class scratch_ring {
+public:
+    /// Get the shape of the ring for the family of a device.
+    /// It throws std::runtime_error if the device is not an Evergreen.
+    /// \param device The device.
+    scratch_ring(radeon_device const& device);
+
+    /// Get the shader engines.
+    unsigned shader_engines() const { return _ses; }
+    /// Get the SIMDs, over all the shader engines.
+    unsigned simds() const { return _simds; }
+    /// Get the wavefront slots of a shader engine.
+    unsigned se_waves() const { return _se_waves; }
+
+    /// Get the wavefronts of a pipeline that can be in flight on a shader
+    /// engine.
+    /// \param pipeline The pipeline.
+    unsigned waves(compute_pipeline const& pipeline) const;
+    /// Get the bytes of ring that a shader engine needs for a pipeline, a
+    /// multiple of 256, or 0 if it does not spill.
+    /// \param pipeline The pipeline.
+    std::uint32_t se_size(compute_pipeline const& pipeline) const;
+    /// Make the ring large enough for a pipeline.
+    /// The buffer objects which the ring replaces are kept until \c trim,
+    /// since command streams which have not been emitted may refer to them.
+    /// \param pipeline The pipeline.
+    /// \returns Whether the buffer object of the ring was replaced.
+    bool reserve(compute_pipeline const& pipeline);
+    /// Close the buffer objects which the ring has replaced, once the
+    /// command streams which refer to them have been emitted.
+    void trim() { _replaced.clear(); }
+
+    /// Get the handle of the buffer object of the ring, 0 if there is none.
+    std::uint32_t handle() const { return _bo ? _bo->handle() : 0; }
+    /// Get the size of the ring in bytes.
+    std::uint64_t size() const { return _bo ? _bo->size() : 0; }
+    /// Get the domain of the ring.
+    std::uint32_t domain() const { return RADEON_GEM_DOMAIN_VRAM; }
+
+private:
+    radeon_device const& _device;
+    unsigned _ses, _simds, _se_waves;
+    std::unique_ptr<radeon_buffer_object> _bo;
+    std::vector<std::unique_ptr<radeon_buffer_object> > _replaced;
+};
@@ -1,14 +1,273 @@
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <iomanip>
+#include <stdexcept>
+#include <string>
 #include <system_error>
+#include <vector>
 
 #include "radeon_device.hpp"
 #include "radeon_buffer_object.hpp"
 #include "radeon_command_stream.hpp"
+#include "evergreen_command_stream.hpp"
+#include "cs_recording.hpp"
+#include "pm4_decoder.hpp"
 #include "hex_dump.hpp"
+#include "pm4.hpp"
 
-#include "radeon/r600d.h"
+namespace {
+
+/// The registers which the checks without a GPU look for.
+const std::uint32_t VGT_COMPUTE_START_X = 0x899c;
+const std::uint32_t SQ_GPR_RESOURCE_MGMT_1 = 0x8c04;
+const std::uint32_t CB_TARGET_MASK = 0x28238;
+
+/// The IBs which a command stream would have submitted.
+typedef std::vector<std::vector<std::uint32_t> > ib_list;
+
+/// The number of failed checks.
+unsigned failures = 0;
+
+/// Report a failed check.
+void check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+/// Record the IBs of a command stream instead of submitting them.
+void record(radeon_command_stream& cs, ib_list& ibs)
+{
+    cs.set_recorder([&ibs](cs_recording const& r) { ibs.push_back(r.ib); }, false);
+}
+
+/// A dispatch as decoded from an IB: its VGT_COMPUTE_START and the grid of
+/// its DISPATCH_DIRECT.
+struct decoded_dispatch {
+    std::uint32_t start[3], grid[3];
+
+    bool operator == (decoded_dispatch const& d) const
+        { return std::equal(start, start + 3, d.start) && std::equal(grid, grid + 3, d.grid); }
+};
+
+/// Decode the dispatches of IBs, each with the last VGT_COMPUTE_START before
+/// it.
+std::vector<decoded_dispatch> decode_dispatches(pm4_decoder const& decoder, ib_list const& ibs)
+{
+    std::vector<decoded_dispatch> dispatches;
+    for (std::size_t i = 0; i < ibs.size(); ++i) {
+        std::vector<std::uint32_t> const& ib = ibs[i];
+        std::vector<pm4_packet> packets = decoder.decode(ib.data(), ib.size());
+        decoded_dispatch d = decoded_dispatch();
+        for (std::size_t j = 0; j < packets.size(); ++j) {
+            pm4_packet const& p = packets[j];
+            if (p.type == 3 && p.reg == VGT_COMPUTE_START_X && p.regs == 3)
+                std::copy(&ib[p.offset + p.size - 3], &ib[p.offset + p.size], d.start);
+            else if (p.type == 3 && p.opcode == pm4::op::dispatch_direct) {
+                std::copy(&ib[p.offset + 1], &ib[p.offset + 4], d.grid);
+                dispatches.push_back(d);
+            }
+        }
+    }
+    return dispatches;
+}
+
+/// Get the dispatches of a grid split into chunks, whole rows of X first.
+std::vector<decoded_dispatch> expected_dispatches(std::uint32_t const* grid, std::uint32_t const* chunk)
+{
+    std::vector<decoded_dispatch> dispatches;
+    for (std::uint32_t z = 0; z < grid[2]; z += chunk[2])
+        for (std::uint32_t y = 0; y < grid[1]; y += chunk[1])
+            for (std::uint32_t x = 0; x < grid[0]; x += chunk[0]) {
+                decoded_dispatch d = { { x, y, z }, {
+                    std::min(chunk[0], grid[0] - x),
+                    std::min(chunk[1], grid[1] - y),
+                    std::min(chunk[2], grid[2] - z) } };
+                dispatches.push_back(d);
+            }
+    return dispatches;
+}
+
+/// Check that a grid is split into the dispatches of its chunks, each one
+/// starting at the group id of its first group.
+void check_split(radeon_device const& dev, pm4_decoder const& decoder)
+{
+    ib_list ibs;
+    evergreen_command_stream cs(dev);
+    record(cs, ibs);
+
+    // At most 4 groups per dimension and 8 per dispatch: chunks of 4x2x1.
+    const std::uint32_t grid[3] = { 10, 3, 2 }, chunk[3] = { 4, 2, 1 };
+    evergreen_command_stream::dispatch_limits limits;
+    limits.max_dim = 4;
+    limits.max_groups = 8;
+    unsigned n = cs.dispatch_split({ 64 }, { grid[0], grid[1], grid[2] }, limits);
+    cs.emit();
+
+    std::vector<decoded_dispatch> expected = expected_dispatches(grid, chunk);
+    check(n == expected.size(), "split: number of dispatches");
+    check(ibs.size() == 1, "split: one IB");
+    check(decode_dispatches(decoder, ibs) == expected, "split: chunks and VGT_COMPUTE_START");
+}
+
+/// Check that every IB after a flush starts with the state set before the
+/// dispatches, whether the flushes are those of \c dispatch_split or those
+/// of a full IB, and that \c clear drops the state.
+void check_restore(radeon_device const& dev, pm4_decoder const& decoder, bool full)
+{
+    ib_list ibs;
+    evergreen_command_stream cs(dev);
+    record(cs, ibs);
+    if (full)
+        cs.set_limit(256);
+
+    cs.start_3d();
+    cs.set_gds(0, 64);
+    cs.set_rat(0, 1, 0, 4096);
+    std::vector<std::uint32_t> state = cs.record().ib;
+
+    // One group per dispatch, flushed by dispatch_split or when full.
+    const std::uint32_t grid[3] = { 40, 1, 1 }, chunk[3] = { 1, 1, 1 };
+    evergreen_command_stream::dispatch_limits limits;
+    limits.max_groups = 1;
+    if (full)
+        cs.dispatch_split({ 64 }, { grid[0] }, limits);
+    else
+        cs.dispatch_split({ 64 }, { grid[0] }, limits,
+            [](evergreen_command_stream& cs) { cs.flush(); });
+    cs.emit();
+
+    check(cs.flushes() > 0 && ibs.size() == cs.flushes() + 1, "restore: one IB per flush");
+    bool restored = true;
+    for (std::size_t i = 0; i < ibs.size(); ++i)
+        restored = restored && ibs[i].size() > state.size() &&
+            std::equal(state.begin(), state.end(), ibs[i].begin());
+    check(restored, "restore: the state precedes the first packet of every IB");
+    check(decode_dispatches(decoder, ibs) == expected_dispatches(grid, chunk), "restore: dispatches");
+
+    cs.clear();
+    cs.flush();
+    check(cs.size() == 0, "restore: clear drops the state");
+}
+
+/// Get the last value of a register which an IB sets, or ~0 if it sets none.
+std::uint32_t last_value(pm4_decoder const& decoder, std::vector<std::uint32_t> const& ib, std::uint32_t reg)
+{
+    std::uint32_t value = ~0u;
+    std::vector<pm4_packet> packets = decoder.decode(ib.data(), ib.size());
+    for (std::size_t i = 0; i < packets.size(); ++i)
+        if (packets[i].type == 3 && packets[i].reg == reg)
+            value = ib[packets[i].offset + packets[i].size - packets[i].regs];
+    return value;
+}
+
+/// Check that binding a RAT keeps the RATs bound before enabled, before and
+/// after a flush.
+void check_target_mask(radeon_device const& dev, pm4_decoder const& decoder)
+{
+    ib_list ibs;
+    evergreen_command_stream cs(dev);
+    record(cs, ibs);
+
+    cs.set_rat(0, 1, 0, 4096);
+    cs.set_rat(2, 2, 0, 4096);
+    cs.flush();
+    cs.emit();
+
+    check(ibs.size() == 2 && last_value(decoder, ibs[0], CB_TARGET_MASK) == 0xf0f &&
+        last_value(decoder, ibs[1], CB_TARGET_MASK) == 0xf0f, "RATs: CB_TARGET_MASK");
+}
+
+/// Check the CP_DMA packets of the GDS copies: the source and destination
+/// selects, and the address space bit of the side in the GDS.
+void check_gds_dma(radeon_device const& dev, pm4_decoder const& decoder)
+{
+    evergreen_command_stream cs(dev);
+    cs.fill_gds(0, 64, 0);
+    cs.copy_to_gds(0, 64, 1, 0);
+    cs.copy_from_gds(0, 64, 1, 0);
+    std::vector<std::uint32_t> ib = cs.record().ib;
+
+    // SRC_SEL and DST_SEL of the header, then SAS and DAS of the command.
+    const std::uint32_t expected[][4] = {
+        { 2, 1, 0, 1 },     // fill: data into the GDS
+        { 0, 1, 0, 1 },     // memory into the GDS
+        { 1, 0, 1, 0 }      // the GDS into memory
+    };
+    std::vector<pm4_packet> packets = decoder.decode(ib.data(), ib.size());
+    unsigned n = 0;
+    for (std::size_t i = 0; i < packets.size(); ++i)
+        if (packets[i].type == 3 && packets[i].opcode == pm4::op::cp_dma && n < 3) {
+            std::uint32_t const* p = &ib[packets[i].offset];
+            const std::uint32_t got[] = { (p[2] >> 29) & 3, (p[2] >> 20) & 3, (p[5] >> 26) & 1, (p[5] >> 27) & 1 };
+            check(std::equal(got, got + 4, expected[n++]), "GDS: CP_DMA selects and address spaces");
+        }
+    check(n == 3, "GDS: CP_DMA packets");
+}
+
+/// Check that the flags chunk is recorded as it was set.
+void check_flags(radeon_device const& dev)
+{
+    evergreen_command_stream cs(dev);
+    cs.set_flags(RADEON_CS_KEEP_TILING_FLAGS, RADEON_CS_RING_COMPUTE);
+    cs_recording r = cs.record();
+    check(r.flags[0] == RADEON_CS_KEEP_TILING_FLAGS && r.flags[1] == RADEON_CS_RING_COMPUTE, "flags chunk");
+}
+
+/// Check that a pipeline programs its clause temporaries and gives the rest
+/// of the GPRs to the LS stage, as many as NUM_LS_GPRS holds.
+void check_pipeline(radeon_device const& dev, pm4_decoder const& decoder, unsigned temp_gprs)
+{
+    compute_pipeline::desc d;
+    d.handle = 1;
+    d.num_gprs = 8;
+    d.temp_gprs = temp_gprs;
+    d.group[0] = 64;
+    compute_pipeline pipeline(dev, d);
+
+    std::vector<std::uint32_t> const& f = pipeline.fragment();
+    std::vector<pm4_packet> packets = decoder.decode(f.data(), f.size());
+    const std::uint32_t expected[] = {
+        temp_gprs << 28, 0, std::min(256 - 2 * temp_gprs, 255u) << 16 };
+    bool found = false;
+    for (std::size_t i = 0; i < packets.size(); ++i)
+        if (packets[i].reg == SQ_GPR_RESOURCE_MGMT_1 && packets[i].regs == 3)
+            found = std::equal(expected, expected + 3, &f[packets[i].offset + packets[i].size - 3]);
+    check(found, "pipeline: SQ_GPR_RESOURCE_MGMT");
+}
+
+/// Check the command streams of an Evergreen without a GPU: record the IBs
+/// which they would submit and decode them.
+int check_without_gpu()
+{
+    try {
+        radeon_device dev(radeon_device::CHIP_CYPRESS);
+        pm4_decoder decoder(dev.family());
+        check_split(dev, decoder);
+        check_restore(dev, decoder, false);
+        check_restore(dev, decoder, true);
+        check_target_mask(dev, decoder);
+        check_flags(dev);
+        check_gds_dma(dev, decoder);
+        check_pipeline(dev, decoder, 0);
+        check_pipeline(dev, decoder, 4);
+    }
+    catch (std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    catch (std::logic_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << (failures ? "FAILED" : "PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
+
+}
 
 int main(int argc, char* argv[])
 {
@@ -16,10 +275,13 @@ int main(int argc, char* argv[])
     {
         std::cerr
             << "Usage " << argv[0]
-            << " /dev/dri/card?"
+            << " /dev/dri/card? | -n\n\n"
+            << "\t-n\tcheck the command streams of an Evergreen without a GPU"
             << std::endl;
         return 1;
     }
+    if (std::string(argv[1]) == "-n")
+        return check_without_gpu();
 
     try {
         std::cout << "Opening " << argv[1] << std::endl;
@@ -47,8 +309,8 @@ int main(int argc, char* argv[])
         std::cout << "CS id = " << cs.id() << std::endl;
 
         // R6xx requires this packet at the start
-        //cs.write({ PACKET3(PACKET3_START_3D_CMDBUF, 0), 0 });
-        //cs.write({ PACKET3(PACKET3_CONTEXT_CONTROL, 1), 0x80000000, 0x80000000 });
+        //cs.write({ pm4::type3(pm4::op::start_3d_cmdbuf, 1), 0 });
+        //cs.write(pm4::context_control{ 0x80000000, 0x80000000 });
 
         /// According to AMD Radeon R6xx/R7xx Acceleration document version 1.0
         /// section 4.4.1 on page 21:
@@ -59,13 +321,12 @@ int main(int argc, char* argv[])
 
 #if 0
         // Fence, write 32-bit data.
-        cs.write({
-            PACKET3(PACKET3_EVENT_WRITE_EOP, 4),
-            EVENT_TYPE(CACHE_FLUSH_AND_INV_EVENT) | EVENT_INDEX(5),
-            0u & ~0x3u, // lower 32 bits of address
-            DATA_SEL(1) | INT_SEL(0) | ((0ul >> 32) & 0xffu), // upper 32-39
-            0x89abcdef,
-            0x01234567
+        cs.write(pm4::event_write_eop{
+            pm4::cache_flush_and_inv_event,
+            0,  // address, added to the BO's
+            pm4::data_32,
+            pm4::int_none,
+            0x0123456789abcdef
             });
         //cs.write_reloc(bo.handle());
         cs.write_reloc(bo.handle(), 0, bo_domain);
@@ -73,13 +334,12 @@ int main(int argc, char* argv[])
 
 #if 1
         // Fence, write 64-bit data.
-        cs.write({
-            PACKET3(PACKET3_EVENT_WRITE_EOP, 4),
-            CACHE_FLUSH_AND_INV_EVENT, //EVENT_TYPE(CACHE_FLUSH_AND_INV_EVENT) | EVENT_INDEX(0),
-            16u & ~0x3u, // lower 32 bits of address
-            DATA_SEL(2) | INT_SEL(0) | ((16ul >> 32) & 0xffu), // upper 32-39
-            0x89abcdef,
-            0x01234567
+        cs.write(pm4::event_write_eop{
+            pm4::cache_flush_and_inv_event,
+            16, // address, added to the BO's
+            pm4::data_64,
+            pm4::int_none,
+            0x0123456789abcdef
             });
         //cs.write_reloc(bo.handle());
         cs.write_reloc(bo.handle(), 0, bo_domain);
@@ -87,14 +347,12 @@ int main(int argc, char* argv[])
 
 #if 0
         // Write 64-bit timestamp.
-        cs.write({
-            PACKET3(PACKET3_EVENT_WRITE_EOP, 4),
-            //EVENT_TYPE(4) | EVENT_INDEX(5),
-            EVENT_TYPE(CACHE_FLUSH_AND_INV_EVENT_TS) | EVENT_INDEX(5),
-            24u & ~0x3u, // lower 32 bits of address
-            DATA_SEL(3) | INT_SEL(2) | ((24ul >> 32) & 0xffu), // upper 32-39
-            0x89abcdef,
-            0x01234567
+        cs.write(pm4::event_write_eop{
+            pm4::cache_flush_and_inv_ts_event,
+            24, // address, added to the BO's
+            pm4::data_timestamp,
+            pm4::int_confirmed,
+            0
             });
         //cs.write_reloc(bo.handle());
         cs.write_reloc(bo.handle(), 0, bo_domain);
@@ -0,0 +1,67 @@
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include "evergreen_program.hpp"
+#include "gpr_allocator.hpp"
+#include "kernel_analysis.hpp"
+#include "kernel_metadata.hpp"
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2 && argc != 3)
+    {
+        std::cerr
+            << "Usage " << argv[0]
+            << " kernel.bin [allocated.bin]"
+            << std::endl;
+        return 1;
+    }
+
+    try {
+        evergreen_program program = evergreen_program::read(argv[1]);
+
+        // Start from the metadata of the kernel if there is any.
+        kernel_metadata meta;
+        kernel_analysis before(program);
+        std::string meta_path = kernel_metadata::path(argv[1]);
+        if (std::ifstream(meta_path.c_str()))
+            meta = kernel_metadata::read(meta_path.c_str());
+        else {
+            meta.num_gprs = before.num_gprs;
+            meta.temp_gprs = before.temp_gprs;
+            meta.stack_size = before.stack_entries;
+        }
+
+        gpr_allocator allocator;
+        bool changed = allocator.allocate(program);
+        std::cout
+            << "GPRs " << before.num_gprs << " -> " << allocator.num_gprs()
+            << " temp GPRs " << before.temp_gprs << " -> " << allocator.temp_gprs()
+            << " forwarded " << allocator.forwarded()
+            << (changed ? "" : " (unchanged)")
+            << std::endl;
+
+        if (argc == 3) {
+            meta.num_gprs = allocator.num_gprs();
+            meta.temp_gprs = allocator.temp_gprs();
+            program.write(argv[2]);
+            meta.write(kernel_metadata::path(argv[2]).c_str());
+        }
+        return 0;
+    }
+    catch (std::system_error& e) {
+        std::cerr
+            << e.what()
+            << " : "
+            << e.code().message()
+            << std::endl;
+        return 1;
+    }
+    catch (std::runtime_error& e) {
+        std::cerr << argv[1] << " : " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,831 @@
+#include "alu_packer.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+typedef alu_instruction alu;
+
+/// Cycle in which each source is read, for vector and trans bank swizzles.
+const unsigned vector_cycles[6][3] = {
+    { 0, 1, 2 }, { 0, 2, 1 }, { 1, 2, 0 }, { 1, 0, 2 }, { 2, 0, 1 }, { 2, 1, 0 }
+};
+const unsigned scalar_cycles[4][3] = {
+    { 2, 1, 0 }, { 1, 2, 2 }, { 2, 1, 2 }, { 2, 2, 1 }
+};
+
+/// Read port reservations of an instruction group.
+/// Each cycle can read one GPR per channel, and the group can read two
+/// constant pairs (x/y or z/w) from the kcache.
+struct read_ports {
+    int gpr[3][4];
+    int cfile_sel[2];
+    int cfile_chan[2];
+
+    read_ports()
+    {
+        for (unsigned c = 0; c < 3; ++c)
+            for (unsigned e = 0; e < 4; ++e)
+                gpr[c][e] = -1;
+        cfile_sel[0] = cfile_sel[1] = -1;
+        cfile_chan[0] = cfile_chan[1] = -1;
+    }
+
+    bool reserve_gpr(unsigned sel, unsigned chan, unsigned cycle)
+    {
+        if (gpr[cycle][chan] == -1)
+            gpr[cycle][chan] = sel;
+        return gpr[cycle][chan] == int(sel);
+    }
+
+    bool reserve_cfile(unsigned sel, unsigned chan)
+    {
+        for (unsigned i = 0; i < 2; ++i) {
+            if (cfile_sel[i] == -1) {
+                cfile_sel[i] = sel;
+                cfile_chan[i] = chan / 2;
+            }
+            if (cfile_sel[i] == int(sel) && cfile_chan[i] == int(chan / 2))
+                return true;
+        }
+        return false;
+    }
+};
+
+/// Source operand as resolved by the dependence analysis.
+struct operand {
+    enum { OTHER, GPR, FORWARD, LITERAL } kind;
+    int producer;           ///< Member producing the value, or -1 for clause inputs.
+    bool flexible;          ///< Forwarded value which is also in a GPR.
+    uint32_t value;         ///< Literal value.
+};
+
+struct member {
+    alu_instruction inst;
+    unsigned group;         ///< Group in the original region.
+    unsigned slot;          ///< Slot in the original region.
+    operand src[3];
+    unsigned unit;
+    unsigned new_slot;      ///< Slot in the packed region.
+};
+
+/// A set of instructions which must be issued in the same group.
+struct unit {
+    vector<unsigned> members;
+    bool fixed_slots;       ///< Reductions and 64-bit operations keep their slots.
+    unsigned group;
+    vector<unsigned> strict_preds;  ///< Must be issued in an earlier group.
+    vector<unsigned> adj_preds;     ///< Must be issued in the previous group.
+    vector<unsigned> order_preds;   ///< Must not be issued in a later group.
+    vector<unsigned> adj_succs;
+    int height;
+};
+
+/// The result of fitting a set of units into one group.
+struct placement {
+    vector<unsigned> members;
+    vector<unsigned> slots;
+    vector<unsigned> swizzles;
+    vector<uint32_t> literals;
+};
+
+void add_unique(vector<unsigned>& v, unsigned x)
+{
+    if (find(v.begin(), v.end(), x) == v.end())
+        v.push_back(x);
+}
+
+/// This class schedules one region of an ALU clause.
+class region_scheduler {
+public:
+    explicit region_scheduler(vector<alu_group> const& groups) : _groups(groups) {}
+
+    bool run(vector<alu_group>& out);
+
+private:
+    bool analyze();
+    void make_units();
+    void link_units();
+    unsigned find(unsigned m);
+    unsigned rank(unsigned m) const;
+    bool ready(unsigned u, int k) const;
+    bool successors_fit(unsigned u, int k) const;
+    bool fit(vector<unsigned> const& units, int k, placement& p);
+    bool assign(vector<unsigned> const& ms, size_t i, unsigned* slots, bool* used, int k, placement& p);
+    bool swizzle(vector<unsigned> const& ms, unsigned const* slots, size_t i, read_ports ports,
+        int k, unsigned* swz);
+    void effective_source(unsigned m, unsigned s, int k, uint32_t& sel, uint32_t& chan) const;
+    alu_group emit(placement const& p, int k);
+
+    vector<alu_group> const& _groups;
+    vector<member> _members;
+    vector<unsigned> _parent;
+    vector<unit> _units;
+    vector<int> _sched;
+};
+
+unsigned region_scheduler::find(unsigned m)
+{
+    while (_parent[m] != m)
+        m = _parent[m] = _parent[_parent[m]];
+    return m;
+}
+
+unsigned region_scheduler::rank(unsigned m) const
+{
+    alu_instruction const& inst = _members[m].inst;
+    if (_units[_members[m].unit].fixed_slots)
+        return 0;
+    if ((inst.flags() & alu::TRANS_ONLY) != 0)
+        return 1;
+    return inst.writes_gpr() ? 2 : 3;
+}
+
+bool region_scheduler::analyze()
+{
+    vector<int> last_writer(128 * 4, -1);
+
+    for (unsigned g = 0; g < _groups.size(); ++g) {
+        alu_group const& group = _groups[g];
+        unsigned slots[5];
+        group.assign_slots(slots);
+
+        unsigned base = _members.size();
+        for (unsigned i = 0; i < group.slots.size(); ++i) {
+            member m;
+            m.inst = group.slots[i];
+            m.group = g;
+            m.slot = slots[i];
+            m.unit = 0;
+            m.new_slot = 0;
+            _members.push_back(m);
+        }
+        unsigned end = _members.size();
+
+        // Sources are read before any destination of the group is written.
+        for (unsigned i = base; i < end; ++i) {
+            member& m = _members[i];
+            for (unsigned s = 0; s < 3; ++s) {
+                operand& op = m.src[s];
+                op.kind = operand::OTHER;
+                op.producer = -1;
+                op.flexible = false;
+                op.value = 0;
+                if (s >= m.inst.num_sources())
+                    continue;
+
+                alu_source const& src = m.inst.src[s];
+                if (alu::is_gpr(src.sel)) {
+                    unsigned reg = src.sel * 4 + src.chan;
+                    op.kind = operand::GPR;
+                    op.producer = last_writer[reg];
+                }
+                else if (src.sel == alu::ALU_SRC_PV || src.sel == alu::ALU_SRC_PS) {
+                    if (g == 0)
+                        return false;
+                    unsigned slot = src.sel == alu::ALU_SRC_PS ? 4 : src.chan;
+                    int p = -1;
+                    for (unsigned j = 0; j < base; ++j)
+                        if (_members[j].group == g - 1 && _members[j].slot == slot)
+                            p = j;
+                    if (p == -1)
+                        return false;
+                    alu_instruction const& prod = _members[p].inst;
+                    op.kind = operand::FORWARD;
+                    op.producer = p;
+                    if (prod.writes_gpr() && alu::is_gpr(prod.dst_gpr)) {
+                        unsigned reg = prod.dst_gpr * 4 + prod.dst_chan;
+                        op.flexible = last_writer[reg] == p;
+                    }
+                }
+                else if (src.sel == alu::ALU_SRC_LITERAL) {
+                    if (src.chan >= group.literals.size())
+                        return false;
+                    op.kind = operand::LITERAL;
+                    op.value = group.literals[src.chan];
+                }
+            }
+        }
+
+        for (unsigned i = base; i < end; ++i) {
+            member& m = _members[i];
+            if (!m.inst.writes_gpr())
+                continue;
+            if (!alu::is_gpr(m.inst.dst_gpr))
+                return false;
+            unsigned reg = m.inst.dst_gpr * 4 + m.inst.dst_chan;
+            if (last_writer[reg] >= int(base))
+                return false;
+            last_writer[reg] = i;
+        }
+    }
+    return true;
+}
+
+void region_scheduler::make_units()
+{
+    _parent.resize(_members.size());
+    for (unsigned m = 0; m < _members.size(); ++m)
+        _parent[m] = m;
+
+    // Reductions and 64-bit operations of a group go together.
+    for (unsigned m = 0; m < _members.size(); ++m) {
+        if ((_members[m].inst.flags() & (alu::REDUCTION | alu::DOUBLE)) == 0)
+            continue;
+        for (unsigned n = 0; n < m; ++n)
+            if (_members[n].group == _members[m].group &&
+                (_members[n].inst.flags() & (alu::REDUCTION | alu::DOUBLE)) != 0)
+                _parent[find(m)] = find(n);
+    }
+
+    // Values forwarded through PV and PS which are not also in a GPR must be
+    // produced in the group just before the consumers, so the producers of
+    // every unit must go together.
+    for (bool changed = true; changed; ) {
+        changed = false;
+        vector<int> first(_members.size(), -1);
+        for (unsigned m = 0; m < _members.size(); ++m) {
+            unsigned root = find(m);
+            for (unsigned s = 0; s < 3; ++s) {
+                operand const& op = _members[m].src[s];
+                if (op.kind != operand::FORWARD || op.flexible)
+                    continue;
+                unsigned p = find(op.producer);
+                if (first[root] == -1)
+                    first[root] = p;
+                else if (find(first[root]) != p) {
+                    _parent[p] = find(first[root]);
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+void region_scheduler::link_units()
+{
+    for (bool merged = true; merged; ) {
+        merged = false;
+
+        vector<int> index(_members.size(), -1);
+        _units.clear();
+        for (unsigned m = 0; m < _members.size(); ++m) {
+            unsigned root = find(m);
+            if (index[root] == -1) {
+                index[root] = _units.size();
+                _units.push_back(unit());
+                _units.back().fixed_slots = false;
+                _units.back().group = _members[m].group;
+                _units.back().height = 0;
+            }
+            unit& u = _units[index[root]];
+            u.members.push_back(m);
+            if ((_members[m].inst.flags() & (alu::REDUCTION | alu::DOUBLE)) != 0)
+                u.fixed_slots = true;
+            _members[m].unit = index[root];
+        }
+
+        // Collect the unit level edges.
+        for (unsigned m = 0; m < _members.size(); ++m) {
+            member const& mm = _members[m];
+            unit& u = _units[mm.unit];
+            for (unsigned s = 0; s < 3; ++s) {
+                operand const& op = mm.src[s];
+                if (op.producer < 0)
+                    continue;
+                unsigned p = _members[op.producer].unit;
+                if (op.kind == operand::FORWARD && !op.flexible)
+                    add_unique(u.adj_preds, p);
+                else if (p != mm.unit)
+                    add_unique(u.strict_preds, p);
+            }
+        }
+
+        // Writers go after the readers of the value they overwrite, and
+        // after the previous writer.
+        vector<int> last_writer(128 * 4, -1);
+        vector<vector<unsigned> > readers(128 * 4);
+        for (unsigned m = 0; m < _members.size(); ) {
+            unsigned g = _members[m].group;
+            unsigned end = m;
+            while (end < _members.size() && _members[end].group == g)
+                ++end;
+            for (unsigned i = m; i < end; ++i)
+                for (unsigned s = 0; s < 3; ++s) {
+                    operand const& op = _members[i].src[s];
+                    unsigned reg;
+                    if (op.kind == operand::GPR) {
+                        alu_source const& src = _members[i].inst.src[s];
+                        reg = src.sel * 4 + src.chan;
+                    }
+                    else if (op.kind == operand::FORWARD && op.flexible) {
+                        alu_instruction const& prod = _members[op.producer].inst;
+                        reg = prod.dst_gpr * 4 + prod.dst_chan;
+                    }
+                    else
+                        continue;
+                    readers[reg].push_back(i);
+                }
+            for (unsigned i = m; i < end; ++i) {
+                alu_instruction const& inst = _members[i].inst;
+                if (!inst.writes_gpr())
+                    continue;
+                unsigned reg = inst.dst_gpr * 4 + inst.dst_chan;
+                unit& u = _units[_members[i].unit];
+                for (size_t r = 0; r < readers[reg].size(); ++r)
+                    if (_members[readers[reg][r]].unit != _members[i].unit)
+                        add_unique(u.order_preds, _members[readers[reg][r]].unit);
+                if (last_writer[reg] >= 0)
+                    add_unique(u.strict_preds, _members[last_writer[reg]].unit);
+                last_writer[reg] = i;
+                readers[reg].clear();
+            }
+            m = end;
+        }
+
+        // Units which must not go after each other must go together.
+        for (unsigned a = 0; a < _units.size() && !merged; ++a)
+            for (size_t i = 0; i < _units[a].order_preds.size(); ++i) {
+                unsigned b = _units[a].order_preds[i];
+                vector<unsigned> const& rev = _units[b].order_preds;
+                if (std::find(rev.begin(), rev.end(), a) != rev.end()) {
+                    _parent[find(_units[a].members[0])] = find(_units[b].members[0]);
+                    merged = true;
+                    break;
+                }
+            }
+    }
+
+    for (unsigned u = 0; u < _units.size(); ++u)
+        for (size_t i = 0; i < _units[u].adj_preds.size(); ++i)
+            add_unique(_units[_units[u].adj_preds[i]].adj_succs, u);
+
+    // Height of each unit over the dependence graph, used as priority.
+    // Units are numbered in order of their first member, so edges go
+    // from lower to higher numbers except for same-group ordering.
+    for (unsigned pass = 0; pass < 2; ++pass)
+        for (unsigned u = _units.size(); u-- > 0; ) {
+            unit const& cu = _units[u];
+            for (size_t i = 0; i < cu.strict_preds.size(); ++i) {
+                unit& p = _units[cu.strict_preds[i]];
+                p.height = max(p.height, cu.height + 1);
+            }
+            for (size_t i = 0; i < cu.adj_preds.size(); ++i) {
+                unit& p = _units[cu.adj_preds[i]];
+                p.height = max(p.height, cu.height + 1);
+            }
+            for (size_t i = 0; i < cu.order_preds.size(); ++i) {
+                unit& p = _units[cu.order_preds[i]];
+                p.height = max(p.height, cu.height);
+            }
+        }
+}
+
+bool region_scheduler::ready(unsigned u, int k) const
+{
+    unit const& cu = _units[u];
+    for (size_t i = 0; i < cu.strict_preds.size(); ++i) {
+        int s = _sched[cu.strict_preds[i]];
+        if (s < 0 || s >= k)
+            return false;
+    }
+    for (size_t i = 0; i < cu.adj_preds.size(); ++i)
+        if (k == 0 || _sched[cu.adj_preds[i]] != k - 1)
+            return false;
+    for (size_t i = 0; i < cu.order_preds.size(); ++i) {
+        int s = _sched[cu.order_preds[i]];
+        if (s < 0 || s > k)
+            return false;
+    }
+    return true;
+}
+
+bool region_scheduler::successors_fit(unsigned u, int k) const
+{
+    // Every consumer of a value forwarded from this unit must be able to
+    // go into the next group.
+    unit const& cu = _units[u];
+    for (size_t i = 0; i < cu.adj_succs.size(); ++i) {
+        unit const& c = _units[cu.adj_succs[i]];
+        for (size_t j = 0; j < c.strict_preds.size(); ++j) {
+            int s = _sched[c.strict_preds[j]];
+            if (s < 0 || s > k)
+                return false;
+        }
+        for (size_t j = 0; j < c.adj_preds.size(); ++j)
+            if (_sched[c.adj_preds[j]] != k)
+                return false;
+        for (size_t j = 0; j < c.order_preds.size(); ++j) {
+            int s = _sched[c.order_preds[j]];
+            if (s < 0 || s > k)
+                return false;
+        }
+    }
+    return true;
+}
+
+void region_scheduler::effective_source(unsigned m, unsigned s, int k, uint32_t& sel, uint32_t& chan) const
+{
+    member const& mm = _members[m];
+    operand const& op = mm.src[s];
+    sel = mm.inst.src[s].sel;
+    chan = mm.inst.src[s].chan;
+
+    if (op.kind == operand::FORWARD) {
+        member const& prod = _members[op.producer];
+        if (_sched[prod.unit] == k - 1) {
+            sel = prod.new_slot == 4 ? alu::ALU_SRC_PS : alu::ALU_SRC_PV;
+            chan = prod.new_slot == 4 ? 0 : prod.new_slot;
+        }
+        else {
+            sel = prod.inst.dst_gpr;
+            chan = prod.inst.dst_chan;
+        }
+    }
+}
+
+bool region_scheduler::swizzle(vector<unsigned> const& ms, unsigned const* slots, size_t i,
+    read_ports ports, int k, unsigned* swz)
+{
+    if (i == ms.size())
+        return true;
+
+    member const& mm = _members[ms[i]];
+    unsigned n = mm.inst.num_sources();
+    uint32_t sel[3], chan[3];
+    for (unsigned s = 0; s < n; ++s)
+        effective_source(ms[i], s, k, sel[s], chan[s]);
+
+    if (slots[i] < 4) {
+        for (unsigned bs = 0; bs < 6; ++bs) {
+            read_ports r = ports;
+            bool ok = true;
+            for (unsigned s = 0; s < n && ok; ++s) {
+                if (alu::is_gpr(sel[s])) {
+                    if (s == 1 && sel[1] == sel[0] && chan[1] == chan[0])
+                        continue;
+                    ok = r.reserve_gpr(sel[s], chan[s], vector_cycles[bs][s]);
+                }
+                else if (alu::is_kcache(sel[s]))
+                    ok = r.reserve_cfile(sel[s], chan[s]);
+            }
+            if (ok && swizzle(ms, slots, i + 1, r, k, swz)) {
+                swz[i] = bs;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    for (unsigned bs = 0; bs < 4; ++bs) {
+        read_ports r = ports;
+        bool ok = true;
+        unsigned consts = 0;
+        for (unsigned s = 0; s < n && ok; ++s) {
+            if (alu::is_kcache(sel[s]) || alu::is_inline_constant(sel[s])) {
+                ok = consts++ < 2;
+                if (ok && alu::is_kcache(sel[s]))
+                    ok = r.reserve_cfile(sel[s], chan[s]);
+            }
+        }
+        for (unsigned s = 0; s < n && ok; ++s) {
+            unsigned cycle = scalar_cycles[bs][s];
+            if (alu::is_gpr(sel[s]))
+                ok = cycle >= consts && r.reserve_gpr(sel[s], chan[s], cycle);
+            else if (consts != 0 && (sel[s] == alu::ALU_SRC_PV || sel[s] == alu::ALU_SRC_PS))
+                ok = cycle >= consts;
+        }
+        if (ok && swizzle(ms, slots, i + 1, r, k, swz)) {
+            swz[i] = bs;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool region_scheduler::assign(vector<unsigned> const& ms, size_t i, unsigned* slots, bool* used,
+    int k, placement& p)
+{
+    if (i == ms.size()) {
+        // An instruction only goes to the trans slot if the vector slot of
+        // its channel is taken.
+        for (size_t j = 0; j < ms.size(); ++j) {
+            if (slots[j] != 4)
+                continue;
+            alu_instruction const& inst = _members[ms[j]].inst;
+            if ((inst.flags() & alu::TRANS_ONLY) != 0)
+                continue;
+            if (inst.writes_gpr() ? !used[inst.dst_chan] :
+                !(used[0] || used[1] || used[2] || used[3]))
+                return false;
+        }
+
+        for (size_t j = 0; j < ms.size(); ++j)
+            _members[ms[j]].new_slot = slots[j];
+        unsigned swz[5];
+        if (!swizzle(ms, slots, 0, read_ports(), k, swz))
+            return false;
+
+        p.members = ms;
+        p.slots.assign(slots, slots + ms.size());
+        p.swizzles.assign(swz, swz + ms.size());
+        return true;
+    }
+
+    member const& mm = _members[ms[i]];
+    unsigned flags = mm.inst.flags();
+    unsigned options[5];
+    unsigned n = 0;
+    if (_units[mm.unit].fixed_slots)
+        options[n++] = mm.slot;
+    else if ((flags & alu::TRANS_ONLY) != 0)
+        options[n++] = 4;
+    else {
+        if (mm.inst.writes_gpr())
+            options[n++] = mm.inst.dst_chan;
+        else
+            for (unsigned s = 0; s < 4; ++s)
+                options[n++] = s;
+        if ((flags & alu::VECTOR_ONLY) == 0)
+            options[n++] = 4;
+    }
+
+    for (unsigned o = 0; o < n; ++o) {
+        unsigned s = options[o];
+        if (used[s])
+            continue;
+        used[s] = true;
+        slots[i] = s;
+        if (assign(ms, i + 1, slots, used, k, p))
+            return true;
+        used[s] = false;
+    }
+    return false;
+}
+
+bool region_scheduler::fit(vector<unsigned> const& units, int k, placement& p)
+{
+    vector<unsigned> ms;
+    for (size_t i = 0; i < units.size(); ++i)
+        ms.insert(ms.end(), _units[units[i]].members.begin(), _units[units[i]].members.end());
+    if (ms.size() > 5)
+        return false;
+
+    vector<uint32_t> literals;
+    for (size_t i = 0; i < ms.size(); ++i)
+        for (unsigned s = 0; s < 3; ++s) {
+            operand const& op = _members[ms[i]].src[s];
+            if (op.kind == operand::LITERAL &&
+                std::find(literals.begin(), literals.end(), op.value) == literals.end())
+                literals.push_back(op.value);
+        }
+    if (literals.size() > 4)
+        return false;
+
+    // Try the most constrained instructions first.
+    stable_sort(ms.begin(), ms.end(), [this](unsigned a, unsigned b) {
+        return this->rank(a) < this->rank(b);
+    });
+
+    unsigned slots[5];
+    bool used[5] = { false, false, false, false, false };
+    if (!assign(ms, 0, slots, used, k, p))
+        return false;
+    p.literals = literals;
+    return true;
+}
+
+alu_group region_scheduler::emit(placement const& p, int k)
+{
+    vector<size_t> order(p.members.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    sort(order.begin(), order.end(), [&p](size_t a, size_t b) {
+        return p.slots[a] < p.slots[b];
+    });
+
+    bool used[4] = { false, false, false, false };
+    for (size_t i = 0; i < p.members.size(); ++i)
+        if (p.slots[i] < 4)
+            used[p.slots[i]] = true;
+
+    alu_group group;
+    group.literals = p.literals;
+    for (size_t o = 0; o < order.size(); ++o) {
+        size_t i = order[o];
+        unsigned m = p.members[i];
+        alu_instruction inst = _members[m].inst;
+        unsigned slot = p.slots[i];
+
+        if (!inst.writes_gpr() && !_units[_members[m].unit].fixed_slots) {
+            if (slot < 4)
+                inst.dst_chan = slot;
+            else if ((inst.flags() & alu::TRANS_ONLY) == 0)
+                inst.dst_chan = used[0] ? 0 : used[1] ? 1 : used[2] ? 2 : 3;
+        }
+
+        for (unsigned s = 0; s < inst.num_sources(); ++s) {
+            operand const& op = _members[m].src[s];
+            if (op.kind == operand::FORWARD) {
+                uint32_t sel, chan;
+                effective_source(m, s, k, sel, chan);
+                inst.src[s].sel = sel;
+                inst.src[s].chan = chan;
+                inst.src[s].rel = false;
+            }
+            else if (op.kind == operand::LITERAL) {
+                inst.src[s].chan =
+                    std::find(p.literals.begin(), p.literals.end(), op.value) - p.literals.begin();
+            }
+        }
+        inst.bank_swizzle = p.swizzles[i];
+        inst.last = o + 1 == order.size();
+        group.slots.push_back(inst);
+    }
+    return group;
+}
+
+bool region_scheduler::run(vector<alu_group>& out)
+{
+    if (!analyze())
+        return false;
+    make_units();
+    link_units();
+
+    _sched.assign(_units.size(), -1);
+    vector<unsigned> order(_units.size());
+    for (unsigned u = 0; u < order.size(); ++u)
+        order[u] = u;
+    stable_sort(order.begin(), order.end(), [this](unsigned a, unsigned b) {
+        return _units[a].height > _units[b].height;
+    });
+
+    vector<unsigned> forced;
+    unsigned remaining = _units.size();
+    vector<alu_group> groups;
+
+    for (int k = 0; remaining != 0; ++k) {
+        if (size_t(k) >= _groups.size())
+            return false;
+
+        vector<unsigned> current;
+        placement p;
+        for (size_t i = 0; i < forced.size(); ++i) {
+            if (!ready(forced[i], k))
+                return false;
+            current.push_back(forced[i]);
+            _sched[forced[i]] = k;
+        }
+        if (!current.empty() && !fit(current, k, p))
+            return false;
+
+        vector<unsigned> next;
+        for (size_t i = 0; i < current.size(); ++i)
+            for (size_t j = 0; j < _units[current[i]].adj_succs.size(); ++j)
+                add_unique(next, _units[current[i]].adj_succs[j]);
+
+        for (bool changed = true; changed; ) {
+            changed = false;
+            for (size_t i = 0; i < order.size(); ++i) {
+                unsigned u = order[i];
+                if (_sched[u] >= 0 || !ready(u, k))
+                    continue;
+
+                _sched[u] = k;
+                current.push_back(u);
+                placement q;
+                bool ok = successors_fit(u, k) && fit(current, k, q);
+                vector<unsigned> candidate = next;
+                for (size_t j = 0; ok && j < _units[u].adj_succs.size(); ++j)
+                    add_unique(candidate, _units[u].adj_succs[j]);
+                if (ok && candidate.size() != next.size()) {
+                    placement r;
+                    ok = fit(candidate, k + 1, r);
+                }
+                if (!ok) {
+                    current.pop_back();
+                    _sched[u] = -1;
+                    continue;
+                }
+                p = q;
+                next.swap(candidate);
+                changed = true;
+            }
+        }
+
+        if (current.empty())
+            return false;
+        for (size_t i = 0; i < p.members.size(); ++i)
+            _members[p.members[i]].new_slot = p.slots[i];
+        groups.push_back(emit(p, k));
+        remaining -= current.size();
+        forced.swap(next);
+    }
+
+    out.swap(groups);
+    return true;
+}
+
+}
+
+void alu_utilization::add(vector<alu_group> const& clause)
+{
+    ++clauses;
+    groups += clause.size();
+    for (size_t i = 0; i < clause.size(); ++i) {
+        instructions += clause[i].slots.size();
+        literals += clause[i].literals.size();
+        size += clause[i].size();
+    }
+}
+
+bool alu_packer::pack(vector<alu_group>& clause)
+{
+    _before.add(clause);
+
+    // Groups with side effects stay where they are.
+    vector<bool> fixed(clause.size(), false);
+    vector<bool> forwards(clause.size(), false);
+    for (size_t g = 0; g < clause.size(); ++g) {
+        unsigned slots[5];
+        try {
+            clause[g].assign_slots(slots);
+        }
+        catch (std::runtime_error&) {
+            _after.add(clause);
+            return false;
+        }
+        for (size_t i = 0; i < clause[g].slots.size(); ++i) {
+            alu_instruction const& inst = clause[g].slots[i];
+            if ((inst.flags() & alu::ORDERED) != 0 || inst.update_exec_mask ||
+                inst.update_pred || inst.dst_rel)
+                fixed[g] = true;
+            for (unsigned s = 0; s < inst.num_sources(); ++s) {
+                alu_source const& src = inst.src[s];
+                if (src.rel || (src.sel >= alu::ALU_SRC_LDS_OQ_A && src.sel <= alu::ALU_SRC_MASK_LO))
+                    fixed[g] = true;
+                if (src.sel == alu::ALU_SRC_PV || src.sel == alu::ALU_SRC_PS)
+                    forwards[g] = true;
+            }
+        }
+    }
+    if (!clause.empty() && forwards[0])
+        fixed[0] = true;
+
+    // Values forwarded into or out of a fixed group tie the neighbour to it.
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (size_t g = 1; g < clause.size(); ++g)
+            if (forwards[g] && fixed[g] != fixed[g - 1]) {
+                fixed[g] = fixed[g - 1] = true;
+                changed = true;
+            }
+    }
+
+    vector<alu_group> result;
+    for (size_t g = 0; g < clause.size(); ) {
+        if (fixed[g]) {
+            result.push_back(clause[g++]);
+            continue;
+        }
+        size_t end = g;
+        while (end < clause.size() && !fixed[end])
+            ++end;
+
+        vector<alu_group> region(clause.begin() + g, clause.begin() + end);
+        vector<alu_group> packed;
+        bool ok = false;
+        if (region.size() > 1) {
+            ++_regions;
+            try {
+                ok = region_scheduler(region).run(packed) && packed.size() < region.size();
+            }
+            catch (std::runtime_error&) {
+                ok = false;
+            }
+        }
+        if (ok) {
+            ++_packed;
+            result.insert(result.end(), packed.begin(), packed.end());
+        }
+        else
+            result.insert(result.end(), region.begin(), region.end());
+        g = end;
+    }
+
+    bool changed = result.size() != clause.size();
+    if (changed)
+        clause.swap(result);
+    _after.add(clause);
+    return changed;
+}
+
+void alu_packer::pack(evergreen_program& program)
+{
+    for (size_t i = 0; i < program.size(); ++i)
+        if (program[i].cf.is_alu())
+            pack(program[i].alu);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "evergreen_program.hpp"
+
+#include <vector>
+
+/// This structure accumulates slot utilization statistics of ALU clauses.
+struct alu_utilization {
+    unsigned clauses;       ///< Number of ALU clauses.
+    unsigned groups;        ///< Number of instruction groups.
+    unsigned instructions;  ///< Number of ALU instructions.
+    unsigned literals;      ///< Number of literal double words.
+    unsigned size;          ///< Size of the clauses in 64-bit words.
+
+    alu_utilization() : clauses(), groups(), instructions(), literals(), size() {}
+
+    /// Add the statistics of a clause.
+    void add(std::vector<alu_group> const& clause);
+
+    /// Get the fraction of the x, y, z, w and t slots which are in use.
+    double ratio() const { return groups ? double(instructions) / (5 * groups) : 0; }
+};
+
+/// This class repacks the instruction groups of ALU clauses so that the
+/// five slots of the VLIW are better used.
+///
+/// The instructions of a clause are scheduled again over a dependence graph
+/// which honours GPR dependences, PV and PS forwarding, the limit of four
+/// literal constants per group, the slot restrictions of each opcode and
+/// the read port restrictions of the bank swizzles.
+/// Groups with side effects (predicate updates, LDS accesses, barriers,
+/// relative addressing, time counters...) are never moved and split the
+/// clause into regions which are packed independently. A region is kept as
+/// it was if it cannot be packed into fewer groups.
+class alu_packer {
+public:
+    alu_packer() : _regions(), _packed() {}
+
+    /// Pack one ALU clause in place.
+    /// \returns Whether the clause has changed.
+    bool pack(std::vector<alu_group>& clause);
+    /// Pack every ALU clause of a program.
+    void pack(evergreen_program& program);
+
+    /// Access the statistics of the clauses before packing.
+    alu_utilization const& before() const { return _before; }
+    /// Access the statistics of the clauses after packing.
+    alu_utilization const& after() const { return _after; }
+    /// Get the number of regions which were considered for packing.
+    unsigned regions() const { return _regions; }
+    /// Get the number of regions which were packed into fewer groups.
+    unsigned packed() const { return _packed; }
+
+private:
+    alu_utilization _before;
+    alu_utilization _after;
+    unsigned _regions;
+    unsigned _packed;
+};
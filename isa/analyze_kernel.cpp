@@ -0,0 +1,48 @@
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+
+#include "evergreen_program.hpp"
+#include "evergreen_disassembler.hpp"
+#include "kernel_analysis.hpp"
+
+int main(int argc, char* argv[])
+{
+    bool listing = argc == 3 && std::strcmp(argv[1], "-d") == 0;
+    if (argc != 2 && !listing)
+    {
+        std::cerr
+            << "Usage " << argv[0]
+            << " [-d] kernel.bin"
+            << std::endl;
+        return 1;
+    }
+    const char* path = argv[argc - 1];
+
+    try {
+        evergreen_program program = evergreen_program::read(path);
+
+        if (listing) {
+            evergreen_disassembler disassembler(std::cout);
+            disassembler.print(program);
+        }
+        else {
+            kernel_analysis analysis(program);
+            analysis.write_json(std::cout);
+        }
+        return 0;
+    }
+    catch (std::system_error& e) {
+        std::cerr
+            << e.what()
+            << " : "
+            << e.code().message()
+            << std::endl;
+        return 1;
+    }
+    catch (std::runtime_error& e) {
+        std::cerr << path << " : " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,178 @@
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "evergreen_emulator.hpp"
+#include "microbenchmark.hpp"
+#include "sample_host.hpp"
+#include "scheduling_trace.hpp"
+
+using namespace std;
+
+namespace {
+
+/// Items of the dispatch: one wavefront.
+const int items = 64;
+
+vector<unsigned> parse_opcodes(string const& list)
+{
+    vector<unsigned> ops;
+    istringstream in(list);
+    for (string item; getline(in, item, ','); )
+        ops.push_back(alu_microbenchmark::find(item));
+    return ops;
+}
+
+/// Print a buffer as the timing host does, four columns with addresses.
+void print(ostream& os, vector<uint32_t> const& buffer)
+{
+    os << hex << right;
+    for (size_t i = 0; i < buffer.size(); i += 4) {
+        os << setfill(' ') << setw(6) << i << ':';
+        for (size_t k = i; k < i + 4 && k < buffer.size(); ++k)
+            os << '\t' << setfill('0') << setw(8) << buffer[k];
+        os << '\n';
+    }
+    os << dec;
+}
+
+/// Get the output of a benchmark from the text printed by the host.
+vector<uint32_t> parse_output(string const& text)
+{
+    vector<uint32_t> words;
+    scheduling_trace::parse(text.data(), text.data() + text.size(), words);
+    return words;
+}
+
+string read_text(string const& path)
+{
+    ifstream file(path.c_str(), ios::in | ios::binary);
+    if (!file)
+        throw system_error(error_code(errno, system_category()), path);
+    ostringstream text;
+    text << file.rdbuf();
+    return text.str();
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned length = 8;
+    vector<unsigned> ops;
+    const char* generate = 0;
+    const char* results = 0;
+    const char* table_path = "alu_timing.tsv";
+    string device_name;
+    bool emulate = false;
+
+    for (int opt = 0; (opt = getopt(argc, argv, "g:r:d:t:n:o:e")) != -1; )
+        switch (opt) {
+            case 'g': generate = optarg; break;
+            case 'r': results = optarg; break;
+            case 'd': device_name = optarg; break;
+            case 't': table_path = optarg; break;
+            case 'n': length = atoi(optarg); break;
+            case 'o':
+                try {
+                    ops = parse_opcodes(optarg);
+                }
+                catch (runtime_error& e) {
+                    cerr << e.what() << endl;
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'e': emulate = true; break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    if (optind != argc || (generate != 0) + (results != 0) + emulate != 1 || (results && device_name.empty())) {
+        cerr << "Usage: " << argv[0] << " -g<dir> [-n<n>] [-o<op>,...]\n"
+            "       " << argv[0] << " -r<dir> -d<device> [-t<table>] [-n<n>] [-o<op>,...]\n"
+            "       " << argv[0] << " -e [-d<device>] [-t<table>] [-n<n>] [-o<op>,...]\n\n"
+            "\tGenerate the latency and throughput benchmarks of the ALU instructions\n"
+            "\tin every slot, for the timing host, and print the commands which run them;\n"
+            "\tor read their outputs and record the cycles in the timing table; or run\n"
+            "\tthem on the emulator and record its cycles.\n\n"
+            "\t-g <d>\tdirectory of the kernels (timing-<benchmark>.bin)\n"
+            "\t-r <d>\tdirectory of the outputs (timing-<benchmark>.out)\n"
+            "\t-e\trun on the emulator\n"
+            "\t-d <s>\tdevice family of the outputs (emulator with -e)\n"
+            "\t-t <f>\ttiming table, rows of other devices are kept (alu_timing.tsv)\n"
+            "\t-n <n>\tinstruction groups in the first segment (8)\n"
+            "\t-o <l>\topcodes to measure (every one)\n" << endl;
+        return EXIT_FAILURE;
+    }
+    if (device_name.empty())
+        device_name = "emulator";
+
+    try {
+        vector<alu_microbenchmark> benchmarks = alu_microbenchmark::all(ops, length);
+
+        if (generate) {
+            for (size_t i = 0; i < benchmarks.size(); ++i) {
+                string name = benchmarks[i].name();
+                benchmarks[i].program().write((string(generate) + "/timing-" + name + ".bin").c_str());
+                cout << "./timing -s-" << name << " -x " << items << " > timing-" << name << ".out\n";
+            }
+            return EXIT_SUCCESS;
+        }
+
+        alu_timing_table table = alu_timing_table::read(table_path);
+        table.clear(device_name);
+        unsigned measured = 0;
+        for (size_t i = 0; i < benchmarks.size(); ++i) {
+            alu_microbenchmark const& b = benchmarks[i];
+            try {
+                string text;
+                if (emulate) {
+                    evergreen_program program = b.program();
+                    int size[] = { items, 1, 1 }, groups[] = { 1, 1, 1 };
+                    sample_host host(sample_host::TIMING, size, groups, 16);
+                    evergreen_emulator emulator(program, 1);
+                    emulator.run(host.get_dispatch());
+                    ostringstream out;
+                    print(out, host.output());
+                    text = out.str();
+                }
+                else
+                    text = read_text(string(results) + "/timing-" + b.name() + ".out");
+                double cycles = b.cycles(parse_output(text));
+                table.set(device_name, b, cycles);
+                ++measured;
+                cout << b.name() << '\t' << cycles << '\n';
+            }
+            catch (system_error& e) {
+                cerr << e.what() << " : " << e.code().message() << endl;
+            }
+            catch (runtime_error& e) {
+                cerr << b.name() << " : " << e.what() << endl;
+            }
+        }
+        cout << "Measured " << measured << " of " << benchmarks.size() << " benchmarks" << endl;
+        table.write(table_path);
+        return EXIT_SUCCESS;
+    }
+    catch (system_error& e) {
+        cerr
+            << e.what()
+            << " : "
+            << e.code().message()
+            << endl;
+        return EXIT_FAILURE;
+    }
+    catch (runtime_error& e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,207 @@
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "scan_primitives.hpp"
+
+using namespace std;
+
+namespace {
+
+typedef chrono::steady_clock clock_type;
+
+const char* const kind_names[] = { "inclusive", "exclusive", "reduce" };
+
+double seconds(clock_type::time_point start)
+{
+    return chrono::duration<double>(clock_type::now() - start).count();
+}
+
+vector<size_t> parse_sizes(string const& list)
+{
+    vector<size_t> sizes;
+    istringstream in(list);
+    for (string item; getline(in, item, ','); ) {
+        size_t n = strtoul(item.c_str(), 0, 0);
+        if (n == 0)
+            throw runtime_error("bad size " + item);
+        sizes.push_back(n);
+    }
+    return sizes;
+}
+
+/// Make an input whose scans are exact in any order: any integers, and
+/// floats which are small integers, so that their sums stay exact below
+/// 2^24.
+vector<uint32_t> make_input(scan_operator o, size_t n)
+{
+    mt19937 random(n);
+    vector<uint32_t> in(n);
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t r = random();
+        if (o.type == scan_operator::F32) {
+            float f = float(int(r % 17) - 8);
+            memcpy(&in[i], &f, sizeof(f));
+        }
+        else if (o.type == scan_operator::I32)
+            in[i] = uint32_t(int32_t(r % 2001) - 1000);
+        else
+            in[i] = r;
+    }
+    return in;
+}
+
+/// Run a kind of scan or reduction, on the emulator or with the reference.
+void run(scan_primitive& primitive, unsigned k, bool emulate, vector<uint32_t> const& in, vector<uint32_t>& out)
+{
+    scan_operator o = primitive.get_operator();
+    if (emulate) {
+        if (k == scan_kernel::INCLUSIVE)
+            primitive.inclusive(in, out);
+        else if (k == scan_kernel::EXCLUSIVE)
+            primitive.exclusive(in, out);
+        else
+            out.assign(1, primitive.reduce(in));
+        return;
+    }
+    if (k == scan_kernel::REDUCE) {
+        out.assign(1, scan_reference::reduce(o, &in[0], in.size()));
+        return;
+    }
+    out.resize(in.size());
+    if (k == scan_kernel::INCLUSIVE)
+        scan_reference::inclusive(o, &in[0], &out[0], in.size());
+    else
+        scan_reference::exclusive(o, &in[0], &out[0], in.size());
+}
+
+/// Get the elements per second of the fastest of several runs.
+double throughput(scan_primitive& primitive, unsigned k, bool emulate, unsigned repeat,
+                  vector<uint32_t> const& in, vector<uint32_t>& out)
+{
+    double best = 0;
+    for (unsigned r = 0; r < repeat; ++r) {
+        clock_type::time_point start = clock_type::now();
+        run(primitive, k, emulate, in, out);
+        double elapsed = seconds(start);
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best > 0 ? in.size() / best : 0;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    string op = "add-u32", sizes = "1024,16384,262144,1048576";
+    unsigned items = 8, group_size = 64, repeat = 3, threads = 0;
+    const char* generate = 0;
+
+    for (int opt = 0; (opt = getopt(argc, argv, "o:k:g:n:r:j:w:")) != -1; )
+        switch (opt) {
+            case 'o': op = optarg; break;
+            case 'k': items = strtoul(optarg, 0, 0); break;
+            case 'g': group_size = strtoul(optarg, 0, 0); break;
+            case 'n': sizes = optarg; break;
+            case 'r': repeat = strtoul(optarg, 0, 0); break;
+            case 'j': threads = strtoul(optarg, 0, 0); break;
+            case 'w': generate = optarg; break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    if (optind != argc || repeat == 0) {
+        cerr << "Usage: " << argv[0] << " [-o<op>] [-k<n>] [-g<n>] [-n<n>,...] [-r<n>] [-j<n>] [-w<dir>]\n\n"
+            "\tRun the inclusive and exclusive scans and the reduction of arrays of\n"
+            "\tevery size on the emulator, check them against the reference and\n"
+            "\treport the elements per second of both; or write the kernels.\n"
+            "\tFloats are small integers, so that their sums are exact.\n\n"
+            "\t-o <s>\toperator, add, min or max of u32, i32 or f32 (add-u32)\n"
+            "\t-k <n>\telements per work-item, a multiple of 4 (8)\n"
+            "\t-g <n>\twork-items per group (64)\n"
+            "\t-n <l>\telements of the arrays (1024,16384,262144,1048576)\n"
+            "\t-r <n>\truns of which the fastest is reported (3)\n"
+            "\t-j <n>\thost threads of the emulator (one per processor)\n"
+            "\t-w <d>\twrite the kernels to a directory (<kernel>.bin) and exit\n" << endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        scan_operator o = scan_operator::find(op);
+
+        if (generate) {
+            for (unsigned k = 0; k < 3; ++k)
+                for (unsigned offsets = 0; offsets < (k == scan_kernel::REDUCE ? 1u : 2u); ++offsets) {
+                    scan_kernel kernel(o, scan_kernel::kind(k), items, group_size, offsets);
+                    kernel.program().write((string(generate) + '/' + kernel.name() + ".bin").c_str());
+                    cout << kernel.name() << ".bin\t" << kernel.gprs() << " GPRs, "
+                         << kernel.lds_size() << " LDS double words\n";
+                }
+            return EXIT_SUCCESS;
+        }
+
+        vector<size_t> n = parse_sizes(sizes);
+        scan_primitive primitive(o, items, group_size, threads);
+        bool passed = true;
+
+        cout << o.name() << ", " << items << " elements per work-item, groups of " << group_size
+             << ", tiles of " << primitive.tile() << "\n\n"
+             << left << setw(12) << "elements" << setw(12) << "kernel" << setw(16) << "reference"
+             << setw(16) << "emulator" << "dispatches\n";
+        for (size_t i = 0; i < n.size(); ++i) {
+            vector<uint32_t> in = make_input(o, n[i]), expected, out;
+            for (unsigned k = 0; k < 3; ++k) {
+                double cpu = throughput(primitive, k, false, repeat, in, expected);
+                unsigned long dispatches = primitive.dispatches();
+                double emulated = throughput(primitive, k, true, repeat, in, out);
+                dispatches = (primitive.dispatches() - dispatches) / repeat;
+
+                ostringstream reference, emulator;
+                reference << fixed << setprecision(2) << cpu / 1e6 << " M/s";
+                emulator << fixed << setprecision(2) << emulated / 1e6 << " M/s";
+                cout << setw(12) << n[i] << setw(12) << kind_names[k] << setw(16) << reference.str()
+                     << setw(16) << emulator.str() << dispatches;
+                size_t j = 0;
+                while (j < out.size() && out[j] == expected[j])
+                    ++j;
+                if (out.size() != expected.size() || j < out.size()) {
+                    passed = false;
+                    cout << "\tMISMATCH";
+                    if (j < out.size())
+                        cerr << kind_names[k] << " of " << n[i] << " elements: element " << j << " is 0x"
+                             << hex << out[j] << " instead of 0x" << expected[j] << dec << endl;
+                }
+                cout << '\n';
+            }
+        }
+        cout << flush;
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    catch (system_error& e) {
+        cerr
+            << e.what()
+            << " : "
+            << e.code().message()
+            << endl;
+        return EXIT_FAILURE;
+    }
+    catch (runtime_error& e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    catch (invalid_argument& e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+}
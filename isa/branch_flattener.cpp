@@ -0,0 +1,361 @@
+#include "branch_flattener.hpp"
+
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+typedef cf_instruction cf;
+typedef alu_instruction alu;
+
+/// The kcache fields of CF_ALU_WORD0 (banks and mode 0) and CF_ALU_WORD1
+/// (mode 1, addresses and ALT_CONST).
+const uint32_t kcache_mask0 = 0xffc00000u;
+const uint32_t kcache_mask1 = 0x0203ffffu;
+
+const unsigned max_clause_size = 128;
+
+/// This structure locates the parts of an if/else region.
+struct region {
+    size_t first;               ///< PUSH or ALU_PUSH_BEFORE.
+    size_t cond;                ///< The clause which sets the predicate.
+    size_t last;                ///< POP or ALU_POP_AFTER.
+    vector<size_t> then_clauses;
+    vector<size_t> else_clauses;
+};
+
+bool is_plain_alu(cf_instruction const& c)
+{
+    return c.inst() == cf::CF_INST_ALU;
+}
+
+bool is_pop(cf_instruction const& c)
+{
+    return c.inst() == cf::CF_INST_POP && c.pop_count() == 1;
+}
+
+/// Determine whether an opcode sets the predicate from a comparison, without
+/// touching the stack.
+bool is_compare(unsigned op)
+{
+    switch (op) {
+    case alu::OP2_PRED_SETGT_UINT:
+    case alu::OP2_PRED_SETGE_UINT:
+    case alu::OP2_PRED_SETE:
+    case alu::OP2_PRED_SETGT:
+    case alu::OP2_PRED_SETGE:
+    case alu::OP2_PRED_SETNE:
+    case alu::OP2_PREDE_INT:
+    case alu::OP2_PRED_SETGT_INT:
+    case alu::OP2_PRED_SETGE_INT:
+    case alu::OP2_PRED_SETNE_INT:
+    case alu::OP2_PRED_SETGT_64:
+    case alu::OP2_PRED_SETE_64:
+    case alu::OP2_PRED_SETGE_64:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/// Determine whether a condition clause leaves the predicate equal to the
+/// execute mask: every update of one also updates the other, and the first
+/// update is done by every thread.
+bool sets_condition(vector<alu_group> const& clause)
+{
+    bool first = true;
+    for (size_t g = 0; g < clause.size(); ++g) {
+        for (size_t s = 0; s < clause[g].slots.size(); ++s) {
+            alu_instruction const& inst = clause[g].slots[s];
+            if (inst.flags() & alu::PRED_SET && !is_compare(inst.op))
+                return false;
+            if (!inst.update_pred && !inst.update_exec_mask)
+                continue;
+            if (!inst.update_pred || !inst.update_exec_mask)
+                return false;
+            if (first && inst.pred_sel != alu::PRED_SEL_OFF)
+                return false;
+            first = false;
+        }
+    }
+    return !first;
+}
+
+/// Determine whether every instruction of a clause can be predicated.
+bool is_predicable(vector<alu_group> const& clause)
+{
+    for (size_t g = 0; g < clause.size(); ++g) {
+        for (size_t s = 0; s < clause[g].slots.size(); ++s) {
+            alu_instruction const& inst = clause[g].slots[s];
+            if (inst.pred_sel != alu::PRED_SEL_OFF ||
+                inst.update_pred || inst.update_exec_mask ||
+                inst.flags() & (alu::PRED_SET | alu::KILL | alu::LDS | alu::ORDERED))
+                return false;
+        }
+    }
+    return true;
+}
+
+/// Determine whether a clause neither reads nor updates the predicate, so
+/// that it can follow a flattened region in the same clause.
+bool is_unpredicated(vector<alu_group> const& clause)
+{
+    for (size_t g = 0; g < clause.size(); ++g) {
+        for (size_t s = 0; s < clause[g].slots.size(); ++s) {
+            alu_instruction const& inst = clause[g].slots[s];
+            if (inst.pred_sel != alu::PRED_SEL_OFF ||
+                inst.update_pred || inst.update_exec_mask)
+                return false;
+        }
+    }
+    return true;
+}
+
+bool uses_kcache(vector<alu_group> const& clause)
+{
+    for (size_t g = 0; g < clause.size(); ++g) {
+        for (size_t s = 0; s < clause[g].slots.size(); ++s) {
+            alu_instruction const& inst = clause[g].slots[s];
+            for (unsigned i = 0; i < inst.num_sources(); ++i)
+                if (alu::is_kcache(inst.src[i].sel))
+                    return true;
+        }
+    }
+    return false;
+}
+
+/// Find the if/else region which begins at a CF instruction.
+bool find_region(evergreen_program const& program, size_t i, region& r)
+{
+    size_t n = program.size();
+    r.first = i;
+    if (program[i].cf.inst() == cf::CF_INST_PUSH) {
+        if (i + 1 >= n || !is_plain_alu(program[i + 1].cf))
+            return false;
+        r.cond = i + 1;
+    }
+    else if (program[i].cf.inst() == cf::CF_INST_ALU_PUSH_BEFORE)
+        r.cond = i;
+    else
+        return false;
+
+    size_t k = r.cond + 1;
+    if (k >= n)
+        return false;
+    cf_instruction const& jump = program[k].cf;
+    if (jump.inst() != cf::CF_INST_JUMP || jump.cond() != 0)
+        return false;
+
+    r.then_clauses.clear();
+    r.else_clauses.clear();
+    for (++k; k < n && is_plain_alu(program[k].cf); ++k)
+        r.then_clauses.push_back(k);
+    if (k >= n)
+        return false;
+
+    // if (...) { ... ALU_POP_AFTER }
+    cf_instruction const& end = program[k].cf;
+    if (end.inst() == cf::CF_INST_ALU_POP_AFTER) {
+        r.then_clauses.push_back(k);
+        r.last = k;
+        return jump.addr() == k + 1 && jump.pop_count() == 1;
+    }
+    if (jump.addr() != k || jump.pop_count() != 0)
+        return false;
+    // if (...) { ... } POP
+    if (is_pop(end)) {
+        r.last = k;
+        return true;
+    }
+    if (end.inst() != cf::CF_INST_ELSE || end.cond() != 0)
+        return false;
+
+    for (++k; k < n && is_plain_alu(program[k].cf); ++k)
+        r.else_clauses.push_back(k);
+    if (k >= n)
+        return false;
+    r.last = k;
+
+    // if (...) { ... } else { ... ALU_POP_AFTER }
+    if (program[k].cf.inst() == cf::CF_INST_ALU_POP_AFTER) {
+        r.else_clauses.push_back(k);
+        return end.addr() == k + 1 && end.pop_count() == 1;
+    }
+    // if (...) { ... } else { ... } POP
+    if (!is_pop(program[k].cf) || program[k].cf.end_of_program())
+        return false;
+    return (end.addr() == k + 1 && end.pop_count() == 1) ||
+           (end.addr() == k && end.pop_count() == 0);
+}
+
+/// Determine whether some branch outside [first, last] targets (first, last].
+bool is_entered(evergreen_program const& program, size_t first, size_t last)
+{
+    for (size_t k = 0; k < program.size(); ++k) {
+        if (k >= first && k <= last)
+            continue;
+        cf_instruction const& c = program[k].cf;
+        if (c.is_branch() && c.addr() > first && c.addr() <= last)
+            return true;
+        // Returns come back after the calls.
+        if (c.inst() == cf::CF_INST_CALL && k + 1 > first && k + 1 <= last)
+            return true;
+    }
+    return false;
+}
+
+/// Choose the kcache settings for the flattened clause. All the clauses which
+/// read the kcache must agree.
+bool merge_kcache(evergreen_program const& program, vector<size_t> const& clauses, cf_instruction& merged)
+{
+    bool found = false;
+    uint32_t word0 = 0, word1 = 0;
+    for (size_t i = 0; i < clauses.size(); ++i) {
+        cf_node const& node = program[clauses[i]];
+        if (!uses_kcache(node.alu))
+            continue;
+        if (!found) {
+            word0 = node.cf.word0 & kcache_mask0;
+            word1 = node.cf.word1 & kcache_mask1;
+            found = true;
+        }
+        else if ((node.cf.word0 & kcache_mask0) != word0 ||
+                 (node.cf.word1 & kcache_mask1) != word1)
+            return false;
+    }
+    if (found) {
+        merged.word0 = (merged.word0 & ~kcache_mask0) | word0;
+        merged.word1 = (merged.word1 & ~kcache_mask1) | word1;
+    }
+    return true;
+}
+
+unsigned groups(evergreen_program const& program, vector<size_t> const& clauses)
+{
+    unsigned n = 0;
+    for (size_t i = 0; i < clauses.size(); ++i)
+        n += program[clauses[i]].alu.size();
+    return n;
+}
+
+/// Append the groups of a clause, predicated with the given PRED_SEL.
+void append(vector<alu_group>& dst, vector<alu_group> const& src, unsigned pred_sel)
+{
+    for (size_t g = 0; g < src.size(); ++g) {
+        dst.push_back(src[g]);
+        for (size_t s = 0; s < dst.back().slots.size(); ++s)
+            dst.back().slots[s].pred_sel = pred_sel;
+    }
+}
+
+/// Remove the CF instructions [first, last) and fix the branch targets
+/// which follow them.
+void erase(evergreen_program& program, size_t first, size_t last)
+{
+    vector<cf_node>& nodes = program.nodes();
+    nodes.erase(nodes.begin() + first, nodes.begin() + last);
+    for (size_t k = 0; k < nodes.size(); ++k) {
+        cf_instruction& c = nodes[k].cf;
+        if (c.is_branch() && c.addr() >= last)
+            c.set_addr(c.addr() - (last - first));
+    }
+}
+
+}
+
+bool branch_flattener::flatten(evergreen_program& program)
+{
+    _regions.clear();
+    bool changed = false;
+    size_t removed = 0;
+    region r;
+
+    for (size_t i = 0; i < program.size(); ++i) {
+        if (!find_region(program, i, r) ||
+            is_entered(program, r.first, r.last) ||
+            !sets_condition(program[r.cond].alu))
+            continue;
+
+        // Every clause of the region, and the following clause if it is not
+        // the target of a branch, go to the flattened clause.
+        vector<size_t> clauses(1, r.cond);
+        clauses.insert(clauses.end(), r.then_clauses.begin(), r.then_clauses.end());
+        clauses.insert(clauses.end(), r.else_clauses.begin(), r.else_clauses.end());
+        bool predicable = true;
+        for (size_t k = 1; k < clauses.size(); ++k)
+            predicable = predicable && is_predicable(program[clauses[k]].alu);
+        if (!predicable)
+            continue;
+
+        cf_node merged(program[r.cond].cf);
+        merged.cf.set_inst(cf::CF_INST_ALU);
+        merged.cf.set_barrier(program[r.first].cf.barrier() || merged.cf.barrier());
+        if (!merge_kcache(program, clauses, merged.cf))
+            continue;
+        unsigned size = 0;
+        for (size_t k = 0; k < clauses.size(); ++k)
+            size += program[clauses[k]].clause_size();
+        if (size > max_clause_size)
+            continue;
+
+        size_t follow = r.last + 1;
+        bool merge_follow = follow < program.size() &&
+            is_plain_alu(program[follow].cf) &&
+            is_unpredicated(program[follow].alu) &&
+            !is_entered(program, r.first, follow) &&
+            size + program[follow].clause_size() <= max_clause_size;
+        if (merge_follow) {
+            clauses.push_back(follow);
+            cf_instruction kcache = merged.cf;
+            if (merge_kcache(program, clauses, kcache))
+                merged.cf = kcache;
+            else {
+                clauses.pop_back();
+                merge_follow = false;
+            }
+        }
+
+        branch_region info;
+        info.cf = i + removed;
+        info.cf_count = r.last - r.first + 1 + merge_follow;
+        info.then_groups = groups(program, r.then_clauses);
+        info.else_groups = groups(program, r.else_clauses);
+        unsigned shared = program[r.cond].alu.size() + (merge_follow ? program[follow].alu.size() : 0);
+        unsigned then_cost = _costs.clause_switch * r.then_clauses.size() + _costs.alu_group * info.then_groups;
+        unsigned else_cost = _costs.clause_switch * r.else_clauses.size() + _costs.alu_group * info.else_groups;
+        info.branch_cost =
+            _costs.cf_instruction * info.cf_count +
+            _costs.clause_switch * (1 + merge_follow) +
+            _costs.alu_group * shared +
+            min(then_cost, else_cost);
+        info.flat_cost =
+            _costs.cf_instruction +
+            _costs.clause_switch +
+            _costs.alu_group * (shared + info.then_groups + info.else_groups);
+        info.flattened = info.flat_cost <= info.branch_cost;
+        _regions.push_back(info);
+        if (!info.flattened)
+            continue;
+
+        // The PRED_SET instructions now only update the predicate.
+        merged.alu = program[r.cond].alu;
+        for (size_t g = 0; g < merged.alu.size(); ++g)
+            for (size_t s = 0; s < merged.alu[g].slots.size(); ++s)
+                merged.alu[g].slots[s].update_exec_mask = false;
+        for (size_t k = 0; k < r.then_clauses.size(); ++k)
+            append(merged.alu, program[r.then_clauses[k]].alu, alu::PRED_SEL_ONE);
+        for (size_t k = 0; k < r.else_clauses.size(); ++k)
+            append(merged.alu, program[r.else_clauses[k]].alu, alu::PRED_SEL_ZERO);
+        if (merge_follow)
+            merged.alu.insert(merged.alu.end(), program[follow].alu.begin(), program[follow].alu.end());
+
+        size_t last = merge_follow ? follow : r.last;
+        program[r.first] = merged;
+        erase(program, r.first + 1, last + 1);
+        removed += last - r.first;
+        changed = true;
+    }
+    return changed;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "evergreen_program.hpp"
+
+#include <vector>
+
+/// This structure describes an if/else region found by the branch flattener.
+struct branch_region {
+    unsigned cf;            ///< Index of the first CF instruction (PUSH or ALU_PUSH_BEFORE).
+    unsigned cf_count;      ///< Number of CF instructions in the region.
+    unsigned then_groups;   ///< Instruction groups executed when the condition holds.
+    unsigned else_groups;   ///< Instruction groups executed otherwise.
+    unsigned branch_cost;   ///< Estimated cycles of the branches.
+    unsigned flat_cost;     ///< Estimated cycles of the flattened clause.
+    bool flattened;         ///< Whether the region was flattened.
+
+    branch_region()
+        : cf(), cf_count(), then_groups(), else_groups(),
+          branch_cost(), flat_cost(), flattened() {}
+};
+
+/// This class flattens short if/else regions of the CF program into a
+/// single ALU clause, the way branchesalu.asm does by hand for branches.asm.
+///
+/// A region is a PUSH followed by an ALU clause, or an ALU_PUSH_BEFORE, whose
+/// PRED_SET instructions update the execute mask, then a JUMP, the ALU
+/// clauses of the then side, optionally an ELSE and the ALU clauses of the
+/// else side, and a POP (or an ALU_POP_AFTER). The flattened clause keeps the
+/// PRED_SET instructions but only updates the predicate with them, and
+/// executes the then side with PRED_SEL_ONE and the else side with
+/// PRED_SEL_ZERO. The ALU clause which follows the region is merged as well.
+///
+/// Only innermost regions whose clauses can be predicated (no predicate
+/// updates, kills, LDS accesses or ordered instructions) and which fit in
+/// one clause with one set of kcache lines are considered. Since no stack
+/// entry is pushed for a flattened region, the stack may shrink.
+///
+/// The cost model compares the cycles of one wavefront. The branches cost
+/// their CF instructions, one clause switch per ALU clause and the groups of
+/// the cheaper side, assuming the wavefront does not diverge (a divergent
+/// wavefront executes both sides anyway). The flattened clause costs one CF
+/// instruction, one clause switch and the groups of both sides. A region is
+/// flattened when that does not cost more.
+class branch_flattener {
+public:
+    /// This structure holds the parameters of the cost model, in cycles.
+    struct costs {
+        unsigned cf_instruction;    ///< Issue of a CF instruction.
+        unsigned clause_switch;     ///< Switch to a new ALU clause.
+        unsigned alu_group;         ///< Issue of an instruction group for a wavefront.
+
+        costs() : cf_instruction(8), clause_switch(40), alu_group(4) {}
+    };
+
+    explicit branch_flattener(costs const& c = costs()) : _costs(c) {}
+
+    /// Flatten the profitable regions of a program in place.
+    /// \returns Whether the program has changed.
+    bool flatten(evergreen_program& program);
+
+    /// Access the regions found by the last call to \c flatten(), with the
+    /// CF indices of the program before flattening.
+    std::vector<branch_region> const& regions() const { return _regions; }
+
+private:
+    costs _costs;
+    std::vector<branch_region> _regions;
+};
@@ -0,0 +1,413 @@
+#include "clause_profiler.hpp"
+#include "kernel_analysis.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+typedef cf_instruction cf;
+typedef alu_instruction alu;
+
+const unsigned num_gprs_total = 128;
+const unsigned wavefront_size = 64;
+/// EXPORT_RAT_INST_STORE_RAW.
+const unsigned rat_inst_store_raw = 2;
+/// CF_KCACHE_LOCK_1.
+const unsigned kcache_lock_1 = 1;
+
+alu_source source(uint32_t sel, uint32_t chan = 0)
+{
+    alu_source s = { sel, chan, false, false, false };
+    return s;
+}
+
+/// Make an OP2 instruction. Only the instructions with \c write set update
+/// their destination GPR, the others only PV or PS.
+alu_instruction op2(unsigned op, unsigned gpr, unsigned chan, bool write,
+                    alu_source const& a, alu_source const& b = source(alu::ALU_SRC_0))
+{
+    alu_instruction inst(op);
+    inst.dst_gpr = gpr;
+    inst.dst_chan = chan;
+    inst.write_mask = write;
+    inst.src[0] = a;
+    inst.src[1] = b;
+    return inst;
+}
+
+alu_group group(alu_instruction const& a)
+{
+    alu_group g;
+    g.slots.push_back(a);
+    return g;
+}
+
+alu_group group(alu_instruction const& a, alu_instruction const& b)
+{
+    alu_group g = group(a);
+    g.slots.push_back(b);
+    return g;
+}
+
+alu_group group(alu_instruction const& a, alu_instruction const& b, alu_instruction const& c)
+{
+    alu_group g = group(a, b);
+    g.slots.push_back(c);
+    return g;
+}
+
+/// Make the prologue, which sets R<c>.x to the first record of the
+/// wavefront and R<c>.y to its last one. R<t> is used as a temporary.
+cf_node prologue(unsigned c, unsigned t, unsigned bank)
+{
+    cf_node node(cf_instruction(cf::CF_INST_ALU));
+    node.cf.word0 |= bank << 22 | kcache_lock_1 << 30;
+    node.cf.set_barrier(true);
+
+    const uint32_t k0 = alu::ALU_SRC_KCACHE0_BASE;
+    vector<alu_group>& g = node.alu;
+    // R<t>.xyz <- local id * item strides, R<c>.xyz <- group id * group strides
+    for (unsigned r = 0; r < 2; ++r)
+        g.push_back(group(
+            op2(alu::OP2_MUL_UINT24, r ? c : t, 0, true, source(r, 0), source(k0 + r, 0)),
+            op2(alu::OP2_MUL_UINT24, r ? c : t, 1, true, source(r, 1), source(k0 + r, 1)),
+            op2(alu::OP2_MUL_UINT24, r ? c : t, 2, true, source(r, 2), source(k0 + r, 2))));
+    // PV.x <- R<c>.x + R<c>.y
+    g.push_back(group(op2(alu::OP2_ADD_INT, 0, 0, false, source(alu::ALU_SRC_PV, 0), source(alu::ALU_SRC_PV, 1))));
+    // R<c>.x <- PV.x + R<c>.z, PV.y <- R<t>.x + R<t>.y
+    g.push_back(group(
+        op2(alu::OP2_ADD_INT, c, 0, true, source(alu::ALU_SRC_PV, 0), source(c, 2)),
+        op2(alu::OP2_ADD_INT, 0, 1, false, source(t, 0), source(t, 1))));
+    // PV.y <- (PV.y + R<t>.z) >> 6
+    g.push_back(group(op2(alu::OP2_ADD_INT, 0, 1, false, source(alu::ALU_SRC_PV, 1), source(t, 2))));
+    g.push_back(group(op2(alu::OP2_LSHR_INT, 0, 1, false, source(alu::ALU_SRC_PV, 1), source(alu::ALU_SRC_LITERAL, 0))));
+    g.back().literals.push_back(6);
+    // R<c>.x <- (R<c>.x + PV.y) * records, R<c>.y <- R<c>.x + records - 1
+    g.push_back(group(op2(alu::OP2_ADD_INT, 0, 0, false, source(c, 0), source(alu::ALU_SRC_PV, 1))));
+    g.push_back(group(op2(alu::OP2_MUL_UINT24, c, 0, true, source(alu::ALU_SRC_PV, 0), source(k0 + 2, 0))));
+    g.push_back(group(op2(alu::OP2_ADD_INT, c, 1, true, source(alu::ALU_SRC_PV, 0), source(k0 + 2, 1))));
+    return node;
+}
+
+/// Make the clause of a profiling point, which fills R<t> with the record
+/// and moves R<c>.x to the next record.
+cf_node sample(unsigned c, unsigned t, unsigned point)
+{
+    cf_node node(cf_instruction(cf::CF_INST_ALU));
+    // Wait for the export of the previous point, which reads R<t>.
+    node.cf.set_barrier(true);
+
+    alu_group g;
+    g.slots.push_back(op2(alu::OP2_MOV, t, 0, true, source(c, 0)));
+    g.slots.push_back(op2(alu::OP2_MOV, t, 1, true, source(alu::ALU_SRC_LITERAL, 0)));
+    g.slots.push_back(op2(alu::OP2_MOV, t, 2, true, source(alu::ALU_SRC_TIME_LO)));
+    g.slots.push_back(op2(alu::OP2_MOV, t, 3, true, source(alu::ALU_SRC_TIME_HI)));
+    g.literals.push_back(point);
+    node.alu.push_back(g);
+    // R<c>.x <- min(R<c>.x + 1, R<c>.y)
+    node.alu.push_back(group(op2(alu::OP2_ADD_INT, 0, 0, false, source(alu::ALU_SRC_PV, 0), source(alu::ALU_SRC_1_INT))));
+    node.alu.push_back(group(op2(alu::OP2_MIN_UINT, c, 0, true, source(alu::ALU_SRC_PV, 0), source(c, 1))));
+    return node;
+}
+
+/// Make the export of the record in R<t> to RAT R<t>.x.
+cf_node store(unsigned t, unsigned rat)
+{
+    cf_node node(cf_instruction(cf::CF_INST_MEM_RAT_CACHELESS));
+    node.cf.word0 = rat | rat_inst_store_raw << 4 | 1 << 13 | 3u << 30;
+    node.cf.set_rw_gpr(t);
+    node.cf.set_index_gpr(t);
+    node.cf.word1 |= 0xf << 12;
+    node.cf.set_barrier(true);
+    return node;
+}
+
+bool updates_exec_mask(vector<alu_group> const& clause)
+{
+    for (size_t g = 0; g < clause.size(); ++g)
+        for (size_t s = 0; s < clause[g].slots.size(); ++s)
+            if (clause[g].slots[s].update_exec_mask)
+                return true;
+    return false;
+}
+
+/// Find the loops whose bodies may run with a partial execute mask: those
+/// with breaks, continues or execute mask updates outside conditionals.
+/// \returns The divergence of each loop, by the index of its LOOP_START.
+map<size_t, bool> divergent_loops(evergreen_program const& program)
+{
+    map<size_t, bool> loops;
+    vector<size_t> open;
+    for (size_t i = 0; i < program.size(); ++i) {
+        cf_instruction const& c = program[i].cf;
+        switch (c.inst()) {
+        case cf::CF_INST_LOOP_START:
+        case cf::CF_INST_LOOP_START_DX10:
+        case cf::CF_INST_LOOP_START_NO_AL:
+            open.push_back(i);
+            loops[i] = false;
+            break;
+        case cf::CF_INST_LOOP_END:
+            if (!open.empty())
+                open.pop_back();
+            break;
+        case cf::CF_INST_LOOP_BREAK:
+        case cf::CF_INST_LOOP_CONTINUE:
+        case cf::CF_INST_ALU_BREAK:
+        case cf::CF_INST_ALU_CONTINUE:
+            for (size_t k = 0; k < open.size(); ++k)
+                loops[open[k]] = true;
+            break;
+        case cf::CF_INST_ALU:
+            if (updates_exec_mask(program[i].alu))
+                for (size_t k = 0; k < open.size(); ++k)
+                    loops[open[k]] = true;
+            break;
+        }
+    }
+    return loops;
+}
+
+/// Determine whether a program addresses GPRs relative to AR or the loop
+/// index.
+bool relative(evergreen_program const& program)
+{
+    for (size_t i = 0; i < program.size(); ++i) {
+        cf_node const& node = program[i];
+        if (node.cf.is_export() && node.cf.rw_rel())
+            return true;
+        for (size_t f = 0; f < node.fetch.size(); ++f)
+            if (node.fetch[f].src_rel() || node.fetch[f].dst_rel())
+                return true;
+        for (size_t g = 0; g < node.alu.size(); ++g)
+            for (size_t s = 0; s < node.alu[g].slots.size(); ++s) {
+                alu_instruction const& inst = node.alu[g].slots[s];
+                if (inst.dst_rel)
+                    return true;
+                for (unsigned k = 0; k < inst.num_sources(); ++k)
+                    if (inst.src[k].rel)
+                        return true;
+            }
+    }
+    return false;
+}
+
+unsigned bucket(uint64_t cycles)
+{
+    unsigned b = 0;
+    for (; cycles != 0; cycles >>= 1)
+        ++b;
+    return b;
+}
+
+string point_name(unsigned point, evergreen_program const* program)
+{
+    string name = "CF " + to_string(point);
+    if (program && point < program->size())
+        name += string(" ") + (*program)[point].cf.name();
+    return name;
+}
+
+}
+
+vector<unsigned> clause_profiler::candidates(evergreen_program const& program)
+{
+    map<size_t, bool> divergent = divergent_loops(program);
+    vector<unsigned> points;
+    vector<bool> loops;
+    int conditionals = 0;
+    bool partial = false;
+
+    for (size_t i = 0; i < program.size(); ++i) {
+        cf_node const& node = program[i];
+        cf_instruction const& c = node.cf;
+        bool whole = conditionals == 0 && !partial &&
+            find(loops.begin(), loops.end(), true) == loops.end();
+        if (c.is_clause() && whole)
+            points.push_back(i);
+        if (c.end_of_program()) {
+            if (conditionals == 0 && loops.empty())
+                points.push_back(i);
+            break;
+        }
+
+        switch (c.inst()) {
+        case cf::CF_INST_PUSH:
+        case cf::CF_INST_ALU_PUSH_BEFORE:
+            ++conditionals;
+            break;
+        case cf::CF_INST_POP:
+            conditionals -= c.pop_count();
+            break;
+        case cf::CF_INST_ALU_POP_AFTER:
+            --conditionals;
+            break;
+        case cf::CF_INST_ALU_POP2_AFTER:
+            conditionals -= 2;
+            break;
+        case cf::CF_INST_ALU:
+            if (conditionals == 0 && loops.empty() && updates_exec_mask(node.alu))
+                partial = true;
+            break;
+        case cf::CF_INST_LOOP_START:
+        case cf::CF_INST_LOOP_START_DX10:
+        case cf::CF_INST_LOOP_START_NO_AL:
+            loops.push_back(divergent[i]);
+            break;
+        case cf::CF_INST_LOOP_END:
+            if (!loops.empty())
+                loops.pop_back();
+            break;
+        case cf::CF_INST_RETURN:
+            // Subroutines follow, they may be called from anywhere.
+            return points;
+        }
+        if (conditionals < 0)
+            throw runtime_error("unbalanced POP at CF " + to_string(i));
+    }
+    return points;
+}
+
+void clause_profiler::instrument(evergreen_program& program, vector<unsigned> points)
+{
+    vector<unsigned> allowed = candidates(program);
+    if (points.empty())
+        points = allowed;
+    sort(points.begin(), points.end());
+    points.erase(unique(points.begin(), points.end()), points.end());
+    for (size_t i = 0; i < points.size(); ++i)
+        if (!binary_search(allowed.begin(), allowed.end(), points[i]))
+            throw runtime_error("CF " + to_string(points[i]) + " cannot be profiled");
+
+    kernel_analysis analysis(program);
+    unsigned c = _options.gpr;
+    if (c == 0) {
+        if (relative(program))
+            throw runtime_error("the kernel uses relative addressing, the profiling GPRs must be chosen");
+        c = max(analysis.num_gprs, 2u);
+    }
+    else if (c < max(analysis.num_gprs, 2u))
+        throw runtime_error("R" + to_string(c) + " is used by the kernel");
+    unsigned t = c + 1;
+    if (t >= num_gprs_total - analysis.temp_gprs)
+        throw runtime_error("no GPRs left for profiling");
+
+    // Every point adds two CF instructions before its instruction, branches
+    // to the instruction go to the point.
+    auto start = [&](size_t i) {
+        return 1 + i + 2 * (lower_bound(points.begin(), points.end(), i) - points.begin());
+    };
+
+    vector<cf_node> nodes;
+    nodes.push_back(prologue(c, t, _options.constant_buffer));
+    for (size_t i = 0, p = 0; i < program.size(); ++i) {
+        if (p < points.size() && points[p] == i) {
+            nodes.push_back(sample(c, t, i));
+            nodes.push_back(store(t, _options.rat));
+            ++p;
+        }
+        nodes.push_back(program[i]);
+        cf_instruction& inst = nodes.back().cf;
+        if (inst.is_branch())
+            inst.set_addr(start(inst.addr()));
+    }
+    program.nodes().swap(nodes);
+    _gpr = c;
+    _points = points;
+}
+
+vector<uint32_t> clause_profiler::constants(unsigned const* size, unsigned const* groups, unsigned records)
+{
+    unsigned waves = (size[0] * size[1] * size[2] + wavefront_size - 1) / wavefront_size;
+    uint32_t layout[] = {
+        1, size[0], size[0] * size[1], 0,
+        waves, groups[0] * waves, groups[0] * groups[1] * waves, 0,
+        records, records - 1, 0, 0
+    };
+    return vector<uint32_t>(layout, layout + 12);
+}
+
+unsigned clause_profiler::wavefronts(unsigned const* size, unsigned const* groups)
+{
+    unsigned waves = (size[0] * size[1] * size[2] + wavefront_size - 1) / wavefront_size;
+    return waves * groups[0] * groups[1] * groups[2];
+}
+
+clause_profile::span::span(unsigned from, unsigned to)
+    : from(from), to(to), count(), total(), min(~uint64_t(0)), max()
+{
+    fill(histogram, histogram + buckets, 0);
+}
+
+void clause_profile::span::add(uint64_t cycles)
+{
+    ++count;
+    total += cycles;
+    min = std::min(min, cycles);
+    max = std::max(max, cycles);
+    ++histogram[std::min(bucket(cycles), buckets - 1)];
+}
+
+clause_profile::clause_profile(vector<uint32_t> const& buffer, unsigned records, unsigned overhead)
+    : _wavefronts(), _overflows()
+{
+    if (records == 0)
+        throw runtime_error("no records per wavefront");
+    map<pair<unsigned, unsigned>, span> spans;
+    size_t waves = buffer.size() / (4 * records);
+
+    for (size_t w = 0; w < waves; ++w) {
+        // A record is valid if it holds its own index.
+        size_t first = w * records;
+        size_t n = 0;
+        while (n < records && buffer[4 * (first + n)] == first + n)
+            ++n;
+        if (n == 0)
+            continue;
+        ++_wavefronts;
+        if (n == records) {
+            ++_overflows;
+            --n;
+        }
+        for (size_t i = 1; i < n; ++i) {
+            uint32_t const* a = &buffer[4 * (first + i - 1)];
+            uint32_t const* b = &buffer[4 * (first + i)];
+            uint64_t ta = uint64_t(a[3]) << 32 | a[2];
+            uint64_t tb = uint64_t(b[3]) << 32 | b[2];
+            uint64_t cycles = tb - ta;
+            cycles = cycles > overhead ? cycles - overhead : 0;
+            pair<unsigned, unsigned> key(a[1], b[1]);
+            map<pair<unsigned, unsigned>, span>::iterator s = spans.find(key);
+            if (s == spans.end())
+                s = spans.insert(make_pair(key, span(a[1], b[1]))).first;
+            s->second.add(cycles);
+        }
+    }
+    for (map<pair<unsigned, unsigned>, span>::const_iterator s = spans.begin(); s != spans.end(); ++s)
+        _spans.push_back(s->second);
+}
+
+void clause_profile::write(ostream& os, evergreen_program const* program) const
+{
+    os << "Wavefronts " << _wavefronts << ", out of records " << _overflows << '\n';
+    for (size_t i = 0; i < _spans.size(); ++i) {
+        span const& s = _spans[i];
+        os << '\n'
+           << point_name(s.from, program) << " -> " << point_name(s.to, program) << ": "
+           << s.count << " spans, mean " << s.mean() << " min " << s.min << " max " << s.max << " cycles\n";
+        for (unsigned b = 0; b < buckets; ++b) {
+            if (s.histogram[b] == 0)
+                continue;
+            uint64_t low = b ? uint64_t(1) << (b - 1) : 0;
+            uint64_t high = uint64_t(1) << b;
+            os << "    [" << setw(10) << low << ", " << setw(10) << high << ") " << setw(10) << s.histogram[b] << '\n';
+        }
+    }
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "evergreen_program.hpp"
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+/// This class instruments a kernel so that it records a TIME_LO timestamp
+/// before its clauses, the way timing.asm does by hand.
+///
+/// A prologue is added at the start of the program which computes the index
+/// of the wavefront in the dispatch, and an ALU clause and a RAT export are
+/// added before every profiling point. Each wavefront owns \c records
+/// consecutive records of four double words in the profiling RAT:
+///
+///     x: index of the record in the buffer
+///     y: profiling point (CF index in the original program)
+///     z: TIME_LO
+///     w: TIME_HI
+///
+/// When the records of a wavefront are used up, the last one is written
+/// over again. The prologue reads a constant buffer which the host fills
+/// with \c constants():
+///
+///     0: item strides 1, x, x * y, 0
+///     1: group strides in wavefronts w, X * w, X * Y * w, 0
+///        (w being the number of wavefronts per group)
+///     2: records, records - 1, 0, 0
+///
+/// Two GPRs above those of the kernel hold the index of the next record and
+/// the record being written, so the kernel needs two more GPRs. Kernels with
+/// relative addressing may reach beyond the GPRs they name, the GPRs must be
+/// chosen for them.
+///
+/// Every lane of a wavefront writes the same record, hence the records stay
+/// consistent only if the lanes which write a record are the lanes which
+/// wrote the previous ones. Points are therefore only taken where the
+/// execute mask is known to hold every thread of the wavefront: outside
+/// conditionals, outside loops with breaks and before any execute mask
+/// update. The end of the program is a point as well unless it is in a loop
+/// or a conditional, the lanes which are still active record it.
+class clause_profiler {
+public:
+    /// This structure holds the resources the instrumented kernel uses.
+    struct options {
+        unsigned rat;               ///< RAT id of the profiling buffer.
+        unsigned constant_buffer;   ///< Constant buffer id of the layout.
+        unsigned gpr;               ///< First of the two GPRs, or 0 for the first free one.
+
+        options() : rat(1), constant_buffer(1), gpr() {}
+    };
+
+    explicit clause_profiler(options const& o = options()) : _options(o), _gpr() {}
+
+    /// Get the CF indices of the clauses which can be profiled, and of the
+    /// end of the program if it can.
+    static std::vector<unsigned> candidates(evergreen_program const& program);
+
+    /// Instrument a program in place.
+    /// It throws std::runtime_error if a point cannot be profiled, there
+    /// are not enough GPRs left or the GPRs must be chosen.
+    /// \param program The program.
+    /// \param points The CF indices to profile, or every candidate if empty.
+    void instrument(evergreen_program& program, std::vector<unsigned> points = std::vector<unsigned>());
+
+    /// Access the points of the last instrumented program, in the CF indices
+    /// of the program before instrumentation.
+    std::vector<unsigned> const& points() const { return _points; }
+    /// Get the first of the two GPRs taken by the instrumentation.
+    unsigned gpr() const { return _gpr; }
+
+    /// Make the contents of the layout constant buffer for a dispatch.
+    /// \param size Work-items per group in X, Y and Z.
+    /// \param groups Groups in X, Y and Z.
+    /// \param records Records per wavefront.
+    static std::vector<std::uint32_t> constants(unsigned const* size, unsigned const* groups, unsigned records);
+    /// Get the number of wavefronts of a dispatch.
+    static unsigned wavefronts(unsigned const* size, unsigned const* groups);
+
+private:
+    options _options;
+    unsigned _gpr;
+    std::vector<unsigned> _points;
+};
+
+/// This class folds the records written by an instrumented kernel into
+/// latency histograms.
+///
+/// The time between two consecutive records of a wavefront is a span from
+/// one point to the next; spans are grouped by their two points, so that
+/// the latency of a clause (or of a region without points inside) is the
+/// span from its point to the following one. Spans include the overhead of
+/// the instrumentation itself, which can be subtracted.
+class clause_profile {
+public:
+    /// Number of histogram buckets: bucket i counts latencies in
+    /// [2^(i-1), 2^i), bucket 0 counts zero.
+    static const unsigned buckets = 33;
+
+    /// This structure holds the latencies of the spans between two points.
+    struct span {
+        unsigned from;              ///< Point at the start.
+        unsigned to;                ///< Point at the end.
+        std::uint64_t count;        ///< Number of spans.
+        std::uint64_t total;        ///< Sum of the latencies in cycles.
+        std::uint64_t min;          ///< Shortest latency.
+        std::uint64_t max;          ///< Longest latency.
+        std::uint64_t histogram[buckets];
+
+        span(unsigned from, unsigned to);
+
+        /// Add a latency.
+        void add(std::uint64_t cycles);
+        /// Get the mean latency.
+        double mean() const { return count ? double(total) / count : 0; }
+    };
+
+    /// This constructor decodes a profiling buffer.
+    /// \param buffer The buffer, \c records records of four double words per
+    /// wavefront.
+    /// \param records Records per wavefront.
+    /// \param overhead Cycles to subtract from every span (the cost of a
+    /// profiling point).
+    clause_profile(std::vector<std::uint32_t> const& buffer, unsigned records, unsigned overhead = 0);
+
+    /// Access the spans, ordered by their points.
+    std::vector<span> const& spans() const { return _spans; }
+    /// Get the number of wavefronts which wrote records.
+    unsigned wavefronts() const { return _wavefronts; }
+    /// Get the number of wavefronts which ran out of records. Their last
+    /// record is ignored.
+    unsigned overflows() const { return _overflows; }
+
+    /// Write the histograms as text, naming the points after the CF
+    /// instructions of the program if there is one.
+    void write(std::ostream& os, evergreen_program const* program = 0) const;
+
+private:
+    std::vector<span> _spans;
+    unsigned _wavefronts;
+    unsigned _overflows;
+};
@@ -0,0 +1,88 @@
+#include "control_flow.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+control_flow_graph::control_flow_graph(evergreen_program const& program)
+    : _successors(program.size()), _predecessors(program.size())
+{
+    unsigned n = program.size();
+    vector<unsigned> return_sites;
+
+    for (unsigned i = 0; i < n; ++i) {
+        cf_instruction const& cf = program[i].cf;
+        if (cf.inst() == cf_instruction::CF_INST_CALL || cf.inst() == cf_instruction::CF_INST_CALL_FS)
+            if (i + 1 < n)
+                return_sites.push_back(i + 1);
+    }
+
+    for (unsigned i = 0; i < n; ++i) {
+        cf_instruction const& cf = program[i].cf;
+        vector<unsigned>& succ = _successors[i];
+
+        if (cf.is_branch() && cf.addr() >= n)
+            throw runtime_error("branch target out of range");
+
+        switch (cf.is_alu() ? unsigned(cf_instruction::CF_INST_ALU) : cf.inst()) {
+        case cf_instruction::CF_INST_CALL:
+        case cf_instruction::CF_INST_CALL_FS:
+            succ.push_back(cf.addr());
+            break;
+        case cf_instruction::CF_INST_RETURN:
+            succ = return_sites;
+            break;
+        case cf_instruction::CF_INST_HALT:
+            break;
+        default:
+            if (cf.end_of_program())
+                break;
+            if (i + 1 < n)
+                succ.push_back(i + 1);
+            if (cf.is_branch() && cf.addr() != i + 1)
+                succ.push_back(cf.addr());
+            break;
+        }
+    }
+
+    for (unsigned i = 0; i < n; ++i)
+        for (size_t s = 0; s < _successors[i].size(); ++s)
+            _predecessors[_successors[i][s]].push_back(i);
+}
+
+vector<unsigned> control_flow_graph::reverse_post_order() const
+{
+    unsigned n = size();
+    vector<unsigned> order;
+    vector<char> visited(n);
+    // Iterative depth first search, each entry is a node and the index of
+    // the next successor to visit.
+    vector<pair<unsigned, unsigned> > stack;
+
+    if (n != 0) {
+        stack.push_back(make_pair(0u, 0u));
+        visited[0] = true;
+    }
+    while (!stack.empty()) {
+        unsigned i = stack.back().first;
+        unsigned& next = stack.back().second;
+        if (next < _successors[i].size()) {
+            unsigned s = _successors[i][next++];
+            if (!visited[s]) {
+                visited[s] = true;
+                stack.push_back(make_pair(s, 0u));
+            }
+        }
+        else {
+            order.push_back(i);
+            stack.pop_back();
+        }
+    }
+    reverse(order.begin(), order.end());
+
+    for (unsigned i = 0; i < n; ++i)
+        if (!visited[i])
+            order.push_back(i);
+    return order;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "evergreen_program.hpp"
+
+#include <vector>
+
+/// This class holds the control flow graph of an Evergreen program, whose
+/// nodes are the CF instructions.
+///
+/// Jumps, ELSE, PUSH and the loop instructions may either fall through or go
+/// to their target, depending on the execute mask. A CALL goes to the
+/// subroutine and every RETURN goes back to the instruction after each CALL
+/// (the graph does not tell calls apart). Instructions with END_OF_PROGRAM
+/// and HALT have no successors.
+class control_flow_graph {
+public:
+    /// This constructor builds the graph of a program.
+    explicit control_flow_graph(evergreen_program const& program);
+
+    /// Get the number of nodes.
+    std::size_t size() const { return _successors.size(); }
+    /// Get the indices of the CF instructions which may execute after the given one.
+    std::vector<unsigned> const& successors(unsigned i) const { return _successors[i]; }
+    /// Get the indices of the CF instructions which may execute before the given one.
+    std::vector<unsigned> const& predecessors(unsigned i) const { return _predecessors[i]; }
+
+    /// Get the CF indices in reverse post-order from the first instruction.
+    /// Unreachable instructions are appended at the end in program order.
+    std::vector<unsigned> reverse_post_order() const;
+
+private:
+    std::vector<std::vector<unsigned> > _successors;
+    std::vector<std::vector<unsigned> > _predecessors;
+};
@@ -0,0 +1,230 @@
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "evergreen_emulator.hpp"
+#include "evergreen_program.hpp"
+#include "sample_host.hpp"
+
+using namespace std;
+
+namespace {
+
+uint32_t as_uint(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+float as_float(uint32_t u)
+{
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+/// Print a buffer as the sample hosts do.
+void print(vector<uint32_t> const& buffer, bool floats, size_t cols, size_t addr)
+{
+    ios_base::fmtflags flags = cout.flags();
+    char fill = cout.fill();
+    for (size_t i = 0; i != buffer.size(); ++i) {
+        if (i % cols == 0) {
+            if (i != 0) cout << '\n';
+            if (addr != 0) {
+                cout.flags(floats ? ios_base::right | ios_base::dec : ios_base::right | ios_base::hex);
+                cout.fill(floats ? ' ' : '0');
+                cout.width(addr);
+                cout << i << ':' << '\t';
+            }
+        }
+        else cout << '\t';
+        if (floats) {
+            cout.flags(flags);
+            cout.fill(' ');
+            cout.width(8);
+            cout << as_float(buffer[i]);
+        }
+        else {
+            cout.flags(ios_base::right | ios_base::hex);
+            cout.fill('0');
+            cout.width(8);
+            cout << buffer[i];
+        }
+    }
+    cout << endl;
+    cout.flags(flags);
+    cout.fill(fill);
+}
+
+/// Read the values of an output file of a sample host, skipping the lines
+/// which are not output (driver messages) and the address column.
+vector<uint32_t> read_expected(const char* path, bool floats)
+{
+    ifstream in(path);
+    if (!in)
+        throw system_error(error_code(errno, system_category()), path);
+
+    vector<uint32_t> values;
+    for (string line; getline(in, line); ) {
+        istringstream fields(line);
+        vector<uint32_t> row;
+        bool valid = true;
+        for (string field; fields >> field; ) {
+            if (field[field.size() - 1] == ':')
+                continue;
+            char* end;
+            uint32_t value = floats
+                ? as_uint(strtof(field.c_str(), &end))
+                : uint32_t(strtoul(field.c_str(), &end, 16));
+            if (*end != 0) {
+                valid = false;
+                break;
+            }
+            row.push_back(value);
+        }
+        if (valid)
+            values.insert(values.end(), row.begin(), row.end());
+    }
+    return values;
+}
+
+/// Compare floats with a relative tolerance, NaN matches NaN.
+bool same_float(float a, float b, float tolerance)
+{
+    if (std::isnan(a) || std::isnan(b))
+        return std::isnan(a) && std::isnan(b);
+    if (a == b)
+        return true;
+    return fabs(a - b) <= tolerance * max(1.0f, max(fabs(a), fabs(b)));
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int x = 1, y = 1, z = 1;
+    int X = 1, Y = 1, Z = 1;
+    int guard = 16, columns = 4, address = 6;
+    unsigned threads = 0;
+    uint32_t mask = 0xffffffff;
+    float tolerance = 1e-5f;
+    const char* preset_name = 0;
+    const char* expected = 0;
+
+    for (int opt = 0; (opt = getopt(argc, argv, "x:y:z:X:Y:Z:G:w:a:p:t:e:m:f:")) != -1; )
+        switch (opt) {
+            case 'x': x = atoi(optarg); break;
+            case 'y': y = atoi(optarg); break;
+            case 'z': z = atoi(optarg); break;
+            case 'X': X = atoi(optarg); break;
+            case 'Y': Y = atoi(optarg); break;
+            case 'Z': Z = atoi(optarg); break;
+            case 'G': guard = atoi(optarg); break;
+            case 'w': columns = atoi(optarg); break;
+            case 'a': address = atoi(optarg); break;
+            case 'p': preset_name = optarg; break;
+            case 't': threads = atoi(optarg); break;
+            case 'e': expected = optarg; break;
+            case 'm': mask = strtoul(optarg, 0, 16); break;
+            case 'f': tolerance = strtof(optarg, 0); break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    if (optind != argc - 1) {
+        cerr << "Usage: " << argv[0] << " [-x<n>] [-y<n>] [-z<n>] [-X<n>] [-Y<n>] [-Z<n>] [-G<n>] [-w<n>] [-a<n>]\n"
+            "\t[-p<preset>] [-t<n>] [-e<expected.out>] [-m<mask>] [-f<tolerance>] kernel.bin\n\n"
+            "\t-x <n>\tnumber of items per group in X (1)\n"
+            "\t-y <n>\tnumber of items per group in Y (1)\n"
+            "\t-z <n>\tnumber of items per group in Z (1)\n"
+            "\t-X <n>\tnumber of groups in X (1)\n"
+            "\t-Y <n>\tnumber of groups in Y (1)\n"
+            "\t-Z <n>\tnumber of groups in Z (1)\n"
+            "\t-G <n>\tbuffer guard size (16)\n"
+            "\t-w <n>\tcolumns in the output (4)\n"
+            "\t-a <n>\taddress columns (6)\n"
+            "\t-p <s>\tsample host: integer, timing, scheduling, vector or lds (from the kernel name)\n"
+            "\t-t <n>\thost threads (one per processor)\n"
+            "\t-e <f>\tcompare with the output of the sample on the GPU\n"
+            "\t-m <h>\tmask of the bits compared in integer outputs (ffffffff)\n"
+            "\t-f <f>\trelative tolerance of float comparisons (1e-5)\n" << endl;
+        return EXIT_FAILURE;
+    }
+    const char* path = argv[optind];
+
+    try {
+        if (x < 1 || y < 1 || z < 1 || X < 1 || Y < 1 || Z < 1 || guard < 0 || columns < 1)
+            throw runtime_error("domain size error");
+
+        sample_host::preset kind = sample_host::find(preset_name ? preset_name : path);
+        int size[] = { x, y, z }, groups[] = { X, Y, Z };
+        sample_host host(kind, size, groups, guard);
+        vector<uint32_t>& output = host.output();
+        bool floats = host.floats();
+
+        evergreen_program program = evergreen_program::read(path);
+        evergreen_emulator emulator(program, threads);
+
+        auto start = chrono::steady_clock::now();
+        emulator.run(host.get_dispatch());
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        host.finish();
+
+        emulator_statistics const& s = emulator.statistics();
+        cerr
+            << "Emulated " << s.wavefronts << " wavefronts on " << emulator.threads() << " threads"
+            << " in " << (elapsed * 1e3) << " ms\n"
+            << "CF instructions " << s.cf_instructions
+            << " ALU groups " << s.alu_groups
+            << " fetches " << s.fetches
+            << " exports " << s.exports
+            << " barriers " << s.barriers
+            << endl;
+
+        print(output, floats, columns, host.addresses() ? address : 0);
+
+        if (expected) {
+            vector<uint32_t> reference = read_expected(expected, floats);
+            size_t mismatches = 0;
+            for (size_t i = 0; i < output.size() && i < reference.size(); ++i) {
+                bool same = floats
+                    ? same_float(as_float(output[i]), as_float(reference[i]), tolerance)
+                    : ((output[i] ^ reference[i]) & mask) == 0;
+                if (!same && mismatches++ < 8)
+                    cerr << "Mismatch at " << i << hex
+                         << ": " << output[i] << " expected " << reference[i] << dec << endl;
+            }
+            if (reference.size() != output.size())
+                cerr << "Expected " << reference.size() << " values, got " << output.size() << endl;
+            cerr << mismatches << " of " << output.size() << " values differ from " << expected << endl;
+            if (mismatches || reference.size() != output.size())
+                return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    catch (system_error& e) {
+        cerr
+            << e.what()
+            << " : "
+            << e.code().message()
+            << endl;
+        return EXIT_FAILURE;
+    }
+    catch (runtime_error& e) {
+        cerr << path << " : " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,357 @@
+#include "evergreen_disassembler.hpp"
+
+#include <iomanip>
+#include <set>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+const char* const chan_names[4] = { "CHAN_X", "CHAN_Y", "CHAN_Z", "CHAN_W" };
+
+const char* const sel_names[8] = { "SEL_X", "SEL_Y", "SEL_Z", "SEL_W", "SEL_0", "SEL_1", 0, "SEL_MASK" };
+
+const char* const kcache_mode_names[4] = {
+    "CF_KCACHE_NOP", "CF_KCACHE_LOCK_1", "CF_KCACHE_LOCK_2", "CF_KCACHE_LOCK_LOOP_INDEX"
+};
+
+const char* const fetch_type_names[4] = {
+    "VTX_FETCH_VERTEX_DATA", "VTX_FETCH_INSTANCE_DATA", "VTX_FETCH_NO_INDEX_OFFSET", 0
+};
+
+const char* const index_mode_names[8] = {
+    "INDEX_AR_X", "INDEX_AR_Y", "INDEX_AR_Z", "INDEX_AR_W",
+    "INDEX_LOOP", "INDEX_GLOBAL", "INDEX_GLOBAL_AR_X", 0
+};
+
+const char* const pred_sel_names[4] = { "PRED_SEL_OFF", 0, "PRED_SEL_ZERO", "PRED_SEL_ONE" };
+
+const char* const vec_swizzle_names[8] = {
+    "ALU_VEC_012", "ALU_VEC_021", "ALU_VEC_120", "ALU_VEC_102", "ALU_VEC_201", "ALU_VEC_210", 0, 0
+};
+
+const char* const scl_swizzle_names[8] = {
+    "ALU_SCL_210", "ALU_SCL_122", "ALU_SCL_212", "ALU_SCL_221", 0, 0, 0, 0
+};
+
+const char* const rat_inst_names[20] = {
+    "NOP", "STORE_TYPED", "STORE_RAW", "STORE_RAW_FDENORM",
+    "CMPXCHG_INT", "CMPXCHG_FLT", "CMPXCHG_FDENORM", "ADD",
+    "SUB", "RSUB", "MIN_INT", "MIN_UINT",
+    "MAX_INT", "MAX_UINT", "AND", "OR",
+    "XOR", "MSKOR", "INC_UINT", "DEC_UINT"
+};
+
+/// Get the name of a special source selector.
+const char* source_name(uint32_t sel)
+{
+    switch (sel) {
+    case alu_instruction::ALU_SRC_LDS_OQ_A:             return "ALU_SRC_LDS_OQ_A";
+    case alu_instruction::ALU_SRC_LDS_OQ_B:             return "ALU_SRC_LDS_OQ_B";
+    case alu_instruction::ALU_SRC_LDS_OQ_A_POP:         return "ALU_SRC_LDS_OQ_A_POP";
+    case alu_instruction::ALU_SRC_LDS_OQ_B_POP:         return "ALU_SRC_LDS_OQ_B_POP";
+    case alu_instruction::ALU_SRC_LDS_DIRECT_A:         return "ALU_SRC_LDS_DIRECT_A";
+    case alu_instruction::ALU_SRC_LDS_DIRECT_B:         return "ALU_SRC_LDS_DIRECT_B";
+    case alu_instruction::ALU_SRC_TIME_HI:              return "ALU_SRC_TIME_HI";
+    case alu_instruction::ALU_SRC_TIME_LO:              return "ALU_SRC_TIME_LO";
+    case alu_instruction::ALU_SRC_MASK_HI:              return "ALU_SRC_MASK_HI";
+    case alu_instruction::ALU_SRC_MASK_LO:              return "ALU_SRC_MASK_LO";
+    case alu_instruction::ALU_SRC_HW_WAVE_ID:           return "ALU_SRC_HW_WAVE_ID";
+    case alu_instruction::ALU_SRC_SIMD_ID:              return "ALU_SRC_SIMD_ID";
+    case alu_instruction::ALU_SRC_SE_ID:                return "ALU_SRC_SE_ID";
+    case alu_instruction::ALU_SRC_HW_THREADGRP_ID:      return "ALU_SRC_HW_THREADGRP_ID";
+    case alu_instruction::ALU_SRC_WAVE_ID_IN_GRP:       return "ALU_SRC_WAVE_ID_IN_GRP";
+    case alu_instruction::ALU_SRC_NUM_THREADGRP_WAVES:  return "ALU_SRC_NUM_THREADGRP_WAVES";
+    case alu_instruction::ALU_SRC_HW_ALU_ODD:           return "ALU_SRC_HW_ALU_ODD";
+    case alu_instruction::ALU_SRC_LOOP_IDX:             return "ALU_SRC_LOOP_IDX";
+    case alu_instruction::ALU_SRC_PARAM_BASE_ADDR:      return "ALU_SRC_PARAM_BASE_ADDR";
+    case alu_instruction::ALU_SRC_NEW_PRIM_MASK:        return "ALU_SRC_NEW_PRIM_MASK";
+    case alu_instruction::ALU_SRC_PRIM_MASK_HI:         return "ALU_SRC_PRIM_MASK_HI";
+    case alu_instruction::ALU_SRC_PRIM_MASK_LO:         return "ALU_SRC_PRIM_MASK_LO";
+    case alu_instruction::ALU_SRC_1_DBL_L:              return "ALU_SRC_1_DBL_L";
+    case alu_instruction::ALU_SRC_1_DBL_M:              return "ALU_SRC_1_DBL_M";
+    case alu_instruction::ALU_SRC_0_5_DBL_L:            return "ALU_SRC_0_5_DBL_L";
+    case alu_instruction::ALU_SRC_0_5_DBL_M:            return "ALU_SRC_0_5_DBL_M";
+    case alu_instruction::ALU_SRC_0:                    return "ALU_SRC_0";
+    case alu_instruction::ALU_SRC_1:                    return "ALU_SRC_1";
+    case alu_instruction::ALU_SRC_1_INT:                return "ALU_SRC_1_INT";
+    case alu_instruction::ALU_SRC_M_1_INT:              return "ALU_SRC_M_1_INT";
+    case alu_instruction::ALU_SRC_0_5:                  return "ALU_SRC_0_5";
+    case alu_instruction::ALU_SRC_LITERAL:              return "ALU_SRC_LITERAL";
+    case alu_instruction::ALU_SRC_PV:                   return "ALU_SRC_PV";
+    case alu_instruction::ALU_SRC_PS:                   return "ALU_SRC_PS";
+    default:                                            return 0;
+    }
+}
+
+/// This structure prints a double word in hexadecimal with the 0x prefix.
+struct hex32 {
+    uint32_t value;
+    explicit hex32(uint32_t v) : value(v) {}
+};
+
+ostream& operator<<(ostream& os, hex32 h)
+{
+    ios::fmtflags flags = os.flags();
+    char fill = os.fill('0');
+    os << "0x" << hex << setw(8) << h.value;
+    os.fill(fill);
+    os.flags(flags);
+    return os;
+}
+
+/// Print a value as a symbolic name if it has one or in parentheses otherwise.
+void print_enum(ostream& os, const char* field, const char* name, unsigned value)
+{
+    if (name)
+        os << ' ' << field << '.' << name;
+    else
+        os << ' ' << field << '(' << value << ')';
+}
+
+}
+
+void evergreen_disassembler::print(evergreen_program const& program)
+{
+    set<unsigned> targets;
+    for (size_t i = 0; i < program.size(); ++i)
+        if (program[i].cf.is_branch())
+            targets.insert(program[i].cf.addr());
+
+    for (size_t i = 0; i < program.size(); ++i) {
+        cf_node const& node = program[i];
+        if (targets.count(i))
+            _os << "@L" << i << "\n";
+        print(node.cf);
+        for (size_t g = 0; g < node.alu.size(); ++g)
+            print(node.alu[g]);
+        for (size_t f = 0; f < node.fetch.size(); ++f)
+            print(node.fetch[f]);
+        _os << "\n";
+    }
+    _os << "end;\n";
+}
+
+void evergreen_disassembler::print(cf_instruction const& cf)
+{
+    if (cf.name())
+        _os << cf.name() << ':';
+    else
+        _os << "CF_INST(" << cf.inst() << "):";
+
+    if (cf.is_alu()) {
+        for (unsigned k = 0; k < 2; ++k) {
+            if (cf.kcache_mode(k) == 0)
+                continue;
+            _os << " KCACHE_BANK" << k << '(' << cf.kcache_bank(k) << ')'
+                << " KCACHE_MODE" << k << '.' << kcache_mode_names[cf.kcache_mode(k)];
+            if (cf.kcache_addr(k) != 0)
+                _os << " KCACHE_ADDR" << k << '(' << cf.kcache_addr(k) << ')';
+        }
+        if (cf.alt_const())
+            _os << " ALT_CONST";
+    }
+    else if (cf.is_export()) {
+        bool rat = cf.inst() >= cf_instruction::CF_INST_MEM_RAT &&
+            cf.inst() <= cf_instruction::CF_INST_MEM_RAT_CACHELESS;
+        bool pixel = cf.inst() == cf_instruction::CF_INST_EXPORT ||
+            cf.inst() == cf_instruction::CF_INST_EXPORT_DONE;
+        if (rat) {
+            _os << " RAT_ID(" << cf.rat_id() << ')';
+            if (cf.rat_inst() < 20)
+                _os << " RAT_INST.EXPORT_RAT_INST_" << rat_inst_names[cf.rat_inst()];
+            else
+                _os << " RAT_INST(" << cf.rat_inst() << ')';
+            if (cf.rat_index_mode() != 0)
+                _os << " RAT_INDEX_MODE(" << cf.rat_index_mode() << ')';
+        }
+        else
+            _os << " ARRAY_BASE(" << cf.array_base() << ')';
+        _os << " TYPE(" << cf.type() << ')'
+            << " RW_GPR(" << cf.rw_gpr() << ')';
+        if (cf.rw_rel())
+            _os << " RW_REL";
+        _os << " INDEX_GPR(" << cf.index_gpr() << ')'
+            << " ELEM_SIZE(" << cf.elem_size() << ')';
+        if (pixel) {
+            for (unsigned c = 0; c < 4; ++c)
+                print_enum(_os, c == 0 ? "SRC_SEL_X" : c == 1 ? "SRC_SEL_Y" : c == 2 ? "SRC_SEL_Z" : "SRC_SEL_W",
+                           sel_names[cf.word1 >> (3 * c) & 7], cf.word1 >> (3 * c) & 7);
+        }
+        else {
+            if (cf.array_size() != 0)
+                _os << " ARRAY_SIZE(" << cf.array_size() << ')';
+            _os << " COMP_MASK(" << cf.comp_mask() << ')';
+        }
+        if (cf.burst_count() != 0)
+            _os << " BURST_COUNT(" << cf.burst_count() << ')';
+        if (cf.whole_quad_mode())
+            _os << " MARK";
+    }
+    else {
+        if (!cf.is_fetch() && cf.count() != 0)
+            _os << " COUNT(" << cf.count() << ')';
+        if (cf.is_branch())
+            _os << " ADDR(@L" << cf.addr() << ')';
+        if (cf.pop_count() != 0)
+            _os << " POP_COUNT(" << cf.pop_count() << ')';
+        if (cf.cf_const() != 0 || cf.inst() == cf_instruction::CF_INST_LOOP_START ||
+            cf.inst() == cf_instruction::CF_INST_LOOP_END)
+            _os << " CF_CONST(" << cf.cf_const() << ')';
+        if (cf.cond() != 0)
+            _os << " COND(" << cf.cond() << ')';
+        if ((cf.word1 >> 20 & 1) != 0)
+            _os << " VALID_PIXEL_MODE";
+    }
+
+    if (!cf.is_export() && cf.whole_quad_mode())
+        _os << " WHOLE_QUAD_MODE";
+    if (cf.barrier())
+        _os << " BARRIER";
+    if (cf.end_of_program())
+        _os << " END_OF_PROGRAM";
+    _os << ";\n";
+}
+
+void evergreen_disassembler::print(alu_group const& group)
+{
+    unsigned unit[5] = { 0, 0, 0, 0, 0 };
+    try {
+        group.assign_slots(unit);
+    }
+    catch (runtime_error&) {
+        // Print invalid groups too, with vector bank swizzles.
+    }
+
+    for (size_t i = 0; i < group.slots.size(); ++i)
+        print(group.slots[i], unit[i]);
+
+    if (!group.literals.empty()) {
+        _os << "   ";
+        for (size_t i = 0; i < group.literals.size(); ++i)
+            _os << ' ' << hex32(group.literals[i]);
+        if (group.literals.size() % 2 != 0)
+            _os << ' ' << hex32(0);
+        _os << ";\n";
+    }
+}
+
+void evergreen_disassembler::print(alu_instruction const& alu, unsigned unit)
+{
+    bool lds = alu.op == alu_instruction::OP3_LDS_IDX_OP;
+
+    _os << "    ";
+    if (lds && alu_instruction::lds_name(alu.lds_op))
+        _os << "LDS_" << alu_instruction::lds_name(alu.lds_op) << ':';
+    else if (lds)
+        _os << "LDS_OP(" << alu.lds_op << "):";
+    else if (alu.name())
+        _os << alu.name() << ':';
+    else
+        _os << "ALU_INST(" << alu.op << "):";
+
+    if (!lds)
+        _os << " DST_GPR(" << alu.dst_gpr << ')';
+    _os << " DST_CHAN." << chan_names[alu.dst_chan];
+    if (alu.dst_rel)
+        _os << " DST_REL";
+    if (!alu.is_op3() && alu.write_mask)
+        _os << " WRITE_MASK";
+    if (alu.clamp)
+        _os << " CLAMP";
+    if (alu.omod != 0)
+        _os << " OMOD(" << alu.omod << ')';
+    if (alu.update_exec_mask)
+        _os << " UPDATE_EXEC_MASK";
+    if (alu.update_pred)
+        _os << " UPDATE_PRED";
+    if (alu.pred_sel != alu_instruction::PRED_SEL_OFF)
+        print_enum(_os, "PRED_SEL", pred_sel_names[alu.pred_sel & 3], alu.pred_sel);
+    if (alu.index_mode != 0)
+        print_enum(_os, "INDEX_MODE", index_mode_names[alu.index_mode & 7], alu.index_mode);
+    if (lds)
+        for (unsigned b = 6; b-- > 0; )
+            if (alu.idx_offset >> b & 1)
+                _os << " IDX_OFFSET_" << b;
+    if (alu.bank_swizzle != 0)
+        print_enum(_os, "BANK_SWIZZLE",
+                   unit == 4 ? scl_swizzle_names[alu.bank_swizzle & 7] : vec_swizzle_names[alu.bank_swizzle & 7],
+                   alu.bank_swizzle);
+
+    for (unsigned s = 0, n = alu.num_sources(); s < n; ++s) {
+        alu_source const& src = alu.src[s];
+        _os << "\n        SRC" << s << "_SEL.";
+        if (alu_instruction::is_gpr(src.sel))
+            _os << "GPR(" << src.sel << ')';
+        else if (alu_instruction::is_kcache(src.sel)) {
+            unsigned bank = src.sel < alu_instruction::ALU_SRC_KCACHE2_BASE
+                ? (src.sel - alu_instruction::ALU_SRC_KCACHE0_BASE) / 32
+                : 2 + (src.sel - alu_instruction::ALU_SRC_KCACHE2_BASE) / 32;
+            _os << "Kcache_bank" << bank << '(' << src.sel % 32 << ')';
+        }
+        else if (source_name(src.sel))
+            _os << source_name(src.sel);
+        else
+            _os << "ALU_SRC(" << src.sel << ')';
+        _os << " SRC" << s << "_CHAN." << chan_names[src.chan & 3];
+        if (src.rel)
+            _os << " SRC" << s << "_REL";
+        if (src.neg)
+            _os << " SRC" << s << "_NEG";
+        if (src.abs)
+            _os << " SRC" << s << "_ABS";
+    }
+
+    if (alu.last)
+        _os << " LAST";
+    _os << ";\n";
+}
+
+void evergreen_disassembler::print(fetch_instruction const& fetch)
+{
+    _os << "    " << fetch.name() << ':';
+    if (!fetch.is_vertex()) {
+        // Texture instructions are not decoded, their words are printed raw.
+        _os << " WORD0(" << hex32(fetch.words[0]) << ");\n"
+            << "        WORD1(" << hex32(fetch.words[1]) << ");\n"
+            << "        WORD2(" << hex32(fetch.words[2]) << ");\n";
+        return;
+    }
+
+    print_enum(_os, "FETCH_TYPE", fetch_type_names[fetch.fetch_type()], fetch.fetch_type());
+    if ((fetch.words[0] >> 7 & 1) != 0)
+        _os << " FETCH_WHOLE_QUAD";
+    _os << " BUFFER_ID(" << fetch.resource_id() << ')'
+        << " SRC_GPR(" << fetch.src_gpr() << ')';
+    if (fetch.src_rel())
+        _os << " SRC_REL";
+    _os << " SRC_SEL_X." << sel_names[fetch.src_sel_x()]
+        << " MEGA_FETCH_COUNT(" << fetch.mega_fetch_count() << ')'
+        << ";\n";
+
+    _os << "        DST_GPR(" << fetch.dst_gpr() << ')';
+    if (fetch.dst_rel())
+        _os << " DST_REL";
+    for (unsigned c = 0; c < 4; ++c) {
+        const char* field = c == 0 ? "DST_SEL_X" : c == 1 ? "DST_SEL_Y" : c == 2 ? "DST_SEL_Z" : "DST_SEL_W";
+        print_enum(_os, field, sel_names[fetch.dst_sel(c)], fetch.dst_sel(c));
+    }
+    if (fetch.use_const_fields())
+        _os << " USE_CONST_FIELDS";
+    else
+        _os << " DATA_FORMAT(" << fetch.data_format() << ')'
+            << " NUM_FORMAT_ALL(" << (fetch.words[1] >> 28 & 3) << ')'
+            << " FORMAT_COMP_ALL(" << (fetch.words[1] >> 30 & 1) << ')'
+            << " SRF_MODE_ALL(" << (fetch.words[1] >> 31) << ')';
+    _os << ";\n";
+
+    _os << "       ";
+    if (fetch.offset() != 0 || (!fetch.endian_swap() && !fetch.mega_fetch()))
+        _os << " OFFSET(" << fetch.offset() << ')';
+    if (fetch.endian_swap() != 0)
+        _os << " ENDIAN_SWAP(" << fetch.endian_swap() << ')';
+    if (fetch.mega_fetch())
+        _os << " MEGA_FETCH";
+    _os << ";\n";
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "evergreen_program.hpp"
+
+#include <ostream>
+
+/// This class prints Evergreen programs in the syntax of the as_r800
+/// assembler, so that the listing can be read side by side with the sources
+/// and assembled again.
+///
+/// Branch targets are printed as labels named after the CF index of the
+/// target (\c @L12). The ADDR and COUNT fields of clauses are implied by the
+/// layout and are not printed.
+class evergreen_disassembler {
+public:
+    /// This constructor creates a disassembler which prints to a stream.
+    explicit evergreen_disassembler(std::ostream& os) : _os(os) {}
+
+    /// Print a whole program, followed by the \c end statement.
+    void print(evergreen_program const& program);
+    /// Print a CF instruction without its clause.
+    void print(cf_instruction const& cf);
+    /// Print an ALU instruction group and its literal constants.
+    void print(alu_group const& group);
+    /// Print a fetch instruction (three statements, one per double word).
+    void print(fetch_instruction const& fetch);
+
+private:
+    void print(alu_instruction const& alu, unsigned unit);
+
+    std::ostream& _os;
+};
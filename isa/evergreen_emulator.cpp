@@ -0,0 +1,1544 @@
+#include "evergreen_emulator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+typedef cf_instruction cf;
+typedef alu_instruction alu;
+typedef fetch_instruction fetch;
+
+const unsigned wavefront_size = 64;
+const unsigned num_gprs = 128;
+const unsigned max_stack_depth = 64;
+const unsigned max_call_depth = 32;
+const uint64_t max_cf_instructions = uint64_t(1) << 28;
+
+/// Issue cycles counted by the time counter.
+const unsigned cf_cycles = 4;
+const unsigned alu_group_cycles = 4;
+const unsigned fetch_cycles = 4;
+
+const float two_pi = 6.28318530717958647692f;
+
+/// This structure holds one double word per lane of a wavefront.
+struct lanes {
+    uint32_t v[wavefront_size];
+};
+
+inline float as_float(uint32_t u)
+{
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+inline uint32_t as_uint(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+inline uint32_t as_bool(bool b) { return b ? ~0u : 0; }
+inline uint32_t as_one(bool b) { return b ? as_uint(1.0f) : 0; }
+
+void broadcast(lanes& r, uint32_t value)
+{
+    for (unsigned l = 0; l < wavefront_size; ++l)
+        r.v[l] = value;
+}
+
+/// Copy the lanes of a mask.
+void select(lanes& dst, lanes const& src, uint64_t mask)
+{
+    if (mask == ~uint64_t(0)) {
+        dst = src;
+        return;
+    }
+    for (unsigned l = 0; l < wavefront_size; ++l) {
+        uint32_t m = -uint32_t(mask >> l & 1);
+        dst.v[l] = (dst.v[l] & ~m) | (src.v[l] & m);
+    }
+}
+
+// The lane loops below are simple enough for the compiler to vectorize.
+
+template < typename F >
+void map1(lanes& r, lanes const& a, F f)
+{
+    for (unsigned l = 0; l < wavefront_size; ++l)
+        r.v[l] = f(a.v[l]);
+}
+
+template < typename F >
+void map2(lanes& r, lanes const& a, lanes const& b, F f)
+{
+    for (unsigned l = 0; l < wavefront_size; ++l)
+        r.v[l] = f(a.v[l], b.v[l]);
+}
+
+template < typename F >
+void map3(lanes& r, lanes const& a, lanes const& b, lanes const& c, F f)
+{
+    for (unsigned l = 0; l < wavefront_size; ++l)
+        r.v[l] = f(a.v[l], b.v[l], c.v[l]);
+}
+
+template < typename F >
+void mapf1(lanes& r, lanes const& a, F f)
+{
+    for (unsigned l = 0; l < wavefront_size; ++l)
+        r.v[l] = as_uint(f(as_float(a.v[l])));
+}
+
+template < typename F >
+void mapf2(lanes& r, lanes const& a, lanes const& b, F f)
+{
+    for (unsigned l = 0; l < wavefront_size; ++l)
+        r.v[l] = as_uint(f(as_float(a.v[l]), as_float(b.v[l])));
+}
+
+template < typename F >
+void mapf3(lanes& r, lanes const& a, lanes const& b, lanes const& c, F f)
+{
+    for (unsigned l = 0; l < wavefront_size; ++l)
+        r.v[l] = as_uint(f(as_float(a.v[l]), as_float(b.v[l]), as_float(c.v[l])));
+}
+
+/// Apply a comparison of floats, the predicate condition goes to \p cond.
+template < typename F >
+void comparef(lanes& r, lanes& cond, lanes const& a, lanes const& b, F f)
+{
+    for (unsigned l = 0; l < wavefront_size; ++l) {
+        bool c = f(as_float(a.v[l]), as_float(b.v[l]));
+        cond.v[l] = c;
+        r.v[l] = as_one(c);
+    }
+}
+
+/// Apply a comparison of integers, the predicate condition goes to \p cond.
+template < typename F >
+void compare(lanes& r, lanes& cond, lanes const& a, lanes const& b, F f)
+{
+    for (unsigned l = 0; l < wavefront_size; ++l) {
+        bool c = f(a.v[l], b.v[l]);
+        cond.v[l] = c;
+        r.v[l] = c;
+    }
+}
+
+/// Multiply with the legacy rule 0 * anything = 0.
+inline float mul_legacy(float x, float y)
+{
+    return x == 0 || y == 0 ? 0.0f : x * y;
+}
+
+inline float clamp_inf(float x)
+{
+    return isinf(x) ? copysignf(3.402823466e+38f, x) : x;
+}
+
+inline uint32_t flt_to_int(float x)
+{
+    if (isnan(x))
+        return 0;
+    if (x >= 2147483647.0f)
+        return 0x7fffffff;
+    if (x <= -2147483648.0f)
+        return 0x80000000u;
+    return uint32_t(int32_t(x));
+}
+
+inline uint32_t flt_to_uint(float x)
+{
+    if (isnan(x) || x <= 0)
+        return 0;
+    if (x >= 4294967295.0f)
+        return 0xffffffffu;
+    return uint32_t(x);
+}
+
+inline uint32_t bit_count(uint32_t x)
+{
+    unsigned n = 0;
+    for (; x; x &= x - 1)
+        ++n;
+    return n;
+}
+
+/// Count the active lanes of a mask.
+inline unsigned active_lanes(uint64_t mask)
+{
+    return bit_count(uint32_t(mask)) + bit_count(uint32_t(mask >> 32));
+}
+
+inline uint32_t first_bit_high(uint32_t x)
+{
+    for (unsigned i = 0; i < 32; ++i)
+        if (x & 0x80000000u >> i)
+            return i;
+    return ~0u;
+}
+
+inline uint32_t first_bit_low(uint32_t x)
+{
+    for (unsigned i = 0; i < 32; ++i)
+        if (x >> i & 1)
+            return i;
+    return ~0u;
+}
+
+inline uint32_t bit_reverse(uint32_t x)
+{
+    uint32_t r = 0;
+    for (unsigned i = 0; i < 32; ++i)
+        r |= (x >> i & 1) << (31 - i);
+    return r;
+}
+
+inline double as_double(uint32_t hi, uint32_t lo)
+{
+    uint64_t u = uint64_t(hi) << 32 | lo;
+    double d;
+    memcpy(&d, &u, sizeof(d));
+    return d;
+}
+
+inline uint64_t as_uint64(double d)
+{
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    return u;
+}
+
+string unsupported(const char* what, const char* name, unsigned code)
+{
+    string s = string("unsupported ") + what + " ";
+    if (name)
+        return s + name;
+    return s + to_string(code);
+}
+
+/// Evaluate an ALU instruction which works on its slot alone.
+/// \param a The source operands.
+/// \param r Receives the result.
+/// \param cond Receives the condition of PRED_SET instructions (0 or 1).
+void evaluate(unsigned op, lanes const* a, lanes& r, lanes& cond)
+{
+    switch (op) {
+    case alu::OP2_ADD:
+        mapf2(r, a[0], a[1], [](float x, float y) { return x + y; });
+        break;
+    case alu::OP2_MUL:
+        mapf2(r, a[0], a[1], mul_legacy);
+        break;
+    case alu::OP2_MUL_IEEE:
+        mapf2(r, a[0], a[1], [](float x, float y) { return x * y; });
+        break;
+    case alu::OP2_MAX:
+        mapf2(r, a[0], a[1], [](float x, float y) { return x >= y ? x : y; });
+        break;
+    case alu::OP2_MIN:
+        mapf2(r, a[0], a[1], [](float x, float y) { return x < y ? x : y; });
+        break;
+    case alu::OP2_MAX_DX10:
+        mapf2(r, a[0], a[1], [](float x, float y) { return fmaxf(x, y); });
+        break;
+    case alu::OP2_MIN_DX10:
+        mapf2(r, a[0], a[1], [](float x, float y) { return fminf(x, y); });
+        break;
+    case alu::OP2_SETE:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return as_one(as_float(x) == as_float(y)); });
+        break;
+    case alu::OP2_SETGT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return as_one(as_float(x) > as_float(y)); });
+        break;
+    case alu::OP2_SETGE:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return as_one(as_float(x) >= as_float(y)); });
+        break;
+    case alu::OP2_SETNE:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return as_one(as_float(x) != as_float(y)); });
+        break;
+    case alu::OP2_SETE_DX10:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return as_bool(as_float(x) == as_float(y)); });
+        break;
+    case alu::OP2_SETGT_DX10:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return as_bool(as_float(x) > as_float(y)); });
+        break;
+    case alu::OP2_SETGE_DX10:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return as_bool(as_float(x) >= as_float(y)); });
+        break;
+    case alu::OP2_SETNE_DX10:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return as_bool(as_float(x) != as_float(y)); });
+        break;
+    case alu::OP2_FRACT:
+        mapf1(r, a[0], [](float x) { return x - floorf(x); });
+        break;
+    case alu::OP2_TRUNC:
+        mapf1(r, a[0], [](float x) { return truncf(x); });
+        break;
+    case alu::OP2_CEIL:
+        mapf1(r, a[0], [](float x) { return ceilf(x); });
+        break;
+    case alu::OP2_RNDNE:
+        mapf1(r, a[0], [](float x) { return rintf(x); });
+        break;
+    case alu::OP2_FLOOR:
+        mapf1(r, a[0], [](float x) { return floorf(x); });
+        break;
+    case alu::OP2_ASHR_INT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return uint32_t(int32_t(x) >> (y & 31)); });
+        break;
+    case alu::OP2_LSHR_INT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return x >> (y & 31); });
+        break;
+    case alu::OP2_LSHL_INT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return x << (y & 31); });
+        break;
+    case alu::OP2_MOV:
+    case alu::OP2_MOVA_INT:
+        r = a[0];
+        break;
+    case alu::OP2_PRED_SETGT_UINT:
+        compare(r, cond, a[0], a[1], [](uint32_t x, uint32_t y) { return x > y; });
+        break;
+    case alu::OP2_PRED_SETGE_UINT:
+        compare(r, cond, a[0], a[1], [](uint32_t x, uint32_t y) { return x >= y; });
+        break;
+    case alu::OP2_PRED_SETE:
+        comparef(r, cond, a[0], a[1], [](float x, float y) { return x == y; });
+        break;
+    case alu::OP2_PRED_SETGT:
+        comparef(r, cond, a[0], a[1], [](float x, float y) { return x > y; });
+        break;
+    case alu::OP2_PRED_SETGE:
+        comparef(r, cond, a[0], a[1], [](float x, float y) { return x >= y; });
+        break;
+    case alu::OP2_PRED_SETNE:
+        comparef(r, cond, a[0], a[1], [](float x, float y) { return x != y; });
+        break;
+    case alu::OP2_PREDE_INT:
+        compare(r, cond, a[0], a[1], [](uint32_t x, uint32_t y) { return x == y; });
+        break;
+    case alu::OP2_PRED_SETGT_INT:
+        compare(r, cond, a[0], a[1], [](uint32_t x, uint32_t y) { return int32_t(x) > int32_t(y); });
+        break;
+    case alu::OP2_PRED_SETGE_INT:
+        compare(r, cond, a[0], a[1], [](uint32_t x, uint32_t y) { return int32_t(x) >= int32_t(y); });
+        break;
+    case alu::OP2_PRED_SETNE_INT:
+        compare(r, cond, a[0], a[1], [](uint32_t x, uint32_t y) { return x != y; });
+        break;
+    case alu::OP2_AND_INT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return x & y; });
+        break;
+    case alu::OP2_OR_INT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return x | y; });
+        break;
+    case alu::OP2_XOR_INT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return x ^ y; });
+        break;
+    case alu::OP2_NOT_INT:
+        map1(r, a[0], [](uint32_t x) { return ~x; });
+        break;
+    case alu::OP2_ADD_INT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return x + y; });
+        break;
+    case alu::OP2_SUB_INT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return x - y; });
+        break;
+    case alu::OP2_MAX_INT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return int32_t(x) > int32_t(y) ? x : y; });
+        break;
+    case alu::OP2_MIN_INT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return int32_t(x) < int32_t(y) ? x : y; });
+        break;
+    case alu::OP2_MAX_UINT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return x > y ? x : y; });
+        break;
+    case alu::OP2_MIN_UINT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return x < y ? x : y; });
+        break;
+    case alu::OP2_SETE_INT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return as_bool(x == y); });
+        break;
+    case alu::OP2_SETGT_INT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return as_bool(int32_t(x) > int32_t(y)); });
+        break;
+    case alu::OP2_SETGE_INT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return as_bool(int32_t(x) >= int32_t(y)); });
+        break;
+    case alu::OP2_SETNE_INT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return as_bool(x != y); });
+        break;
+    case alu::OP2_SETGT_UINT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return as_bool(x > y); });
+        break;
+    case alu::OP2_SETGE_UINT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return as_bool(x >= y); });
+        break;
+    case alu::OP2_FLT_TO_INT:
+        map1(r, a[0], [](uint32_t x) { return flt_to_int(as_float(x)); });
+        break;
+    case alu::OP2_FLT_TO_INT_FLOOR:
+        map1(r, a[0], [](uint32_t x) { return flt_to_int(floorf(as_float(x))); });
+        break;
+    case alu::OP2_FLT_TO_INT_RPI:
+        map1(r, a[0], [](uint32_t x) { return flt_to_int(floorf(as_float(x) + 0.5f)); });
+        break;
+    case alu::OP2_FLT_TO_UINT:
+        map1(r, a[0], [](uint32_t x) { return flt_to_uint(as_float(x)); });
+        break;
+    case alu::OP2_INT_TO_FLT:
+        map1(r, a[0], [](uint32_t x) { return as_uint(float(int32_t(x))); });
+        break;
+    case alu::OP2_UINT_TO_FLT:
+        map1(r, a[0], [](uint32_t x) { return as_uint(float(x)); });
+        break;
+    case alu::OP2_BFREV_INT:
+        map1(r, a[0], bit_reverse);
+        break;
+    case alu::OP2_BCNT_INT:
+        map1(r, a[0], bit_count);
+        break;
+    case alu::OP2_FFBH_UINT:
+        map1(r, a[0], first_bit_high);
+        break;
+    case alu::OP2_FFBL_INT:
+        map1(r, a[0], first_bit_low);
+        break;
+    case alu::OP2_FFBH_INT:
+        map1(r, a[0], [](uint32_t x) { return first_bit_high(int32_t(x) < 0 ? ~x : x); });
+        break;
+    case alu::OP2_ADDC_UINT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return uint32_t(x + y < x); });
+        break;
+    case alu::OP2_SUBB_UINT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return uint32_t(x < y); });
+        break;
+    case alu::OP2_BFM_INT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return ((1u << (x & 31)) - 1) << (y & 31); });
+        break;
+    case alu::OP2_EXP_IEEE:
+        mapf1(r, a[0], [](float x) { return exp2f(x); });
+        break;
+    case alu::OP2_LOG_IEEE:
+        mapf1(r, a[0], [](float x) { return log2f(x); });
+        break;
+    case alu::OP2_LOG_CLAMPED:
+        mapf1(r, a[0], [](float x) { return clamp_inf(log2f(x)); });
+        break;
+    case alu::OP2_RECIP_IEEE:
+        mapf1(r, a[0], [](float x) { return 1.0f / x; });
+        break;
+    case alu::OP2_RECIP_CLAMPED:
+    case alu::OP2_RECIP_FF:
+        mapf1(r, a[0], [](float x) { return clamp_inf(1.0f / x); });
+        break;
+    case alu::OP2_RECIPSQRT_IEEE:
+        mapf1(r, a[0], [](float x) { return 1.0f / sqrtf(x); });
+        break;
+    case alu::OP2_RECIPSQRT_CLAMPED:
+    case alu::OP2_RECIPSQRT_FF:
+        mapf1(r, a[0], [](float x) { return clamp_inf(1.0f / sqrtf(x)); });
+        break;
+    case alu::OP2_SQRT_IEEE:
+        mapf1(r, a[0], [](float x) { return sqrtf(x); });
+        break;
+    case alu::OP2_SIN:
+        mapf1(r, a[0], [](float x) { return sinf(x * two_pi); });
+        break;
+    case alu::OP2_COS:
+        mapf1(r, a[0], [](float x) { return cosf(x * two_pi); });
+        break;
+    case alu::OP2_MULLO_INT:
+    case alu::OP2_MULLO_UINT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return x * y; });
+        break;
+    case alu::OP2_MULHI_INT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y)
+            { return uint32_t(uint64_t(int64_t(int32_t(x)) * int32_t(y)) >> 32); });
+        break;
+    case alu::OP2_MULHI_UINT:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return uint32_t(uint64_t(x) * y >> 32); });
+        break;
+    case alu::OP2_MUL_UINT24:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y) { return (x & 0xffffff) * (y & 0xffffff); });
+        break;
+    case alu::OP2_MULHI_UINT24:
+        map2(r, a[0], a[1], [](uint32_t x, uint32_t y)
+            { return uint32_t(uint64_t(x & 0xffffff) * (y & 0xffffff) >> 32); });
+        break;
+    case alu::OP3_BFE_UINT:
+        map3(r, a[0], a[1], a[2], [](uint32_t x, uint32_t y, uint32_t z)
+            { return (z & 31) ? x >> (y & 31) & ((1u << (z & 31)) - 1) : 0; });
+        break;
+    case alu::OP3_BFE_INT:
+        map3(r, a[0], a[1], a[2], [](uint32_t x, uint32_t y, uint32_t z) -> uint32_t {
+            unsigned w = z & 31;
+            if (w == 0)
+                return 0;
+            uint32_t v = x >> (y & 31) & ((1u << w) - 1);
+            return v & (1u << (w - 1)) ? v | ~((1u << w) - 1) : v;
+        });
+        break;
+    case alu::OP3_BFI_INT:
+        map3(r, a[0], a[1], a[2], [](uint32_t x, uint32_t y, uint32_t z) { return (x & y) | (~x & z); });
+        break;
+    case alu::OP3_BIT_ALIGN_INT:
+        map3(r, a[0], a[1], a[2], [](uint32_t x, uint32_t y, uint32_t z)
+            { return uint32_t((uint64_t(x) << 32 | y) >> (z & 31)); });
+        break;
+    case alu::OP3_BYTE_ALIGN_INT:
+        map3(r, a[0], a[1], a[2], [](uint32_t x, uint32_t y, uint32_t z)
+            { return uint32_t((uint64_t(x) << 32 | y) >> (8 * (z & 3))); });
+        break;
+    case alu::OP3_MULADD_UINT24:
+        map3(r, a[0], a[1], a[2], [](uint32_t x, uint32_t y, uint32_t z)
+            { return (x & 0xffffff) * (y & 0xffffff) + z; });
+        break;
+    case alu::OP3_FMA:
+        mapf3(r, a[0], a[1], a[2], [](float x, float y, float z) { return fmaf(x, y, z); });
+        break;
+    case alu::OP3_MULADD:
+        mapf3(r, a[0], a[1], a[2], [](float x, float y, float z) { return mul_legacy(x, y) + z; });
+        break;
+    case alu::OP3_MULADD_M2:
+        mapf3(r, a[0], a[1], a[2], [](float x, float y, float z) { return (mul_legacy(x, y) + z) * 2; });
+        break;
+    case alu::OP3_MULADD_M4:
+        mapf3(r, a[0], a[1], a[2], [](float x, float y, float z) { return (mul_legacy(x, y) + z) * 4; });
+        break;
+    case alu::OP3_MULADD_D2:
+        mapf3(r, a[0], a[1], a[2], [](float x, float y, float z) { return (mul_legacy(x, y) + z) / 2; });
+        break;
+    case alu::OP3_MULADD_IEEE:
+        mapf3(r, a[0], a[1], a[2], [](float x, float y, float z) { return x * y + z; });
+        break;
+    case alu::OP3_CNDE:
+        map3(r, a[0], a[1], a[2], [](uint32_t x, uint32_t y, uint32_t z) { return as_float(x) == 0 ? y : z; });
+        break;
+    case alu::OP3_CNDGT:
+        map3(r, a[0], a[1], a[2], [](uint32_t x, uint32_t y, uint32_t z) { return as_float(x) > 0 ? y : z; });
+        break;
+    case alu::OP3_CNDGE:
+        map3(r, a[0], a[1], a[2], [](uint32_t x, uint32_t y, uint32_t z) { return as_float(x) >= 0 ? y : z; });
+        break;
+    case alu::OP3_CNDE_INT:
+        map3(r, a[0], a[1], a[2], [](uint32_t x, uint32_t y, uint32_t z) { return x == 0 ? y : z; });
+        break;
+    case alu::OP3_CNDGT_INT:
+        map3(r, a[0], a[1], a[2], [](uint32_t x, uint32_t y, uint32_t z) { return int32_t(x) > 0 ? y : z; });
+        break;
+    case alu::OP3_CNDGE_INT:
+        map3(r, a[0], a[1], a[2], [](uint32_t x, uint32_t y, uint32_t z) { return int32_t(x) >= 0 ? y : z; });
+        break;
+    default:
+        throw runtime_error(unsupported("ALU instruction", alu::name(op), op));
+    }
+}
+
+/// Evaluate a pair of slots executing a 64-bit instruction. The first slot
+/// reads the high and the second the low double words of the operands, the
+/// first slot returns the low and the second the high double word of the
+/// result (this is how Mesa uses them).
+void evaluate_double(unsigned op, lanes const* hi, lanes const* lo, lanes& r0, lanes& r1)
+{
+    for (unsigned l = 0; l < wavefront_size; ++l) {
+        double x = as_double(hi[0].v[l], lo[0].v[l]);
+        double y = as_double(hi[1].v[l], lo[1].v[l]);
+        double z = as_double(hi[2].v[l], lo[2].v[l]);
+        double d;
+        switch (op) {
+        case alu::OP2_ADD_64:
+            d = x + y;
+            break;
+        case alu::OP2_MUL_64:
+            d = x * y;
+            break;
+        case alu::OP3_FMA_64:
+            d = fma(x, y, z);
+            break;
+        case alu::OP3_MULADD_64:
+            d = x * y + z;
+            break;
+        default:
+            throw runtime_error(unsupported("ALU instruction", alu::name(op), op));
+        }
+        uint64_t u = as_uint64(d);
+        r0.v[l] = uint32_t(u);
+        r1.v[l] = uint32_t(u >> 32);
+    }
+}
+
+/// Get the number of 32-bit components of a data format.
+unsigned components(unsigned format)
+{
+    switch (format) {
+    case fetch::FMT_32:
+    case fetch::FMT_32_FLOAT:
+        return 1;
+    case fetch::FMT_32_32:
+    case fetch::FMT_32_32_FLOAT:
+        return 2;
+    case fetch::FMT_32_32_32:
+    case fetch::FMT_32_32_32_FLOAT:
+        return 3;
+    case fetch::FMT_32_32_32_32:
+    case fetch::FMT_32_32_32_32_FLOAT:
+        return 4;
+    default:
+        throw runtime_error("unsupported data format " + to_string(format));
+    }
+}
+
+/// This structure holds an entry of the stack of a wavefront: the execute
+/// mask saved by a push, or the state of a loop.
+struct stack_entry {
+    bool loop;
+    uint64_t mask;          ///< Execute mask restored by the pop or at the end of the loop.
+    unsigned count;         ///< Remaining trips (loops only).
+    int index;              ///< Loop index of the enclosing loop (loops only).
+    int inc;                ///< Increment of the loop index (loops only).
+    uint64_t broken;        ///< Lanes which left the loop (loops only).
+    uint64_t continued;     ///< Lanes waiting for the next trip (loops only).
+};
+
+/// This structure holds the state of a wavefront.
+struct wavefront {
+    vector<lanes> gprs;     ///< GPR channels, 4 * gpr + chan.
+    lanes pv[4];            ///< Previous vector results.
+    lanes ps;               ///< Previous scalar result.
+    lanes ar;               ///< Address register (MOVA_INT).
+    uint64_t exec;          ///< Execute mask.
+    uint64_t exec_next;     ///< Execute mask at the end of the current ALU clause.
+    uint64_t pred;          ///< Predicate.
+    int loop_index;         ///< Loop index (aL).
+    vector<stack_entry> stack;
+    vector<unsigned> calls; ///< Return addresses.
+    deque<lanes> lds_queue; ///< LDS output queue A.
+    unsigned pc;            ///< Current CF instruction.
+    unsigned group;         ///< Next instruction group of the current ALU clause.
+    bool in_clause;         ///< Suspended within an ALU clause.
+    bool at_barrier;        ///< Waiting at a GROUP_BARRIER.
+    bool done;
+    unsigned id;            ///< Wavefront id in the dispatch.
+    unsigned id_in_group;
+    uint64_t time;          ///< Issue cycles.
+    uint64_t executed;      ///< CF instructions executed.
+    unsigned bytes;         ///< Bytes fetched or exported by the current CF instruction.
+};
+
+/// This class executes work groups, one at a time.
+class group_executor {
+public:
+    group_executor(evergreen_program const& program, vector<vector<unsigned> > const& units, dispatch const& d,
+                   vector<wavefront_trace>* traces)
+        : _program(program), _units(units), _dispatch(d), _traces(traces), _group(), _stats() {}
+
+    /// Execute a group given its index in the dispatch.
+    void run(unsigned group, emulator_statistics& stats);
+
+private:
+    void start(unsigned group);
+    void step(wavefront& w);
+    void record(wavefront& w, unsigned first, bool barrier);
+    bool execute_alu(wavefront& w, unsigned node);
+    bool execute_group(wavefront& w, cf_instruction const& c, alu_group const& g, unsigned const* unit);
+    void read_source(wavefront& w, cf_instruction const& c, alu_group const& g, alu_instruction const& inst, unsigned i, lanes& r);
+    lanes& gpr(wavefront& w, unsigned sel, unsigned chan, bool rel, unsigned index_mode);
+    void write(wavefront& w, alu_instruction const& inst, lanes const& r, uint64_t mask);
+    void execute_lds(wavefront& w, alu_instruction const& inst, lanes const* a, uint64_t mask);
+    void execute_fetch(wavefront& w, cf_node const& node);
+    void execute_export(wavefront& w, cf_instruction const& c);
+    uint32_t constant(unsigned bank, unsigned index, unsigned chan) const;
+
+    void push(wavefront& w, stack_entry const& e);
+    void push_mask(wavefront& w);
+    void pop(wavefront& w, unsigned n);
+    uint64_t else_mask(wavefront const& w) const;
+    stack_entry& innermost_loop(wavefront& w);
+
+    evergreen_program const& _program;
+    vector<vector<unsigned> > const& _units;
+    dispatch const& _dispatch;
+    vector<wavefront_trace>* _traces;
+    vector<wavefront> _waves;
+    vector<uint32_t> _lds;
+    unsigned _group;
+    emulator_statistics* _stats;
+};
+
+void group_executor::run(unsigned group, emulator_statistics& stats)
+{
+    _stats = &stats;
+    start(group);
+    for (;;) {
+        bool waiting = false;
+        for (size_t i = 0; i < _waves.size(); ++i) {
+            step(_waves[i]);
+            waiting = waiting || _waves[i].at_barrier;
+        }
+        if (!waiting)
+            break;
+        // Every wavefront which has not finished is at the barrier.
+        for (size_t i = 0; i < _waves.size(); ++i)
+            _waves[i].at_barrier = false;
+    }
+}
+
+void group_executor::start(unsigned group)
+{
+    unsigned const* size = _dispatch.group_size;
+    unsigned const* groups = _dispatch.groups;
+    unsigned threads = size[0] * size[1] * size[2];
+    unsigned waves = (threads + wavefront_size - 1) / wavefront_size;
+    unsigned group_id[3] = {
+        group % groups[0],
+        group / groups[0] % groups[1],
+        group / (groups[0] * groups[1])
+    };
+
+    _group = group;
+    _lds.assign(_dispatch.lds_size, 0);
+    _waves.resize(waves);
+    for (unsigned i = 0; i < waves; ++i) {
+        wavefront& w = _waves[i];
+        lanes zero;
+        broadcast(zero, 0);
+        w.gprs.assign(4 * num_gprs, zero);
+        for (unsigned c = 0; c < 4; ++c)
+            w.pv[c] = zero;
+        w.ps = w.ar = zero;
+        w.exec = 0;
+        for (unsigned l = 0; l < wavefront_size; ++l) {
+            unsigned t = i * wavefront_size + l;
+            if (t >= threads)
+                break;
+            w.exec |= uint64_t(1) << l;
+            w.gprs[0].v[l] = t % size[0];
+            w.gprs[1].v[l] = t / size[0] % size[1];
+            w.gprs[2].v[l] = t / (size[0] * size[1]);
+            for (unsigned c = 0; c < 3; ++c)
+                w.gprs[4 + c].v[l] = group_id[c];
+        }
+        w.exec_next = w.exec;
+        w.pred = 0;
+        w.loop_index = 0;
+        w.stack.clear();
+        w.calls.clear();
+        w.lds_queue.clear();
+        w.pc = 0;
+        w.group = 0;
+        w.in_clause = w.at_barrier = w.done = false;
+        w.id = group * waves + i;
+        w.id_in_group = i;
+        w.time = 0;
+        w.executed = 0;
+        if (_traces) {
+            wavefront_trace& t = (*_traces)[w.id];
+            t.group = group;
+            t.id_in_group = i;
+            t.events.clear();
+        }
+    }
+    _stats->wavefronts += waves;
+}
+
+/// Run a wavefront until it ends or reaches a barrier.
+void group_executor::step(wavefront& w)
+{
+    while (!w.done && !w.at_barrier) {
+        if (w.pc >= _program.size())
+            throw runtime_error("the program runs past its end");
+        if (++w.executed > max_cf_instructions)
+            throw runtime_error("the program does not terminate");
+
+        cf_node const& node = _program[w.pc];
+        cf_instruction const& c = node.cf;
+        unsigned next = w.pc + 1;
+        unsigned first = w.in_clause ? w.group : 0;
+        w.bytes = 0;
+
+        switch (c.inst()) {
+        case cf::CF_INST_NOP:
+        case cf::CF_INST_WAIT_ACK:
+            break;
+
+        case cf::CF_INST_TC:
+        case cf::CF_INST_VC:
+            execute_fetch(w, node);
+            break;
+
+        case cf::CF_INST_ALU:
+        case cf::CF_INST_ALU_PUSH_BEFORE:
+        case cf::CF_INST_ALU_POP_AFTER:
+        case cf::CF_INST_ALU_POP2_AFTER:
+        case cf::CF_INST_ALU_ELSE_AFTER:
+            if (!execute_alu(w, w.pc)) {
+                record(w, first, true);
+                return;
+            }
+            break;
+
+        case cf::CF_INST_LOOP_START:
+        case cf::CF_INST_LOOP_START_DX10:
+        case cf::CF_INST_LOOP_START_NO_AL: {
+            loop_const const& lc = _dispatch.loop_consts[c.cf_const()];
+            if (lc.count == 0 || w.exec == 0) {
+                next = c.addr();
+                break;
+            }
+            bool no_al = c.inst() == cf::CF_INST_LOOP_START_NO_AL;
+            stack_entry e = { true, w.exec, lc.count, w.loop_index, no_al ? 0 : lc.inc, 0, 0 };
+            push(w, e);
+            if (!no_al)
+                w.loop_index = lc.init;
+            break;
+        }
+
+        case cf::CF_INST_LOOP_END: {
+            // Discard what the loop body has left on the stack.
+            innermost_loop(w);
+            while (!w.stack.back().loop)
+                w.stack.pop_back();
+            stack_entry& e = w.stack.back();
+            e.continued = 0;
+            w.exec = e.mask & ~e.broken;
+            if (--e.count != 0 && w.exec != 0) {
+                w.loop_index += e.inc;
+                next = c.addr();
+            }
+            else {
+                w.exec = e.mask;
+                w.loop_index = e.index;
+                w.stack.pop_back();
+            }
+            break;
+        }
+
+        case cf::CF_INST_LOOP_BREAK:
+        case cf::CF_INST_LOOP_CONTINUE: {
+            stack_entry& e = innermost_loop(w);
+            if (c.inst() == cf::CF_INST_LOOP_BREAK)
+                e.broken |= w.exec;
+            else
+                e.continued |= w.exec;
+            w.exec = 0;
+            if ((e.mask & ~e.broken & ~e.continued) == 0)
+                next = c.addr();
+            break;
+        }
+
+        case cf::CF_INST_JUMP:
+            if (c.cond() != 0)
+                throw runtime_error("unsupported JUMP condition");
+            if (w.exec == 0) {
+                next = c.addr();
+                pop(w, c.pop_count());
+            }
+            break;
+
+        case cf::CF_INST_ELSE:
+            w.exec = else_mask(w);
+            if (w.exec == 0) {
+                next = c.addr();
+                pop(w, c.pop_count());
+            }
+            break;
+
+        case cf::CF_INST_PUSH:
+            push_mask(w);
+            if (w.exec == 0) {
+                next = c.addr();
+                pop(w, c.pop_count());
+            }
+            break;
+
+        case cf::CF_INST_POP:
+            pop(w, c.pop_count());
+            break;
+
+        case cf::CF_INST_CALL:
+        case cf::CF_INST_CALL_FS:
+            if (w.exec != 0) {
+                if (w.calls.size() >= max_call_depth)
+                    throw runtime_error("call stack overflow");
+                w.calls.push_back(next);
+                next = c.addr();
+            }
+            break;
+
+        case cf::CF_INST_RETURN:
+            if (w.calls.empty())
+                throw runtime_error("RETURN outside a subroutine");
+            next = w.calls.back();
+            w.calls.pop_back();
+            break;
+
+        case cf::CF_INST_MEM_RAT:
+        case cf::CF_INST_MEM_RAT_CACHELESS:
+            execute_export(w, c);
+            break;
+
+        case cf::CF_INST_HALT:
+            w.done = true;
+            break;
+
+        default:
+            throw runtime_error(unsupported("CF instruction", c.name(), c.inst()));
+        }
+
+        record(w, first, false);
+        w.time += cf_cycles;
+        ++_stats->cf_instructions;
+        if (c.end_of_program())
+            w.done = true;
+        w.pc = next;
+    }
+}
+
+/// Append the CF instruction just executed to the trace of the wavefront.
+void group_executor::record(wavefront& w, unsigned first, bool barrier)
+{
+    if (!_traces)
+        return;
+    wavefront_event e;
+    e.cf = w.pc;
+    e.first = first;
+    e.groups = _program[w.pc].cf.is_alu() ? (barrier ? w.group : _program[w.pc].alu.size()) - first : 0;
+    e.bytes = w.bytes;
+    e.barrier = barrier;
+    (*_traces)[w.id].events.push_back(e);
+}
+
+/// Execute or resume an ALU clause.
+/// \returns Whether the clause has ended, false if it stopped at a barrier.
+bool group_executor::execute_alu(wavefront& w, unsigned node)
+{
+    cf_instruction const& c = _program[node].cf;
+    vector<alu_group> const& clause = _program[node].alu;
+    unsigned const* unit = &_units[node][0];
+
+    if (!w.in_clause) {
+        if (c.inst() == cf::CF_INST_ALU_PUSH_BEFORE)
+            push_mask(w);
+        w.exec_next = w.exec;
+        w.group = 0;
+        w.in_clause = true;
+    }
+    while (w.group < clause.size()) {
+        unsigned g = w.group++;
+        bool barrier = execute_group(w, c, clause[g], unit + 5 * g);
+        w.time += alu_group_cycles;
+        ++_stats->alu_groups;
+        if (barrier) {
+            ++_stats->barriers;
+            w.at_barrier = true;
+            return false;
+        }
+    }
+
+    // Execute mask updates take effect at the end of the clause.
+    w.in_clause = false;
+    w.exec = w.exec_next;
+    switch (c.inst()) {
+    case cf::CF_INST_ALU_POP_AFTER:
+        pop(w, 1);
+        break;
+    case cf::CF_INST_ALU_POP2_AFTER:
+        pop(w, 2);
+        break;
+    case cf::CF_INST_ALU_ELSE_AFTER:
+        w.exec = else_mask(w);
+        break;
+    }
+    return true;
+}
+
+/// Execute an instruction group.
+/// \returns Whether the group has a GROUP_BARRIER.
+bool group_executor::execute_group(wavefront& w, cf_instruction const& c, alu_group const& g, unsigned const* unit)
+{
+    lanes operands[5][3];
+    lanes result[5];
+    lanes cond;
+    uint64_t mask[5];
+    alu_instruction const* slot[5] = {};
+    bool barrier = false;
+
+    // Every source is read before anything is written.
+    for (size_t s = 0; s < g.slots.size(); ++s) {
+        alu_instruction const& inst = g.slots[s];
+        unsigned u = unit[s];
+        uint64_t m = w.exec;
+        if (inst.pred_sel == alu::PRED_SEL_ONE)
+            m &= w.pred;
+        else if (inst.pred_sel == alu::PRED_SEL_ZERO)
+            m &= ~w.pred;
+
+        if (inst.op == alu::OP2_NOP)
+            continue;
+        if (inst.op == alu::OP2_GROUP_BARRIER) {
+            barrier = true;
+            continue;
+        }
+        for (unsigned i = 0; i < inst.num_sources(); ++i)
+            read_source(w, c, g, inst, i, operands[u][i]);
+        if (inst.op == alu::OP3_LDS_IDX_OP) {
+            execute_lds(w, inst, operands[u], m);
+            continue;
+        }
+        slot[u] = &inst;
+        mask[u] = m;
+    }
+
+    // Reductions combine the vector slots.
+    bool reduction = false;
+    for (unsigned u = 0; u < 4; ++u)
+        reduction = reduction || (slot[u] && slot[u]->flags() & alu::REDUCTION);
+    if (reduction) {
+        float acc[wavefront_size];
+        bool first = true;
+        for (unsigned u = 0; u < 4; ++u) {
+            if (!slot[u] || !(slot[u]->flags() & alu::REDUCTION))
+                continue;
+            unsigned op = slot[u]->op;
+            for (unsigned l = 0; l < wavefront_size; ++l) {
+                float x = as_float(operands[u][0].v[l]);
+                float y = as_float(operands[u][1].v[l]);
+                float v;
+                if (op == alu::OP2_MAX4)
+                    v = first ? x : max(acc[l], x);
+                else if (op == alu::OP2_DOT4)
+                    v = (first ? 0 : acc[l]) + mul_legacy(x, y);
+                else if (op == alu::OP2_DOT4_IEEE || op == alu::OP2_DOT_IEEE)
+                    v = (first ? 0 : acc[l]) + x * y;
+                else
+                    throw runtime_error(unsupported("ALU instruction", slot[u]->name(), op));
+                acc[l] = v;
+            }
+            first = false;
+        }
+        for (unsigned u = 0; u < 4; ++u)
+            if (slot[u] && slot[u]->flags() & alu::REDUCTION)
+                for (unsigned l = 0; l < wavefront_size; ++l)
+                    result[u].v[l] = as_uint(acc[l]);
+    }
+
+    uint64_t pred = w.pred;
+    for (unsigned u = 0; u < 5; ++u) {
+        if (!slot[u])
+            continue;
+        alu_instruction const& inst = *slot[u];
+        unsigned f = inst.flags();
+
+        if (f & alu::DOUBLE) {
+            if (u & 1)
+                continue;
+            if (u == 4 || !slot[u + 1] || slot[u + 1]->op != inst.op)
+                throw runtime_error(string("unpaired ") + inst.name());
+            evaluate_double(inst.op, operands[u], operands[u + 1], result[u], result[u + 1]);
+            continue;
+        }
+        if (!(f & alu::REDUCTION))
+            evaluate(inst.op, operands[u], result[u], cond);
+
+        if (f & alu::PRED_SET) {
+            uint64_t bits = 0;
+            for (unsigned l = 0; l < wavefront_size; ++l)
+                bits |= uint64_t(cond.v[l] & 1) << l;
+            if (inst.update_pred)
+                pred = (pred & ~mask[u]) | (bits & mask[u]);
+            if (inst.update_exec_mask)
+                w.exec_next = (w.exec_next & ~mask[u]) | (bits & mask[u]);
+        }
+
+        // Output modifiers of floating point results.
+        if (!(f & (alu::INTEGER | alu::PRED_SET)) && (inst.omod || inst.clamp)) {
+            static const float scale[4] = { 1.0f, 2.0f, 4.0f, 0.5f };
+            float k = scale[inst.omod & 3];
+            bool clamp = inst.clamp;
+            mapf1(result[u], result[u], [k, clamp](float x) {
+                x *= k;
+                return clamp ? min(max(x, 0.0f), 1.0f) : x;
+            });
+        }
+    }
+
+    // Write the results, PV and PS.
+    for (unsigned u = 0; u < 5; ++u) {
+        if (!slot[u])
+            continue;
+        alu_instruction const& inst = *slot[u];
+        if (inst.writes_gpr())
+            write(w, inst, result[u], mask[u]);
+        if (inst.op == alu::OP2_MOVA_INT)
+            select(w.ar, result[u], mask[u]);
+        if (u < 4)
+            w.pv[u] = result[u];
+        else
+            w.ps = result[u];
+    }
+    w.pred = pred;
+    return barrier;
+}
+
+lanes& group_executor::gpr(wavefront& w, unsigned sel, unsigned chan, bool rel, unsigned index_mode)
+{
+    if (rel) {
+        if (index_mode != alu::INDEX_LOOP)
+            throw runtime_error("unsupported relative addressing mode " + to_string(index_mode));
+        sel += w.loop_index;
+    }
+    if (sel >= num_gprs)
+        throw runtime_error("GPR index out of range: " + to_string(sel));
+    return w.gprs[4 * sel + chan];
+}
+
+void group_executor::read_source(wavefront& w, cf_instruction const& c, alu_group const& g, alu_instruction const& inst, unsigned i, lanes& r)
+{
+    alu_source const& src = inst.src[i];
+    uint32_t sel = src.sel;
+
+    if (alu::is_gpr(sel)) {
+        if (src.rel && inst.index_mode == alu::INDEX_AR_X) {
+            for (unsigned l = 0; l < wavefront_size; ++l) {
+                unsigned index = sel + w.ar.v[l];
+                r.v[l] = index < num_gprs ? w.gprs[4 * index + src.chan].v[l] : 0;
+            }
+        }
+        else
+            r = gpr(w, sel, src.chan, src.rel, inst.index_mode);
+    }
+    else if (alu::is_kcache(sel)) {
+        if (sel >= alu::ALU_SRC_KCACHE2_BASE)
+            throw runtime_error("unsupported kcache banks 2 and 3");
+        unsigned set = sel >= alu::ALU_SRC_KCACHE1_BASE;
+        unsigned index = sel - (set ? alu::ALU_SRC_KCACHE1_BASE : alu::ALU_SRC_KCACHE0_BASE);
+        broadcast(r, constant(c.kcache_bank(set), 16 * c.kcache_addr(set) + index, src.chan));
+    }
+    else {
+        switch (sel) {
+        case alu::ALU_SRC_0:
+        case alu::ALU_SRC_1_DBL_L:
+        case alu::ALU_SRC_0_5_DBL_L:
+            broadcast(r, 0);
+            break;
+        case alu::ALU_SRC_1:
+            broadcast(r, as_uint(1.0f));
+            break;
+        case alu::ALU_SRC_1_INT:
+            broadcast(r, 1);
+            break;
+        case alu::ALU_SRC_M_1_INT:
+            broadcast(r, ~0u);
+            break;
+        case alu::ALU_SRC_0_5:
+            broadcast(r, as_uint(0.5f));
+            break;
+        case alu::ALU_SRC_1_DBL_M:
+            broadcast(r, 0x3ff00000);
+            break;
+        case alu::ALU_SRC_0_5_DBL_M:
+            broadcast(r, 0x3fe00000);
+            break;
+        case alu::ALU_SRC_LITERAL:
+            if (src.chan >= g.literals.size())
+                throw runtime_error("missing literal constant");
+            broadcast(r, g.literals[src.chan]);
+            break;
+        case alu::ALU_SRC_PV:
+            r = w.pv[src.chan];
+            break;
+        case alu::ALU_SRC_PS:
+            r = w.ps;
+            break;
+        case alu::ALU_SRC_LDS_OQ_A:
+        case alu::ALU_SRC_LDS_OQ_A_POP:
+            if (w.lds_queue.empty())
+                throw runtime_error("read from an empty LDS queue");
+            r = w.lds_queue.front();
+            if (sel == alu::ALU_SRC_LDS_OQ_A_POP)
+                w.lds_queue.pop_front();
+            break;
+        case alu::ALU_SRC_TIME_LO:
+            broadcast(r, uint32_t(w.time));
+            break;
+        case alu::ALU_SRC_TIME_HI:
+            broadcast(r, uint32_t(w.time >> 32));
+            break;
+        case alu::ALU_SRC_MASK_LO:
+            broadcast(r, uint32_t(w.exec));
+            break;
+        case alu::ALU_SRC_MASK_HI:
+            broadcast(r, uint32_t(w.exec >> 32));
+            break;
+        case alu::ALU_SRC_HW_WAVE_ID:
+            broadcast(r, w.id);
+            break;
+        case alu::ALU_SRC_SIMD_ID:
+        case alu::ALU_SRC_SE_ID:
+            broadcast(r, 0);
+            break;
+        case alu::ALU_SRC_HW_THREADGRP_ID:
+            broadcast(r, _group);
+            break;
+        case alu::ALU_SRC_WAVE_ID_IN_GRP:
+            broadcast(r, w.id_in_group);
+            break;
+        case alu::ALU_SRC_NUM_THREADGRP_WAVES:
+            broadcast(r, _waves.size());
+            break;
+        case alu::ALU_SRC_HW_ALU_ODD:
+            broadcast(r, w.id_in_group & 1);
+            break;
+        case alu::ALU_SRC_LOOP_IDX:
+            broadcast(r, w.loop_index);
+            break;
+        default:
+            throw runtime_error("unsupported source select " + to_string(sel));
+        }
+    }
+
+    if (src.abs)
+        map1(r, r, [](uint32_t x) { return x & 0x7fffffffu; });
+    if (src.neg)
+        map1(r, r, [](uint32_t x) { return x ^ 0x80000000u; });
+}
+
+void group_executor::write(wavefront& w, alu_instruction const& inst, lanes const& r, uint64_t mask)
+{
+    if (inst.dst_rel && inst.index_mode == alu::INDEX_AR_X) {
+        for (unsigned l = 0; l < wavefront_size; ++l) {
+            unsigned index = inst.dst_gpr + w.ar.v[l];
+            if (mask >> l & 1 && index < num_gprs)
+                w.gprs[4 * index + inst.dst_chan].v[l] = r.v[l];
+        }
+    }
+    else
+        select(gpr(w, inst.dst_gpr, inst.dst_chan, inst.dst_rel, inst.index_mode), r, mask);
+}
+
+/// Execute an LDS_IDX_OP instruction. Addresses are in bytes; the REL
+/// operations add IDX_OFFSET double words to the address.
+void group_executor::execute_lds(wavefront& w, alu_instruction const& inst, lanes const* a, uint64_t mask)
+{
+    unsigned op = inst.lds_op;
+    bool rel = op == alu::LDS_OP_WRITE_REL || op == alu::LDS_OP_READ_REL_RET || op == alu::LDS_OP_XCHG_REL_RET;
+    bool ret = op >= alu::LDS_OP_ADD_RET;
+    lanes out;
+    broadcast(out, 0);
+
+    for (unsigned l = 0; l < wavefront_size; ++l) {
+        if (!(mask >> l & 1))
+            continue;
+        uint32_t index = a[0].v[l] / 4 + (rel ? inst.idx_offset : 0);
+        if (index >= _lds.size())
+            continue;
+        uint32_t& d = _lds[index];
+        uint32_t old = d, b = a[1].v[l], c = a[2].v[l];
+        switch (op) {
+        case alu::LDS_OP_ADD:
+        case alu::LDS_OP_ADD_RET:
+            d = old + b;
+            break;
+        case alu::LDS_OP_SUB:
+        case alu::LDS_OP_SUB_RET:
+            d = old - b;
+            break;
+        case alu::LDS_OP_RSUB:
+        case alu::LDS_OP_RSUB_RET:
+            d = b - old;
+            break;
+        case alu::LDS_OP_INC:
+        case alu::LDS_OP_INC_RET:
+            d = old >= b ? 0 : old + 1;
+            break;
+        case alu::LDS_OP_DEC:
+        case alu::LDS_OP_DEC_RET:
+            d = old == 0 || old > b ? b : old - 1;
+            break;
+        case alu::LDS_OP_MIN_INT:
+        case alu::LDS_OP_MIN_INT_RET:
+            d = int32_t(b) < int32_t(old) ? b : old;
+            break;
+        case alu::LDS_OP_MAX_INT:
+        case alu::LDS_OP_MAX_INT_RET:
+            d = int32_t(b) > int32_t(old) ? b : old;
+            break;
+        case alu::LDS_OP_MIN_UINT:
+        case alu::LDS_OP_MIN_UINT_RET:
+            d = min(b, old);
+            break;
+        case alu::LDS_OP_MAX_UINT:
+        case alu::LDS_OP_MAX_UINT_RET:
+            d = max(b, old);
+            break;
+        case alu::LDS_OP_AND:
+        case alu::LDS_OP_AND_RET:
+            d = old & b;
+            break;
+        case alu::LDS_OP_OR:
+        case alu::LDS_OP_OR_RET:
+            d = old | b;
+            break;
+        case alu::LDS_OP_XOR:
+        case alu::LDS_OP_XOR_RET:
+            d = old ^ b;
+            break;
+        case alu::LDS_OP_MSKOR:
+        case alu::LDS_OP_MSKOR_RET:
+            d = (old & ~b) | c;
+            break;
+        case alu::LDS_OP_WRITE:
+        case alu::LDS_OP_WRITE_REL:
+        case alu::LDS_OP_XCHG_RET:
+        case alu::LDS_OP_XCHG_REL_RET:
+            d = b;
+            break;
+        case alu::LDS_OP_CMP_XCHG_RET:
+            if (old == b)
+                d = c;
+            break;
+        case alu::LDS_OP_READ_RET:
+        case alu::LDS_OP_READ_REL_RET:
+            break;
+        default:
+            throw runtime_error(unsupported("LDS operation", alu::lds_name(op), op));
+        }
+        out.v[l] = old;
+    }
+    if (ret)
+        w.lds_queue.push_back(out);
+}
+
+void group_executor::execute_fetch(wavefront& w, cf_node const& node)
+{
+    for (size_t i = 0; i < node.fetch.size(); ++i) {
+        fetch_instruction const& f = node.fetch[i];
+        if (f.inst() != fetch::VTX_INST_FETCH)
+            throw runtime_error("unsupported fetch instruction " + to_string(f.inst()));
+
+        map<unsigned, vertex_resource>::const_iterator res = _dispatch.vertex_resources.find(f.resource_id());
+        if (res == _dispatch.vertex_resources.end() || !res->second.buffer)
+            throw runtime_error("no vertex resource " + to_string(f.resource_id()));
+        vector<uint32_t> const& buffer = *res->second.buffer;
+        unsigned stride = res->second.stride;
+        unsigned n = components(f.use_const_fields() ? res->second.format : f.data_format());
+        uint32_t offset = f.offset() / 4;
+
+        lanes const& index = gpr(w, f.src_gpr(), f.src_sel_x(), f.src_rel(), alu::INDEX_LOOP);
+        lanes value[4];
+        for (unsigned c = 0; c < 4; ++c)
+            broadcast(value[c], c == 3 ? as_uint(1.0f) : 0);
+        for (unsigned l = 0; l < wavefront_size; ++l) {
+            if (!(w.exec >> l & 1))
+                continue;
+            size_t base = size_t(index.v[l]) * stride + offset;
+            for (unsigned c = 0; c < n; ++c)
+                value[c].v[l] = base + c < buffer.size() ? buffer[base + c] : 0;
+        }
+
+        for (unsigned c = 0; c < 4; ++c) {
+            unsigned sel = f.dst_sel(c);
+            if (sel == fetch::SEL_MASK)
+                continue;
+            lanes& dst = gpr(w, f.dst_gpr(), c, f.dst_rel(), alu::INDEX_LOOP);
+            if (sel <= fetch::SEL_W)
+                select(dst, value[sel], w.exec);
+            else {
+                lanes k;
+                broadcast(k, sel == fetch::SEL_1 ? as_uint(1.0f) : 0);
+                select(dst, k, w.exec);
+            }
+        }
+        w.bytes += 4 * n * active_lanes(w.exec);
+        w.time += fetch_cycles;
+        ++_stats->fetches;
+    }
+}
+
+void group_executor::execute_export(wavefront& w, cf_instruction const& c)
+{
+    // EXPORT_RAT_INST_STORE_RAW
+    if (c.rat_inst() != 2)
+        throw runtime_error("unsupported RAT instruction " + to_string(c.rat_inst()));
+    if (c.type() > 1)
+        throw runtime_error("unsupported RAT export type " + to_string(c.type()));
+    map<unsigned, vector<uint32_t>*>::const_iterator rat = _dispatch.rats.find(c.rat_id());
+    if (rat == _dispatch.rats.end() || !rat->second)
+        throw runtime_error("no RAT " + to_string(c.rat_id()));
+    vector<uint32_t>& buffer = *rat->second;
+
+    unsigned elem = c.elem_size() + 1;
+    bool indexed = c.type() & 1;
+    lanes const& index = w.gprs[4 * c.index_gpr()];
+    for (unsigned b = 0; b <= c.burst_count(); ++b) {
+        for (unsigned ch = 0; ch < elem && ch < 4; ++ch) {
+            if (!(c.comp_mask() >> ch & 1))
+                continue;
+            lanes const& value = gpr(w, c.rw_gpr() + b, ch, c.rw_rel(), alu::INDEX_LOOP);
+            for (unsigned l = 0; l < wavefront_size; ++l) {
+                if (!(w.exec >> l & 1))
+                    continue;
+                size_t address = (size_t(indexed ? index.v[l] : 0) + b) * elem + ch;
+                if (address < buffer.size())
+                    buffer[address] = value.v[l];
+            }
+            w.bytes += 4 * active_lanes(w.exec);
+        }
+    }
+    ++_stats->exports;
+}
+
+uint32_t group_executor::constant(unsigned bank, unsigned index, unsigned chan) const
+{
+    map<unsigned, vector<uint32_t> const*>::const_iterator buffer = _dispatch.constant_buffers.find(bank);
+    if (buffer == _dispatch.constant_buffers.end() || !buffer->second)
+        throw runtime_error("no constant buffer " + to_string(bank));
+    size_t i = 4 * size_t(index) + chan;
+    return i < buffer->second->size() ? (*buffer->second)[i] : 0;
+}
+
+void group_executor::push(wavefront& w, stack_entry const& e)
+{
+    if (w.stack.size() >= max_stack_depth)
+        throw runtime_error("stack overflow");
+    w.stack.push_back(e);
+}
+
+void group_executor::push_mask(wavefront& w)
+{
+    stack_entry e = { false, w.exec, 0, 0, 0, 0, 0 };
+    push(w, e);
+}
+
+/// Pop entries pushed by PUSH and restore the execute mask, without
+/// reactivating lanes which left the innermost loop.
+void group_executor::pop(wavefront& w, unsigned n)
+{
+    if (n == 0)
+        return;
+    for (unsigned i = 0; i < n; ++i) {
+        if (w.stack.empty() || w.stack.back().loop)
+            throw runtime_error("stack underflow");
+        w.exec = w.stack.back().mask;
+        w.stack.pop_back();
+    }
+    for (size_t i = w.stack.size(); i-- > 0; ) {
+        if (w.stack[i].loop) {
+            w.exec &= ~(w.stack[i].broken | w.stack[i].continued);
+            break;
+        }
+    }
+}
+
+/// Get the execute mask of the ELSE side: the lanes active at the last push
+/// which are not active now.
+uint64_t group_executor::else_mask(wavefront const& w) const
+{
+    if (w.stack.empty() || w.stack.back().loop)
+        throw runtime_error("ELSE without PUSH");
+    uint64_t mask = w.stack.back().mask & ~w.exec;
+    for (size_t i = w.stack.size(); i-- > 0; ) {
+        if (w.stack[i].loop) {
+            mask &= ~(w.stack[i].broken | w.stack[i].continued);
+            break;
+        }
+    }
+    return mask;
+}
+
+stack_entry& group_executor::innermost_loop(wavefront& w)
+{
+    for (size_t i = w.stack.size(); i-- > 0; )
+        if (w.stack[i].loop)
+            return w.stack[i];
+    throw runtime_error("loop instruction outside a loop");
+}
+
+}
+
+void emulator_statistics::add(emulator_statistics const& s)
+{
+    wavefronts += s.wavefronts;
+    cf_instructions += s.cf_instructions;
+    alu_groups += s.alu_groups;
+    fetches += s.fetches;
+    exports += s.exports;
+    barriers += s.barriers;
+}
+
+evergreen_emulator::evergreen_emulator(evergreen_program const& program, unsigned threads)
+    : _program(program), _threads(threads), _tracing(false)
+{
+    if (_threads == 0)
+        _threads = max(1u, thread::hardware_concurrency());
+
+    // The slots of the instruction groups, five per group.
+    _units.resize(program.size());
+    for (size_t i = 0; i < program.size(); ++i) {
+        vector<alu_group> const& clause = program[i].alu;
+        _units[i].resize(5 * clause.size() + 1);
+        for (size_t g = 0; g < clause.size(); ++g)
+            clause[g].assign_slots(&_units[i][5 * g]);
+    }
+}
+
+void evergreen_emulator::run(dispatch const& d)
+{
+    for (unsigned i = 0; i < 3; ++i)
+        if (d.group_size[i] == 0 || d.groups[i] == 0)
+            throw runtime_error("empty dispatch");
+
+    unsigned total = d.groups[0] * d.groups[1] * d.groups[2];
+    unsigned threads = min(_threads, total);
+    atomic<unsigned> next(0);
+    exception_ptr error;
+    mutex error_mutex;
+    vector<emulator_statistics> stats(threads);
+    unsigned waves = (d.group_size[0] * d.group_size[1] * d.group_size[2] + wavefront_size - 1) / wavefront_size;
+    _traces.clear();
+    if (_tracing)
+        _traces.resize(size_t(total) * waves);
+
+    auto worker = [&](unsigned t) {
+        try {
+            group_executor executor(_program, _units, d, _tracing ? &_traces : 0);
+            for (unsigned g; (g = next++) < total; )
+                executor.run(g, stats[t]);
+        }
+        catch (...) {
+            lock_guard<mutex> lock(error_mutex);
+            if (!error)
+                error = current_exception();
+            next = total;
+        }
+    };
+
+    vector<thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+        pool.push_back(thread(worker, t));
+    worker(0);
+    for (size_t t = 0; t < pool.size(); ++t)
+        pool[t].join();
+    if (error)
+        rethrow_exception(error);
+
+    _statistics = emulator_statistics();
+    for (unsigned t = 0; t < threads; ++t)
+        _statistics.add(stats[t]);
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "evergreen_program.hpp"
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+/// This structure describes a buffer bound as a vertex fetch resource.
+struct vertex_resource {
+    std::vector<std::uint32_t> const* buffer;   ///< The buffer (not owned).
+    unsigned stride;                            ///< Stride in double words.
+    unsigned format;                            ///< Data format (FMT_*), for fetches with USE_CONST_FIELDS.
+
+    vertex_resource() : buffer(), stride(), format() {}
+    vertex_resource(std::vector<std::uint32_t> const* buffer, unsigned stride, unsigned format)
+        : buffer(buffer), stride(stride), format(format) {}
+};
+
+/// This structure holds a loop constant (SQ_LOOP_CONST).
+struct loop_const {
+    unsigned count;     ///< Number of trips.
+    int init;           ///< Initial value of the loop index.
+    int inc;            ///< Increment of the loop index.
+
+    loop_const() : count(), init(), inc() {}
+    loop_const(unsigned count, int init, int inc) : count(count), init(init), inc(inc) {}
+};
+
+/// This structure describes a dispatch: the domain and the resources bound
+/// to the compute shader. Buffers are not owned and must outlive the
+/// dispatch.
+struct dispatch {
+    unsigned group_size[3];     ///< Work-items per group in X, Y and Z.
+    unsigned groups[3];         ///< Number of groups in X, Y and Z.
+    unsigned lds_size;          ///< LDS double words per group.
+    /// Constant buffers by id, four double words per constant.
+    std::map<unsigned, std::vector<std::uint32_t> const*> constant_buffers;
+    /// Vertex fetch resources by id.
+    std::map<unsigned, vertex_resource> vertex_resources;
+    /// RAT buffers by id.
+    std::map<unsigned, std::vector<std::uint32_t>*> rats;
+    /// Loop constants by CF_CONST index.
+    loop_const loop_consts[32];
+
+    dispatch() : lds_size()
+    {
+        group_size[0] = group_size[1] = group_size[2] = 1;
+        groups[0] = groups[1] = groups[2] = 1;
+    }
+};
+
+/// This structure accumulates what a dispatch has executed.
+struct emulator_statistics {
+    std::uint64_t wavefronts;       ///< Wavefronts run.
+    std::uint64_t cf_instructions;  ///< CF instructions executed by all wavefronts.
+    std::uint64_t alu_groups;       ///< Instruction groups executed.
+    std::uint64_t fetches;          ///< Fetch instructions executed.
+    std::uint64_t exports;          ///< Exports executed.
+    std::uint64_t barriers;         ///< GROUP_BARRIER instructions executed.
+
+    emulator_statistics()
+        : wavefronts(), cf_instructions(), alu_groups(), fetches(), exports(), barriers() {}
+
+    /// Add the statistics of another run.
+    void add(emulator_statistics const& s);
+};
+
+/// This structure records a CF instruction executed by a wavefront.
+struct wavefront_event {
+    unsigned cf;        ///< Index of the CF instruction.
+    unsigned first;     ///< First instruction group executed (ALU clauses).
+    unsigned groups;    ///< Instruction groups executed (ALU clauses).
+    unsigned bytes;     ///< Bytes fetched or exported by the active work-items.
+    bool barrier;       ///< The clause stopped at a GROUP_BARRIER, it resumes in a later event.
+
+    wavefront_event() : cf(), first(), groups(), bytes(), barrier() {}
+};
+
+/// This structure holds the CF instructions executed by a wavefront in order.
+struct wavefront_trace {
+    unsigned group;         ///< Index of the work group in the dispatch.
+    unsigned id_in_group;   ///< Index of the wavefront in the group.
+    std::vector<wavefront_event> events;
+
+    wavefront_trace() : group(), id_in_group() {}
+};
+
+/// This class executes an Evergreen compute shader on the CPU.
+///
+/// Work-items are laid out as on the hardware: R0.xyz hold the ids within
+/// the group and R1.xyz the id of the group, and each group is split into
+/// wavefronts of 64 work-items with X varying fastest. Every wavefront keeps
+/// its own GPRs, execute mask, predicate, stack and PV/PS, and every ALU
+/// instruction is evaluated for the 64 lanes at once over plain arrays, so
+/// that the host compiler can vectorize it. Work groups are spread over a
+/// pool of host threads; the wavefronts of a group run in turns on one of
+/// them, switching at GROUP_BARRIER instructions, and share its LDS.
+///
+/// The subset of the ISA used by the samples is supported: CF clauses,
+/// jumps, PUSH/ELSE/POP, loops with the loop index, CALL/RETURN, the ALU
+/// instructions with PV/PS, literals, kcache constants and predication,
+/// vertex fetches from buffers with 32-bit components, RAT STORE_RAW exports
+/// and LDS_IDX_OP instructions. Anything else throws std::runtime_error.
+///
+/// Execute mask updates of an ALU clause take effect at its end. The time
+/// counter (TIME_LO/TIME_HI) counts estimated issue cycles of the
+/// wavefront, it is not a clock, and SIMD_ID and SE_ID read 0.
+class evergreen_emulator {
+public:
+    /// This constructor prepares the emulation of a program.
+    /// \param program The program.
+    /// \param threads Number of host threads, or 0 for one per processor.
+    explicit evergreen_emulator(evergreen_program const& program, unsigned threads = 0);
+
+    /// Execute a dispatch. RAT buffers are written in place.
+    /// It throws std::runtime_error if the program executes an unsupported
+    /// instruction, overflows its stack or does not terminate.
+    void run(dispatch const& d);
+
+    /// Access the statistics of the last run.
+    emulator_statistics const& statistics() const { return _statistics; }
+    /// Get the number of host threads.
+    unsigned threads() const { return _threads; }
+
+    /// Enable or disable recording the CF instructions executed by every
+    /// wavefront in the following runs.
+    void set_tracing(bool tracing) { _tracing = tracing; }
+    /// Access the traces of the last run, by wavefront id (the group index
+    /// times the wavefronts per group plus the index in the group).
+    std::vector<wavefront_trace> const& traces() const { return _traces; }
+
+private:
+    evergreen_program _program;
+    /// Slots of the instructions of every ALU clause, five per group.
+    std::vector<std::vector<unsigned> > _units;
+    unsigned _threads;
+    bool _tracing;
+    emulator_statistics _statistics;
+    std::vector<wavefront_trace> _traces;
+};
@@ -0,0 +1,682 @@
+#include "evergreen_instruction.hpp"
+
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+inline uint32_t field(uint32_t w, unsigned shift, unsigned width)
+{
+    return w >> shift & ((1u << width) - 1);
+}
+
+inline uint32_t bits(uint32_t v, unsigned shift, unsigned width)
+{
+    return (v & ((1u << width) - 1)) << shift;
+}
+
+inline void set_field(uint32_t& w, unsigned shift, unsigned width, uint32_t v)
+{
+    uint32_t mask = ((1u << width) - 1) << shift;
+    w = (w & ~mask) | (v << shift & mask);
+}
+
+struct alu_opcode_info {
+    unsigned op;
+    const char* name;
+    unsigned num_sources;
+    unsigned flags;
+};
+
+enum {
+    T = alu_instruction::TRANS_ONLY,
+    V = alu_instruction::VECTOR_ONLY,
+    R = alu_instruction::REDUCTION | alu_instruction::VECTOR_ONLY,
+    D = alu_instruction::DOUBLE | alu_instruction::VECTOR_ONLY,
+    P = alu_instruction::PRED_SET | alu_instruction::ORDERED,
+    K = alu_instruction::KILL | alu_instruction::ORDERED,
+    L = alu_instruction::LDS | alu_instruction::ORDERED | alu_instruction::VECTOR_ONLY,
+    O = alu_instruction::ORDERED,
+    I = alu_instruction::INTEGER
+};
+
+const alu_opcode_info alu_opcodes[] = {
+    { alu_instruction::OP2_ADD,                 "ADD",                  2, 0 },
+    { alu_instruction::OP2_MUL,                 "MUL",                  2, 0 },
+    { alu_instruction::OP2_MUL_IEEE,            "MUL_IEEE",             2, 0 },
+    { alu_instruction::OP2_MAX,                 "MAX",                  2, 0 },
+    { alu_instruction::OP2_MIN,                 "MIN",                  2, 0 },
+    { alu_instruction::OP2_MAX_DX10,            "MAX_DX10",             2, 0 },
+    { alu_instruction::OP2_MIN_DX10,            "MIN_DX10",             2, 0 },
+    { alu_instruction::OP2_SETE,                "SETE",                 2, 0 },
+    { alu_instruction::OP2_SETGT,               "SETGT",                2, 0 },
+    { alu_instruction::OP2_SETGE,               "SETGE",                2, 0 },
+    { alu_instruction::OP2_SETNE,               "SETNE",                2, 0 },
+    { alu_instruction::OP2_SETE_DX10,           "SETE_DX10",            2, 0 },
+    { alu_instruction::OP2_SETGT_DX10,          "SETGT_DX10",           2, 0 },
+    { alu_instruction::OP2_SETGE_DX10,          "SETGE_DX10",           2, 0 },
+    { alu_instruction::OP2_SETNE_DX10,          "SETNE_DX10",           2, 0 },
+    { alu_instruction::OP2_FRACT,               "FRACT",                1, 0 },
+    { alu_instruction::OP2_TRUNC,               "TRUNC",                1, 0 },
+    { alu_instruction::OP2_CEIL,                "CEIL",                 1, 0 },
+    { alu_instruction::OP2_RNDNE,               "RNDNE",                1, 0 },
+    { alu_instruction::OP2_FLOOR,               "FLOOR",                1, 0 },
+    { alu_instruction::OP2_ASHR_INT,            "ASHR_INT",             2, I },
+    { alu_instruction::OP2_LSHR_INT,            "LSHR_INT",             2, I },
+    { alu_instruction::OP2_LSHL_INT,            "LSHL_INT",             2, I },
+    { alu_instruction::OP2_MOV,                 "MOV",                  1, 0 },
+    { alu_instruction::OP2_NOP,                 "NOP",                  0, O },
+    { alu_instruction::OP2_PRED_SETGT_UINT,     "PRED_SETGT_UINT",      2, P | I },
+    { alu_instruction::OP2_PRED_SETGE_UINT,     "PRED_SETGE_UINT",      2, P | I },
+    { alu_instruction::OP2_PRED_SETE,           "PRED_SETE",            2, P },
+    { alu_instruction::OP2_PRED_SETGT,          "PRED_SETGT",           2, P },
+    { alu_instruction::OP2_PRED_SETGE,          "PRED_SETGE",           2, P },
+    { alu_instruction::OP2_PRED_SETNE,          "PRED_SETNE",           2, P },
+    { alu_instruction::OP2_PRED_SET_INV,        "PRED_SET_INV",         1, P },
+    { alu_instruction::OP2_PRED_SET_POP,        "PRED_SET_POP",         2, P },
+    { alu_instruction::OP2_PRED_SET_CLR,        "PRED_SET_CLR",         0, P },
+    { alu_instruction::OP2_PRED_SET_RESTORE,    "PRED_SET_RESTORE",     1, P },
+    { alu_instruction::OP2_PRED_SETE_PUSH,      "PRED_SETE_PUSH",       2, P },
+    { alu_instruction::OP2_PRED_SETGT_PUSH,     "PRED_SETGT_PUSH",      2, P },
+    { alu_instruction::OP2_PRED_SETGE_PUSH,     "PRED_SETGE_PUSH",      2, P },
+    { alu_instruction::OP2_PRED_SETNE_PUSH,     "PRED_SETNE_PUSH",      2, P },
+    { alu_instruction::OP2_KILLE,               "KILLE",                2, K },
+    { alu_instruction::OP2_KILLGT,              "KILLGT",               2, K },
+    { alu_instruction::OP2_KILLGE,              "KILLGE",               2, K },
+    { alu_instruction::OP2_KILLNE,              "KILLNE",               2, K },
+    { alu_instruction::OP2_AND_INT,             "AND_INT",              2, I },
+    { alu_instruction::OP2_OR_INT,              "OR_INT",               2, I },
+    { alu_instruction::OP2_XOR_INT,             "XOR_INT",              2, I },
+    { alu_instruction::OP2_NOT_INT,             "NOT_INT",              1, I },
+    { alu_instruction::OP2_ADD_INT,             "ADD_INT",              2, I },
+    { alu_instruction::OP2_SUB_INT,             "SUB_INT",              2, I },
+    { alu_instruction::OP2_MAX_INT,             "MAX_INT",              2, I },
+    { alu_instruction::OP2_MIN_INT,             "MIN_INT",              2, I },
+    { alu_instruction::OP2_MAX_UINT,            "MAX_UINT",             2, I },
+    { alu_instruction::OP2_MIN_UINT,            "MIN_UINT",             2, I },
+    { alu_instruction::OP2_SETE_INT,            "SETE_INT",             2, I },
+    { alu_instruction::OP2_SETGT_INT,           "SETGT_INT",            2, I },
+    { alu_instruction::OP2_SETGE_INT,           "SETGE_INT",            2, I },
+    { alu_instruction::OP2_SETNE_INT,           "SETNE_INT",            2, I },
+    { alu_instruction::OP2_SETGT_UINT,          "SETGT_UINT",           2, I },
+    { alu_instruction::OP2_SETGE_UINT,          "SETGE_UINT",           2, I },
+    { alu_instruction::OP2_KILLGT_UINT,         "KILLGT_UINT",          2, K | I },
+    { alu_instruction::OP2_KILLGE_UINT,         "KILLGE_UINT",          2, K | I },
+    { alu_instruction::OP2_PREDE_INT,           "PREDE_INT",            2, P | I },
+    { alu_instruction::OP2_PRED_SETGT_INT,      "PRED_SETGT_INT",       2, P | I },
+    { alu_instruction::OP2_PRED_SETGE_INT,      "PRED_SETGE_INT",       2, P | I },
+    { alu_instruction::OP2_PRED_SETNE_INT,      "PRED_SETNE_INT",       2, P | I },
+    { alu_instruction::OP2_KILLE_INT,           "KILLE_INT",            2, K | I },
+    { alu_instruction::OP2_KILLGT_INT,          "KILLGT_INT",           2, K | I },
+    { alu_instruction::OP2_KILLGE_INT,          "KILLGE_INT",           2, K | I },
+    { alu_instruction::OP2_KILLNE_INT,          "KILLNE_INT",           2, K | I },
+    { alu_instruction::OP2_PRED_SETE_PUSH_INT,  "PRED_SETE_PUSH_INT",   2, P | I },
+    { alu_instruction::OP2_PRED_SETGT_PUSH_INT, "PRED_SETGT_PUSH_INT",  2, P | I },
+    { alu_instruction::OP2_PRED_SETGE_PUSH_INT, "PRED_SETGE_PUSH_INT",  2, P | I },
+    { alu_instruction::OP2_PRED_SETNE_PUSH_INT, "PRED_SETNE_PUSH_INT",  2, P | I },
+    { alu_instruction::OP2_PRED_SETLT_PUSH_INT, "PRED_SETLT_PUSH_INT",  2, P | I },
+    { alu_instruction::OP2_PRED_SETLE_PUSH_INT, "PRED_SETLE_PUSH_INT",  2, P | I },
+    { alu_instruction::OP2_FLT_TO_INT,          "FLT_TO_INT",           1, I },
+    { alu_instruction::OP2_BFREV_INT,           "BFREV_INT",            1, I },
+    { alu_instruction::OP2_ADDC_UINT,           "ADDC_UINT",            2, I },
+    { alu_instruction::OP2_SUBB_UINT,           "SUBB_UINT",            2, I },
+    { alu_instruction::OP2_GROUP_BARRIER,       "GROUP_BARRIER",        0, O },
+    { alu_instruction::OP2_GROUP_SEQ_BEGIN,     "GROUP_SEQ_BEGIN",      0, O },
+    { alu_instruction::OP2_GROUP_SEQ_END,       "GROUP_SEQ_END",        0, O },
+    { alu_instruction::OP2_SET_MODE,            "SET_MODE",             2, O },
+    { alu_instruction::OP2_SET_CF_IDX0,         "SET_CF_IDX0",          1, O },
+    { alu_instruction::OP2_SET_CF_IDX1,         "SET_CF_IDX1",          1, O },
+    { alu_instruction::OP2_SET_LDS_SIZE,        "SET_LDS_SIZE",         1, O },
+    { alu_instruction::OP2_EXP_IEEE,            "EXP_IEEE",             1, T },
+    { alu_instruction::OP2_LOG_CLAMPED,         "LOG_CLAMPED",          1, T },
+    { alu_instruction::OP2_LOG_IEEE,            "LOG_IEEE",             1, T },
+    { alu_instruction::OP2_RECIP_CLAMPED,       "RECIP_CLAMPED",        1, T },
+    { alu_instruction::OP2_RECIP_FF,            "RECIP_FF",             1, T },
+    { alu_instruction::OP2_RECIP_IEEE,          "RECIP_IEEE",           1, T },
+    { alu_instruction::OP2_RECIPSQRT_CLAMPED,   "RECIPSQRT_CLAMPED",    1, T },
+    { alu_instruction::OP2_RECIPSQRT_FF,        "RECIPSQRT_FF",         1, T },
+    { alu_instruction::OP2_RECIPSQRT_IEEE,      "RECIPSQRT_IEEE",       1, T },
+    { alu_instruction::OP2_SQRT_IEEE,           "SQRT_IEEE",            1, T },
+    { alu_instruction::OP2_SIN,                 "SIN",                  1, T },
+    { alu_instruction::OP2_COS,                 "COS",                  1, T },
+    { alu_instruction::OP2_MULLO_INT,           "MULLO_INT",            2, T | I },
+    { alu_instruction::OP2_MULHI_INT,           "MULHI_INT",            2, T | I },
+    { alu_instruction::OP2_MULLO_UINT,          "MULLO_UINT",           2, T | I },
+    { alu_instruction::OP2_MULHI_UINT,          "MULHI_UINT",           2, T | I },
+    { alu_instruction::OP2_RECIP_INT,           "RECIP_INT",            1, T | I },
+    { alu_instruction::OP2_RECIP_UINT,          "RECIP_UINT",           1, T | I },
+    { alu_instruction::OP2_RECIP_64,            "RECIP_64",             2, D },
+    { alu_instruction::OP2_RECIP_CLAMPED_64,    "RECIP_CLAMPED_64",     2, D },
+    { alu_instruction::OP2_RECIPSQRT_64,        "RECIPSQRT_64",         2, D },
+    { alu_instruction::OP2_RECIPSQRT_CLAMPED_64, "RECIPSQRT_CLAMPED_64", 2, D },
+    { alu_instruction::OP2_SQRT_64,             "SQRT_64",              2, D },
+    { alu_instruction::OP2_FLT_TO_UINT,         "FLT_TO_UINT",          1, T | I },
+    { alu_instruction::OP2_INT_TO_FLT,          "INT_TO_FLT",           1, T | I },
+    { alu_instruction::OP2_UINT_TO_FLT,         "UINT_TO_FLT",          1, T | I },
+    { alu_instruction::OP2_BFM_INT,             "BFM_INT",              2, I },
+    { alu_instruction::OP2_FLT32_TO_FLT16,      "FLT32_TO_FLT16",       1, 0 },
+    { alu_instruction::OP2_FLT16_TO_FLT32,      "FLT16_TO_FLT32",       1, 0 },
+    { alu_instruction::OP2_UBYTE0_FLT,          "UBYTE0_FLT",           1, 0 },
+    { alu_instruction::OP2_UBYTE1_FLT,          "UBYTE1_FLT",           1, 0 },
+    { alu_instruction::OP2_UBYTE2_FLT,          "UBYTE2_FLT",           1, 0 },
+    { alu_instruction::OP2_UBYTE3_FLT,          "UBYTE3_FLT",           1, 0 },
+    { alu_instruction::OP2_BCNT_INT,            "BCNT_INT",             1, I },
+    { alu_instruction::OP2_FFBH_UINT,           "FFBH_UINT",            1, I },
+    { alu_instruction::OP2_FFBL_INT,            "FFBL_INT",             1, I },
+    { alu_instruction::OP2_FFBH_INT,            "FFBH_INT",             1, I },
+    { alu_instruction::OP2_FLT_TO_UINT4,        "FLT_TO_UINT4",         1, I },
+    { alu_instruction::OP2_DOT_IEEE,            "DOT_IEEE",             2, R },
+    { alu_instruction::OP2_FLT_TO_INT_RPI,      "FLT_TO_INT_RPI",       1, I },
+    { alu_instruction::OP2_FLT_TO_INT_FLOOR,    "FLT_TO_INT_FLOOR",     1, I },
+    { alu_instruction::OP2_MULHI_UINT24,        "MULHI_UINT24",         2, V | I },
+    { alu_instruction::OP2_MBCNT_32HI_INT,      "MBCNT_32HI_INT",       1, O | I },
+    { alu_instruction::OP2_OFFSET_TO_FLT,       "OFFSET_TO_FLT",        1, 0 },
+    { alu_instruction::OP2_MUL_UINT24,          "MUL_UINT24",           2, V | I },
+    { alu_instruction::OP2_BCNT_ACCUM_PREV_INT, "BCNT_ACCUM_PREV_INT",  1, O | I },
+    { alu_instruction::OP2_MBCNT_32LO_ACCUM_PREV_INT, "MBCNT_32LO_ACCUM_PREV_INT", 1, O | I },
+    { alu_instruction::OP2_SETE_64,             "SETE_64",              2, D },
+    { alu_instruction::OP2_SETNE_64,            "SETNE_64",             2, D },
+    { alu_instruction::OP2_SETGT_64,            "SETGT_64",             2, D },
+    { alu_instruction::OP2_SETGE_64,            "SETGE_64",             2, D },
+    { alu_instruction::OP2_MIN_64,              "MIN_64",               2, D },
+    { alu_instruction::OP2_MAX_64,              "MAX_64",               2, D },
+    { alu_instruction::OP2_DOT4,                "DOT4",                 2, R },
+    { alu_instruction::OP2_DOT4_IEEE,           "DOT4_IEEE",            2, R },
+    { alu_instruction::OP2_CUBE,                "CUBE",                 2, R },
+    { alu_instruction::OP2_MAX4,                "MAX4",                 1, R },
+    { alu_instruction::OP2_FREXP_64,            "FREXP_64",             1, D },
+    { alu_instruction::OP2_LDEXP_64,            "LDEXP_64",             2, D },
+    { alu_instruction::OP2_FRACT_64,            "FRACT_64",             1, D },
+    { alu_instruction::OP2_PRED_SETGT_64,       "PRED_SETGT_64",        2, D | P },
+    { alu_instruction::OP2_PRED_SETE_64,        "PRED_SETE_64",         2, D | P },
+    { alu_instruction::OP2_PRED_SETGE_64,       "PRED_SETGE_64",        2, D | P },
+    { alu_instruction::OP2_MUL_64,              "MUL_64",               2, D },
+    { alu_instruction::OP2_ADD_64,              "ADD_64",               2, D },
+    { alu_instruction::OP2_MOVA_INT,            "MOVA_INT",             1, V | O | I },
+    { alu_instruction::OP2_FLT64_TO_FLT32,      "FLT64_TO_FLT32",       1, D },
+    { alu_instruction::OP2_FLT32_TO_FLT64,      "FLT32_TO_FLT64",       1, D },
+    { alu_instruction::OP2_SAD_ACCUM_PREV_UINT, "SAD_ACCUM_PREV_UINT",  2, O | I },
+    { alu_instruction::OP2_DOT,                 "DOT",                  2, O },
+    { alu_instruction::OP2_MUL_PREV,            "MUL_PREV",             1, O },
+    { alu_instruction::OP2_MUL_IEEE_PREV,       "MUL_IEEE_PREV",        1, O },
+    { alu_instruction::OP2_ADD_PREV,            "ADD_PREV",             1, O },
+    { alu_instruction::OP2_MULADD_PREV,         "MULADD_PREV",          2, O },
+    { alu_instruction::OP2_MULADD_IEEE_PREV,    "MULADD_IEEE_PREV",     2, O },
+    { alu_instruction::OP2_INTERP_XY,           "INTERP_XY",            2, V | O },
+    { alu_instruction::OP2_INTERP_ZW,           "INTERP_ZW",            2, V | O },
+    { alu_instruction::OP2_INTERP_X,            "INTERP_X",             2, V | O },
+    { alu_instruction::OP2_INTERP_Z,            "INTERP_Z",             2, V | O },
+    { alu_instruction::OP2_STORE_FLAGS,         "STORE_FLAGS",          1, O },
+    { alu_instruction::OP2_LOAD_STORE_FLAGS,    "LOAD_STORE_FLAGS",     1, O },
+    { alu_instruction::OP2_LDS_1A,              "LDS_1A",               2, L },
+    { alu_instruction::OP2_LDS_1A1D,            "LDS_1A1D",             2, L },
+    { alu_instruction::OP2_LDS_2A,              "LDS_2A",               2, L },
+    { alu_instruction::OP2_INTERP_LOAD_P0,      "INTERP_LOAD_P0",       1, V | O },
+    { alu_instruction::OP2_INTERP_LOAD_P10,     "INTERP_LOAD_P10",      1, V | O },
+    { alu_instruction::OP2_INTERP_LOAD_P20,     "INTERP_LOAD_P20",      1, V | O },
+    { alu_instruction::OP3_BFE_UINT,            "BFE_UINT",             3, I },
+    { alu_instruction::OP3_BFE_INT,             "BFE_INT",              3, I },
+    { alu_instruction::OP3_BFI_INT,             "BFI_INT",              3, I },
+    { alu_instruction::OP3_FMA,                 "FMA",                  3, 0 },
+    { alu_instruction::OP3_MULADD_64,           "MULADD_64",            3, D },
+    { alu_instruction::OP3_CNDNE_64,            "CNDNE_64",             3, D },
+    { alu_instruction::OP3_FMA_64,              "FMA_64",               3, D },
+    { alu_instruction::OP3_LERP_UINT,           "LERP_UINT",            3, I },
+    { alu_instruction::OP3_BIT_ALIGN_INT,       "BIT_ALIGN_INT",        3, I },
+    { alu_instruction::OP3_BYTE_ALIGN_INT,      "BYTE_ALIGN_INT",       3, I },
+    { alu_instruction::OP3_SAD_ACCUM_UINT,      "SAD_ACCUM_UINT",       3, I },
+    { alu_instruction::OP3_SAD_ACCUM_HI_UINT,   "SAD_ACCUM_HI_UINT",    3, I },
+    { alu_instruction::OP3_MULADD_UINT24,       "MULADD_UINT24",        3, V | I },
+    { alu_instruction::OP3_LDS_IDX_OP,          "LDS_IDX_OP",           3, L },
+    { alu_instruction::OP3_MULADD,              "MULADD",               3, 0 },
+    { alu_instruction::OP3_MULADD_M2,           "MULADD_M2",            3, 0 },
+    { alu_instruction::OP3_MULADD_M4,           "MULADD_M4",            3, 0 },
+    { alu_instruction::OP3_MULADD_D2,           "MULADD_D2",            3, 0 },
+    { alu_instruction::OP3_MULADD_IEEE,         "MULADD_IEEE",          3, 0 },
+    { alu_instruction::OP3_CNDE,                "CNDE",                 3, 0 },
+    { alu_instruction::OP3_CNDGT,               "CNDGT",                3, 0 },
+    { alu_instruction::OP3_CNDGE,               "CNDGE",                3, 0 },
+    { alu_instruction::OP3_CNDE_INT,            "CNDE_INT",             3, I },
+    { alu_instruction::OP3_CNDGT_INT,           "CNDGT_INT",            3, I },
+    { alu_instruction::OP3_CNDGE_INT,           "CNDGE_INT",            3, I },
+    { alu_instruction::OP3_MUL_LIT,             "MUL_LIT",              3, T }
+};
+
+/// Table of opcode descriptions indexed by opcode (OP2 below 0x100, OP3
+/// at 0x100 plus the 5-bit field).
+struct alu_opcode_table {
+    alu_opcode_info const* entries[0x100 + 0x20];
+
+    alu_opcode_table()
+    {
+        for (unsigned i = 0; i < sizeof(entries) / sizeof(entries[0]); ++i)
+            entries[i] = 0;
+        for (unsigned i = 0; i < sizeof(alu_opcodes) / sizeof(alu_opcodes[0]); ++i)
+            entries[index(alu_opcodes[i].op)] = &alu_opcodes[i];
+    }
+
+    static unsigned index(unsigned op)
+    {
+        return op < 0x100 ? op : 0x100 + ((op >> 6) & 0x1f);
+    }
+
+    alu_opcode_info const* operator[](unsigned op) const
+    {
+        return op < 0x800 ? entries[index(op)] : 0;
+    }
+};
+
+alu_opcode_table const& opcode_table()
+{
+    static const alu_opcode_table table;
+    return table;
+}
+
+const char* const lds_op_names[0x40] = {
+    "ADD", "SUB", "RSUB", "INC", "DEC", "MIN_INT", "MAX_INT", "MIN_UINT",
+    "MAX_UINT", "AND", "OR", "XOR", "MSKOR", "WRITE", "WRITE_REL", "WRITE2",
+    "CMP_STORE", "CMP_STORE_SPF", "BYTE_WRITE", "SHORT_WRITE", 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    "ADD_RET", "SUB_RET", "RSUB_RET", "INC_RET", "DEC_RET", "MIN_INT_RET", "MAX_INT_RET", "MIN_UINT_RET",
+    "MAX_UINT_RET", "AND_RET", "OR_RET", "XOR_RET", "MSKOR_RET", "XCHG_RET", "XCHG_REL_RET", "XCHG2_RET",
+    "CMP_XCHG_RET", "CMP_XCHG_SPF_RET", "READ_RET", "READ_REL_RET", "READ2_RET", "READWRITE_RET", "BYTE_READ_RET", "UBYTE_READ_RET",
+    "SHORT_READ_RET", "USHORT_READ_RET", 0, 0, 0, 0, 0, 0
+};
+
+const char* const cf_names[0x20] = {
+    "NOP", "TC", "VC", "GDS", "LOOP_START", "LOOP_END", "LOOP_START_DX10", "LOOP_START_NO_AL",
+    "LOOP_CONTINUE", "LOOP_BREAK", "JUMP", "PUSH", 0, "ELSE", "POP", 0,
+    0, 0, "CALL", "CALL_FS", "RETURN", "EMIT_VERTEX", "EMIT_CUT_VERTEX", "CUT_VERTEX",
+    "KILL", 0, "WAIT_ACK", "TC_ACK", "VC_ACK", "JUMPTABLE", "GLOBAL_WAVE_SYNC", "HALT"
+};
+
+const char* const cf_alu_names[8] = {
+    "ALU", "ALU_PUSH_BEFORE", "ALU_POP_AFTER", "ALU_POP2_AFTER",
+    "ALU_EXTENDED", "ALU_CONTINUE", "ALU_BREAK", "ALU_ELSE_AFTER"
+};
+
+const char* const cf_export_names[0x1d] = {
+    "MEM_STREAM0_BUF0", "MEM_STREAM0_BUF1", "MEM_STREAM0_BUF2", "MEM_STREAM0_BUF3",
+    "MEM_STREAM1_BUF0", "MEM_STREAM1_BUF1", "MEM_STREAM1_BUF2", "MEM_STREAM1_BUF3",
+    "MEM_STREAM2_BUF0", "MEM_STREAM2_BUF1", "MEM_STREAM2_BUF2", "MEM_STREAM2_BUF3",
+    "MEM_STREAM3_BUF0", "MEM_STREAM3_BUF1", "MEM_STREAM3_BUF2", "MEM_STREAM3_BUF3",
+    "MEM_SCRATCH", "MEM_RING", 0, "EXPORT", "EXPORT_DONE", "MEM_EXPORT", "MEM_RAT", "MEM_RAT_CACHELESS",
+    "MEM_RING1", "MEM_RING2", "MEM_RING3", "MEM_EXPORT_COMBINED", "MEM_RAT_COMBINED_CACHELESS"
+};
+
+}
+
+cf_instruction::cf_instruction(opcode inst)
+    : word0(), word1()
+{
+    if (inst >= CF_INST_ALU)
+        word1 = bits(inst, 26, 4);
+    else
+        word1 = bits(inst, 22, 8);
+}
+
+unsigned cf_instruction::inst() const
+{
+    if (is_alu())
+        return 0x100 | field(word1, 26, 4);
+    return field(word1, 22, 8);
+}
+
+void cf_instruction::set_inst(opcode inst)
+{
+    if (inst >= CF_INST_ALU)
+        set_field(word1, 26, 4, inst);
+    else
+        set_field(word1, 22, 8, inst);
+}
+
+const char* cf_instruction::name() const
+{
+    unsigned i = inst();
+    if (i >= CF_INST_ALU)
+        return cf_alu_names[i - CF_INST_ALU];
+    if (i < 0x20)
+        return cf_names[i];
+    if (i >= CF_INST_MEM_STREAM0_BUF0 && i <= CF_INST_MEM_RAT_COMBINED_CACHELESS)
+        return cf_export_names[i - CF_INST_MEM_STREAM0_BUF0];
+    return 0;
+}
+
+bool cf_instruction::is_branch() const
+{
+    switch (inst()) {
+    case CF_INST_LOOP_START:
+    case CF_INST_LOOP_END:
+    case CF_INST_LOOP_START_DX10:
+    case CF_INST_LOOP_START_NO_AL:
+    case CF_INST_LOOP_CONTINUE:
+    case CF_INST_LOOP_BREAK:
+    case CF_INST_JUMP:
+    case CF_INST_PUSH:
+    case CF_INST_ELSE:
+    case CF_INST_CALL:
+    case CF_INST_CALL_FS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+uint32_t cf_instruction::addr() const
+{
+    if (is_alu())
+        return field(word0, 0, 22);
+    return field(word0, 0, 24);
+}
+
+void cf_instruction::set_addr(uint32_t addr)
+{
+    if (is_alu())
+        set_field(word0, 0, 22, addr);
+    else
+        set_field(word0, 0, 24, addr);
+}
+
+unsigned cf_instruction::count() const
+{
+    if (is_alu())
+        return field(word1, 18, 7) + 1;
+    if (is_fetch())
+        return field(word1, 10, 6) + 1;
+    return field(word1, 10, 6);
+}
+
+void cf_instruction::set_count(unsigned n)
+{
+    if (is_alu()) {
+        if (n < 1 || n > 128)
+            throw out_of_range("ALU clause size");
+        set_field(word1, 18, 7, n - 1);
+    }
+    else if (is_fetch()) {
+        if (n < 1 || n > 64)
+            throw out_of_range("fetch clause size");
+        set_field(word1, 10, 6, n - 1);
+    }
+    else
+        set_field(word1, 10, 6, n);
+}
+
+void cf_instruction::set_end_of_program(bool b)
+{
+    if (is_alu())
+        throw logic_error("END_OF_PROGRAM on ALU clause");
+    set_field(word1, 21, 1, b);
+}
+
+alu_instruction::alu_instruction()
+{
+    *this = alu_instruction(OP2_NOP);
+}
+
+alu_instruction::alu_instruction(unsigned op)
+    : op(op), dst_gpr(), dst_chan(), dst_rel(), write_mask(), clamp(), omod(),
+      index_mode(), pred_sel(), bank_swizzle(), update_exec_mask(), update_pred(),
+      last(), lds_op(), idx_offset()
+{
+    for (unsigned i = 0; i < 3; ++i) {
+        src[i].sel = 0;
+        src[i].chan = 0;
+        src[i].rel = false;
+        src[i].neg = false;
+        src[i].abs = false;
+    }
+}
+
+alu_instruction::alu_instruction(uint32_t word0, uint32_t word1)
+{
+    src[0].sel = field(word0, 0, 9);
+    src[0].rel = field(word0, 9, 1);
+    src[0].chan = field(word0, 10, 2);
+    src[0].neg = field(word0, 12, 1);
+    src[1].sel = field(word0, 13, 9);
+    src[1].rel = field(word0, 22, 1);
+    src[1].chan = field(word0, 23, 2);
+    src[1].neg = field(word0, 25, 1);
+    index_mode = field(word0, 26, 3);
+    pred_sel = field(word0, 29, 2);
+    last = field(word0, 31, 1);
+
+    bank_swizzle = field(word1, 18, 3);
+    dst_gpr = field(word1, 21, 7);
+    dst_rel = field(word1, 28, 1);
+    dst_chan = field(word1, 29, 2);
+    clamp = field(word1, 31, 1);
+
+    if (field(word1, 15, 3) != 0) {
+        // OP3 encoding
+        op = field(word1, 13, 5) << 6;
+        src[0].abs = src[1].abs = false;
+        src[2].sel = field(word1, 0, 9);
+        src[2].rel = field(word1, 9, 1);
+        src[2].chan = field(word1, 10, 2);
+        src[2].neg = field(word1, 12, 1);
+        src[2].abs = false;
+        write_mask = true;
+        omod = 0;
+        update_exec_mask = update_pred = false;
+        lds_op = idx_offset = 0;
+
+        if (op == OP3_LDS_IDX_OP) {
+            // The index offset is scattered over both words and the LDS
+            // operation takes the place of the destination.
+            idx_offset =
+                field(word1, 27, 1) |
+                field(word1, 12, 1) << 1 |
+                field(word1, 28, 1) << 2 |
+                field(word1, 31, 1) << 3 |
+                field(word0, 12, 1) << 4 |
+                field(word0, 25, 1) << 5;
+            lds_op = field(word1, 21, 6);
+            src[0].neg = src[1].neg = src[2].neg = false;
+            dst_gpr = 0;
+            dst_rel = false;
+            clamp = false;
+            write_mask = false;
+        }
+    }
+    else {
+        // OP2 encoding
+        op = field(word1, 7, 11);
+        src[0].abs = field(word1, 0, 1);
+        src[1].abs = field(word1, 1, 1);
+        update_exec_mask = field(word1, 2, 1);
+        update_pred = field(word1, 3, 1);
+        write_mask = field(word1, 4, 1);
+        omod = field(word1, 5, 2);
+        src[2].sel = src[2].chan = 0;
+        src[2].rel = src[2].neg = src[2].abs = false;
+        lds_op = idx_offset = 0;
+    }
+}
+
+void alu_instruction::encode(uint32_t* words) const
+{
+    uint32_t w0 =
+        bits(src[0].sel, 0, 9) |
+        bits(src[0].rel, 9, 1) |
+        bits(src[0].chan, 10, 2) |
+        bits(src[0].neg, 12, 1) |
+        bits(src[1].sel, 13, 9) |
+        bits(src[1].rel, 22, 1) |
+        bits(src[1].chan, 23, 2) |
+        bits(src[1].neg, 25, 1) |
+        bits(index_mode, 26, 3) |
+        bits(pred_sel, 29, 2) |
+        bits(last, 31, 1);
+    uint32_t w1 = bits(bank_swizzle, 18, 3);
+
+    if (op == OP3_LDS_IDX_OP) {
+        w0 &= ~(bits(1, 12, 1) | bits(1, 25, 1));
+        w0 |= bits(idx_offset >> 4, 12, 1) | bits(idx_offset >> 5, 25, 1);
+        w1 |=
+            bits(src[2].sel, 0, 9) |
+            bits(src[2].rel, 9, 1) |
+            bits(src[2].chan, 10, 2) |
+            bits(idx_offset >> 1, 12, 1) |
+            bits(op >> 6, 13, 5) |
+            bits(lds_op, 21, 6) |
+            bits(idx_offset, 27, 1) |
+            bits(idx_offset >> 2, 28, 1) |
+            bits(dst_chan, 29, 2) |
+            bits(idx_offset >> 3, 31, 1);
+    }
+    else if (is_op3()) {
+        w1 |=
+            bits(src[2].sel, 0, 9) |
+            bits(src[2].rel, 9, 1) |
+            bits(src[2].chan, 10, 2) |
+            bits(src[2].neg, 12, 1) |
+            bits(op >> 6, 13, 5) |
+            bits(dst_gpr, 21, 7) |
+            bits(dst_rel, 28, 1) |
+            bits(dst_chan, 29, 2) |
+            bits(clamp, 31, 1);
+    }
+    else {
+        w1 |=
+            bits(src[0].abs, 0, 1) |
+            bits(src[1].abs, 1, 1) |
+            bits(update_exec_mask, 2, 1) |
+            bits(update_pred, 3, 1) |
+            bits(write_mask, 4, 1) |
+            bits(omod, 5, 2) |
+            bits(op, 7, 11) |
+            bits(dst_gpr, 21, 7) |
+            bits(dst_rel, 28, 1) |
+            bits(dst_chan, 29, 2) |
+            bits(clamp, 31, 1);
+    }
+    words[0] = w0;
+    words[1] = w1;
+}
+
+const char* alu_instruction::name() const
+{
+    return name(op);
+}
+
+unsigned alu_instruction::num_sources() const
+{
+    if (op == OP3_LDS_IDX_OP) {
+        // Reads without data take only the address, the others one or two
+        // data operands.
+        switch (lds_op) {
+        case LDS_OP_READ_RET:
+        case LDS_OP_READ_REL_RET:
+        case LDS_OP_READ2_RET:
+        case LDS_OP_BYTE_READ_RET:
+        case LDS_OP_UBYTE_READ_RET:
+        case LDS_OP_SHORT_READ_RET:
+        case LDS_OP_USHORT_READ_RET:
+        case LDS_OP_INC:
+        case LDS_OP_DEC:
+        case LDS_OP_INC_RET:
+        case LDS_OP_DEC_RET:
+            return 1;
+        case LDS_OP_WRITE2:
+        case LDS_OP_WRITE_REL:
+        case LDS_OP_MSKOR:
+        case LDS_OP_CMP_STORE:
+        case LDS_OP_CMP_STORE_SPF:
+        case LDS_OP_MSKOR_RET:
+        case LDS_OP_XCHG_REL_RET:
+        case LDS_OP_XCHG2_RET:
+        case LDS_OP_CMP_XCHG_RET:
+        case LDS_OP_CMP_XCHG_SPF_RET:
+        case LDS_OP_READWRITE_RET:
+            return 3;
+        default:
+            return 2;
+        }
+    }
+    return num_sources(op);
+}
+
+unsigned alu_instruction::flags() const
+{
+    return flags(op);
+}
+
+bool alu_instruction::writes_gpr() const
+{
+    return is_op3() ? op != OP3_LDS_IDX_OP : write_mask;
+}
+
+bool alu_instruction::reads(uint32_t sel) const
+{
+    for (unsigned i = 0, n = num_sources(); i < n; ++i)
+        if (src[i].sel == sel)
+            return true;
+    return false;
+}
+
+const char* alu_instruction::name(unsigned op)
+{
+    alu_opcode_info const* info = opcode_table()[op];
+    return info ? info->name : 0;
+}
+
+const char* alu_instruction::lds_name(unsigned lds_op)
+{
+    return lds_op < 0x40 ? lds_op_names[lds_op] : 0;
+}
+
+unsigned alu_instruction::num_sources(unsigned op)
+{
+    alu_opcode_info const* info = opcode_table()[op];
+    return info ? info->num_sources : (op >= 0x100 ? 3 : 2);
+}
+
+unsigned alu_instruction::flags(unsigned op)
+{
+    alu_opcode_info const* info = opcode_table()[op];
+    // Unknown instructions are never moved around.
+    return info ? info->flags : unsigned(ORDERED);
+}
+
+void alu_group::assign_slots(unsigned* unit) const
+{
+    if (slots.empty() || slots.size() > 5)
+        throw runtime_error("invalid instruction group size");
+
+    bool used[5] = { false, false, false, false, false };
+    for (size_t i = 0; i < slots.size(); ++i) {
+        alu_instruction const& alu = slots[i];
+        unsigned u = alu.dst_chan;
+        if (used[u] || (alu.flags() & alu_instruction::TRANS_ONLY) != 0)
+            u = 4;
+        if (used[u])
+            throw runtime_error("instruction group has conflicting slots");
+        if (u == 4 && (alu.flags() & alu_instruction::VECTOR_ONLY) != 0)
+            throw runtime_error("vector instruction in trans slot");
+        used[u] = true;
+        unit[i] = u;
+    }
+}
+
+const char* fetch_instruction::name() const
+{
+    switch (inst()) {
+    case VTX_INST_FETCH:
+        return "FETCH";
+    case VTX_INST_SEMANTIC:
+        return "SEMANTIC";
+    case VTX_INST_MEM:
+        return "MEM";
+    case TEX_INST_LD:
+        return "LD";
+    case TEX_INST_GET_TEXTURE_RESINFO:
+        return "GET_TEXTURE_RESINFO";
+    case TEX_INST_SAMPLE:
+        return "SAMPLE";
+    default:
+        return 0;
+    }
+}
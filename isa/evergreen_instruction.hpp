@@ -0,0 +1,702 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/// This structure wraps the two double words of an Evergreen control flow
+/// instruction.
+///
+/// There are three encodings of CF instructions (CF_WORD, CF_ALU_WORD and
+/// CF_ALLOC_EXPORT_WORD) which are distinguished by the opcode field.
+/// The raw words are kept so that decoding and encoding is always lossless,
+/// the member functions give access to the individual fields.
+struct cf_instruction {
+    /// Enumeration of CF opcodes.
+    /// CF_WORD and CF_ALLOC_EXPORT_WORD opcodes take the value of the 8-bit
+    /// CF_INST field. ALU clause opcodes take the value of the 4-bit CF_INST
+    /// field of CF_ALU_WORD1 plus 0x100, so that all of them are distinct.
+    typedef enum {
+        CF_INST_NOP                         = 0x00,
+        CF_INST_TC                          = 0x01,
+        CF_INST_VC                          = 0x02,
+        CF_INST_GDS                         = 0x03,
+        CF_INST_LOOP_START                  = 0x04,
+        CF_INST_LOOP_END                    = 0x05,
+        CF_INST_LOOP_START_DX10             = 0x06,
+        CF_INST_LOOP_START_NO_AL            = 0x07,
+        CF_INST_LOOP_CONTINUE               = 0x08,
+        CF_INST_LOOP_BREAK                  = 0x09,
+        CF_INST_JUMP                        = 0x0a,
+        CF_INST_PUSH                        = 0x0b,
+        CF_INST_ELSE                        = 0x0d,
+        CF_INST_POP                         = 0x0e,
+        CF_INST_CALL                        = 0x12,
+        CF_INST_CALL_FS                     = 0x13,
+        CF_INST_RETURN                      = 0x14,
+        CF_INST_EMIT_VERTEX                 = 0x15,
+        CF_INST_EMIT_CUT_VERTEX             = 0x16,
+        CF_INST_CUT_VERTEX                  = 0x17,
+        CF_INST_KILL                        = 0x18,
+        CF_INST_WAIT_ACK                    = 0x1a,
+        CF_INST_TC_ACK                      = 0x1b,
+        CF_INST_VC_ACK                      = 0x1c,
+        CF_INST_JUMPTABLE                   = 0x1d,
+        CF_INST_GLOBAL_WAVE_SYNC            = 0x1e,
+        CF_INST_HALT                        = 0x1f,
+        CF_INST_MEM_STREAM0_BUF0            = 0x40,
+        CF_INST_MEM_SCRATCH                 = 0x50,
+        CF_INST_MEM_RING                    = 0x51,
+        CF_INST_EXPORT                      = 0x53,
+        CF_INST_EXPORT_DONE                 = 0x54,
+        CF_INST_MEM_EXPORT                  = 0x55,
+        CF_INST_MEM_RAT                     = 0x56,
+        CF_INST_MEM_RAT_CACHELESS           = 0x57,
+        CF_INST_MEM_RING1                   = 0x58,
+        CF_INST_MEM_RING2                   = 0x59,
+        CF_INST_MEM_RING3                   = 0x5a,
+        CF_INST_MEM_EXPORT_COMBINED         = 0x5b,
+        CF_INST_MEM_RAT_COMBINED_CACHELESS  = 0x5c,
+        CF_INST_ALU                         = 0x108,
+        CF_INST_ALU_PUSH_BEFORE             = 0x109,
+        CF_INST_ALU_POP_AFTER               = 0x10a,
+        CF_INST_ALU_POP2_AFTER              = 0x10b,
+        CF_INST_ALU_EXTENDED                = 0x10c,
+        CF_INST_ALU_CONTINUE                = 0x10d,
+        CF_INST_ALU_BREAK                   = 0x10e,
+        CF_INST_ALU_ELSE_AFTER              = 0x10f
+    } opcode;
+
+    std::uint32_t word0;    ///< The first double word.
+    std::uint32_t word1;    ///< The second double word.
+
+    /// This constructor creates a NOP.
+    cf_instruction() : word0(), word1() {}
+    /// This constructor wraps the given pair of double words.
+    cf_instruction(std::uint32_t w0, std::uint32_t w1) : word0(w0), word1(w1) {}
+    /// This constructor creates an instruction with the given opcode and
+    /// every other field set to zero.
+    explicit cf_instruction(opcode inst);
+
+    /// Get the opcode, as described in the \c opcode enumeration.
+    unsigned inst() const;
+    /// Set the opcode. The new opcode must use the same encoding (an ALU
+    /// clause opcode can only be replaced by another ALU clause opcode).
+    void set_inst(opcode inst);
+    /// Get the mnemonic of the opcode.
+    const char* name() const;
+
+    /// Determine whether this instruction executes an ALU clause.
+    bool is_alu() const { return (word1 >> 29 & 1) != 0; }
+    /// Determine whether this instruction executes a fetch clause.
+    bool is_fetch() const
+        { return !is_alu() && (inst() == CF_INST_TC || inst() == CF_INST_VC); }
+    /// Determine whether this instruction is an allocation or export.
+    bool is_export() const { return !is_alu() && inst() >= CF_INST_MEM_STREAM0_BUF0; }
+    /// Determine whether this instruction executes any clause.
+    bool is_clause() const { return is_alu() || is_fetch(); }
+    /// Determine whether the ADDR field of this instruction is the index of
+    /// another CF instruction (jumps, loops and calls).
+    bool is_branch() const;
+
+    /// Get the ADDR field. For clauses it is the offset of the clause in
+    /// 64-bit words, for branches the index of the target CF instruction.
+    std::uint32_t addr() const;
+    /// Set the ADDR field.
+    void set_addr(std::uint32_t addr);
+    /// Get the number of instructions in a clause. ALU clauses count 64-bit
+    /// slots (literal constants included), fetch clauses count 128-bit
+    /// instructions. For other instructions this returns the raw COUNT field.
+    unsigned count() const;
+    /// Set the number of instructions in the clause.
+    void set_count(unsigned n);
+
+    /// Get the POP_COUNT field.
+    unsigned pop_count() const { return is_alu() || is_export() ? 0 : word1 & 7; }
+    /// Set the POP_COUNT field.
+    void set_pop_count(unsigned n) { word1 = (word1 & ~7u) | (n & 7); }
+    /// Get the CF_CONST field (loop constant or boolean constant index).
+    unsigned cf_const() const { return word1 >> 3 & 0x1f; }
+    /// Get the COND field.
+    unsigned cond() const { return word1 >> 8 & 3; }
+
+    /// Get the BARRIER bit.
+    bool barrier() const { return (word1 >> 31) != 0; }
+    /// Set the BARRIER bit.
+    void set_barrier(bool b) { word1 = (word1 & 0x7fffffffu) | (std::uint32_t(b) << 31); }
+    /// Get the WHOLE_QUAD_MODE bit (MARK for exports).
+    bool whole_quad_mode() const { return (word1 >> 30 & 1) != 0; }
+    /// Get the END_OF_PROGRAM bit.
+    bool end_of_program() const { return !is_alu() && (word1 >> 21 & 1) != 0; }
+    /// Set the END_OF_PROGRAM bit.
+    void set_end_of_program(bool b);
+
+    /// Get the KCACHE_BANK field for the given kcache set (0 or 1).
+    unsigned kcache_bank(unsigned i) const { return word0 >> (22 + 4 * i) & 0xf; }
+    /// Get the KCACHE_MODE field for the given kcache set (0 or 1).
+    unsigned kcache_mode(unsigned i) const
+        { return i == 0 ? word0 >> 30 : word1 & 3; }
+    /// Get the KCACHE_ADDR field for the given kcache set (0 or 1).
+    unsigned kcache_addr(unsigned i) const { return word1 >> (2 + 8 * i) & 0xff; }
+    /// Get the ALT_CONST bit of an ALU clause.
+    bool alt_const() const { return (word1 >> 25 & 1) != 0; }
+
+    /// Get the RAT_ID field of a RAT export.
+    unsigned rat_id() const { return word0 & 0xf; }
+    /// Get the RAT_INST field of a RAT export.
+    unsigned rat_inst() const { return word0 >> 4 & 0x3f; }
+    /// Get the RAT_INDEX_MODE field of a RAT export.
+    unsigned rat_index_mode() const { return word0 >> 11 & 3; }
+    /// Get the ARRAY_BASE field of an export.
+    unsigned array_base() const { return word0 & 0x1fff; }
+    /// Get the TYPE field of an export.
+    unsigned type() const { return word0 >> 13 & 3; }
+    /// Get the RW_GPR field of an export.
+    unsigned rw_gpr() const { return word0 >> 15 & 0x7f; }
+    /// Set the RW_GPR field of an export.
+    void set_rw_gpr(unsigned r) { word0 = (word0 & ~(0x7fu << 15)) | (r & 0x7f) << 15; }
+    /// Get the RW_REL bit of an export.
+    bool rw_rel() const { return (word0 >> 22 & 1) != 0; }
+    /// Get the INDEX_GPR field of an export.
+    unsigned index_gpr() const { return word0 >> 23 & 0x7f; }
+    /// Set the INDEX_GPR field of an export.
+    void set_index_gpr(unsigned r) { word0 = (word0 & ~(0x7fu << 23)) | (r & 0x7f) << 23; }
+    /// Get the ELEM_SIZE field of an export (size in dwords minus one).
+    unsigned elem_size() const { return word0 >> 30; }
+    /// Get the ARRAY_SIZE field of a buffer export.
+    unsigned array_size() const { return word1 & 0xfff; }
+    /// Get the COMP_MASK field of a buffer export.
+    unsigned comp_mask() const { return word1 >> 12 & 0xf; }
+    /// Get the BURST_COUNT field of an export.
+    unsigned burst_count() const { return word1 >> 16 & 0xf; }
+};
+
+/// This structure describes a source operand of an Evergreen ALU instruction.
+struct alu_source {
+    std::uint32_t sel;  ///< Source selector, see \c alu_instruction::source_select.
+    std::uint32_t chan; ///< Source channel (0 to 3 for x, y, z, w).
+    bool rel;           ///< Relative addressing.
+    bool neg;           ///< Negate the operand.
+    bool abs;           ///< Absolute value of the operand (OP2 sources 0 and 1 only).
+};
+
+/// This structure holds a decoded Evergreen ALU instruction.
+///
+/// There are three encodings of ALU instructions: OP2, OP3 and LDS_IDX_OP.
+/// All of them are decoded into the same structure, every bit of the two
+/// double words is represented by a field so that decoding and encoding are
+/// lossless.
+struct alu_instruction {
+    /// Enumeration of ALU opcodes.
+    /// OP2 opcodes take the value of the 11-bit ALU_INST field. OP3 opcodes
+    /// take the value of their 5-bit ALU_INST field shifted left by 6, which
+    /// is where they would fall in the 11-bit field. Hence every OP3 opcode
+    /// is at least 0x100 and every OP2 opcode is less than that.
+    typedef enum {
+        OP2_ADD                     = 0x00,
+        OP2_MUL                     = 0x01,
+        OP2_MUL_IEEE                = 0x02,
+        OP2_MAX                     = 0x03,
+        OP2_MIN                     = 0x04,
+        OP2_MAX_DX10                = 0x05,
+        OP2_MIN_DX10                = 0x06,
+        OP2_SETE                    = 0x08,
+        OP2_SETGT                   = 0x09,
+        OP2_SETGE                   = 0x0a,
+        OP2_SETNE                   = 0x0b,
+        OP2_SETE_DX10               = 0x0c,
+        OP2_SETGT_DX10              = 0x0d,
+        OP2_SETGE_DX10              = 0x0e,
+        OP2_SETNE_DX10              = 0x0f,
+        OP2_FRACT                   = 0x10,
+        OP2_TRUNC                   = 0x11,
+        OP2_CEIL                    = 0x12,
+        OP2_RNDNE                   = 0x13,
+        OP2_FLOOR                   = 0x14,
+        OP2_ASHR_INT                = 0x15,
+        OP2_LSHR_INT                = 0x16,
+        OP2_LSHL_INT                = 0x17,
+        OP2_MOV                     = 0x19,
+        OP2_NOP                     = 0x1a,
+        OP2_PRED_SETGT_UINT         = 0x1e,
+        OP2_PRED_SETGE_UINT         = 0x1f,
+        OP2_PRED_SETE               = 0x20,
+        OP2_PRED_SETGT              = 0x21,
+        OP2_PRED_SETGE              = 0x22,
+        OP2_PRED_SETNE              = 0x23,
+        OP2_PRED_SET_INV            = 0x24,
+        OP2_PRED_SET_POP            = 0x25,
+        OP2_PRED_SET_CLR            = 0x26,
+        OP2_PRED_SET_RESTORE        = 0x27,
+        OP2_PRED_SETE_PUSH          = 0x28,
+        OP2_PRED_SETGT_PUSH         = 0x29,
+        OP2_PRED_SETGE_PUSH         = 0x2a,
+        OP2_PRED_SETNE_PUSH         = 0x2b,
+        OP2_KILLE                   = 0x2c,
+        OP2_KILLGT                  = 0x2d,
+        OP2_KILLGE                  = 0x2e,
+        OP2_KILLNE                  = 0x2f,
+        OP2_AND_INT                 = 0x30,
+        OP2_OR_INT                  = 0x31,
+        OP2_XOR_INT                 = 0x32,
+        OP2_NOT_INT                 = 0x33,
+        OP2_ADD_INT                 = 0x34,
+        OP2_SUB_INT                 = 0x35,
+        OP2_MAX_INT                 = 0x36,
+        OP2_MIN_INT                 = 0x37,
+        OP2_MAX_UINT                = 0x38,
+        OP2_MIN_UINT                = 0x39,
+        OP2_SETE_INT                = 0x3a,
+        OP2_SETGT_INT               = 0x3b,
+        OP2_SETGE_INT               = 0x3c,
+        OP2_SETNE_INT               = 0x3d,
+        OP2_SETGT_UINT              = 0x3e,
+        OP2_SETGE_UINT              = 0x3f,
+        OP2_KILLGT_UINT             = 0x40,
+        OP2_KILLGE_UINT             = 0x41,
+        OP2_PREDE_INT               = 0x42,
+        OP2_PRED_SETGT_INT          = 0x43,
+        OP2_PRED_SETGE_INT          = 0x44,
+        OP2_PRED_SETNE_INT          = 0x45,
+        OP2_KILLE_INT               = 0x46,
+        OP2_KILLGT_INT              = 0x47,
+        OP2_KILLGE_INT              = 0x48,
+        OP2_KILLNE_INT              = 0x49,
+        OP2_PRED_SETE_PUSH_INT      = 0x4a,
+        OP2_PRED_SETGT_PUSH_INT     = 0x4b,
+        OP2_PRED_SETGE_PUSH_INT     = 0x4c,
+        OP2_PRED_SETNE_PUSH_INT     = 0x4d,
+        OP2_PRED_SETLT_PUSH_INT     = 0x4e,
+        OP2_PRED_SETLE_PUSH_INT     = 0x4f,
+        OP2_FLT_TO_INT              = 0x50,
+        OP2_BFREV_INT               = 0x51,
+        OP2_ADDC_UINT               = 0x52,
+        OP2_SUBB_UINT               = 0x53,
+        OP2_GROUP_BARRIER           = 0x54,
+        OP2_GROUP_SEQ_BEGIN         = 0x55,
+        OP2_GROUP_SEQ_END           = 0x56,
+        OP2_SET_MODE                = 0x57,
+        OP2_SET_CF_IDX0             = 0x58,
+        OP2_SET_CF_IDX1             = 0x59,
+        OP2_SET_LDS_SIZE            = 0x5a,
+        OP2_EXP_IEEE                = 0x81,
+        OP2_LOG_CLAMPED             = 0x82,
+        OP2_LOG_IEEE                = 0x83,
+        OP2_RECIP_CLAMPED           = 0x84,
+        OP2_RECIP_FF                = 0x85,
+        OP2_RECIP_IEEE              = 0x86,
+        OP2_RECIPSQRT_CLAMPED       = 0x87,
+        OP2_RECIPSQRT_FF            = 0x88,
+        OP2_RECIPSQRT_IEEE          = 0x89,
+        OP2_SQRT_IEEE               = 0x8a,
+        OP2_SIN                     = 0x8d,
+        OP2_COS                     = 0x8e,
+        OP2_MULLO_INT               = 0x8f,
+        OP2_MULHI_INT               = 0x90,
+        OP2_MULLO_UINT              = 0x91,
+        OP2_MULHI_UINT              = 0x92,
+        OP2_RECIP_INT               = 0x93,
+        OP2_RECIP_UINT              = 0x94,
+        OP2_RECIP_64                = 0x95,
+        OP2_RECIP_CLAMPED_64        = 0x96,
+        OP2_RECIPSQRT_64            = 0x97,
+        OP2_RECIPSQRT_CLAMPED_64    = 0x98,
+        OP2_SQRT_64                 = 0x99,
+        OP2_FLT_TO_UINT             = 0x9a,
+        OP2_INT_TO_FLT              = 0x9b,
+        OP2_UINT_TO_FLT             = 0x9c,
+        OP2_BFM_INT                 = 0xa0,
+        OP2_FLT32_TO_FLT16          = 0xa2,
+        OP2_FLT16_TO_FLT32          = 0xa3,
+        OP2_UBYTE0_FLT              = 0xa4,
+        OP2_UBYTE1_FLT              = 0xa5,
+        OP2_UBYTE2_FLT              = 0xa6,
+        OP2_UBYTE3_FLT              = 0xa7,
+        OP2_BCNT_INT                = 0xaa,
+        OP2_FFBH_UINT               = 0xab,
+        OP2_FFBL_INT                = 0xac,
+        OP2_FFBH_INT                = 0xad,
+        OP2_FLT_TO_UINT4            = 0xae,
+        OP2_DOT_IEEE                = 0xaf,
+        OP2_FLT_TO_INT_RPI          = 0xb0,
+        OP2_FLT_TO_INT_FLOOR        = 0xb1,
+        OP2_MULHI_UINT24            = 0xb2,
+        OP2_MBCNT_32HI_INT          = 0xb3,
+        OP2_OFFSET_TO_FLT           = 0xb4,
+        OP2_MUL_UINT24              = 0xb5,
+        OP2_BCNT_ACCUM_PREV_INT     = 0xb6,
+        OP2_MBCNT_32LO_ACCUM_PREV_INT = 0xb7,
+        OP2_SETE_64                 = 0xb8,
+        OP2_SETNE_64                = 0xb9,
+        OP2_SETGT_64                = 0xba,
+        OP2_SETGE_64                = 0xbb,
+        OP2_MIN_64                  = 0xbc,
+        OP2_MAX_64                  = 0xbd,
+        OP2_DOT4                    = 0xbe,
+        OP2_DOT4_IEEE               = 0xbf,
+        OP2_CUBE                    = 0xc0,
+        OP2_MAX4                    = 0xc1,
+        OP2_FREXP_64                = 0xc4,
+        OP2_LDEXP_64                = 0xc5,
+        OP2_FRACT_64                = 0xc6,
+        OP2_PRED_SETGT_64           = 0xc7,
+        OP2_PRED_SETE_64            = 0xc8,
+        OP2_PRED_SETGE_64           = 0xc9,
+        OP2_MUL_64                  = 0xca,
+        OP2_ADD_64                  = 0xcb,
+        OP2_MOVA_INT                = 0xcc,
+        OP2_FLT64_TO_FLT32          = 0xcd,
+        OP2_FLT32_TO_FLT64          = 0xce,
+        OP2_SAD_ACCUM_PREV_UINT     = 0xcf,
+        OP2_DOT                     = 0xd0,
+        OP2_MUL_PREV                = 0xd1,
+        OP2_MUL_IEEE_PREV           = 0xd2,
+        OP2_ADD_PREV                = 0xd3,
+        OP2_MULADD_PREV             = 0xd4,
+        OP2_MULADD_IEEE_PREV        = 0xd5,
+        OP2_INTERP_XY               = 0xd6,
+        OP2_INTERP_ZW               = 0xd7,
+        OP2_INTERP_X                = 0xd8,
+        OP2_INTERP_Z                = 0xd9,
+        OP2_STORE_FLAGS             = 0xda,
+        OP2_LOAD_STORE_FLAGS        = 0xdb,
+        OP2_LDS_1A                  = 0xdc,
+        OP2_LDS_1A1D                = 0xdd,
+        OP2_LDS_2A                  = 0xde,
+        OP2_INTERP_LOAD_P0          = 0xdf,
+        OP2_INTERP_LOAD_P10         = 0xe0,
+        OP2_INTERP_LOAD_P20         = 0xe1,
+        OP3_BFE_UINT                = 0x04 << 6,
+        OP3_BFE_INT                 = 0x05 << 6,
+        OP3_BFI_INT                 = 0x06 << 6,
+        OP3_FMA                     = 0x07 << 6,
+        OP3_MULADD_64               = 0x08 << 6,
+        OP3_CNDNE_64                = 0x09 << 6,
+        OP3_FMA_64                  = 0x0a << 6,
+        OP3_LERP_UINT               = 0x0b << 6,
+        OP3_BIT_ALIGN_INT           = 0x0c << 6,
+        OP3_BYTE_ALIGN_INT          = 0x0d << 6,
+        OP3_SAD_ACCUM_UINT          = 0x0e << 6,
+        OP3_SAD_ACCUM_HI_UINT       = 0x0f << 6,
+        OP3_MULADD_UINT24           = 0x10 << 6,
+        OP3_LDS_IDX_OP              = 0x11 << 6,
+        OP3_MULADD                  = 0x14 << 6,
+        OP3_MULADD_M2               = 0x15 << 6,
+        OP3_MULADD_M4               = 0x16 << 6,
+        OP3_MULADD_D2               = 0x17 << 6,
+        OP3_MULADD_IEEE             = 0x18 << 6,
+        OP3_CNDE                    = 0x19 << 6,
+        OP3_CNDGT                   = 0x1a << 6,
+        OP3_CNDGE                   = 0x1b << 6,
+        OP3_CNDE_INT                = 0x1c << 6,
+        OP3_CNDGT_INT               = 0x1d << 6,
+        OP3_CNDGE_INT               = 0x1e << 6,
+        OP3_MUL_LIT                 = 0x1f << 6
+    } opcode;
+
+    /// Enumeration of the LDS_OP field of LDS_IDX_OP instructions.
+    typedef enum {
+        LDS_OP_ADD                  = 0x00,
+        LDS_OP_SUB                  = 0x01,
+        LDS_OP_RSUB                 = 0x02,
+        LDS_OP_INC                  = 0x03,
+        LDS_OP_DEC                  = 0x04,
+        LDS_OP_MIN_INT              = 0x05,
+        LDS_OP_MAX_INT              = 0x06,
+        LDS_OP_MIN_UINT             = 0x07,
+        LDS_OP_MAX_UINT             = 0x08,
+        LDS_OP_AND                  = 0x09,
+        LDS_OP_OR                   = 0x0a,
+        LDS_OP_XOR                  = 0x0b,
+        LDS_OP_MSKOR                = 0x0c,
+        LDS_OP_WRITE                = 0x0d,
+        LDS_OP_WRITE_REL            = 0x0e,
+        LDS_OP_WRITE2               = 0x0f,
+        LDS_OP_CMP_STORE            = 0x10,
+        LDS_OP_CMP_STORE_SPF        = 0x11,
+        LDS_OP_BYTE_WRITE           = 0x12,
+        LDS_OP_SHORT_WRITE          = 0x13,
+        LDS_OP_ADD_RET              = 0x20,
+        LDS_OP_SUB_RET              = 0x21,
+        LDS_OP_RSUB_RET             = 0x22,
+        LDS_OP_INC_RET              = 0x23,
+        LDS_OP_DEC_RET              = 0x24,
+        LDS_OP_MIN_INT_RET          = 0x25,
+        LDS_OP_MAX_INT_RET          = 0x26,
+        LDS_OP_MIN_UINT_RET         = 0x27,
+        LDS_OP_MAX_UINT_RET         = 0x28,
+        LDS_OP_AND_RET              = 0x29,
+        LDS_OP_OR_RET               = 0x2a,
+        LDS_OP_XOR_RET              = 0x2b,
+        LDS_OP_MSKOR_RET            = 0x2c,
+        LDS_OP_XCHG_RET             = 0x2d,
+        LDS_OP_XCHG_REL_RET         = 0x2e,
+        LDS_OP_XCHG2_RET            = 0x2f,
+        LDS_OP_CMP_XCHG_RET         = 0x30,
+        LDS_OP_CMP_XCHG_SPF_RET     = 0x31,
+        LDS_OP_READ_RET             = 0x32,
+        LDS_OP_READ_REL_RET         = 0x33,
+        LDS_OP_READ2_RET            = 0x34,
+        LDS_OP_READWRITE_RET        = 0x35,
+        LDS_OP_BYTE_READ_RET        = 0x36,
+        LDS_OP_UBYTE_READ_RET       = 0x37,
+        LDS_OP_SHORT_READ_RET       = 0x38,
+        LDS_OP_USHORT_READ_RET      = 0x39
+    } lds_opcode;
+
+    /// Enumeration of special values of the source selector.
+    /// Values 0 to 127 select a GPR, values 128 to 191 select a constant in
+    /// kcache banks 0 and 1 and values 256 to 319 select a constant in kcache
+    /// banks 2 and 3 (in ALU_EXTENDED clauses).
+    typedef enum {
+        ALU_SRC_GPR_BASE            = 0,
+        ALU_SRC_KCACHE0_BASE        = 128,
+        ALU_SRC_KCACHE1_BASE        = 160,
+        ALU_SRC_LDS_OQ_A            = 219,
+        ALU_SRC_LDS_OQ_B            = 220,
+        ALU_SRC_LDS_OQ_A_POP        = 221,
+        ALU_SRC_LDS_OQ_B_POP        = 222,
+        ALU_SRC_LDS_DIRECT_A        = 223,
+        ALU_SRC_LDS_DIRECT_B        = 224,
+        ALU_SRC_TIME_HI             = 227,
+        ALU_SRC_TIME_LO             = 228,
+        ALU_SRC_MASK_HI             = 229,
+        ALU_SRC_MASK_LO             = 230,
+        ALU_SRC_HW_WAVE_ID          = 231,
+        ALU_SRC_SIMD_ID             = 232,
+        ALU_SRC_SE_ID               = 233,
+        ALU_SRC_HW_THREADGRP_ID     = 234,
+        ALU_SRC_WAVE_ID_IN_GRP      = 235,
+        ALU_SRC_NUM_THREADGRP_WAVES = 236,
+        ALU_SRC_HW_ALU_ODD          = 237,
+        ALU_SRC_LOOP_IDX            = 238,
+        ALU_SRC_PARAM_BASE_ADDR     = 240,
+        ALU_SRC_NEW_PRIM_MASK       = 241,
+        ALU_SRC_PRIM_MASK_HI        = 242,
+        ALU_SRC_PRIM_MASK_LO        = 243,
+        ALU_SRC_1_DBL_L             = 244,
+        ALU_SRC_1_DBL_M             = 245,
+        ALU_SRC_0_5_DBL_L           = 246,
+        ALU_SRC_0_5_DBL_M           = 247,
+        ALU_SRC_0                   = 248,
+        ALU_SRC_1                   = 249,
+        ALU_SRC_1_INT               = 250,
+        ALU_SRC_M_1_INT             = 251,
+        ALU_SRC_0_5                 = 252,
+        ALU_SRC_LITERAL             = 253,
+        ALU_SRC_PV                  = 254,
+        ALU_SRC_PS                  = 255,
+        ALU_SRC_KCACHE2_BASE        = 256,
+        ALU_SRC_KCACHE3_BASE        = 288
+    } source_select;
+
+    /// Enumeration of the PRED_SEL field.
+    typedef enum {
+        PRED_SEL_OFF                = 0,
+        PRED_SEL_ZERO               = 2,
+        PRED_SEL_ONE                = 3
+    } pred_select;
+
+    /// Enumeration of the INDEX_MODE field.
+    typedef enum {
+        INDEX_AR_X                  = 0,
+        INDEX_LOOP                  = 4,
+        INDEX_GLOBAL                = 5,
+        INDEX_GLOBAL_AR_X           = 6
+    } index_select;
+
+    /// Enumeration of bank swizzles. Vector slots use the ALU_VEC values,
+    /// the trans slot uses the ALU_SCL values. The number is the cycle in
+    /// which each of the sources 0, 1 and 2 is read.
+    typedef enum {
+        ALU_VEC_012 = 0, ALU_VEC_021 = 1, ALU_VEC_120 = 2,
+        ALU_VEC_102 = 3, ALU_VEC_201 = 4, ALU_VEC_210 = 5,
+        ALU_SCL_210 = 0, ALU_SCL_122 = 1, ALU_SCL_212 = 2, ALU_SCL_221 = 3
+    } bank_swizzle_select;
+
+    /// Flags describing properties of the opcodes, see \c flags().
+    enum {
+        TRANS_ONLY  = 0x001,    ///< Executes only in the trans slot.
+        VECTOR_ONLY = 0x002,    ///< Never executes in the trans slot.
+        REDUCTION   = 0x004,    ///< Reduces over the vector slots (DOT4...).
+        DOUBLE      = 0x008,    ///< Operates on 64-bit pairs of slots.
+        PRED_SET    = 0x010,    ///< Sets the predicate or execute mask.
+        KILL        = 0x020,    ///< Kills pixels.
+        LDS         = 0x040,    ///< Accesses the LDS.
+        ORDERED     = 0x080,    ///< Has side effects, must not be reordered.
+        INTEGER     = 0x100     ///< Operates on integers.
+    };
+
+    unsigned op;                ///< Opcode, see \c opcode.
+    alu_source src[3];          ///< Source operands.
+    std::uint32_t dst_gpr;      ///< Destination GPR.
+    std::uint32_t dst_chan;     ///< Destination channel.
+    bool dst_rel;               ///< Relative addressing of the destination.
+    bool write_mask;            ///< Write the result to the destination GPR (OP2).
+    bool clamp;                 ///< Clamp the result to [0, 1].
+    std::uint32_t omod;         ///< Output modifier (OP2).
+    std::uint32_t index_mode;   ///< Index for relative addressing.
+    std::uint32_t pred_sel;     ///< Predicate select.
+    std::uint32_t bank_swizzle; ///< Bank swizzle.
+    bool update_exec_mask;      ///< Update the execute mask (OP2).
+    bool update_pred;           ///< Update the predicate (OP2).
+    bool last;                  ///< Last instruction of the group.
+    std::uint32_t lds_op;       ///< LDS operation (LDS_IDX_OP).
+    std::uint32_t idx_offset;   ///< Index offset (LDS_IDX_OP).
+
+    /// This constructor creates a NOP.
+    alu_instruction();
+    /// This constructor creates an instruction with the given opcode and
+    /// default operands (R0.x for every source and destination, no write).
+    explicit alu_instruction(unsigned op);
+    /// This constructor decodes the given pair of double words.
+    alu_instruction(std::uint32_t word0, std::uint32_t word1);
+
+    /// Encode this instruction into a pair of double words.
+    /// \param words Pointer to the destination double words.
+    void encode(std::uint32_t* words) const;
+
+    /// Determine whether the instruction uses the OP3 encoding.
+    bool is_op3() const { return op >= 0x100; }
+    /// Get the mnemonic of the instruction.
+    const char* name() const;
+    /// Get the number of source operands.
+    unsigned num_sources() const;
+    /// Get the opcode property flags.
+    unsigned flags() const;
+
+    /// Determine whether the result of this instruction is written to a GPR.
+    bool writes_gpr() const;
+    /// Determine whether this instruction has a source with the given selector.
+    bool reads(std::uint32_t sel) const;
+
+    /// Get the mnemonic of an opcode.
+    /// \returns A pointer to an internal string, or 0 for unknown opcodes.
+    static const char* name(unsigned op);
+    /// Get the mnemonic of an LDS operation, without the LDS_ prefix.
+    static const char* lds_name(unsigned lds_op);
+    /// Get the number of source operands of an opcode.
+    static unsigned num_sources(unsigned op);
+    /// Get the property flags of an opcode.
+    static unsigned flags(unsigned op);
+
+    /// Determine whether a selector addresses a GPR.
+    static bool is_gpr(std::uint32_t sel) { return sel < ALU_SRC_KCACHE0_BASE; }
+    /// Determine whether a selector addresses a kcache constant.
+    static bool is_kcache(std::uint32_t sel)
+        { return (sel >= ALU_SRC_KCACHE0_BASE && sel < 192) ||
+                 (sel >= ALU_SRC_KCACHE2_BASE && sel < 320); }
+    /// Determine whether a selector is an inline constant or a literal.
+    static bool is_inline_constant(std::uint32_t sel)
+        { return sel >= ALU_SRC_1_DBL_L && sel <= ALU_SRC_LITERAL; }
+};
+
+/// This structure holds an instruction group: up to five ALU instructions
+/// issued together in the x, y, z, w and t slots, followed by up to four
+/// literal constants.
+struct alu_group {
+    /// The instructions in encoding order. Only the last one has \c last set.
+    std::vector<alu_instruction> slots;
+    /// The literal constants which follow the group.
+    std::vector<std::uint32_t> literals;
+
+    /// Get the size of the group in 64-bit words, literals included.
+    unsigned size() const { return slots.size() + (literals.size() + 1) / 2; }
+
+    /// Assign each instruction of the group to an execution slot.
+    /// An instruction goes to the vector slot of its destination channel
+    /// unless that slot was taken by a previous instruction or the opcode is
+    /// trans-only, in which case it goes to the trans slot.
+    /// It throws std::runtime_error if the group is not valid.
+    /// \param unit Pointer to an array receiving, for each instruction, its
+    /// slot (0 to 3 for x, y, z, w and 4 for t).
+    void assign_slots(unsigned* unit) const;
+};
+
+/// This structure wraps the four double words of an Evergreen fetch
+/// instruction (vertex, texture or memory read).
+struct fetch_instruction {
+    /// Enumeration of the kinds of fetch instructions.
+    typedef enum {
+        VTX_INST_FETCH              = 0x00,
+        VTX_INST_SEMANTIC           = 0x01,
+        VTX_INST_MEM                = 0x02,
+        TEX_INST_LD                 = 0x03,
+        TEX_INST_GET_TEXTURE_RESINFO = 0x04,
+        TEX_INST_SAMPLE             = 0x10
+    } opcode;
+
+    /// Enumeration of the FETCH_TYPE field.
+    typedef enum {
+        VTX_FETCH_VERTEX_DATA       = 0,
+        VTX_FETCH_INSTANCE_DATA     = 1,
+        VTX_FETCH_NO_INDEX_OFFSET   = 2
+    } fetch_type_select;
+
+    /// Enumeration of the destination selects.
+    typedef enum {
+        SEL_X = 0, SEL_Y = 1, SEL_Z = 2, SEL_W = 3,
+        SEL_0 = 4, SEL_1 = 5, SEL_MASK = 7
+    } dst_select;
+
+    /// Enumeration of the data formats with 32-bit components.
+    typedef enum {
+        FMT_32                      = 0x0d,
+        FMT_32_FLOAT                = 0x0e,
+        FMT_32_32                   = 0x1d,
+        FMT_32_32_FLOAT             = 0x1e,
+        FMT_32_32_32_32             = 0x22,
+        FMT_32_32_32_32_FLOAT       = 0x23,
+        FMT_32_32_32                = 0x2f,
+        FMT_32_32_32_FLOAT          = 0x30
+    } data_format_select;
+
+    std::uint32_t words[4];     ///< The raw double words.
+
+    /// This constructor creates a zero-filled instruction.
+    fetch_instruction() { words[0] = words[1] = words[2] = words[3] = 0; }
+    /// This constructor wraps the given double words.
+    explicit fetch_instruction(std::uint32_t const* w)
+        { words[0] = w[0]; words[1] = w[1]; words[2] = w[2]; words[3] = w[3]; }
+
+    /// Get the instruction opcode.
+    unsigned inst() const { return words[0] & 0x1f; }
+    /// Get the mnemonic of the instruction.
+    const char* name() const;
+    /// Determine whether this is a vertex fetch.
+    bool is_vertex() const { return inst() == VTX_INST_FETCH || inst() == VTX_INST_SEMANTIC; }
+
+    /// Get the FETCH_TYPE field of a vertex fetch.
+    unsigned fetch_type() const { return words[0] >> 5 & 3; }
+    /// Get the resource id.
+    unsigned resource_id() const { return words[0] >> 8 & 0xff; }
+    /// Get the source GPR.
+    unsigned src_gpr() const { return words[0] >> 16 & 0x7f; }
+    /// Set the source GPR.
+    void set_src_gpr(unsigned r) { words[0] = (words[0] & ~(0x7fu << 16)) | (r & 0x7f) << 16; }
+    /// Get the relative addressing bit of the source GPR.
+    bool src_rel() const { return (words[0] >> 23 & 1) != 0; }
+    /// Get the source channel of a vertex fetch.
+    unsigned src_sel_x() const { return words[0] >> 24 & 3; }
+    /// Get the MEGA_FETCH_COUNT field of a vertex fetch (bytes minus one).
+    unsigned mega_fetch_count() const { return words[0] >> 26; }
+
+    /// Get the destination GPR.
+    unsigned dst_gpr() const { return words[1] & 0x7f; }
+    /// Set the destination GPR.
+    void set_dst_gpr(unsigned r) { words[1] = (words[1] & ~0x7fu) | (r & 0x7f); }
+    /// Get the relative addressing bit of the destination GPR.
+    bool dst_rel() const { return (words[1] >> 7 & 1) != 0; }
+    /// Get the destination select of the given channel.
+    unsigned dst_sel(unsigned chan) const { return words[1] >> (9 + 3 * chan) & 7; }
+    /// Determine whether the format comes from the resource.
+    bool use_const_fields() const { return (words[1] >> 21 & 1) != 0; }
+    /// Get the data format of a vertex fetch.
+    unsigned data_format() const { return words[1] >> 22 & 0x3f; }
+
+    /// Get the byte offset of a vertex fetch.
+    unsigned offset() const { return words[2] & 0xffff; }
+    /// Get the endian swap of a vertex fetch.
+    unsigned endian_swap() const { return words[2] >> 16 & 3; }
+    /// Get the MEGA_FETCH bit of a vertex fetch.
+    bool mega_fetch() const { return (words[2] >> 19 & 1) != 0; }
+};
@@ -0,0 +1,165 @@
+#include "evergreen_program.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <cerrno>
+
+using namespace std;
+
+unsigned cf_node::clause_size() const
+{
+    if (cf.is_alu()) {
+        unsigned n = 0;
+        for (size_t i = 0; i < alu.size(); ++i)
+            n += alu[i].size();
+        return n;
+    }
+    if (cf.is_fetch())
+        return fetch.size();
+    return 0;
+}
+
+evergreen_program::evergreen_program(uint32_t const* image, size_t size)
+{
+    // The CF program ends where the first clause begins, or at the last
+    // END_OF_PROGRAM or RETURN unless some branch jumps beyond it.
+    size_t words = size / 2;
+    size_t clause_start = words;
+    size_t max_target = 0;
+    bool ended = false;
+
+    for (size_t i = 0; i < clause_start; ++i) {
+        if (ended && i >= max_target)
+            break;
+        cf_instruction cf(image[2 * i], image[2 * i + 1]);
+        if (cf.is_clause())
+            clause_start = min<size_t>(clause_start, cf.addr());
+        if (cf.is_branch())
+            max_target = max<size_t>(max_target, cf.addr() + 1);
+        ended = cf.end_of_program() || cf.inst() == cf_instruction::CF_INST_RETURN;
+        _nodes.push_back(cf_node(cf));
+    }
+
+    for (size_t i = 0; i < _nodes.size(); ++i) {
+        cf_node& node = _nodes[i];
+
+        if (node.cf.is_alu()) {
+            size_t begin = node.cf.addr();
+            size_t end = begin + node.cf.count();
+            if (end > words)
+                throw runtime_error("truncated ALU clause");
+
+            alu_group group;
+            unsigned literals = 0;
+            for (size_t w = begin; w < end; ) {
+                alu_instruction alu(image[2 * w], image[2 * w + 1]);
+                ++w;
+                for (unsigned s = 0, n = alu.num_sources(); s < n; ++s)
+                    if (alu.src[s].sel == alu_instruction::ALU_SRC_LITERAL)
+                        literals = max(literals, alu.src[s].chan + 1);
+                group.slots.push_back(alu);
+                if (!alu.last) {
+                    if (group.slots.size() == 5)
+                        throw runtime_error("ALU group without LAST");
+                    continue;
+                }
+
+                // Literals are padded to a 64-bit boundary.
+                if (literals != 0) {
+                    if (w + (literals + 1) / 2 > end)
+                        throw runtime_error("truncated ALU literals");
+                    group.literals.assign(&image[2 * w], &image[2 * w] + literals);
+                    w += (literals + 1) / 2;
+                }
+                node.alu.push_back(group);
+                group = alu_group();
+                literals = 0;
+            }
+            if (!group.slots.empty())
+                throw runtime_error("unterminated ALU group");
+        }
+        else if (node.cf.is_fetch()) {
+            size_t begin = node.cf.addr();
+            size_t end = begin + 2 * node.cf.count();
+            if (end > words)
+                throw runtime_error("truncated fetch clause");
+            for (size_t w = begin; w < end; w += 2)
+                node.fetch.push_back(fetch_instruction(&image[2 * w]));
+        }
+    }
+}
+
+evergreen_program evergreen_program::read(const char* path)
+{
+    ifstream file(path, ios::in | ios::binary);
+    if (!file)
+        throw system_error(error_code(errno, system_category()), path);
+
+    vector<char> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    if (file.bad())
+        throw system_error(error_code(errno, system_category()), path);
+
+    vector<uint32_t> image((bytes.size() + 3) / 4);
+    if (!bytes.empty())
+        copy(bytes.begin(), bytes.end(), reinterpret_cast<char*>(&image.front()));
+    return evergreen_program(image.empty() ? 0 : &image.front(), image.size());
+}
+
+void evergreen_program::write(const char* path) const
+{
+    vector<uint32_t> image = encode();
+
+    ofstream file(path, ios::out | ios::binary | ios::trunc);
+    if (!file)
+        throw system_error(error_code(errno, system_category()), path);
+    file.write(reinterpret_cast<const char*>(image.data()), image.size() * sizeof(uint32_t));
+    file.close();
+    if (!file)
+        throw system_error(error_code(errno, system_category()), path);
+}
+
+vector<uint32_t> evergreen_program::encode() const
+{
+    vector<uint32_t> image(2 * _nodes.size());
+
+    for (size_t i = 0; i < _nodes.size(); ++i) {
+        cf_node const& node = _nodes[i];
+        cf_instruction cf = node.cf;
+
+        if (cf.is_alu()) {
+            cf.set_addr(image.size() / 2);
+            cf.set_count(node.clause_size());
+            for (size_t g = 0; g < node.alu.size(); ++g) {
+                alu_group const& group = node.alu[g];
+                for (size_t s = 0; s < group.slots.size(); ++s) {
+                    alu_instruction alu = group.slots[s];
+                    alu.last = s + 1 == group.slots.size();
+                    uint32_t words[2];
+                    alu.encode(words);
+                    image.push_back(words[0]);
+                    image.push_back(words[1]);
+                }
+                image.insert(image.end(), group.literals.begin(), group.literals.end());
+                if (group.literals.size() % 2 != 0)
+                    image.push_back(0);
+            }
+        }
+        else if (cf.is_fetch()) {
+            // Fetch clauses are aligned to 128 bits.
+            if (image.size() % 4 != 0)
+                image.resize(image.size() + 2);
+            cf.set_addr(image.size() / 2);
+            cf.set_count(node.clause_size());
+            for (size_t f = 0; f < node.fetch.size(); ++f)
+                image.insert(image.end(), node.fetch[f].words, node.fetch[f].words + 4);
+        }
+
+        image[2 * i] = cf.word0;
+        image[2 * i + 1] = cf.word1;
+    }
+
+    return image;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "evergreen_instruction.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/// This structure holds a control flow instruction together with the clause
+/// it executes, if any.
+struct cf_node {
+    cf_instruction cf;                      ///< The CF instruction.
+    std::vector<alu_group> alu;             ///< The ALU clause of ALU* instructions.
+    std::vector<fetch_instruction> fetch;   ///< The fetch clause of TC and VC instructions.
+
+    cf_node() {}
+    explicit cf_node(cf_instruction const& cf) : cf(cf) {}
+
+    /// Get the size of the clause in the units of the COUNT field.
+    unsigned clause_size() const;
+};
+
+/// This class holds a decoded Evergreen program (the image produced by the
+/// assembler and loaded into a shader buffer object).
+///
+/// The image begins with the CF program, one 64-bit word per instruction, and
+/// the clauses follow. ADDR fields of clause instructions are in 64-bit words
+/// from the start of the image, ADDR fields of branches are CF indices.
+/// Decoding resolves the clauses into the nodes, and encoding lays them out
+/// again after the CF program, so passes can freely change clauses.
+class evergreen_program {
+public:
+    /// This constructor creates an empty program.
+    evergreen_program() {}
+    /// This constructor decodes a program image.
+    /// It throws std::runtime_error if the image is malformed.
+    /// \param image The image as an array of double words.
+    /// \param size The size of the image in double words.
+    evergreen_program(std::uint32_t const* image, std::size_t size);
+
+    /// Read and decode a program image from a file.
+    /// It may throw a std::system_error exception if the file cannot be read.
+    /// \param path Pathname to the image.
+    static evergreen_program read(const char* path);
+    /// Encode and write the program image to a file.
+    /// It may throw a std::system_error exception if the file cannot be written.
+    /// \param path Pathname to the image.
+    void write(const char* path) const;
+
+    /// Encode the program into an image.
+    std::vector<std::uint32_t> encode() const;
+
+    /// Access the CF nodes.
+    std::vector<cf_node>& nodes() { return _nodes; }
+    /// Access the CF nodes.
+    std::vector<cf_node> const& nodes() const { return _nodes; }
+
+    /// Get the number of CF instructions.
+    std::size_t size() const { return _nodes.size(); }
+    /// Access a CF node by index.
+    cf_node& operator[](std::size_t i) { return _nodes[i]; }
+    /// Access a CF node by index.
+    cf_node const& operator[](std::size_t i) const { return _nodes[i]; }
+
+private:
+    std::vector<cf_node> _nodes;
+};
@@ -0,0 +1,81 @@
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include "evergreen_program.hpp"
+#include "branch_flattener.hpp"
+#include "kernel_analysis.hpp"
+#include "kernel_metadata.hpp"
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2 && argc != 3)
+    {
+        std::cerr
+            << "Usage " << argv[0]
+            << " kernel.bin [flattened.bin]"
+            << std::endl;
+        return 1;
+    }
+
+    try {
+        evergreen_program program = evergreen_program::read(argv[1]);
+
+        // Start from the metadata of the kernel if there is any.
+        kernel_metadata meta;
+        kernel_analysis before(program);
+        std::string meta_path = kernel_metadata::path(argv[1]);
+        if (std::ifstream(meta_path.c_str()))
+            meta = kernel_metadata::read(meta_path.c_str());
+        else {
+            meta.num_gprs = before.num_gprs;
+            meta.temp_gprs = before.temp_gprs;
+            meta.stack_size = before.stack_entries;
+        }
+
+        branch_flattener flattener;
+        bool changed = flattener.flatten(program);
+        unsigned flattened = 0;
+        for (std::size_t i = 0; i < flattener.regions().size(); ++i) {
+            branch_region const& r = flattener.regions()[i];
+            std::cout
+                << "CF " << r.cf << ": " << r.cf_count << " CF instructions"
+                << " then " << r.then_groups << " groups"
+                << " else " << r.else_groups << " groups"
+                << " cost " << r.branch_cost << " -> " << r.flat_cost
+                << (r.flattened ? " flattened" : " kept")
+                << std::endl;
+            flattened += r.flattened;
+        }
+
+        kernel_analysis after(program);
+        std::cout
+            << "Flattened " << flattened << " of " << flattener.regions().size() << " regions"
+            << " CF instructions " << before.cf_instructions << " -> " << after.cf_instructions
+            << " stack entries " << before.stack_entries << " -> " << after.stack_entries
+            << (changed ? "" : " (unchanged)")
+            << std::endl;
+
+        if (argc == 3) {
+            if (after.stack_entries < meta.stack_size)
+                meta.stack_size = after.stack_entries;
+            program.write(argv[2]);
+            meta.write(kernel_metadata::path(argv[2]).c_str());
+        }
+        return 0;
+    }
+    catch (std::system_error& e) {
+        std::cerr
+            << e.what()
+            << " : "
+            << e.code().message()
+            << std::endl;
+        return 1;
+    }
+    catch (std::runtime_error& e) {
+        std::cerr << argv[1] << " : " << e.what() << std::endl;
+        return 1;
+    }
+}
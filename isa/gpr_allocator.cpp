@@ -0,0 +1,713 @@
+#include "gpr_allocator.hpp"
+#include "control_flow.hpp"
+#include "gpr_liveness.hpp"
+#include "kernel_analysis.hpp"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+typedef alu_instruction alu;
+
+const unsigned num_gprs_total = 128;
+const unsigned max_temp_gprs = 4;
+const unsigned none = ~0u;
+
+/// Kinds of register operands.
+enum operand_kind { ALU_SRC, ALU_DST, FETCH_SRC, FETCH_DST, EXPORT_RW, EXPORT_INDEX };
+
+/// This structure locates a register operand in the program. Fetch and
+/// export operands access up to four channels of the GPR.
+struct operand {
+    operand_kind kind;
+    unsigned node;      ///< CF index.
+    unsigned index;     ///< Group or fetch index.
+    unsigned slot;      ///< Instruction in the group.
+    unsigned src;       ///< Source number.
+};
+
+/// This structure describes the access of one GPR channel by an operand.
+struct access {
+    unsigned channel;   ///< 4 * gpr + chan.
+    unsigned op;        ///< Index of the operand.
+    unsigned def;       ///< Definition number (definitions only).
+    bool kill;          ///< Overwrites the channel in every thread (definitions only).
+};
+
+/// This structure holds the accesses of an ALU group, a fetch or an export.
+/// Uses come before definitions.
+struct site {
+    unsigned node;
+    unsigned group;     ///< Group index for ALU groups, none otherwise.
+    vector<access> uses;
+    vector<access> defs;
+};
+
+/// This structure describes a definition.
+struct definition {
+    unsigned channel;
+    unsigned site;      ///< Site index, none for the values live at the start.
+};
+
+typedef map<unsigned, set<unsigned> > reaching;
+
+/// This structure describes a group of webs which share a GPR.
+struct group_info {
+    unsigned first;     ///< First site.
+    unsigned node;      ///< CF node, none if several.
+    unsigned fixed;     ///< Original GPR if fixed, none otherwise.
+    bool local;
+};
+
+struct union_find {
+    vector<unsigned> parent;
+
+    unsigned add() { parent.push_back(parent.size()); return parent.size() - 1; }
+    unsigned find(unsigned i)
+    {
+        while (parent[i] != i)
+            i = parent[i] = parent[parent[i]];
+        return i;
+    }
+    void unite(unsigned a, unsigned b) { parent[find(a)] = find(b); }
+};
+
+/// This class holds the state of one allocation.
+class allocation {
+public:
+    allocation(evergreen_program& program) : _program(program), _cfg(program), _temp_gprs(), _forwarded() {}
+
+    bool run();
+
+    unsigned num_gprs() const { return _num_gprs; }
+    unsigned temp_gprs() const { return _temp_gprs; }
+    unsigned forwarded() const { return _forwarded; }
+
+private:
+    void find_reserved();
+    void find_masked(vector<bool>& masked);
+    void build_sites();
+    void compute_liveness();
+    void compute_reaching();
+    void build_webs();
+    void forward();
+    bool colour();
+    bool is_free(unsigned group, unsigned gpr) const;
+    void rewrite();
+
+    unsigned add_operand(operand_kind kind, unsigned node, unsigned index, unsigned slot = 0, unsigned src = 0);
+    unsigned entry_def(unsigned channel);
+    void transfer(site const& s, reaching& state) const;
+
+    evergreen_program& _program;
+    control_flow_graph _cfg;
+
+    vector<bool> _reserved;         ///< GPRs which keep their numbers and are not allocated.
+    vector<operand> _operands;
+    vector<site> _sites;
+    vector<vector<unsigned> > _node_sites;
+    vector<definition> _defs;
+    map<unsigned, unsigned> _entry_defs;
+
+    vector<gpr_set> _live_in;       ///< Live channels before each node.
+    vector<gpr_set> _live_out;      ///< Live channels after each node.
+    vector<gpr_set> _live_after;    ///< Live channels after each site.
+    vector<reaching> _reach_in;     ///< Definitions reaching each node.
+
+    union_find _webs;               ///< Definitions of the same web.
+    vector<unsigned> _op_def;       ///< A definition of the web of each operand.
+    vector<vector<unsigned> > _op_defs; ///< Definitions reaching or made by each operand.
+    vector<bool> _crossing;         ///< Definitions live across CF instructions.
+    set<pair<unsigned, unsigned> > _interference;   ///< Pairs of interfering definitions.
+
+    map<unsigned, set<unsigned> > _neighbours;  ///< Interference graph of the groups.
+    map<unsigned, unsigned> _colour;    ///< GPR of each group (root definition).
+    unsigned _num_gprs;
+    unsigned _temp_gprs;
+    unsigned _forwarded;
+};
+
+unsigned allocation::add_operand(operand_kind kind, unsigned node, unsigned index, unsigned slot, unsigned src)
+{
+    operand op = { kind, node, index, slot, src };
+    _operands.push_back(op);
+    return _operands.size() - 1;
+}
+
+unsigned allocation::entry_def(unsigned channel)
+{
+    map<unsigned, unsigned>::iterator i = _entry_defs.find(channel);
+    if (i != _entry_defs.end())
+        return i->second;
+    definition d = { channel, none };
+    _defs.push_back(d);
+    _webs.add();
+    _crossing.push_back(true);
+    _entry_defs[channel] = _defs.size() - 1;
+    return _defs.size() - 1;
+}
+
+void allocation::find_reserved()
+{
+    // Relative addressing may reach any GPR from the lowest base up, and
+    // export bursts need consecutive GPRs.
+    _reserved.assign(num_gprs_total, false);
+    unsigned rel_base = num_gprs_total;
+
+    for (size_t i = 0; i < _program.size(); ++i) {
+        cf_node const& node = _program[i];
+        for (size_t g = 0; g < node.alu.size(); ++g)
+            for (size_t k = 0; k < node.alu[g].slots.size(); ++k) {
+                alu const& inst = node.alu[g].slots[k];
+                for (unsigned s = 0, n = inst.num_sources(); s < n; ++s)
+                    if (alu::is_gpr(inst.src[s].sel) && inst.src[s].rel)
+                        rel_base = min(rel_base, inst.src[s].sel);
+                if (inst.writes_gpr() && inst.dst_rel)
+                    rel_base = min(rel_base, inst.dst_gpr);
+            }
+        for (size_t f = 0; f < node.fetch.size(); ++f) {
+            if (node.fetch[f].src_rel())
+                rel_base = min(rel_base, node.fetch[f].src_gpr());
+            if (node.fetch[f].dst_rel())
+                rel_base = min(rel_base, node.fetch[f].dst_gpr());
+        }
+        if (node.cf.is_export()) {
+            if (node.cf.rw_rel())
+                rel_base = min(rel_base, node.cf.rw_gpr());
+            if (node.cf.burst_count() != 0)
+                for (unsigned r = 0; r <= node.cf.burst_count(); ++r)
+                    _reserved[min(node.cf.rw_gpr() + r, num_gprs_total - 1)] = true;
+        }
+    }
+    for (unsigned r = rel_base; r < num_gprs_total; ++r)
+        _reserved[r] = true;
+}
+
+void allocation::find_masked(vector<bool>& masked)
+{
+    // Writes which may execute with some threads inactive do not kill the
+    // previous value. That is the case inside loops and conditionals, and
+    // everywhere if there are subroutines.
+    bool calls = false;
+    for (size_t i = 0; i < _program.size(); ++i)
+        if (_program[i].cf.inst() == cf_instruction::CF_INST_CALL ||
+            _program[i].cf.inst() == cf_instruction::CF_INST_CALL_FS)
+            calls = true;
+
+    unsigned depth = 0;
+    masked.resize(_program.size());
+    for (size_t i = 0; i < _program.size(); ++i) {
+        cf_instruction const& cf = _program[i].cf;
+        masked[i] = calls || depth != 0;
+        switch (cf.inst()) {
+        case cf_instruction::CF_INST_LOOP_START:
+        case cf_instruction::CF_INST_LOOP_START_DX10:
+        case cf_instruction::CF_INST_LOOP_START_NO_AL:
+        case cf_instruction::CF_INST_PUSH:
+        case cf_instruction::CF_INST_ALU_PUSH_BEFORE:
+            ++depth;
+            break;
+        case cf_instruction::CF_INST_LOOP_END:
+        case cf_instruction::CF_INST_ALU_POP_AFTER:
+            depth -= min(depth, 1u);
+            break;
+        case cf_instruction::CF_INST_ALU_POP2_AFTER:
+            depth -= min(depth, 2u);
+            break;
+        default:
+            depth -= min(depth, cf.pop_count());
+            break;
+        }
+    }
+}
+
+void allocation::build_sites()
+{
+    vector<bool> masked;
+    find_masked(masked);
+    _node_sites.resize(_program.size());
+
+    for (unsigned i = 0; i < _program.size(); ++i) {
+        cf_node const& node = _program[i];
+        bool partial = masked[i];
+
+        for (unsigned g = 0; g < node.alu.size(); ++g) {
+            site s = { i, g, vector<access>(), vector<access>() };
+            bool mask_update = false;
+            for (unsigned k = 0; k < node.alu[g].slots.size(); ++k) {
+                alu const& inst = node.alu[g].slots[k];
+                for (unsigned o = 0, n = inst.num_sources(); o < n; ++o) {
+                    alu_source const& src = inst.src[o];
+                    if (!alu::is_gpr(src.sel) || src.rel || _reserved[src.sel])
+                        continue;
+                    access a = { 4 * src.sel + src.chan, add_operand(ALU_SRC, i, g, k, o), none, false };
+                    s.uses.push_back(a);
+                }
+                if (inst.writes_gpr() && !inst.dst_rel && !_reserved[inst.dst_gpr]) {
+                    access a = { 4 * inst.dst_gpr + inst.dst_chan, add_operand(ALU_DST, i, g, k), none,
+                                 !partial && inst.pred_sel == alu::PRED_SEL_OFF };
+                    s.defs.push_back(a);
+                }
+                mask_update = mask_update || inst.update_exec_mask;
+            }
+            // The rest of the clause runs with the new execute mask.
+            partial = partial || mask_update;
+            _node_sites[i].push_back(_sites.size());
+            _sites.push_back(s);
+        }
+
+        for (unsigned f = 0; f < node.fetch.size(); ++f) {
+            fetch_instruction const& fetch = node.fetch[f];
+            site s = { i, none, vector<access>(), vector<access>() };
+            if (!fetch.src_rel() && !_reserved[fetch.src_gpr()]) {
+                unsigned op = add_operand(FETCH_SRC, i, f);
+                for (unsigned c = 0; c < 4; ++c)
+                    if (fetch.is_vertex() ? c == fetch.src_sel_x() : true) {
+                        access a = { 4 * fetch.src_gpr() + c, op, none, false };
+                        s.uses.push_back(a);
+                    }
+            }
+            if (!fetch.dst_rel() && !_reserved[fetch.dst_gpr()]) {
+                unsigned op = add_operand(FETCH_DST, i, f);
+                for (unsigned c = 0; c < 4; ++c)
+                    if (fetch.dst_sel(c) != fetch_instruction::SEL_MASK) {
+                        access a = { 4 * fetch.dst_gpr() + c, op, none, !partial };
+                        s.defs.push_back(a);
+                    }
+            }
+            _node_sites[i].push_back(_sites.size());
+            _sites.push_back(s);
+        }
+
+        if (node.cf.is_export()) {
+            cf_instruction const& cf = node.cf;
+            site s = { i, none, vector<access>(), vector<access>() };
+            if (!cf.rw_rel() && !_reserved[cf.rw_gpr()]) {
+                unsigned op = add_operand(EXPORT_RW, i, 0);
+                bool pixel = cf.inst() == cf_instruction::CF_INST_EXPORT ||
+                    cf.inst() == cf_instruction::CF_INST_EXPORT_DONE;
+                for (unsigned c = 0; c < 4; ++c) {
+                    unsigned chan = pixel ? cf.word1 >> (3 * c) & 7 : c;
+                    if (pixel ? chan < 4 : (cf.comp_mask() >> c & 1) != 0) {
+                        access a = { 4 * cf.rw_gpr() + chan, op, none, false };
+                        s.uses.push_back(a);
+                    }
+                }
+            }
+            // Typed RAT stores take x, y and z coordinates, the others a
+            // linear index.
+            if ((cf.type() & 1) != 0 && !_reserved[cf.index_gpr()]) {
+                bool typed = cf.inst() >= cf_instruction::CF_INST_MEM_RAT &&
+                    cf.inst() <= cf_instruction::CF_INST_MEM_RAT_CACHELESS && cf.rat_inst() == 1;
+                unsigned op = add_operand(EXPORT_INDEX, i, 0);
+                for (unsigned c = 0; c < (typed ? 3u : 1u); ++c) {
+                    access a = { 4 * cf.index_gpr() + c, op, none, false };
+                    s.uses.push_back(a);
+                }
+            }
+            _node_sites[i].push_back(_sites.size());
+            _sites.push_back(s);
+        }
+    }
+
+    // Number the definitions.
+    for (unsigned s = 0; s < _sites.size(); ++s)
+        for (size_t d = 0; d < _sites[s].defs.size(); ++d) {
+            definition def = { _sites[s].defs[d].channel, s };
+            _sites[s].defs[d].def = _defs.size();
+            _defs.push_back(def);
+            _webs.add();
+            _crossing.push_back(false);
+        }
+}
+
+void allocation::compute_liveness()
+{
+    unsigned n = _program.size();
+    _live_in.assign(n, gpr_set());
+    _live_out.assign(n, gpr_set());
+    _live_after.assign(_sites.size(), gpr_set());
+
+    vector<unsigned> order = _cfg.reverse_post_order();
+    reverse(order.begin(), order.end());
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (size_t k = 0; k < order.size(); ++k) {
+            unsigned i = order[k];
+            gpr_set live;
+            for (size_t s = 0; s < _cfg.successors(i).size(); ++s)
+                live |= _live_in[_cfg.successors(i)[s]];
+            _live_out[i] = live;
+            for (size_t j = _node_sites[i].size(); j-- > 0; ) {
+                site const& s = _sites[_node_sites[i][j]];
+                _live_after[_node_sites[i][j]] = live;
+                for (size_t d = 0; d < s.defs.size(); ++d)
+                    if (s.defs[d].kill)
+                        live.reset(s.defs[d].channel);
+                for (size_t u = 0; u < s.uses.size(); ++u)
+                    live.set(s.uses[u].channel);
+            }
+            if (live != _live_in[i]) {
+                _live_in[i] = live;
+                changed = true;
+            }
+        }
+    }
+}
+
+void allocation::transfer(site const& s, reaching& state) const
+{
+    for (size_t d = 0; d < s.defs.size(); ++d) {
+        set<unsigned>& r = state[s.defs[d].channel];
+        if (s.defs[d].kill)
+            r.clear();
+        r.insert(s.defs[d].def);
+    }
+}
+
+void allocation::compute_reaching()
+{
+    unsigned n = _program.size();
+    _reach_in.assign(n, reaching());
+    if (n == 0)
+        return;
+
+    // The values live at the start are defined by the hardware.
+    for (unsigned c = 0; c < 4 * num_gprs_total; ++c)
+        if (_live_in[0][c])
+            _reach_in[0][c].insert(entry_def(c));
+    reaching start = _reach_in[0];
+
+    vector<unsigned> order = _cfg.reverse_post_order();
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (size_t k = 0; k < order.size(); ++k) {
+            unsigned i = order[k];
+            reaching in = i == 0 ? start : reaching();
+            for (size_t p = 0; p < _cfg.predecessors(i).size(); ++p) {
+                reaching out = _reach_in[_cfg.predecessors(i)[p]];
+                for (size_t j = 0; j < _node_sites[_cfg.predecessors(i)[p]].size(); ++j)
+                    transfer(_sites[_node_sites[_cfg.predecessors(i)[p]][j]], out);
+                for (reaching::iterator r = out.begin(); r != out.end(); ++r)
+                    in[r->first].insert(r->second.begin(), r->second.end());
+            }
+            if (in != _reach_in[i]) {
+                _reach_in[i] = in;
+                changed = true;
+            }
+        }
+    }
+}
+
+void allocation::build_webs()
+{
+    _op_def.assign(_operands.size(), none);
+    _op_defs.assign(_operands.size(), vector<unsigned>());
+
+    for (unsigned i = 0; i < _program.size(); ++i) {
+        reaching state = _reach_in[i];
+        for (size_t j = 0; j < _node_sites[i].size(); ++j) {
+            unsigned si = _node_sites[i][j];
+            site const& s = _sites[si];
+
+            // Every definition reaching a use belongs to the same web. The
+            // value crosses CF instructions if it comes from another node
+            // or from a later site (around a loop).
+            for (size_t u = 0; u < s.uses.size(); ++u) {
+                access const& a = s.uses[u];
+                set<unsigned>& r = state[a.channel];
+                if (r.empty())
+                    r.insert(entry_def(a.channel));
+                for (set<unsigned>::iterator d = r.begin(); d != r.end(); ++d) {
+                    _webs.unite(*d, *r.begin());
+                    unsigned ds = _defs[*d].site;
+                    if (ds == none || _sites[ds].node != i || ds >= si)
+                        _crossing[*d] = true;
+                    _op_defs[a.op].push_back(*d);
+                }
+                _op_def[a.op] = *r.begin();
+            }
+
+            transfer(s, state);
+            for (size_t d = 0; d < s.defs.size(); ++d) {
+                access const& a = s.defs[d];
+                _op_def[a.op] = a.def;
+                _op_defs[a.op].push_back(a.def);
+            }
+
+            // A definition interferes with every other value of the same
+            // channel live after it, and with the other definitions of the
+            // same channel in the group.
+            for (size_t d = 0; d < s.defs.size(); ++d) {
+                unsigned chan = s.defs[d].channel % 4;
+                for (unsigned c = chan; c < 4 * num_gprs_total; c += 4) {
+                    if (c == s.defs[d].channel || !_live_after[si][c])
+                        continue;
+                    set<unsigned>& r = state[c];
+                    if (r.empty())
+                        r.insert(entry_def(c));
+                    _interference.insert(make_pair(s.defs[d].def, *r.begin()));
+                }
+                for (size_t e = 0; e < s.defs.size(); ++e)
+                    if (s.defs[e].channel != s.defs[d].channel && s.defs[e].channel % 4 == chan)
+                        _interference.insert(make_pair(s.defs[d].def, s.defs[e].def));
+            }
+        }
+
+        for (unsigned c = 0; c < 4 * num_gprs_total; ++c)
+            if (_live_out[i][c])
+                for (set<unsigned>::iterator d = state[c].begin(); d != state[c].end(); ++d)
+                    _crossing[*d] = true;
+    }
+}
+
+void allocation::forward()
+{
+    // Gather the definitions and uses of each web.
+    map<unsigned, vector<unsigned> > defs, uses;
+    for (unsigned op = 0; op < _operands.size(); ++op) {
+        if (_op_def[op] == none)
+            continue;
+        unsigned w = _webs.find(_op_def[op]);
+        bool def = _operands[op].kind == ALU_DST || _operands[op].kind == FETCH_DST;
+        (def ? defs : uses)[w].push_back(op);
+    }
+    set<unsigned> fixed_or_crossing;
+    for (unsigned d = 0; d < _defs.size(); ++d)
+        if (_crossing[d] || _defs[d].site == none)
+            fixed_or_crossing.insert(_webs.find(d));
+
+    for (map<unsigned, vector<unsigned> >::iterator w = defs.begin(); w != defs.end(); ++w) {
+        if (w->second.size() != 1 || fixed_or_crossing.count(w->first) || uses[w->first].empty())
+            continue;
+        operand const& def = _operands[w->second[0]];
+        if (def.kind != ALU_DST)
+            continue;
+        alu_group& group = _program[def.node].alu[def.index];
+        alu& producer = group.slots[def.slot];
+        if (producer.is_op3() || producer.pred_sel != alu::PRED_SEL_OFF ||
+            (producer.flags() & (alu::REDUCTION | alu::DOUBLE | alu::ORDERED | alu::LDS)) != 0)
+            continue;
+
+        // Every use must be in the next group of the clause.
+        vector<unsigned> const& u = uses[w->first];
+        bool next = true;
+        for (size_t k = 0; k < u.size() && next; ++k) {
+            operand const& use = _operands[u[k]];
+            next = use.kind == ALU_SRC && use.node == def.node && use.index == def.index + 1;
+        }
+        if (!next)
+            continue;
+
+        unsigned unit[5];
+        group.assign_slots(unit);
+        for (size_t k = 0; k < u.size(); ++k) {
+            operand const& use = _operands[u[k]];
+            alu_source& src = _program[use.node].alu[use.index].slots[use.slot].src[use.src];
+            src.sel = unit[def.slot] == 4 ? alu::ALU_SRC_PS : alu::ALU_SRC_PV;
+            src.chan = unit[def.slot] == 4 ? 0 : unit[def.slot];
+            _op_def[u[k]] = none;
+        }
+        producer.write_mask = false;
+        _op_def[w->second[0]] = none;
+        ++_forwarded;
+    }
+}
+
+bool allocation::colour()
+{
+    // Webs accessed by the same fetch or export operand share a GPR, they
+    // make up a group. Groups are the nodes of the interference graph.
+    union_find groups = _webs;
+    for (unsigned op = 0; op < _operands.size(); ++op) {
+        if (_op_def[op] == none)
+            continue;
+        for (size_t d = 0; d < _op_defs[op].size(); ++d)
+            groups.unite(_op_defs[op][d], _op_def[op]);
+    }
+
+    for (set<pair<unsigned, unsigned> >::iterator e = _interference.begin(); e != _interference.end(); ++e) {
+        unsigned a = groups.find(e->first), b = groups.find(e->second);
+        if (a == b)
+            return false;
+        _neighbours[a].insert(b);
+        _neighbours[b].insert(a);
+    }
+
+    // Describe the groups which are still referenced.
+    map<unsigned, group_info> info;
+    for (unsigned op = 0; op < _operands.size(); ++op) {
+        if (_op_def[op] == none)
+            continue;
+        unsigned g = groups.find(_op_def[op]);
+        operand const& o = _operands[op];
+        if (!info.count(g)) {
+            group_info i = { none, o.node, none, true };
+            info[g] = i;
+        }
+        group_info& i = info[g];
+        if (i.node != o.node)
+            i.node = none;
+        i.local = i.local && i.node != none && _program[o.node].cf.is_alu();
+        for (size_t d = 0; d < _op_defs[op].size(); ++d) {
+            definition const& def = _defs[_op_defs[op][d]];
+            if (def.site == none)
+                i.fixed = def.channel / 4;
+            else
+                i.first = min(i.first, def.site);
+            if (_crossing[_op_defs[op][d]])
+                i.local = false;
+        }
+    }
+
+    bool temps = true;
+    for (map<unsigned, group_info>::iterator g = info.begin(); g != info.end(); ++g)
+        if (g->second.fixed != none) {
+            _colour[g->first] = g->second.fixed;
+            temps = temps && g->second.fixed < num_gprs_total - max_temp_gprs;
+        }
+    for (unsigned r = num_gprs_total - max_temp_gprs; r < num_gprs_total; ++r)
+        temps = temps && !_reserved[r];
+
+    // Clause-local groups go to the clause temporaries, from the top.
+    vector<pair<unsigned, unsigned> > order;
+    for (map<unsigned, group_info>::iterator g = info.begin(); g != info.end(); ++g)
+        if (g->second.fixed == none)
+            order.push_back(make_pair(g->second.first, g->first));
+    sort(order.begin(), order.end());
+
+    unsigned lowest_temp = num_gprs_total;
+    if (temps)
+        for (size_t k = 0; k < order.size(); ++k) {
+            unsigned g = order[k].second;
+            if (!info[g].local)
+                continue;
+            for (unsigned r = num_gprs_total; r-- > num_gprs_total - max_temp_gprs; )
+                if (is_free(g, r)) {
+                    _colour[g] = r;
+                    lowest_temp = min(lowest_temp, r);
+                    break;
+                }
+        }
+    _temp_gprs = num_gprs_total - lowest_temp;
+
+    // Reserved GPRs count if the program uses them.
+    unsigned limit = gpr_liveness::gpr_limit(_program);
+    _num_gprs = 0;
+    for (unsigned r = 0; r < limit; ++r)
+        if (_reserved[r] && r < lowest_temp)
+            _num_gprs = r + 1;
+    for (map<unsigned, unsigned>::iterator c = _colour.begin(); c != _colour.end(); ++c)
+        if (c->second < lowest_temp)
+            _num_gprs = max(_num_gprs, c->second + 1);
+
+    for (size_t k = 0; k < order.size(); ++k) {
+        unsigned g = order[k].second;
+        if (_colour.count(g))
+            continue;
+        unsigned r = 0;
+        while (r < lowest_temp && (_reserved[r] || !is_free(g, r)))
+            ++r;
+        if (r == lowest_temp)
+            return false;
+        _colour[g] = r;
+        _num_gprs = max(_num_gprs, r + 1);
+    }
+
+    // Map the operands to their groups.
+    for (unsigned op = 0; op < _operands.size(); ++op)
+        if (_op_def[op] != none)
+            _op_def[op] = groups.find(_op_def[op]);
+    return true;
+}
+
+bool allocation::is_free(unsigned group, unsigned gpr) const
+{
+    map<unsigned, set<unsigned> >::const_iterator n = _neighbours.find(group);
+    if (n == _neighbours.end())
+        return true;
+    for (set<unsigned>::const_iterator k = n->second.begin(); k != n->second.end(); ++k) {
+        map<unsigned, unsigned>::const_iterator c = _colour.find(*k);
+        if (c != _colour.end() && c->second == gpr)
+            return false;
+    }
+    return true;
+}
+
+void allocation::rewrite()
+{
+    for (unsigned op = 0; op < _operands.size(); ++op) {
+        if (_op_def[op] == none)
+            continue;
+        unsigned r = _colour[_op_def[op]];
+        operand const& o = _operands[op];
+        cf_node& node = _program[o.node];
+        switch (o.kind) {
+        case ALU_SRC:
+            node.alu[o.index].slots[o.slot].src[o.src].sel = r;
+            break;
+        case ALU_DST:
+            node.alu[o.index].slots[o.slot].dst_gpr = r;
+            break;
+        case FETCH_SRC:
+            node.fetch[o.index].set_src_gpr(r);
+            break;
+        case FETCH_DST:
+            node.fetch[o.index].set_dst_gpr(r);
+            break;
+        case EXPORT_RW:
+            node.cf.set_rw_gpr(r);
+            break;
+        case EXPORT_INDEX:
+            node.cf.set_index_gpr(r);
+            break;
+        }
+    }
+}
+
+bool allocation::run()
+{
+    find_reserved();
+    build_sites();
+    compute_liveness();
+    compute_reaching();
+    build_webs();
+    forward();
+    if (!colour())
+        return false;
+    rewrite();
+    return true;
+}
+
+}
+
+bool gpr_allocator::allocate(evergreen_program& program)
+{
+    kernel_analysis before(program);
+    _num_gprs = before.num_gprs;
+    _temp_gprs = before.temp_gprs;
+    _forwarded = 0;
+
+    evergreen_program result = program;
+    allocation a(result);
+    if (!a.run())
+        return false;
+
+    // Keep the allocation if it needs fewer GPRs per thread, or as many
+    // with some values forwarded instead of written.
+    bool better = a.num_gprs() < before.num_gprs ||
+        (a.num_gprs() == before.num_gprs && a.temp_gprs() <= before.temp_gprs && a.forwarded() != 0);
+    if (!better)
+        return false;
+
+    program = result;
+    _num_gprs = a.num_gprs();
+    _temp_gprs = a.temp_gprs();
+    _forwarded = a.forwarded();
+    return true;
+}
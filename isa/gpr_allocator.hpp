@@ -0,0 +1,42 @@
+#pragma once
+
+#include "evergreen_program.hpp"
+
+/// This class renumbers the GPRs of a program so that it needs as few of
+/// them as possible, which raises the number of wavefronts a SIMD can hold.
+///
+/// Every GPR channel is split into webs (sets of definitions and the uses
+/// they reach) which are allocated independently by colouring their
+/// interference graph. Channels are never changed, since the destination
+/// channel selects the ALU slot; instead a GPR may hold the x channel of one
+/// value and the y channel of another. Fetches and exports access four
+/// channels of one GPR, so the webs they touch are kept together.
+///
+/// Before colouring, values which are only read by the next instruction
+/// group are forwarded through PV or PS and no longer written. Values which
+/// live within one ALU clause go to the clause temporaries (the top GPRs),
+/// which do not count against the GPRs of each thread.
+///
+/// Values live at the start (the thread and group ids), GPRs accessed with
+/// relative addressing and bursts of exports keep their numbers.
+class gpr_allocator {
+public:
+    gpr_allocator() : _num_gprs(), _temp_gprs(), _forwarded() {}
+
+    /// Allocate the GPRs of a program in place. The program is left as it
+    /// was if the allocation does not need fewer GPRs.
+    /// \returns Whether the program has changed.
+    bool allocate(evergreen_program& program);
+
+    /// Get the number of GPRs per thread of the program.
+    unsigned num_gprs() const { return _num_gprs; }
+    /// Get the number of clause temporary GPRs of the program.
+    unsigned temp_gprs() const { return _temp_gprs; }
+    /// Get the number of values forwarded through PV or PS.
+    unsigned forwarded() const { return _forwarded; }
+
+private:
+    unsigned _num_gprs;
+    unsigned _temp_gprs;
+    unsigned _forwarded;
+};
@@ -0,0 +1,171 @@
+#include "gpr_liveness.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+const unsigned num_gprs = 128;
+
+void add(gpr_set& set, unsigned gpr, unsigned chan, bool rel, unsigned limit)
+{
+    unsigned end = rel ? max(limit, gpr + 1) : gpr + 1;
+    for (unsigned r = gpr; r < end && r < num_gprs; ++r)
+        set.set(4 * r + chan);
+}
+
+/// Get the channels of the index GPR read by a memory export.
+unsigned index_mask(cf_instruction const& cf)
+{
+    // Typed RAT stores take x, y and z coordinates, the others a linear index.
+    if (cf.inst() >= cf_instruction::CF_INST_MEM_RAT && cf.inst() <= cf_instruction::CF_INST_MEM_RAT_CACHELESS &&
+        cf.rat_inst() == 1)
+        return 7;
+    return 1;
+}
+
+}
+
+unsigned gpr_count(gpr_set const& set)
+{
+    unsigned n = 0;
+    for (unsigned r = 0; r < num_gprs; ++r)
+        if (set[4 * r] || set[4 * r + 1] || set[4 * r + 2] || set[4 * r + 3])
+            ++n;
+    return n;
+}
+
+gpr_access::gpr_access(alu_group const& group, unsigned limit)
+{
+    for (size_t i = 0; i < group.slots.size(); ++i) {
+        alu_instruction const& alu = group.slots[i];
+        for (unsigned s = 0, n = alu.num_sources(); s < n; ++s)
+            if (alu_instruction::is_gpr(alu.src[s].sel))
+                add(uses, alu.src[s].sel, alu.src[s].chan, alu.src[s].rel, limit);
+        if (!alu.writes_gpr())
+            continue;
+        add(writes, alu.dst_gpr, alu.dst_chan, alu.dst_rel, limit);
+        if (!alu.dst_rel && alu.pred_sel == alu_instruction::PRED_SEL_OFF)
+            defs.set(4 * alu.dst_gpr + alu.dst_chan);
+    }
+}
+
+gpr_access::gpr_access(fetch_instruction const& fetch, unsigned limit)
+{
+    if (fetch.is_vertex())
+        add(uses, fetch.src_gpr(), fetch.src_sel_x(), fetch.src_rel(), limit);
+    else
+        for (unsigned c = 0; c < 4; ++c)
+            add(uses, fetch.src_gpr(), c, fetch.src_rel(), limit);
+
+    for (unsigned c = 0; c < 4; ++c) {
+        if (fetch.dst_sel(c) == fetch_instruction::SEL_MASK)
+            continue;
+        add(writes, fetch.dst_gpr(), c, fetch.dst_rel(), limit);
+        if (!fetch.dst_rel())
+            defs.set(4 * fetch.dst_gpr() + c);
+    }
+}
+
+gpr_access::gpr_access(cf_instruction const& cf, unsigned limit)
+{
+    if (!cf.is_export())
+        return;
+
+    if (cf.inst() == cf_instruction::CF_INST_EXPORT || cf.inst() == cf_instruction::CF_INST_EXPORT_DONE) {
+        // The swizzle selects which channel goes to each component.
+        for (unsigned r = 0; r <= cf.burst_count(); ++r)
+            for (unsigned c = 0; c < 4; ++c) {
+                unsigned sel = cf.word1 >> (3 * c) & 7;
+                if (sel < 4)
+                    add(uses, cf.rw_gpr() + r, sel, cf.rw_rel(), limit);
+            }
+        return;
+    }
+
+    for (unsigned r = 0; r <= cf.burst_count(); ++r)
+        for (unsigned c = 0; c < 4; ++c)
+            if (cf.comp_mask() >> c & 1)
+                add(uses, cf.rw_gpr() + r, c, cf.rw_rel(), limit);
+    // Types 1 and 3 (WRITE_IND and WRITE_IND_ACK) use the index GPR.
+    if (cf.type() & 1)
+        for (unsigned c = 0; c < 4; ++c)
+            if (index_mask(cf) >> c & 1)
+                add(uses, cf.index_gpr(), c, false, limit);
+}
+
+void gpr_access::append(gpr_access const& next)
+{
+    uses |= next.uses & ~defs;
+    defs |= next.defs;
+    writes |= next.writes;
+}
+
+gpr_liveness::gpr_liveness(evergreen_program const& program, control_flow_graph const& cfg,
+                           unsigned temp_gprs)
+    : _live_in(program.size()), _live_out(program.size()), _access(program.size()),
+      _limit(gpr_limit(program))
+{
+    gpr_set temps;
+    for (unsigned r = num_gprs - min(temp_gprs, num_gprs); r < num_gprs; ++r)
+        for (unsigned c = 0; c < 4; ++c)
+            temps.set(4 * r + c);
+
+    for (unsigned i = 0; i < program.size(); ++i) {
+        cf_node const& node = program[i];
+        gpr_access& a = _access[i];
+        for (size_t g = 0; g < node.alu.size(); ++g)
+            a.append(gpr_access(node.alu[g], _limit));
+        for (size_t f = 0; f < node.fetch.size(); ++f)
+            a.append(gpr_access(node.fetch[f], _limit));
+        a.append(gpr_access(node.cf, _limit));
+    }
+
+    // Visit the nodes backwards until nothing changes.
+    vector<unsigned> order = cfg.reverse_post_order();
+    reverse(order.begin(), order.end());
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (size_t k = 0; k < order.size(); ++k) {
+            unsigned i = order[k];
+            gpr_set out;
+            for (size_t s = 0; s < cfg.successors(i).size(); ++s)
+                out |= _live_in[cfg.successors(i)[s]];
+            out &= ~temps;
+            gpr_set in = (_access[i].uses | (out & ~_access[i].defs)) & ~temps;
+            if (in != _live_in[i] || out != _live_out[i]) {
+                _live_in[i] = in;
+                _live_out[i] = out;
+                changed = true;
+            }
+        }
+    }
+}
+
+unsigned gpr_liveness::gpr_limit(evergreen_program const& program)
+{
+    unsigned limit = 0;
+    for (size_t i = 0; i < program.size(); ++i) {
+        cf_node const& node = program[i];
+        for (size_t g = 0; g < node.alu.size(); ++g)
+            for (size_t k = 0; k < node.alu[g].slots.size(); ++k) {
+                alu_instruction const& alu = node.alu[g].slots[k];
+                for (unsigned s = 0, n = alu.num_sources(); s < n; ++s)
+                    if (alu_instruction::is_gpr(alu.src[s].sel))
+                        limit = max(limit, alu.src[s].sel + 1);
+                if (alu.writes_gpr())
+                    limit = max(limit, alu.dst_gpr + 1);
+            }
+        for (size_t f = 0; f < node.fetch.size(); ++f) {
+            limit = max(limit, node.fetch[f].src_gpr() + 1);
+            limit = max(limit, node.fetch[f].dst_gpr() + 1);
+        }
+        if (node.cf.is_export()) {
+            limit = max(limit, node.cf.rw_gpr() + node.cf.burst_count() + 1);
+            if (node.cf.type() & 1)
+                limit = max(limit, node.cf.index_gpr() + 1);
+        }
+    }
+    return min(limit, num_gprs);
+}
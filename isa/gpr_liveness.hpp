@@ -0,0 +1,71 @@
+#pragma once
+
+#include "control_flow.hpp"
+#include "evergreen_program.hpp"
+
+#include <bitset>
+#include <vector>
+
+/// Set of GPR channels. Channel c of GPR r is bit 4 * r + c.
+typedef std::bitset<512> gpr_set;
+
+/// Get the number of GPRs with some channel in a set.
+unsigned gpr_count(gpr_set const& set);
+
+/// This structure describes the GPR channels accessed by an instruction or
+/// by a sequence of instructions.
+///
+/// Relative accesses may touch any GPR from the base one up to a limit,
+/// which is usually one past the highest GPR referenced by the program, so
+/// they are uses of the whole range but never definitions.
+struct gpr_access {
+    gpr_set uses;       ///< Channels read before being written.
+    gpr_set defs;       ///< Channels overwritten in every thread.
+    gpr_set writes;     ///< Channels which may be written.
+
+    gpr_access() {}
+    /// This constructor describes an ALU instruction group. Every source of
+    /// the group is read before any destination is written.
+    gpr_access(alu_group const& group, unsigned limit);
+    /// This constructor describes a fetch instruction.
+    gpr_access(fetch_instruction const& fetch, unsigned limit);
+    /// This constructor describes an export. Other CF instructions access
+    /// no GPRs.
+    gpr_access(cf_instruction const& cf, unsigned limit);
+
+    /// Append the accesses of another instruction executed after these.
+    void append(gpr_access const& next);
+};
+
+/// This class computes which GPR channels are live before and after each CF
+/// instruction, by backwards data flow over the control flow graph.
+///
+/// Clause temporaries (the top \c temp_gprs GPRs) are never live across
+/// CF instructions, since the hardware does not preserve them.
+class gpr_liveness {
+public:
+    /// This constructor analyzes a program.
+    /// \param program The program.
+    /// \param cfg The control flow graph of the program.
+    /// \param temp_gprs The number of clause temporary GPRs.
+    gpr_liveness(evergreen_program const& program, control_flow_graph const& cfg,
+                 unsigned temp_gprs = 0);
+
+    /// Get the channels live before a CF instruction executes.
+    gpr_set const& live_in(unsigned i) const { return _live_in[i]; }
+    /// Get the channels live after a CF instruction executes.
+    gpr_set const& live_out(unsigned i) const { return _live_out[i]; }
+    /// Get the accesses of a CF instruction and its clause.
+    gpr_access const& access(unsigned i) const { return _access[i]; }
+    /// Get one past the highest GPR referenced by the program.
+    unsigned limit() const { return _limit; }
+
+    /// Get the highest GPR referenced by a program, plus one.
+    static unsigned gpr_limit(evergreen_program const& program);
+
+private:
+    std::vector<gpr_set> _live_in;
+    std::vector<gpr_set> _live_out;
+    std::vector<gpr_access> _access;
+    unsigned _limit;
+};
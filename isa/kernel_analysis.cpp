@@ -0,0 +1,309 @@
+#include "kernel_analysis.hpp"
+#include "control_flow.hpp"
+#include "gpr_liveness.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+const unsigned num_gprs_total = 128;
+/// Clause temporaries can only be the top four GPRs.
+const unsigned max_temp_gprs = 4;
+
+const char* const chan_letters = "xyzw";
+
+string channel_name(unsigned bit)
+{
+    ostringstream s;
+    s << 'R' << bit / 4 << '.' << chan_letters[bit % 4];
+    return s.str();
+}
+
+/// Get the number of GPRs of a set below a limit.
+unsigned gpr_count(gpr_set set, unsigned limit)
+{
+    for (unsigned b = 4 * limit; b < set.size(); ++b)
+        set.reset(b);
+    return ::gpr_count(set);
+}
+
+/// This class tracks the depth of the stack while walking the CF program,
+/// the way the driver of the hardware estimates the STACK_SIZE field.
+struct stack_depth {
+    unsigned loops;
+    unsigned pushes;
+
+    stack_depth() : loops(), pushes() {}
+
+    unsigned nesting() const { return loops + pushes; }
+
+    /// Get the number of entries: loops take a whole entry of four
+    /// elements, pushes one element, and one more element is reserved
+    /// when anything was pushed.
+    unsigned entries() const
+    {
+        unsigned elements = 4 * loops + pushes + (pushes != 0 ? 1 : 0);
+        return (elements + 3) / 4;
+    }
+
+    void pop(unsigned n) { pushes -= min(pushes, n); }
+};
+
+void write_list(ostream& os, vector<string> const& list)
+{
+    os << '[';
+    for (size_t i = 0; i < list.size(); ++i)
+        os << (i ? ", " : "") << '"' << list[i] << '"';
+    os << ']';
+}
+
+}
+
+kernel_analysis::kernel_analysis(evergreen_program const& program)
+    : cf_instructions(program.size()), alu_clauses(), fetch_clauses(), exports(), branches(),
+      max_nesting(), max_loop_nesting(), stack_entries(),
+      alu_groups(), alu_instructions(), literals(), literal_groups(), fetch_instructions(),
+      kcache_reads(), kcache_lines(), num_gprs(), temp_gprs(), max_live()
+{
+    fill(slot_use, slot_use + 5, 0);
+    fill(group_width, group_width + 6, 0);
+
+    // Instruction statistics.
+    set<string> constants;
+    for (unsigned i = 0; i < program.size(); ++i) {
+        cf_node const& node = program[i];
+        cf_instruction const& cf = node.cf;
+
+        if (cf.is_export())
+            ++exports;
+        if (cf.is_branch())
+            ++branches;
+
+        if (cf.is_fetch()) {
+            ++fetch_clauses;
+            fetch_instructions += node.fetch.size();
+            clause c = { i, cf.name(), 0, unsigned(node.fetch.size()), 0, node.clause_size(), 0 };
+            _clauses.push_back(c);
+        }
+        if (!cf.is_alu())
+            continue;
+
+        ++alu_clauses;
+        clause c = { i, cf.name(), unsigned(node.alu.size()), 0, 0, node.clause_size(), 0 };
+        for (unsigned k = 0; k < 2; ++k) {
+            unsigned mode = cf.kcache_mode(k);
+            kcache_lines += mode == 2 ? 2 : mode != 0 ? 1 : 0;
+        }
+
+        for (size_t g = 0; g < node.alu.size(); ++g) {
+            alu_group const& group = node.alu[g];
+            unsigned unit[5];
+            group.assign_slots(unit);
+
+            ++alu_groups;
+            ++group_width[group.slots.size()];
+            alu_instructions += group.slots.size();
+            c.instructions += group.slots.size();
+            for (size_t s = 0; s < group.slots.size(); ++s)
+                ++slot_use[unit[s]];
+            if (!group.literals.empty()) {
+                ++literal_groups;
+                literals += group.literals.size();
+                c.literals += group.literals.size();
+            }
+
+            for (size_t s = 0; s < group.slots.size(); ++s) {
+                alu_instruction const& alu = group.slots[s];
+                for (unsigned o = 0, n = alu.num_sources(); o < n; ++o) {
+                    uint32_t sel = alu.src[o].sel;
+                    if (!alu_instruction::is_kcache(sel))
+                        continue;
+                    ++kcache_reads;
+                    unsigned set = sel < alu_instruction::ALU_SRC_KCACHE2_BASE
+                        ? (sel - alu_instruction::ALU_SRC_KCACHE0_BASE) / 32
+                        : 2 + (sel - alu_instruction::ALU_SRC_KCACHE2_BASE) / 32;
+                    ostringstream name;
+                    // The bank and address of sets 2 and 3 are in the
+                    // ALU_EXTENDED word, which is not decoded.
+                    if (set < 2) {
+                        name << cf.kcache_bank(set) << '[' << 16 * cf.kcache_addr(set) + sel % 32;
+                        if (cf.kcache_mode(set) == 3)
+                            name << "+loop";
+                        name << ']';
+                    }
+                    else
+                        name << "kcache" << set << '[' << sel % 32 << ']';
+                    name << '.' << chan_letters[alu.src[o].chan & 3];
+                    constants.insert(name.str());
+                }
+            }
+        }
+        _clauses.push_back(c);
+    }
+    kcache_constants.assign(constants.begin(), constants.end());
+
+    // Control flow nesting.
+    stack_depth depth;
+    for (unsigned i = 0; i < program.size(); ++i) {
+        cf_instruction const& cf = program[i].cf;
+        switch (cf.inst()) {
+        case cf_instruction::CF_INST_LOOP_START:
+        case cf_instruction::CF_INST_LOOP_START_DX10:
+        case cf_instruction::CF_INST_LOOP_START_NO_AL:
+            ++depth.loops;
+            break;
+        case cf_instruction::CF_INST_LOOP_END:
+            depth.loops -= min(depth.loops, 1u);
+            break;
+        case cf_instruction::CF_INST_PUSH:
+        case cf_instruction::CF_INST_ALU_PUSH_BEFORE:
+            ++depth.pushes;
+            break;
+        case cf_instruction::CF_INST_ALU_POP_AFTER:
+            depth.pop(1);
+            break;
+        case cf_instruction::CF_INST_ALU_POP2_AFTER:
+            depth.pop(2);
+            break;
+        default:
+            depth.pop(cf.pop_count());
+            break;
+        }
+        max_nesting = max(max_nesting, depth.nesting());
+        max_loop_nesting = max(max_loop_nesting, depth.loops);
+        stack_entries = max(stack_entries, depth.entries());
+    }
+
+    // GPR usage. The top GPRs are taken for clause temporaries if none of
+    // them is ever live across CF instructions.
+    control_flow_graph cfg(program);
+    gpr_liveness plain(program, cfg);
+    gpr_set used, crossing;
+    for (unsigned i = 0; i < program.size(); ++i) {
+        used |= plain.access(i).uses | plain.access(i).writes;
+        crossing |= plain.live_in(i) | plain.live_out(i);
+    }
+    for (unsigned r = num_gprs_total; r-- > num_gprs_total - max_temp_gprs; ) {
+        bool is_used = false, crosses = false;
+        for (unsigned c = 0; c < 4; ++c) {
+            is_used = is_used || used[4 * r + c];
+            crosses = crosses || crossing[4 * r + c];
+        }
+        if (crosses)
+            break;
+        if (is_used)
+            temp_gprs = num_gprs_total - r;
+    }
+    unsigned limit = num_gprs_total - temp_gprs;
+    for (unsigned b = 0; b < 4 * limit; ++b)
+        if (used[b])
+            num_gprs = b / 4 + 1;
+
+    gpr_liveness liveness(program, cfg, temp_gprs);
+    for (unsigned b = 0; program.size() != 0 && b < 4 * limit; ++b)
+        if (liveness.live_in(0)[b])
+            live_in.push_back(channel_name(b));
+
+    vector<clause>::iterator c = _clauses.begin();
+    for (unsigned i = 0; i < program.size(); ++i) {
+        cf_node const& node = program[i];
+        gpr_set live = liveness.live_out(i);
+        unsigned peak = max(gpr_count(live, limit), gpr_count(liveness.live_in(i), limit));
+
+        // Walk the clause backwards; what is written must be allocated
+        // while the instruction executes even if it is never read.
+        for (size_t g = node.alu.size(); g-- > 0; ) {
+            gpr_access a(node.alu[g], liveness.limit());
+            peak = max(peak, gpr_count(live | a.writes, limit));
+            live = a.uses | (live & ~a.defs);
+            peak = max(peak, gpr_count(live, limit));
+        }
+        for (size_t f = node.fetch.size(); f-- > 0; ) {
+            gpr_access a(node.fetch[f], liveness.limit());
+            peak = max(peak, gpr_count(live | a.writes, limit));
+            live = a.uses | (live & ~a.defs);
+            peak = max(peak, gpr_count(live, limit));
+        }
+
+        max_live = max(max_live, peak);
+        if (node.cf.is_clause()) {
+            c->max_live = peak;
+            ++c;
+        }
+    }
+}
+
+void kernel_analysis::write_json(ostream& os) const
+{
+    ios::fmtflags flags = os.flags();
+    os << fixed << setprecision(3);
+
+    double utilization = alu_groups ? double(alu_instructions) / (5 * alu_groups) : 0;
+    double fetch_alu = alu_groups ? double(fetch_instructions) / alu_groups : 0;
+    double alu_fetch = fetch_instructions ? double(alu_groups) / fetch_instructions : 0;
+
+    os << "{\n"
+        << "  \"cf\": {\n"
+        << "    \"instructions\": " << cf_instructions << ",\n"
+        << "    \"alu_clauses\": " << alu_clauses << ",\n"
+        << "    \"fetch_clauses\": " << fetch_clauses << ",\n"
+        << "    \"exports\": " << exports << ",\n"
+        << "    \"branches\": " << branches << ",\n"
+        << "    \"max_nesting\": " << max_nesting << ",\n"
+        << "    \"max_loop_nesting\": " << max_loop_nesting << ",\n"
+        << "    \"stack_entries\": " << stack_entries << "\n"
+        << "  },\n"
+        << "  \"alu\": {\n"
+        << "    \"groups\": " << alu_groups << ",\n"
+        << "    \"instructions\": " << alu_instructions << ",\n"
+        << "    \"slots\": { \"x\": " << slot_use[0] << ", \"y\": " << slot_use[1]
+        << ", \"z\": " << slot_use[2] << ", \"w\": " << slot_use[3] << ", \"t\": " << slot_use[4] << " },\n"
+        << "    \"group_widths\": [" << group_width[1] << ", " << group_width[2] << ", "
+        << group_width[3] << ", " << group_width[4] << ", " << group_width[5] << "],\n"
+        << "    \"utilization\": " << utilization << ",\n"
+        << "    \"literals\": " << literals << ",\n"
+        << "    \"literal_groups\": " << literal_groups << "\n"
+        << "  },\n"
+        << "  \"fetch\": {\n"
+        << "    \"instructions\": " << fetch_instructions << ",\n"
+        << "    \"fetch_alu_ratio\": " << fetch_alu << ",\n"
+        << "    \"alu_fetch_ratio\": " << alu_fetch << "\n"
+        << "  },\n"
+        << "  \"kcache\": {\n"
+        << "    \"reads\": " << kcache_reads << ",\n"
+        << "    \"lines\": " << kcache_lines << ",\n"
+        << "    \"constants\": ";
+    write_list(os, kcache_constants);
+    os << "\n"
+        << "  },\n"
+        << "  \"gprs\": {\n"
+        << "    \"num_gprs\": " << num_gprs << ",\n"
+        << "    \"temp_gprs\": " << temp_gprs << ",\n"
+        << "    \"max_live\": " << max_live << ",\n"
+        << "    \"live_in\": ";
+    write_list(os, live_in);
+    os << "\n"
+        << "  },\n"
+        << "  \"clauses\": [\n";
+    for (size_t i = 0; i < _clauses.size(); ++i) {
+        clause const& c = _clauses[i];
+        os << "    { \"cf\": " << c.cf
+            << ", \"inst\": \"" << c.inst << '"'
+            << ", \"groups\": " << c.groups
+            << ", \"instructions\": " << c.instructions
+            << ", \"literals\": " << c.literals
+            << ", \"size\": " << c.size
+            << ", \"max_live\": " << c.max_live
+            << " }" << (i + 1 < _clauses.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n"
+        << "}\n";
+
+    os.flags(flags);
+}
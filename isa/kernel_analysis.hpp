@@ -0,0 +1,68 @@
+#pragma once
+
+#include "evergreen_program.hpp"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+/// This class computes static statistics of an Evergreen program: VLIW slot
+/// utilization, clause counts and sizes, the ratio of fetch to ALU work,
+/// literal and kcache usage, an estimate of the GPR pressure and the
+/// nesting of the control flow.
+///
+/// The statistics are written as JSON with a stable layout, one value per
+/// line, so that the summaries of two versions of a kernel can be compared
+/// with diff.
+class kernel_analysis {
+public:
+    /// This structure describes one clause.
+    struct clause {
+        unsigned cf;            ///< Index of the CF instruction.
+        std::string inst;       ///< Mnemonic of the CF instruction.
+        unsigned groups;        ///< Number of ALU groups (0 for fetch clauses).
+        unsigned instructions;  ///< Number of ALU or fetch instructions.
+        unsigned literals;      ///< Number of literal double words.
+        unsigned size;          ///< Size in the units of the COUNT field.
+        unsigned max_live;      ///< Maximum number of live GPRs in the clause.
+    };
+
+    /// This constructor analyzes a program.
+    /// It throws std::runtime_error if the control flow is malformed.
+    explicit kernel_analysis(evergreen_program const& program);
+
+    /// Write the statistics as a JSON object.
+    void write_json(std::ostream& os) const;
+
+    /// Get the clauses in program order.
+    std::vector<clause> const& clauses() const { return _clauses; }
+
+    unsigned cf_instructions;   ///< Number of CF instructions.
+    unsigned alu_clauses;       ///< Number of ALU clauses.
+    unsigned fetch_clauses;     ///< Number of fetch clauses.
+    unsigned exports;           ///< Number of exports (RAT writes included).
+    unsigned branches;          ///< Number of jumps, loops and calls.
+    unsigned max_nesting;       ///< Deepest nesting of loops and conditionals.
+    unsigned max_loop_nesting;  ///< Deepest nesting of loops.
+    unsigned stack_entries;     ///< Estimated number of stack entries needed.
+
+    unsigned alu_groups;            ///< Number of ALU instruction groups.
+    unsigned alu_instructions;      ///< Number of ALU instructions.
+    unsigned slot_use[5];           ///< Instructions in the x, y, z, w and t slots.
+    unsigned group_width[6];        ///< Number of groups by instruction count.
+    unsigned literals;              ///< Number of literal double words.
+    unsigned literal_groups;        ///< Number of groups with literals.
+    unsigned fetch_instructions;    ///< Number of fetch instructions.
+
+    unsigned kcache_reads;                  ///< Number of kcache operands.
+    std::vector<std::string> kcache_constants;  ///< Distinct constants read, as "buffer[index].chan".
+    unsigned kcache_lines;                  ///< Kcache lines locked, over all clauses.
+
+    unsigned num_gprs;          ///< One past the highest GPR used, clause temporaries excluded.
+    unsigned temp_gprs;         ///< Number of GPRs used as clause temporaries.
+    unsigned max_live;          ///< Maximum number of live GPRs.
+    std::vector<std::string> live_in;   ///< GPR channels read before being written.
+
+private:
+    std::vector<clause> _clauses;
+};
@@ -0,0 +1,70 @@
+#include "kernel_metadata.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <cerrno>
+
+using namespace std;
+
+string kernel_metadata::path(string const& image)
+{
+    string::size_type n = image.size();
+    if (n >= 4 && image.compare(n - 4, 4, ".bin") == 0)
+        return image.substr(0, n - 4) + ".meta";
+    return image + ".meta";
+}
+
+kernel_metadata kernel_metadata::read(const char* path)
+{
+    ifstream file(path);
+    if (!file)
+        throw system_error(error_code(errno, system_category()), path);
+
+    kernel_metadata meta;
+    string line;
+    while (getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        istringstream s(line);
+        string name, equals;
+        unsigned value;
+        if (!(s >> name >> equals >> value) || equals != "=")
+            throw runtime_error("malformed metadata line: " + line);
+
+        if (name == "num_gprs")
+            meta.num_gprs = value;
+        else if (name == "temp_gprs")
+            meta.temp_gprs = value;
+        else if (name == "global_gprs")
+            meta.global_gprs = value;
+        else if (name == "stack_size")
+            meta.stack_size = value;
+        else if (name == "lds_alloc")
+            meta.lds_alloc = value;
+        else
+            throw runtime_error("unknown metadata field: " + name);
+    }
+    if (file.bad())
+        throw system_error(error_code(errno, system_category()), path);
+    return meta;
+}
+
+void kernel_metadata::write(const char* path) const
+{
+    ofstream file(path, ios::out | ios::trunc);
+    if (!file)
+        throw system_error(error_code(errno, system_category()), path);
+    file
+        << "num_gprs = " << num_gprs << "\n"
+        << "temp_gprs = " << temp_gprs << "\n"
+        << "global_gprs = " << global_gprs << "\n"
+        << "stack_size = " << stack_size << "\n"
+        << "lds_alloc = " << lds_alloc << "\n";
+    file.close();
+    if (!file)
+        throw system_error(error_code(errno, system_category()), path);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+
+/// This structure holds the resource requirements of a kernel, which the
+/// host program copies into the shader state (SQ_PGM_RESOURCES and the LDS
+/// allocation) before dispatching it.
+///
+/// The metadata lives next to the kernel image in a text file with one
+/// "name = value" line per field, see \c path().
+struct kernel_metadata {
+    unsigned num_gprs;      ///< GPRs per thread.
+    unsigned temp_gprs;     ///< Clause temporary GPRs.
+    unsigned global_gprs;   ///< Global GPRs.
+    unsigned stack_size;    ///< Stack entries.
+    unsigned lds_alloc;     ///< LDS double words per work-group.
+
+    kernel_metadata() : num_gprs(), temp_gprs(), global_gprs(), stack_size(), lds_alloc() {}
+
+    /// Get the pathname of the metadata of a kernel image: the image
+    /// pathname with the .bin suffix replaced by .meta.
+    static std::string path(std::string const& image);
+
+    /// Read metadata from a file.
+    /// It may throw a std::system_error exception if the file cannot be read
+    /// or std::runtime_error if it is malformed.
+    static kernel_metadata read(const char* path);
+    /// Write the metadata to a file.
+    /// It may throw a std::system_error exception if the file cannot be written.
+    void write(const char* path) const;
+};
@@ -0,0 +1,224 @@
+#include "kernel_tuner.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+using namespace std;
+
+namespace {
+
+const unsigned wave_size = 64;
+
+vector<unsigned> divisors(unsigned n, unsigned limit)
+{
+    vector<unsigned> d;
+    for (unsigned i = 1; i <= n && i <= limit; ++i)
+        if (n % i == 0)
+            d.push_back(i);
+    return d;
+}
+
+bool higher_occupancy(kernel_tuner::candidate const& a, kernel_tuner::candidate const& b)
+{
+    return a.occupancy > b.occupancy;
+}
+
+}
+
+unsigned kernel_tuner::resident_waves(tuning_config const& c, unsigned temp_gprs, unsigned wave_slots)
+{
+    unsigned items = c.group_items();
+    if (items == 0 || items > max_group_items || 2 * temp_gprs >= simd_gprs)
+        return 0;
+    unsigned group_waves = (items + wave_size - 1) / wave_size;
+
+    unsigned waves = min(wave_slots, (simd_gprs - 2 * temp_gprs) / max(c.num_gprs, 1u));
+    unsigned groups = waves / group_waves;
+    if (c.lds_alloc)
+        groups = min(groups, simd_lds / c.lds_alloc);
+    return groups * group_waves;
+}
+
+kernel_tuner::kernel_tuner(unsigned const* domain, kernel_metadata const& needs, unsigned wave_slots)
+    : _needs(needs), _wave_slots(wave_slots),
+      _gprs(1, needs.num_gprs), _lds(1, needs.lds_alloc),
+      _min_occupancy(0.5), _infeasible(), _pruned()
+{
+    copy(domain, domain + 3, _domain);
+    if (_domain[0] == 0 || _domain[1] == 0 || _domain[2] == 0)
+        throw runtime_error("empty domain");
+}
+
+void kernel_tuner::search()
+{
+    _candidates.clear();
+    _reserve.clear();
+    _infeasible = _pruned = 0;
+
+    vector<unsigned> dx = divisors(_domain[0], max_group_items),
+                     dy = divisors(_domain[1], max_group_items),
+                     dz = divisors(_domain[2], max_group_items);
+    double best = 0;
+    for (size_t i = 0; i < dx.size(); ++i)
+        for (size_t j = 0; j < dy.size() && dx[i] * dy[j] <= max_group_items; ++j)
+            for (size_t k = 0; k < dz.size() && dx[i] * dy[j] * dz[k] <= max_group_items; ++k)
+                for (size_t g = 0; g < _gprs.size(); ++g)
+                    for (size_t l = 0; l < _lds.size(); ++l) {
+                        candidate c;
+                        c.config.group_size[0] = dx[i];
+                        c.config.group_size[1] = dy[j];
+                        c.config.group_size[2] = dz[k];
+                        c.config.num_gprs = _gprs[g];
+                        c.config.lds_alloc = _lds[l];
+                        c.waves = resident_waves(c.config, _needs.temp_gprs, _wave_slots);
+                        if (c.config.num_gprs < _needs.num_gprs ||
+                            c.config.lds_alloc < _needs.lds_alloc || c.waves == 0) {
+                            ++_infeasible;
+                            continue;
+                        }
+                        unsigned group_waves = (c.config.group_items() + wave_size - 1) / wave_size;
+                        c.occupancy = double(c.waves / group_waves * c.config.group_items()) /
+                            (_wave_slots * wave_size);
+                        c.cycles = -1;
+                        best = max(best, c.occupancy);
+                        _candidates.push_back(c);
+                    }
+
+    vector<candidate> kept;
+    for (size_t i = 0; i < _candidates.size(); ++i)
+        if (_candidates[i].occupancy >= _min_occupancy * best)
+            kept.push_back(_candidates[i]);
+        else {
+            _reserve.push_back(_candidates[i]);
+            ++_pruned;
+        }
+    stable_sort(kept.begin(), kept.end(), higher_occupancy);
+    stable_sort(_reserve.begin(), _reserve.end(), higher_occupancy);
+    _candidates.swap(kept);
+}
+
+size_t kernel_tuner::tune(measure const& m)
+{
+    const size_t none = ~size_t(0);
+    size_t best = none;
+    for (size_t i = 0; i < _candidates.size(); ++i) {
+        try {
+            _candidates[i].cycles = m(_candidates[i]);
+            if (best == none || _candidates[i].cycles < _candidates[best].cycles)
+                best = i;
+        }
+        catch (runtime_error&) {
+        }
+
+        // Fall back on the pruned candidates if none of the others runs.
+        if (i + 1 == _candidates.size() && best == none && !_reserve.empty()) {
+            _candidates.insert(_candidates.end(), _reserve.begin(), _reserve.end());
+            _reserve.clear();
+            _pruned = 0;
+        }
+    }
+    if (best == none)
+        throw runtime_error("no configuration could be measured");
+    return best;
+}
+
+unsigned tuning_database::size_class(uint64_t items)
+{
+    unsigned c = 0;
+    while (items >>= 1)
+        ++c;
+    return c;
+}
+
+string tuning_database::kernel_name(string const& image)
+{
+    string name = image;
+    string::size_type slash = name.rfind('/');
+    if (slash != string::npos)
+        name.erase(0, slash + 1);
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".bin") == 0)
+        name.erase(name.size() - 4);
+    return name;
+}
+
+string tuning_database::path(string const& image)
+{
+    string::size_type slash = image.rfind('/');
+    return slash == string::npos ? "tuning.txt" : image.substr(0, slash + 1) + "tuning.txt";
+}
+
+tuning_database tuning_database::read(const char* path)
+{
+    tuning_database db;
+    ifstream file(path);
+    if (!file) {
+        if (errno == ENOENT)
+            return db;
+        throw system_error(error_code(errno, system_category()), path);
+    }
+
+    string line;
+    while (getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        istringstream s(line);
+        entry e;
+        tuning_config& c = e.config;
+        if (!(s >> e.kernel >> e.family >> e.size_class
+                >> c.group_size[0] >> c.group_size[1] >> c.group_size[2]
+                >> c.num_gprs >> c.lds_alloc >> e.cycles))
+            throw runtime_error("malformed tuning line: " + line);
+        db._entries.push_back(e);
+    }
+    if (file.bad())
+        throw system_error(error_code(errno, system_category()), path);
+    return db;
+}
+
+void tuning_database::write(const char* path) const
+{
+    ofstream file(path, ios::out | ios::trunc);
+    if (!file)
+        throw system_error(error_code(errno, system_category()), path);
+    file << "# kernel family class x y z num_gprs lds_alloc cycles\n";
+    for (size_t i = 0; i < _entries.size(); ++i) {
+        entry const& e = _entries[i];
+        tuning_config const& c = e.config;
+        file
+            << e.kernel << ' ' << e.family << ' ' << e.size_class << ' '
+            << c.group_size[0] << ' ' << c.group_size[1] << ' ' << c.group_size[2] << ' '
+            << c.num_gprs << ' ' << c.lds_alloc << ' ' << e.cycles << '\n';
+    }
+    file.close();
+    if (!file)
+        throw system_error(error_code(errno, system_category()), path);
+}
+
+tuning_database::entry const* tuning_database::find(string const& kernel, string const& family, uint64_t items) const
+{
+    unsigned c = size_class(items);
+    for (size_t i = 0; i < _entries.size(); ++i)
+        if (_entries[i].kernel == kernel && _entries[i].family == family && _entries[i].size_class == c)
+            return &_entries[i];
+    return 0;
+}
+
+bool tuning_database::update(entry const& e, bool replace)
+{
+    for (size_t i = 0; i < _entries.size(); ++i) {
+        entry& old = _entries[i];
+        if (old.kernel == e.kernel && old.family == e.family && old.size_class == e.size_class) {
+            if (!replace && old.cycles <= e.cycles)
+                return false;
+            old = e;
+            return true;
+        }
+    }
+    _entries.push_back(e);
+    return true;
+}
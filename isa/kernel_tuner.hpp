@@ -0,0 +1,160 @@
+#pragma once
+
+#include "kernel_metadata.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/// This structure holds a launch configuration of a kernel: the shape of its
+/// work groups and the resources allocated to it.
+struct tuning_config {
+    unsigned group_size[3];     ///< Work-items per group in X, Y and Z.
+    unsigned num_gprs;          ///< GPRs per thread.
+    unsigned lds_alloc;         ///< LDS double words per work-group.
+
+    tuning_config() : num_gprs(), lds_alloc()
+    {
+        group_size[0] = group_size[1] = group_size[2] = 1;
+    }
+
+    /// Get the number of work-items per group.
+    unsigned group_items() const { return group_size[0] * group_size[1] * group_size[2]; }
+};
+
+/// This class searches the launch configurations of a kernel over a domain
+/// for the fastest one.
+///
+/// The candidates are the group shapes which divide the domain, with up to
+/// 256 work-items, combined with the given GPR counts and LDS allocations.
+/// Those which cannot run (fewer GPRs or less LDS than the kernel needs, or
+/// a group which does not fit in a SIMD) and those whose occupancy is below
+/// a fraction of the best occupancy are pruned before anything is measured.
+///
+/// Occupancy counts the resident work-items of a SIMD, so that the idle lanes
+/// of groups smaller than a wavefront do not count. A SIMD holds as many
+/// whole groups as its wavefront slots, its register file (256 GPRs per
+/// thread, less two sets of clause temporaries) and its LDS (8192 double
+/// words) allow.
+class kernel_tuner {
+public:
+    /// Largest work group.
+    static const unsigned max_group_items = 256;
+    /// GPRs per thread of the register file of a SIMD.
+    static const unsigned simd_gprs = 256;
+    /// LDS double words of a SIMD.
+    static const unsigned simd_lds = 8192;
+
+    /// This structure holds a candidate configuration.
+    struct candidate {
+        tuning_config config;
+        unsigned waves;     ///< Resident wavefronts per SIMD.
+        double occupancy;   ///< Resident work-items over the work-items of the wavefront slots.
+        double cycles;      ///< Measured cycles, or a negative value if not measured.
+    };
+
+    /// Measure a configuration.
+    /// It returns the cycles of the dispatch, or throws std::runtime_error
+    /// if the configuration fails.
+    typedef std::function<double(candidate const&)> measure;
+
+    /// Get the number of resident wavefronts of a SIMD in a configuration.
+    /// \param c The configuration.
+    /// \param temp_gprs The clause temporaries of the kernel.
+    /// \param wave_slots Wavefront slots of a SIMD.
+    /// \returns The number of wavefronts, 0 if a group does not fit.
+    static unsigned resident_waves(tuning_config const& c, unsigned temp_gprs, unsigned wave_slots);
+
+    /// This constructor prepares the search.
+    /// \param domain Work-items in X, Y and Z.
+    /// \param needs The resources the kernel needs.
+    /// \param wave_slots Wavefront slots of a SIMD.
+    kernel_tuner(unsigned const* domain, kernel_metadata const& needs, unsigned wave_slots);
+
+    /// Set the GPR counts to try (the kernel's own by default).
+    void set_gprs(std::vector<unsigned> const& gprs) { _gprs = gprs; }
+    /// Set the LDS allocations to try (the kernel's own by default).
+    void set_lds(std::vector<unsigned> const& lds) { _lds = lds; }
+    /// Set the fraction of the best occupancy below which candidates are
+    /// pruned (0.5 by default).
+    void set_min_occupancy(double fraction) { _min_occupancy = fraction; }
+
+    /// Enumerate and prune the candidates, the highest occupancy first.
+    void search();
+    /// Measure the candidates. If none of them can be measured, those
+    /// pruned for their occupancy are measured too.
+    /// \param m The measurement.
+    /// \returns The index of the fastest candidate.
+    /// It throws std::runtime_error if no candidate could be measured.
+    std::size_t tune(measure const& m);
+
+    /// Access the candidates left by the last search.
+    std::vector<candidate> const& candidates() const { return _candidates; }
+    /// Get the number of configurations which cannot run.
+    unsigned infeasible() const { return _infeasible; }
+    /// Get the number of configurations pruned for their occupancy.
+    unsigned pruned() const { return _pruned; }
+
+private:
+    unsigned _domain[3];
+    kernel_metadata _needs;
+    unsigned _wave_slots;
+    std::vector<unsigned> _gprs, _lds;
+    double _min_occupancy;
+    std::vector<candidate> _candidates;
+    std::vector<candidate> _reserve;    ///< The candidates pruned for their occupancy.
+    unsigned _infeasible, _pruned;
+};
+
+/// This class holds the best configurations found for kernels, by kernel
+/// name, device family and domain size class, so that launches can pick
+/// them up.
+///
+/// The database is a text file with one line per entry:
+///
+///     kernel family class x y z num_gprs lds_alloc cycles
+///
+/// where the class of a domain of n work-items is floor(log2(n)), and lines
+/// starting with # are comments.
+class tuning_database {
+public:
+    /// This structure holds an entry.
+    struct entry {
+        std::string kernel;     ///< Kernel name, without directory and .bin.
+        std::string family;     ///< Device family ("redwood").
+        unsigned size_class;    ///< Domain size class.
+        tuning_config config;
+        double cycles;          ///< Cycles of the configuration when it was tuned.
+    };
+
+    /// Get the size class of a domain.
+    static unsigned size_class(std::uint64_t items);
+    /// Get the name of a kernel from the pathname of its image.
+    static std::string kernel_name(std::string const& image);
+    /// Get the pathname of the database of the kernels in the directory of
+    /// a kernel image: tuning.txt next to it.
+    static std::string path(std::string const& image);
+
+    /// Read a database from a file. A missing file is an empty database.
+    /// It may throw a std::system_error exception if the file cannot be read
+    /// or std::runtime_error if it is malformed.
+    static tuning_database read(const char* path);
+    /// Write the database to a file.
+    /// It may throw a std::system_error exception if the file cannot be written.
+    void write(const char* path) const;
+
+    /// Find the entry of a kernel on a family for a domain.
+    /// \returns The entry, or 0 if there is none.
+    entry const* find(std::string const& kernel, std::string const& family, std::uint64_t items) const;
+    /// Add an entry, or replace the entry with the same key if the new one
+    /// is faster or \c replace is set.
+    /// \returns Whether the database changed.
+    bool update(entry const& e, bool replace = false);
+
+    /// Access the entries.
+    std::vector<entry> const& entries() const { return _entries; }
+
+private:
+    std::vector<entry> _entries;
+};
@@ -0,0 +1,344 @@
+#include "microbenchmark.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+using namespace std;
+
+namespace {
+
+typedef cf_instruction cf;
+typedef alu_instruction alu;
+
+/// EXPORT_RAT_INST_STORE_RAW.
+const unsigned rat_inst_store_raw = 2;
+const unsigned max_clause_size = 128;
+
+/// GPRs of the kernel: R0 the local id, R1 the timestamps, R2 the results
+/// and R3 the constant operands.
+const unsigned time_gpr = 1, result_gpr = 2, operand_gpr = 3;
+/// Initial operands, 1.0f and 0.5f, which keep float and integer
+/// instructions away from zeros and denormals.
+const uint32_t result_seed = 0x3f800000, operand_seed = 0x3f000000;
+
+const char* const slot_names[] = { "x", "y", "z", "w", "t" };
+
+alu_source source(uint32_t sel, uint32_t chan = 0)
+{
+    alu_source s = { sel, chan, false, false, false };
+    return s;
+}
+
+alu_instruction mov(unsigned gpr, unsigned chan, alu_source const& a, bool write = true)
+{
+    alu_instruction inst(alu::OP2_MOV);
+    inst.dst_gpr = gpr;
+    inst.dst_chan = chan;
+    inst.write_mask = write;
+    inst.src[0] = a;
+    return inst;
+}
+
+/// Make the measured instruction writing R2.<chan>. The first source reads
+/// R2.<from> in latency mode, the others read R3.<from>.
+alu_instruction measured(unsigned op, unsigned chan, unsigned from, bool dependent, bool write = true)
+{
+    alu_instruction inst(op);
+    inst.dst_gpr = result_gpr;
+    inst.dst_chan = chan;
+    inst.write_mask = write;
+    for (unsigned i = 0; i < alu::num_sources(op); ++i)
+        inst.src[i] = source(i == 0 && dependent ? result_gpr : operand_gpr, from);
+    return inst;
+}
+
+alu_group time_read(unsigned chan)
+{
+    alu_group g;
+    g.slots.push_back(mov(time_gpr, chan, source(alu::ALU_SRC_TIME_LO)));
+    return g;
+}
+
+alu_group seed(unsigned gpr, uint32_t value)
+{
+    alu_group g;
+    for (unsigned c = 0; c < 4; ++c)
+        g.slots.push_back(mov(gpr, c, source(alu::ALU_SRC_LITERAL, 0)));
+    g.literals.push_back(value);
+    return g;
+}
+
+string lower(string s)
+{
+    for (size_t i = 0; i < s.size(); ++i)
+        s[i] = tolower(s[i]);
+    return s;
+}
+
+}
+
+const unsigned alu_microbenchmark::trans_slot;
+
+alu_microbenchmark::alu_microbenchmark(unsigned op, unsigned slot, mode m, unsigned length)
+    : _op(op), _slot(slot), _mode(m), _length(length)
+{
+    vector<unsigned> s = slots(op);
+    if (find_if(s.begin(), s.end(), [slot](unsigned u) { return u == slot; }) == s.end())
+        throw runtime_error(string("cannot measure ") + (alu::name(op) ? alu::name(op) : "unknown opcode") +
+                            " in slot " + to_string(slot));
+    if (length == 0)
+        throw runtime_error("empty benchmark");
+}
+
+vector<unsigned> alu_microbenchmark::opcodes()
+{
+    const unsigned excluded = alu::ORDERED | alu::PRED_SET | alu::KILL | alu::LDS;
+    vector<unsigned> ops;
+    for (unsigned op = 0; op < 0x800; op = op < 0x100 ? op + 1 : op + 0x40)
+        if (alu::name(op) && (alu::flags(op) & excluded) == 0)
+            ops.push_back(op);
+    return ops;
+}
+
+vector<unsigned> alu_microbenchmark::slots(unsigned op)
+{
+    unsigned f = alu::flags(op);
+    vector<unsigned> s;
+    if (f & alu::REDUCTION)
+        s.push_back(0);
+    else if (f & alu::DOUBLE) {
+        s.push_back(0);
+        s.push_back(2);
+    }
+    else {
+        if ((f & alu::TRANS_ONLY) == 0)
+            for (unsigned u = 0; u < 4; ++u)
+                s.push_back(u);
+        if ((f & alu::VECTOR_ONLY) == 0)
+            s.push_back(trans_slot);
+    }
+    return s;
+}
+
+vector<alu_microbenchmark> alu_microbenchmark::all(vector<unsigned> const& ops, unsigned length)
+{
+    vector<unsigned> o = ops.empty() ? opcodes() : ops;
+    vector<alu_microbenchmark> benchmarks;
+    for (size_t i = 0; i < o.size(); ++i) {
+        vector<unsigned> s = slots(o[i]);
+        for (size_t k = 0; k < s.size(); ++k) {
+            benchmarks.push_back(alu_microbenchmark(o[i], s[k], LATENCY, length));
+            benchmarks.push_back(alu_microbenchmark(o[i], s[k], THROUGHPUT, length));
+        }
+    }
+    return benchmarks;
+}
+
+unsigned alu_microbenchmark::find(string const& name)
+{
+    string upper = name;
+    for (size_t i = 0; i < upper.size(); ++i)
+        upper[i] = toupper(upper[i]);
+    for (unsigned op = 0; op < 0x800; op = op < 0x100 ? op + 1 : op + 0x40)
+        if (alu::name(op) && upper == alu::name(op))
+            return op;
+    throw runtime_error("unknown opcode " + name);
+}
+
+string alu_microbenchmark::slot_name() const
+{
+    unsigned f = alu::flags(_op);
+    if (f & alu::REDUCTION)
+        return "xyzw";
+    if (f & alu::DOUBLE)
+        return _slot == 0 ? "xy" : "zw";
+    return slot_names[_slot];
+}
+
+string alu_microbenchmark::name() const
+{
+    return lower(alu::name(_op)) + '-' + slot_name() + (_mode == LATENCY ? "-latency" : "-throughput");
+}
+
+evergreen_program alu_microbenchmark::program() const
+{
+    unsigned f = alu::flags(_op);
+    bool dependent = _mode == LATENCY;
+
+    // The instruction group repeated in the segments.
+    alu_group g;
+    unsigned first = 0, count = 1;
+    if (f & alu::REDUCTION) {
+        for (unsigned c = 0; c < 4; ++c)
+            g.slots.push_back(measured(_op, c, c, dependent, c == 0));
+        count = 4;
+    }
+    else if (f & alu::DOUBLE) {
+        // As in timing.asm, each half reads the other half of its operands.
+        g.slots.push_back(measured(_op, _slot, _slot + 1, dependent));
+        g.slots.push_back(measured(_op, _slot + 1, _slot, dependent));
+        count = 2;
+    }
+    else if (_slot == trans_slot && (f & alu::TRANS_ONLY) == 0) {
+        g.slots.push_back(mov(operand_gpr, 0, source(operand_gpr, 0), false));
+        g.slots.push_back(measured(_op, 0, 0, dependent));
+        first = 1;
+    }
+    else
+        g.slots.push_back(measured(_op, _slot == trans_slot ? 0 : _slot, _slot == trans_slot ? 0 : _slot, dependent));
+
+    unsigned unit[5];
+    g.assign_slots(unit);
+    for (unsigned i = 0; i < count; ++i)
+        if (unit[first + i] != (f & alu::REDUCTION ? i : _slot + i))
+            throw runtime_error("cannot place " + name());
+
+    if (2 + 2 * _length * g.size() > max_clause_size)
+        throw runtime_error(name() + " does not fit in a clause, it needs fewer instruction groups");
+
+    evergreen_program program;
+    vector<cf_node>& nodes = program.nodes();
+
+    // R2 <- 1.0, R3 <- 0.5, R1.x <- TIME_LO, the first segment, R1.y <- TIME_LO
+    nodes.push_back(cf_node(cf_instruction(cf::CF_INST_ALU)));
+    nodes.back().alu.push_back(seed(result_gpr, result_seed));
+    nodes.back().alu.push_back(seed(operand_gpr, operand_seed));
+    nodes.back().alu.push_back(time_read(0));
+    nodes.back().alu.insert(nodes.back().alu.end(), _length, g);
+    nodes.back().alu.push_back(time_read(1));
+
+    // R1.z <- TIME_LO, the second segment, R1.w <- TIME_LO
+    nodes.push_back(cf_node(cf_instruction(cf::CF_INST_ALU)));
+    nodes.back().alu.push_back(time_read(2));
+    nodes.back().alu.insert(nodes.back().alu.end(), 2 * _length, g);
+    nodes.back().alu.push_back(time_read(3));
+
+    // R1.y <- R1.y - R1.x, R1.z <- R1.w - R1.z, R1.w <- length
+    nodes.push_back(cf_node(cf_instruction(cf::CF_INST_ALU)));
+    alu_group d;
+    alu_instruction sub(alu::OP2_SUB_INT);
+    sub.dst_gpr = time_gpr;
+    sub.write_mask = true;
+    sub.dst_chan = 1;
+    sub.src[0] = source(time_gpr, 1);
+    sub.src[1] = source(time_gpr, 0);
+    d.slots.push_back(sub);
+    sub.dst_chan = 2;
+    sub.src[0] = source(time_gpr, 3);
+    sub.src[1] = source(time_gpr, 2);
+    d.slots.push_back(sub);
+    d.slots.push_back(mov(time_gpr, 3, source(alu::ALU_SRC_LITERAL, 0)));
+    d.literals.push_back(_length);
+    nodes.back().alu.push_back(d);
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+        nodes[i].cf.set_barrier(true);
+
+    // RAT 0 [R0.x] <- R1
+    cf_node store(cf_instruction(cf::CF_INST_MEM_RAT_CACHELESS));
+    store.cf.word0 = rat_inst_store_raw << 4 | 1 << 13 | 3u << 30;
+    store.cf.set_rw_gpr(time_gpr);
+    store.cf.set_index_gpr(0);
+    store.cf.word1 |= 0xf << 12;
+    store.cf.set_barrier(true);
+    store.cf.set_end_of_program(true);
+    nodes.push_back(store);
+    return program;
+}
+
+double alu_microbenchmark::cycles(vector<uint32_t> const& output) const
+{
+    if (output.size() < 4)
+        throw runtime_error(name() + ": output too short");
+    uint32_t first = output[1], second = output[2];
+    if (output[3] != _length)
+        throw runtime_error(name() + ": output of a benchmark of " + to_string(output[3]) +
+                            " instruction groups");
+    if (first == 0 || second <= first)
+        throw runtime_error(name() + ": segments of " + to_string(first) + " and " + to_string(second) + " cycles");
+    return double(second - first) / _length;
+}
+
+bool alu_timing_table::key::operator < (key const& k) const
+{
+    if (device != k.device)
+        return device < k.device;
+    if (opcode != k.opcode)
+        return opcode < k.opcode;
+    return slot < k.slot;
+}
+
+alu_timing_table alu_timing_table::read(const char* path)
+{
+    alu_timing_table table;
+    ifstream file(path);
+    if (!file) {
+        if (errno == ENOENT)
+            return table;
+        throw system_error(error_code(errno, system_category()), path);
+    }
+
+    string line;
+    while (getline(file, line)) {
+        if (line.empty() || line[0] == '#' || line.compare(0, 7, "device\t") == 0)
+            continue;
+
+        istringstream s(line);
+        key k;
+        string latency, throughput;
+        if (!(s >> k.device >> k.opcode >> k.slot >> latency >> throughput))
+            throw runtime_error("malformed timing line: " + line);
+        entry& e = table._entries[k];
+        e.latency = latency == "-" ? -1 : atof(latency.c_str());
+        e.throughput = throughput == "-" ? -1 : atof(throughput.c_str());
+    }
+    if (file.bad())
+        throw system_error(error_code(errno, system_category()), path);
+    return table;
+}
+
+void alu_timing_table::write(const char* path) const
+{
+    ofstream file(path, ios::out | ios::trunc);
+    if (!file)
+        throw system_error(error_code(errno, system_category()), path);
+    file << "device\topcode\tslot\tlatency\tthroughput\n";
+    for (map<key, entry>::const_iterator i = _entries.begin(); i != _entries.end(); ++i) {
+        char latency[32] = "-", throughput[32] = "-";
+        if (i->second.latency >= 0)
+            snprintf(latency, sizeof(latency), "%.2f", i->second.latency);
+        if (i->second.throughput >= 0)
+            snprintf(throughput, sizeof(throughput), "%.2f", i->second.throughput);
+        file << i->first.device << '\t' << i->first.opcode << '\t' << i->first.slot << '\t'
+             << latency << '\t' << throughput << '\n';
+    }
+    file.close();
+    if (!file)
+        throw system_error(error_code(errno, system_category()), path);
+}
+
+void alu_timing_table::set(string const& device, alu_microbenchmark const& b, double cycles)
+{
+    key k = { device, alu::name(b.op()), b.slot_name() };
+    entry& e = _entries[k];
+    if (b.get_mode() == alu_microbenchmark::LATENCY)
+        e.latency = cycles;
+    else
+        e.throughput = cycles;
+}
+
+void alu_timing_table::clear(string const& device)
+{
+    for (map<key, entry>::iterator i = _entries.begin(); i != _entries.end(); )
+        if (i->first.device == device)
+            _entries.erase(i++);
+        else
+            ++i;
+}
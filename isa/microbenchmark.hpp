@@ -0,0 +1,137 @@
+#pragma once
+
+#include "evergreen_program.hpp"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/// This class generates a kernel which measures the latency or the
+/// throughput of an ALU instruction in a slot, in the way of timing.asm.
+///
+/// The kernel is meant for the timing host (samples/timing.cpp): a 1-D
+/// domain with one group, four GPRs and four double words of output per
+/// item. Two segments of \c length and 2 * \c length instruction groups are
+/// timed with TIME_LO, each in its own ALU clause, so that the cost of
+/// reading the counter and of the clause cancels out:
+///
+///     x: TIME_LO at the start of the first segment
+///     y: cycles of the first segment
+///     z: cycles of the second segment
+///     w: length
+///
+/// In latency mode each instruction reads the result of the previous one,
+/// in throughput mode every instruction reads the same constant operands.
+/// Double precision instructions take a pair of slots (xy or zw) and
+/// reductions the four vector slots. An instruction is put in the trans
+/// slot by a MOV which takes its vector slot.
+class alu_microbenchmark {
+public:
+    /// Enumeration of the measurements.
+    typedef enum {
+        LATENCY,        ///< Dependent chain.
+        THROUGHPUT      ///< Independent instructions.
+    } mode;
+
+    /// Slot of trans instructions.
+    static const unsigned trans_slot = 4;
+
+    /// This constructor describes a benchmark.
+    /// It throws std::runtime_error if the instruction cannot be measured in
+    /// the slot.
+    /// \param op The opcode.
+    /// \param slot The slot: 0 to 3 for x, y, z and w, 4 for t, the first
+    /// slot of the pair for double precision, 0 for reductions.
+    /// \param m The measurement.
+    /// \param length Instruction groups in the first segment.
+    alu_microbenchmark(unsigned op, unsigned slot, mode m, unsigned length = 8);
+
+    /// Get the opcodes which can be measured: those without side effects on
+    /// the predicate, the execute mask, the LDS or the state of the wavefront.
+    static std::vector<unsigned> opcodes();
+    /// Get the slots in which an opcode can be measured.
+    static std::vector<unsigned> slots(unsigned op);
+    /// Get every benchmark of the given opcodes (every opcode if empty), in
+    /// both modes.
+    static std::vector<alu_microbenchmark> all(std::vector<unsigned> const& ops, unsigned length = 8);
+    /// Find an opcode by mnemonic (case is ignored).
+    /// It throws std::runtime_error if there is none.
+    static unsigned find(std::string const& name);
+
+    unsigned op() const { return _op; }
+    unsigned slot() const { return _slot; }
+    mode get_mode() const { return _mode; }
+    unsigned length() const { return _length; }
+
+    /// Get the name of the slot: x, y, z, w, t, xy, zw or xyzw.
+    std::string slot_name() const;
+    /// Get the name of the benchmark, opcode-slot-mode in lower case
+    /// ("fma_64-xy-latency"), which is also the shader suffix of the host.
+    std::string name() const;
+
+    /// Make the kernel.
+    /// It throws std::runtime_error if the segments do not fit in a clause.
+    evergreen_program program() const;
+
+    /// Get the cycles per instruction group from the output of the kernel:
+    /// the difference between the segments over their difference in length.
+    /// It throws std::runtime_error if the output is too short or makes no
+    /// sense (a segment taking no time).
+    double cycles(std::vector<std::uint32_t> const& output) const;
+
+private:
+    unsigned _op;
+    unsigned _slot;
+    mode _mode;
+    unsigned _length;
+};
+
+/// This class holds the latency and throughput of ALU instructions per
+/// device family, as measured by alu_microbenchmark.
+///
+/// The table is kept in a tab separated text file with a header line and one
+/// line per device, opcode and slot:
+///
+///     device  opcode  slot  latency  throughput
+///
+/// Cycles are per instruction group; a measurement which was not taken is
+/// written as "-".
+class alu_timing_table {
+public:
+    /// This structure holds the measurements of an instruction in a slot.
+    struct entry {
+        double latency;     ///< Cycles, or a negative value if unknown.
+        double throughput;  ///< Cycles, or a negative value if unknown.
+
+        entry() : latency(-1), throughput(-1) {}
+    };
+
+    /// This structure identifies a row: device, opcode mnemonic and slot name.
+    struct key {
+        std::string device;
+        std::string opcode;
+        std::string slot;
+
+        bool operator < (key const& k) const;
+    };
+
+    /// Read a table from a file. A missing file gives an empty table.
+    /// It may throw a std::system_error exception if the file cannot be read
+    /// or std::runtime_error if it is malformed.
+    static alu_timing_table read(const char* path);
+    /// Write the table to a file.
+    /// It may throw a std::system_error exception if the file cannot be written.
+    void write(const char* path) const;
+
+    /// Record a measurement.
+    void set(std::string const& device, alu_microbenchmark const& b, double cycles);
+    /// Remove the rows of a device.
+    void clear(std::string const& device);
+
+    /// Access the rows.
+    std::map<key, entry> const& entries() const { return _entries; }
+
+private:
+    std::map<key, entry> _entries;
+};
@@ -0,0 +1,256 @@
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "evergreen_emulator.hpp"
+#include "evergreen_program.hpp"
+#include "performance_model.hpp"
+#include "sample_host.hpp"
+#include "scheduling_trace.hpp"
+
+using namespace std;
+
+namespace {
+
+/// The parameters of a profile which can be set on the command line.
+struct parameter {
+    const char* name;
+    unsigned device_profile::* field;
+};
+
+const parameter parameters[] = {
+    { "wave_slots",             &device_profile::wave_slots },
+    { "max_waves",              &device_profile::max_waves },
+    { "alu_group_cycles",       &device_profile::alu_group_cycles },
+    { "alu_waves",              &device_profile::alu_waves },
+    { "cf_cycles",              &device_profile::cf_cycles },
+    { "clause_switch_cycles",   &device_profile::clause_switch_cycles },
+    { "fetch_cycles",           &device_profile::fetch_cycles },
+    { "fetch_latency",          &device_profile::fetch_latency },
+    { "export_latency",         &device_profile::export_latency },
+    { "group_launch_cycles",    &device_profile::group_launch_cycles },
+    { "wave_launch_cycles",     &device_profile::wave_launch_cycles }
+};
+
+void set_parameter(device_profile& device, string const& setting)
+{
+    string::size_type eq = setting.find('=');
+    string name = setting.substr(0, eq);
+    if (eq != string::npos)
+        for (size_t i = 0; i < sizeof(parameters) / sizeof(parameters[0]); ++i)
+            if (name == parameters[i].name) {
+                device.*parameters[i].field = atoi(setting.c_str() + eq + 1);
+                return;
+            }
+    throw runtime_error("unknown device parameter " + setting);
+}
+
+/// Read the TIME_LO timestamps recorded by the scheduling sample, one per
+/// wavefront in the order of the wavefront ids.
+vector<uint64_t> read_timestamps(const char* path)
+{
+    scheduling_trace trace = scheduling_trace::read(path);
+    vector<uint64_t> timestamps;
+    for (size_t i = 0; i < trace.records().size(); ++i)
+        timestamps.push_back(trace.records()[i].time);
+    return timestamps;
+}
+
+/// Compare the estimated timestamps with the recorded ones, both relative
+/// to the earliest.
+/// \returns The mean absolute error in cycles.
+double timestamp_error(performance_estimate const& e, vector<uint64_t> const& recorded, double* max_error = 0)
+{
+    size_t n = min(e.timestamps.size(), recorded.size());
+    uint64_t first = ~uint64_t(0);
+    for (size_t i = 0; i < n; ++i)
+        first = min(first, e.timestamps[i]);
+    double sum = 0, worst = 0;
+    for (size_t i = 0; i < n; ++i) {
+        double error = fabs(double(e.timestamps[i] - first) - double(recorded[i]));
+        sum += error;
+        worst = max(worst, error);
+    }
+    if (max_error)
+        *max_error = worst;
+    return n ? sum / n : 0;
+}
+
+/// Fit the launch and export parameters of a profile to recorded timestamps:
+/// for each limit of resident wavefronts, by coordinate descent over the
+/// other parameters.
+device_profile calibrate(evergreen_program const& program, device_profile const& device,
+                         vector<wavefront_trace> const& traces, vector<uint64_t> const& recorded)
+{
+    struct range {
+        unsigned device_profile::* field;
+        unsigned low, high, step;
+    } ranges[] = {
+        { &device_profile::group_launch_cycles, 0, 64, 1 },
+        { &device_profile::wave_launch_cycles, 0, 16, 1 },
+        { &device_profile::export_latency, 0, 512, 4 }
+    };
+
+    device_profile fitted = device;
+    double fitted_error = timestamp_error(performance_model(program, device).estimate(traces), recorded);
+    for (unsigned max_waves = 8; max_waves <= 256; max_waves += 8) {
+        device_profile current = device;
+        current.max_waves = max_waves;
+        double best;
+        try {
+            best = timestamp_error(performance_model(program, current).estimate(traces), recorded);
+        }
+        catch (runtime_error&) {
+            continue;
+        }
+        for (bool improved = true; improved; ) {
+            improved = false;
+            for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); ++r) {
+                device_profile trial = current;
+                for (unsigned v = ranges[r].low; v <= ranges[r].high; v += ranges[r].step) {
+                    trial.*ranges[r].field = v;
+                    double error = timestamp_error(performance_model(program, trial).estimate(traces), recorded);
+                    if (error < best) {
+                        best = error;
+                        current = trial;
+                        improved = true;
+                    }
+                }
+            }
+        }
+        if (best < fitted_error) {
+            fitted_error = best;
+            fitted = current;
+        }
+    }
+    return fitted;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int x = 1, y = 1, z = 1;
+    int X = 1, Y = 1, Z = 1;
+    unsigned threads = 0;
+    const char* preset_name = 0;
+    const char* recorded_path = 0;
+    bool fit = false;
+    string device_name = "redwood";
+    vector<string> settings;
+
+    for (int opt = 0; (opt = getopt(argc, argv, "x:y:z:X:Y:Z:p:t:d:s:e:c")) != -1; )
+        switch (opt) {
+            case 'x': x = atoi(optarg); break;
+            case 'y': y = atoi(optarg); break;
+            case 'z': z = atoi(optarg); break;
+            case 'X': X = atoi(optarg); break;
+            case 'Y': Y = atoi(optarg); break;
+            case 'Z': Z = atoi(optarg); break;
+            case 'p': preset_name = optarg; break;
+            case 't': threads = atoi(optarg); break;
+            case 'd': device_name = optarg; break;
+            case 's': settings.push_back(optarg); break;
+            case 'e': recorded_path = optarg; break;
+            case 'c': fit = true; break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    if (optind != argc - 1 || (fit && !recorded_path)) {
+        cerr << "Usage: " << argv[0] << " [-x<n>] [-y<n>] [-z<n>] [-X<n>] [-Y<n>] [-Z<n>] [-p<preset>] [-t<n>]\n"
+            "\t[-d<device>] [-s<parameter>=<n>]... [-e<scheduling.out> [-c]] kernel.bin\n\n"
+            "\t-x <n>\tnumber of items per group in X (1)\n"
+            "\t-y <n>\tnumber of items per group in Y (1)\n"
+            "\t-z <n>\tnumber of items per group in Z (1)\n"
+            "\t-X <n>\tnumber of groups in X (1)\n"
+            "\t-Y <n>\tnumber of groups in Y (1)\n"
+            "\t-Z <n>\tnumber of groups in Z (1)\n"
+            "\t-p <s>\tsample host: integer, timing, scheduling, vector or lds (from the kernel name)\n"
+            "\t-t <n>\thost threads of the emulator (one per processor)\n"
+            "\t-d <s>\tdevice family:";
+        for (size_t i = 0; i < device_profile::profiles().size(); ++i)
+            cerr << ' ' << device_profile::profiles()[i].name;
+        cerr << " (redwood)\n"
+            "\t-s <p>=<n>\tset a parameter of the device profile\n"
+            "\t-e <f>\tcompare with the TIME_LO timestamps recorded by the scheduling sample\n"
+            "\t-c\tfit the launch and export parameters to the recorded timestamps\n" << endl;
+        return EXIT_FAILURE;
+    }
+    const char* path = argv[optind];
+
+    try {
+        if (x < 1 || y < 1 || z < 1 || X < 1 || Y < 1 || Z < 1)
+            throw runtime_error("domain size error");
+
+        device_profile device = device_profile::find(device_name);
+        for (size_t i = 0; i < settings.size(); ++i)
+            set_parameter(device, settings[i]);
+
+        int size[] = { x, y, z }, groups[] = { X, Y, Z };
+        sample_host host(sample_host::find(preset_name ? preset_name : path), size, groups, 0);
+
+        evergreen_program program = evergreen_program::read(path);
+        evergreen_emulator emulator(program, threads);
+        emulator.set_tracing(true);
+        emulator.run(host.get_dispatch());
+
+        vector<uint64_t> recorded;
+        if (recorded_path)
+            recorded = read_timestamps(recorded_path);
+        if (fit) {
+            device = calibrate(program, device, emulator.traces(), recorded);
+            cout << "Fitted";
+            for (size_t i = 0; i < sizeof(parameters) / sizeof(parameters[0]); ++i)
+                cout << " -s" << parameters[i].name << '=' << device.*parameters[i].field;
+            cout << endl;
+        }
+
+        performance_model model(program, device);
+        performance_estimate e = model.estimate(emulator.traces());
+
+        cout
+            << "Device " << device.name << ": " << device.simds << " SIMDs " << device.clock_mhz << " MHz\n"
+            << "Estimated " << e.cycles << " cycles " << e.microseconds << " us\n"
+            << "ALU busy " << e.alu_cycles << " cycles, " << (e.alu_utilization * 100) << "% of the SIMDs\n"
+            << "Memory " << e.bytes << " bytes, " << e.bandwidth << " GB/s\n"
+            << "Stalls (wavefront cycles):"
+            << " launch " << e.launch_stalls
+            << " ALU " << e.alu_stalls
+            << " fetch unit " << e.fetch_stalls
+            << " memory " << e.memory_stalls
+            << " fetch latency " << e.latency_stalls
+            << " clause switch " << e.switch_stalls
+            << " barrier " << e.barrier_stalls
+            << endl;
+
+        if (recorded_path) {
+            if (recorded.size() != e.timestamps.size())
+                cerr << "Recorded " << recorded.size() << " timestamps for " << e.timestamps.size() << " wavefronts" << endl;
+            double worst;
+            double mean = timestamp_error(e, recorded, &worst);
+            cout << "TIME_LO error: mean " << mean << " max " << worst << " cycles" << endl;
+        }
+        return EXIT_SUCCESS;
+    }
+    catch (system_error& e) {
+        cerr
+            << e.what()
+            << " : "
+            << e.code().message()
+            << endl;
+        return EXIT_FAILURE;
+    }
+    catch (runtime_error& e) {
+        cerr << path << " : " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,186 @@
+#include "output_verifier.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VERIFIER_AVX2 1
+#endif
+
+using namespace std;
+
+namespace {
+
+/// The tolerance is capped so that the distance between any two floats which
+/// are not NaN, taken modulo 2^32, never falls within it.
+const uint32_t max_tolerance = 1u << 22;
+
+bool is_nan(uint32_t u)
+{
+    return (u & 0x7fffffff) > 0x7f800000;
+}
+
+/// Map the bits of a float to an integer in the order of the floats.
+int64_t ordered(uint32_t u)
+{
+    return u & 0x80000000 ? -int64_t(u & 0x7fffffff) : int64_t(u);
+}
+
+#ifdef VERIFIER_AVX2
+
+__attribute__((target("avx2")))
+inline __m256i ordered(__m256i u)
+{
+    // INT_MIN - u is the negated magnitude for a negative float.
+    __m256i negated = _mm256_sub_epi32(_mm256_set1_epi32(INT_MIN), u);
+    return _mm256_blendv_epi8(u, negated, _mm256_srai_epi32(u, 31));
+}
+
+/// Compare eight floats at a time until a group has a mismatch.
+/// \return The number of leading floats which matched, a multiple of 8.
+__attribute__((target("avx2")))
+size_t match_avx2(uint32_t const* values, uint32_t const* expected, size_t n, uint32_t tolerance, uint32_t& max_distance)
+{
+    const __m256i magnitude = _mm256_set1_epi32(0x7fffffff), infinity = _mm256_set1_epi32(0x7f800000);
+    const __m256i tol = _mm256_set1_epi32(tolerance);
+    // Unsigned x <= 2 * tol as signed (x ^ INT_MIN) <= (2 * tol ^ INT_MIN).
+    const __m256i bias = _mm256_set1_epi32(INT_MIN);
+    const __m256i range = _mm256_xor_si256(_mm256_set1_epi32(2 * tolerance), bias);
+    __m256i max = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(values + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(expected + i));
+        __m256i nan_a = _mm256_cmpgt_epi32(_mm256_and_si256(a, magnitude), infinity);
+        __m256i nan_b = _mm256_cmpgt_epi32(_mm256_and_si256(b, magnitude), infinity);
+        __m256i diff = _mm256_sub_epi32(ordered(a), ordered(b));
+        __m256i far = _mm256_cmpgt_epi32(_mm256_xor_si256(_mm256_add_epi32(diff, tol), bias), range);
+        // Both NaN match, a single NaN does not, others match when near.
+        __m256i bad = _mm256_or_si256(_mm256_andnot_si256(_mm256_or_si256(nan_a, nan_b), far),
+                                      _mm256_xor_si256(nan_a, nan_b));
+        if (!_mm256_testz_si256(bad, bad))
+            break;
+        __m256i distance = _mm256_andnot_si256(_mm256_or_si256(nan_a, nan_b), _mm256_abs_epi32(diff));
+        max = _mm256_max_epu32(max, distance);
+    }
+
+    __m128i m = _mm_max_epu32(_mm256_castsi256_si128(max), _mm256_extracti128_si256(max, 1));
+    m = _mm_max_epu32(m, _mm_shuffle_epi32(m, 0x4e));
+    m = _mm_max_epu32(m, _mm_shuffle_epi32(m, 0xb1));
+    max_distance = std::max(max_distance, uint32_t(_mm_cvtsi128_si32(m)));
+    return i;
+}
+
+/// Check eight values at a time until a group differs from the guard.
+/// \return The number of leading values which matched, a multiple of 8.
+__attribute__((target("avx2")))
+size_t guard_avx2(uint32_t const* values, size_t n, uint32_t guard)
+{
+    const __m256i g = _mm256_set1_epi32(guard);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(values + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, g)) != -1)
+            break;
+    }
+    return i;
+}
+
+bool avx2_supported()
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+#else
+
+bool avx2_supported()
+{
+    return false;
+}
+
+#endif
+
+}
+
+output_verifier::output_verifier(uint32_t max_ulps, size_t reported, bool simd)
+    : _tolerance(std::min(max_ulps, max_tolerance)), _reported(reported),
+      _simd(simd && avx2_supported()),
+      _compared(0), _mismatches(0), _guard_errors(0), _max_ulps(0)
+{
+}
+
+uint64_t output_verifier::ulps(uint32_t a, uint32_t b)
+{
+    if (is_nan(a) || is_nan(b))
+        return is_nan(a) && is_nan(b) ? 0 : ~uint64_t(0);
+    int64_t d = ordered(a) - ordered(b);
+    return d < 0 ? -d : d;
+}
+
+void output_verifier::compare(float const* values, float const* expected, size_t n)
+{
+    uint32_t const* a = reinterpret_cast<uint32_t const*>(values);
+    uint32_t const* b = reinterpret_cast<uint32_t const*>(expected);
+    size_t i = 0;
+    while (i < n) {
+#ifdef VERIFIER_AVX2
+        if (_simd) {
+            uint32_t distance = 0;
+            i += match_avx2(a + i, b + i, n - i, _tolerance, distance);
+            _max_ulps = std::max<uint64_t>(_max_ulps, distance);
+        }
+#endif
+        size_t k = std::min<size_t>(n - i, _simd ? 8 : n - i);
+        compare_scalar(a + i, b + i, k, _compared + i);
+        i += k;
+    }
+    _compared += n;
+}
+
+void output_verifier::check_guard(uint32_t const* values, size_t n, uint32_t guard)
+{
+    size_t i = 0;
+    while (i < n) {
+#ifdef VERIFIER_AVX2
+        if (_simd)
+            i += guard_avx2(values + i, n - i, guard);
+#endif
+        size_t k = std::min<size_t>(n - i, _simd ? 8 : n - i);
+        check_scalar(values + i, k, guard, _compared + i);
+        i += k;
+    }
+    _compared += n;
+}
+
+void output_verifier::record(size_t index, uint32_t value, uint32_t expected, uint64_t distance)
+{
+    if (_first.size() < _reported) {
+        mismatch m = { index, value, expected, distance };
+        _first.push_back(m);
+    }
+}
+
+void output_verifier::compare_scalar(uint32_t const* values, uint32_t const* expected, size_t n, size_t index)
+{
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t d = ulps(values[i], expected[i]);
+        if (d != ~uint64_t(0))
+            _max_ulps = std::max(_max_ulps, d);
+        if (d > _tolerance) {
+            ++_mismatches;
+            record(index + i, values[i], expected[i], d);
+        }
+    }
+}
+
+void output_verifier::check_scalar(uint32_t const* values, size_t n, uint32_t guard, size_t index)
+{
+    for (size_t i = 0; i < n; ++i)
+        if (values[i] != guard) {
+            ++_guard_errors;
+            record(index + i, values[i], guard, ulps(values[i], guard));
+        }
+}
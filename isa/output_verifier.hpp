@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// This class compares an output buffer of floats with a reference, in
+/// blocks as the buffer is read, and checks the guard after it.
+///
+/// Two floats match if they are within the tolerance in units in the last
+/// place (their distance as ordered integers, so that +0 and -0 are 0 apart
+/// and the smallest denormals of both signs 2 apart), or if both are NaN.
+/// The comparison runs with AVX2 where the CPU supports it, eight floats per
+/// instruction; only the blocks with a mismatch are looked at again one
+/// float at a time, to record it.
+class output_verifier {
+public:
+    /// This structure describes a value which does not match.
+    struct mismatch {
+        std::size_t index;      ///< Index in the buffer.
+        std::uint32_t value;    ///< The value, as bits.
+        std::uint32_t expected; ///< The reference (or guard), as bits.
+        std::uint64_t ulps;     ///< The distance, or ~0 if one is NaN.
+    };
+
+    /// This constructor sets the tolerance.
+    /// \param max_ulps Largest distance of a match.
+    /// \param reported Mismatches recorded (the first ones), others are
+    /// only counted.
+    /// \param simd Use AVX2 if the CPU supports it.
+    explicit output_verifier(std::uint32_t max_ulps = 4, std::size_t reported = 8, bool simd = true);
+
+    /// Compare the next block of the buffer with the reference.
+    /// \param values The block.
+    /// \param expected The reference of the block.
+    /// \param n The size of the block in floats.
+    void compare(float const* values, float const* expected, std::size_t n);
+    /// Check the next block of the guard, every value of which should be
+    /// guard.
+    void check_guard(std::uint32_t const* values, std::size_t n, std::uint32_t guard);
+
+    /// Get the distance in units in the last place between two floats, ~0 if
+    /// only one is NaN.
+    static std::uint64_t ulps(std::uint32_t a, std::uint32_t b);
+
+    /// Floats compared so far, guard included.
+    std::size_t compared() const { return _compared; }
+    /// Values which do not match the reference.
+    std::size_t mismatches() const { return _mismatches; }
+    /// Values of the guard which were overwritten.
+    std::size_t guard_errors() const { return _guard_errors; }
+    /// Largest distance between a value and its reference, among the values
+    /// which are not NaN.
+    std::uint64_t max_ulps() const { return _max_ulps; }
+    /// The first mismatches, guard errors included, in buffer order.
+    std::vector<mismatch> const& first() const { return _first; }
+    /// Determine whether everything matched so far.
+    bool passed() const { return _mismatches == 0 && _guard_errors == 0; }
+
+private:
+    void record(std::size_t index, std::uint32_t value, std::uint32_t expected, std::uint64_t distance);
+    void compare_scalar(std::uint32_t const* values, std::uint32_t const* expected, std::size_t n, std::size_t index);
+    void check_scalar(std::uint32_t const* values, std::size_t n, std::uint32_t guard, std::size_t index);
+
+    std::uint32_t _tolerance;
+    std::size_t _reported;
+    bool _simd;
+    std::size_t _compared;
+    std::size_t _mismatches;
+    std::size_t _guard_errors;
+    std::uint64_t _max_ulps;
+    std::vector<mismatch> _first;
+};
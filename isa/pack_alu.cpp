@@ -0,0 +1,79 @@
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+
+#include "evergreen_program.hpp"
+#include "alu_packer.hpp"
+
+namespace {
+
+void print(const char* label, alu_utilization const& u)
+{
+    std::cout
+        << label
+        << " groups " << u.groups
+        << " instructions " << u.instructions
+        << " literals " << u.literals
+        << " size " << u.size
+        << " utilization " << std::fixed << std::setprecision(1) << 100 * u.ratio() << "%"
+        << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2 && argc != 3)
+    {
+        std::cerr
+            << "Usage " << argv[0]
+            << " kernel.bin [packed.bin]"
+            << std::endl;
+        return 1;
+    }
+
+    try {
+        evergreen_program program = evergreen_program::read(argv[1]);
+        alu_packer packer;
+
+        for (std::size_t i = 0; i < program.size(); ++i) {
+            if (!program[i].cf.is_alu())
+                continue;
+            alu_utilization before, after;
+            before.add(program[i].alu);
+            packer.pack(program[i].alu);
+            after.add(program[i].alu);
+            std::cout
+                << "CF " << i << ": " << program[i].cf.name()
+                << " groups " << before.groups << " -> " << after.groups
+                << " utilization "
+                << std::fixed << std::setprecision(1)
+                << 100 * before.ratio() << "% -> "
+                << 100 * after.ratio() << "%"
+                << std::endl;
+        }
+
+        print("Before:", packer.before());
+        print("After: ", packer.after());
+        std::cout
+            << "Packed " << packer.packed() << " of " << packer.regions() << " regions"
+            << std::endl;
+
+        if (argc == 3)
+            program.write(argv[2]);
+        return 0;
+    }
+    catch (std::system_error& e) {
+        std::cerr
+            << e.what()
+            << " : "
+            << e.code().message()
+            << std::endl;
+        return 1;
+    }
+    catch (std::runtime_error& e) {
+        std::cerr << argv[1] << " : " << e.what() << std::endl;
+        return 1;
+    }
+}
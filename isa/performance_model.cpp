@@ -0,0 +1,254 @@
+#include "performance_model.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+const uint64_t never = ~uint64_t(0);
+
+/// Make a profile; the timing of the SIMDs is the same across the family.
+/// The latencies were fitted with model_kernel -c to the scheduling outputs
+/// recorded on a Redwood device (mean TIME_LO error within 25 cycles).
+device_profile profile(const char* name, unsigned simds, unsigned max_waves, double clock_mhz, double bandwidth_gbs)
+{
+    device_profile d;
+    d.name = name;
+    d.simds = simds;
+    d.wave_slots = 32;
+    d.max_waves = max_waves;
+    d.alu_group_cycles = 4;
+    d.alu_waves = 2;
+    d.cf_cycles = 4;
+    d.clause_switch_cycles = 40;
+    d.fetch_cycles = 4;
+    d.fetch_latency = 400;
+    d.export_latency = 60;
+    d.group_launch_cycles = 0;
+    d.wave_launch_cycles = 1;
+    d.clock_mhz = clock_mhz;
+    d.memory_bytes_per_cycle = bandwidth_gbs * 1e3 / clock_mhz;
+    return d;
+}
+
+/// This structure holds the state of a wavefront in the model.
+struct wave_state {
+    size_t next;            ///< Next event of the trace.
+    unsigned simd;
+    uint64_t retire;        ///< Earliest end, after its writes.
+    bool done;
+};
+
+typedef pair<uint64_t, unsigned> event;
+
+/// This structure holds the state of a work group in the model.
+struct group_state {
+    unsigned live;          ///< Wavefronts which have not ended.
+    vector<event> waiting;  ///< Arrivals at the barrier.
+    uint64_t release;       ///< Latest arrival at the barrier.
+};
+
+}
+
+vector<device_profile> const& device_profile::profiles()
+{
+    static vector<device_profile> known;
+    if (known.empty()) {
+        known.push_back(profile("cedar", 2, 24, 650, 12.8));
+        known.push_back(profile("redwood", 5, 64, 775, 64.0));
+        known.push_back(profile("juniper", 10, 128, 850, 76.8));
+        known.push_back(profile("cypress", 20, 256, 850, 153.6));
+        known.push_back(profile("palm", 2, 24, 492, 8.5));
+        known.push_back(profile("sumo", 5, 64, 600, 29.9));
+    }
+    return known;
+}
+
+device_profile const& device_profile::find(string const& name)
+{
+    vector<device_profile> const& known = profiles();
+    for (size_t i = 0; i < known.size(); ++i)
+        if (known[i].name == name)
+            return known[i];
+    throw runtime_error("unknown device " + name);
+}
+
+performance_model::performance_model(evergreen_program const& program, device_profile const& device)
+    : _program(program), _device(device), _time_reads(program.size(), ~0u)
+{
+    if (device.simds == 0 || device.alu_waves == 0 || device.max_waves == 0 || device.wave_slots == 0)
+        throw runtime_error("invalid device profile " + device.name);
+    for (size_t i = 0; i < program.size(); ++i) {
+        vector<alu_group> const& clause = program[i].alu;
+        for (size_t g = 0; g < clause.size() && _time_reads[i] == ~0u; ++g)
+            for (size_t s = 0; s < clause[g].slots.size(); ++s)
+                if (clause[g].slots[s].reads(alu_instruction::ALU_SRC_TIME_LO))
+                    _time_reads[i] = g;
+    }
+}
+
+performance_estimate performance_model::estimate(vector<wavefront_trace> const& traces) const
+{
+    device_profile const& d = _device;
+    performance_estimate r;
+    unsigned waves = 0;
+    for (size_t i = 0; i < traces.size(); ++i)
+        waves = max(waves, traces[i].id_in_group + 1);
+    if (waves == 0)
+        return r;
+    unsigned groups = traces.size() / waves;
+    if (waves > d.max_waves || waves > d.wave_slots)
+        throw runtime_error("a work group does not fit in " + d.name);
+
+    vector<wave_state> wave(traces.size());
+    vector<group_state> group(groups);
+    vector<unsigned> resident(d.simds);
+    vector<uint64_t> alu_free(d.simds * d.alu_waves);
+    vector<uint64_t> fetch_free(d.simds);
+    vector<uint64_t> alu_busy(d.simds);
+    unsigned resident_total = 0;
+    unsigned pending = 0;
+    uint64_t dispatcher = 0;
+    double memory_free = 0;
+    uint64_t end = 0;
+    unsigned period = d.alu_waves * d.alu_group_cycles;
+
+    r.timestamps.assign(traces.size(), never);
+    r.simd.assign(traces.size(), 0);
+
+    // Events are (time, wavefront id), the earliest first; the retirement of
+    // a wavefront is an event too, once its trace is over.
+    priority_queue<event, vector<event>, greater<event> > queue;
+
+    auto launch = [&](uint64_t now) {
+        for (; pending < groups; ++pending) {
+            unsigned simd = pending % d.simds;
+            if (resident_total + waves > d.max_waves || resident[simd] + waves > d.wave_slots)
+                break;
+            uint64_t start = max(dispatcher, now);
+            if (pending != 0)
+                r.launch_stalls += (start - dispatcher) * waves;
+            resident_total += waves;
+            resident[simd] += waves;
+            group[pending].live = waves;
+            group[pending].release = 0;
+            for (unsigned i = 0; i < waves; ++i) {
+                unsigned id = pending * waves + i;
+                wave[id].next = 0;
+                wave[id].simd = simd;
+                wave[id].retire = 0;
+                wave[id].done = false;
+                r.simd[id] = simd;
+                queue.push(event(start + i * d.wave_launch_cycles, id));
+            }
+            dispatcher = start + d.group_launch_cycles + waves * d.wave_launch_cycles;
+        }
+    };
+
+    // Release the wavefronts of a group at a barrier once all of them are there.
+    auto release = [&](group_state& g) {
+        if (g.live == 0 || g.waiting.size() != g.live)
+            return;
+        for (size_t i = 0; i < g.waiting.size(); ++i) {
+            r.barrier_stalls += g.release - g.waiting[i].first;
+            queue.push(event(g.release, g.waiting[i].second));
+        }
+        g.waiting.clear();
+        g.release = 0;
+    };
+
+    launch(0);
+    while (!queue.empty()) {
+        uint64_t now = queue.top().first;
+        unsigned id = queue.top().second;
+        queue.pop();
+        wave_state& w = wave[id];
+        wavefront_trace const& trace = traces[id];
+        group_state& g = group[id / waves];
+
+        if (w.done) {
+            // Retirement.
+            --resident[w.simd];
+            --resident_total;
+            end = max(end, now);
+            launch(now);
+            continue;
+        }
+        if (w.next == trace.events.size()) {
+            w.done = true;
+            --g.live;
+            release(g);
+            queue.push(event(max(now, w.retire), id));
+            continue;
+        }
+
+        wavefront_event const& e = trace.events[w.next++];
+        cf_node const& node = _program[e.cf];
+        uint64_t next;
+
+        if (node.cf.is_alu()) {
+            uint64_t& slot = alu_free[w.simd * d.alu_waves + trace.id_in_group % d.alu_waves];
+            uint64_t start = max(now, slot);
+            // The slots of a SIMD take turns every ALU_GROUP_CYCLES.
+            uint64_t phase = trace.id_in_group % d.alu_waves * d.alu_group_cycles;
+            start += (phase + period - start % period) % period;
+            r.alu_stalls += start - now;
+            uint64_t finish = start + uint64_t(e.groups) * period;
+            slot = finish;
+            alu_busy[w.simd] += uint64_t(e.groups) * d.alu_group_cycles;
+
+            unsigned t = _time_reads[e.cf];
+            if (r.timestamps[id] == never && t != ~0u && t >= e.first && t < e.first + e.groups)
+                r.timestamps[id] = start + (t - e.first) * period;
+
+            if (e.barrier) {
+                g.waiting.push_back(event(finish, id));
+                g.release = max(g.release, finish);
+                release(g);
+                continue;
+            }
+            next = finish + d.clause_switch_cycles;
+            r.switch_stalls += d.clause_switch_cycles;
+        }
+        else if (node.cf.is_fetch()) {
+            uint64_t start = max(now, fetch_free[w.simd]);
+            r.fetch_stalls += start - now;
+            uint64_t issue = start + node.fetch.size() * d.fetch_cycles;
+            fetch_free[w.simd] = issue;
+            double memory_start = max(double(start), memory_free);
+            r.memory_stalls += uint64_t(memory_start - start);
+            memory_free = memory_start + e.bytes / d.memory_bytes_per_cycle;
+            uint64_t data = max(issue, uint64_t(memory_free)) + d.fetch_latency;
+            r.latency_stalls += data - issue;
+            next = data + d.clause_switch_cycles;
+            r.switch_stalls += d.clause_switch_cycles;
+            r.bytes += e.bytes;
+        }
+        else if (node.cf.is_export()) {
+            double memory_start = max(double(now), memory_free);
+            memory_free = memory_start + e.bytes / d.memory_bytes_per_cycle;
+            w.retire = max(w.retire, uint64_t(memory_free) + d.export_latency);
+            next = now + d.cf_cycles;
+            r.bytes += e.bytes;
+        }
+        else
+            next = now + d.cf_cycles;
+
+        queue.push(event(next, id));
+    }
+
+    r.cycles = max(end, uint64_t(memory_free));
+    for (unsigned s = 0; s < d.simds; ++s)
+        r.alu_cycles += alu_busy[s];
+    if (r.cycles) {
+        r.microseconds = r.cycles / d.clock_mhz;
+        r.alu_utilization = double(r.alu_cycles) / (double(r.cycles) * d.simds);
+        r.bandwidth = r.bytes / (r.microseconds * 1e3);
+    }
+    return r;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "evergreen_emulator.hpp"
+#include "evergreen_program.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// This structure describes the timing of a device family, in core clock
+/// cycles.
+struct device_profile {
+    std::string name;
+    unsigned simds;                 ///< SIMD engines.
+    unsigned wave_slots;            ///< Resident wavefronts per SIMD.
+    unsigned max_waves;             ///< Resident wavefronts in the device.
+    unsigned alu_group_cycles;      ///< Cycles of an instruction group on a SIMD (64 lanes over 16 units).
+    unsigned alu_waves;             ///< Wavefronts whose ALU clauses interleave on a SIMD.
+    unsigned cf_cycles;             ///< Cycles of a CF instruction without a clause.
+    unsigned clause_switch_cycles;  ///< Cycles between the end of a clause and the next CF instruction.
+    unsigned fetch_cycles;          ///< Issue cycles of a fetch instruction.
+    unsigned fetch_latency;         ///< Cycles until fetched data is available.
+    unsigned export_latency;        ///< Cycles until the writes of a wavefront are done.
+    unsigned group_launch_cycles;   ///< Cycles to launch a work group.
+    unsigned wave_launch_cycles;    ///< Cycles to launch each wavefront of a group.
+    double clock_mhz;               ///< Core clock.
+    double memory_bytes_per_cycle;  ///< Memory bandwidth per core clock cycle.
+
+    /// Get the known profiles.
+    static std::vector<device_profile> const& profiles();
+    /// Get a known profile by name.
+    /// It throws std::runtime_error if there is none.
+    static device_profile const& find(std::string const& name);
+};
+
+/// This structure holds the outcome of a performance estimate. Stalls are
+/// summed over the wavefronts, in wavefront cycles.
+struct performance_estimate {
+    std::uint64_t cycles;           ///< Estimated cycles from the launch of the first group to the end.
+    double microseconds;            ///< Estimated time.
+    std::uint64_t alu_cycles;       ///< Busy cycles of the ALU engines, summed over the SIMDs.
+    double alu_utilization;         ///< Fraction of the cycles of the SIMDs their ALU engines are busy.
+    std::uint64_t bytes;            ///< Bytes fetched and exported.
+    double bandwidth;               ///< Achieved bandwidth in GB/s.
+
+    std::uint64_t launch_stalls;    ///< Waiting for resident wavefront slots.
+    std::uint64_t alu_stalls;       ///< Waiting for the ALU engine.
+    std::uint64_t fetch_stalls;     ///< Waiting for the fetch unit.
+    std::uint64_t memory_stalls;    ///< Waiting for memory bandwidth.
+    std::uint64_t latency_stalls;   ///< Waiting for fetched data.
+    std::uint64_t switch_stalls;    ///< Clause switches.
+    std::uint64_t barrier_stalls;   ///< Waiting at GROUP_BARRIER.
+
+    /// The cycle at which each wavefront first reads TIME_LO, or ~0 if it
+    /// never does, by wavefront id.
+    std::vector<std::uint64_t> timestamps;
+    /// The SIMD of each wavefront, by wavefront id.
+    std::vector<unsigned> simd;
+
+    performance_estimate()
+        : cycles(), microseconds(), alu_cycles(), alu_utilization(), bytes(), bandwidth(),
+          launch_stalls(), alu_stalls(), fetch_stalls(), memory_stalls(), latency_stalls(),
+          switch_stalls(), barrier_stalls() {}
+};
+
+/// This class estimates the execution time of a kernel on a device.
+///
+/// The model is driven by the traces of the emulator, which tell which CF
+/// instructions every wavefront executes. Work groups are launched in order
+/// and round-robin over the SIMDs, as far as there are resident wavefront
+/// slots. On each SIMD the ALU clauses of odd and even wavefronts interleave,
+/// each clause keeping its ALU slot to its end, fetch clauses share one fetch
+/// unit, and fetches and exports share the memory bandwidth of the device.
+/// Wavefronts take their turns oldest first.
+///
+/// The default timing was calibrated with the TIME_LO timestamps of the
+/// scheduling sample recorded on a Redwood device (samples/outputs).
+class performance_model {
+public:
+    /// This constructor prepares the model of a program on a device.
+    performance_model(evergreen_program const& program, device_profile const& device);
+
+    /// Estimate the execution of a dispatch.
+    /// \param traces The traces of the wavefronts, by wavefront id, as
+    /// recorded by evergreen_emulator.
+    performance_estimate estimate(std::vector<wavefront_trace> const& traces) const;
+
+    /// Access the device profile.
+    device_profile const& device() const { return _device; }
+
+private:
+    evergreen_program const& _program;
+    device_profile _device;
+    /// The first instruction group of each ALU clause which reads TIME_LO,
+    /// or ~0 if none does.
+    std::vector<unsigned> _time_reads;
+};
@@ -0,0 +1,186 @@
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "clause_profiler.hpp"
+#include "evergreen_emulator.hpp"
+#include "evergreen_program.hpp"
+#include "kernel_analysis.hpp"
+#include "kernel_metadata.hpp"
+#include "sample_host.hpp"
+
+using namespace std;
+
+namespace {
+
+vector<unsigned> parse_points(string const& list)
+{
+    vector<unsigned> points;
+    istringstream in(list);
+    for (string item; getline(in, item, ','); )
+        points.push_back(atoi(item.c_str()));
+    return points;
+}
+
+vector<uint32_t> read_buffer(const char* path)
+{
+    ifstream file(path, ios::in | ios::binary);
+    if (!file)
+        throw system_error(error_code(errno, system_category()), path);
+    vector<char> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    if (file.bad())
+        throw system_error(error_code(errno, system_category()), path);
+    vector<uint32_t> buffer(bytes.size() / 4);
+    if (!buffer.empty())
+        copy(bytes.begin(), bytes.begin() + 4 * buffer.size(), reinterpret_cast<char*>(&buffer.front()));
+    return buffer;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int x = 1, y = 1, z = 1;
+    int X = 1, Y = 1, Z = 1;
+    unsigned threads = 0;
+    unsigned records = 64, overhead = 0;
+    const char* preset_name = 0;
+    const char* buffer_path = 0;
+    bool emulate = false;
+    clause_profiler::options options;
+    vector<unsigned> points;
+
+    for (int opt = 0; (opt = getopt(argc, argv, "x:y:z:X:Y:Z:p:t:P:r:c:g:n:o:b:e")) != -1; )
+        switch (opt) {
+            case 'x': x = atoi(optarg); break;
+            case 'y': y = atoi(optarg); break;
+            case 'z': z = atoi(optarg); break;
+            case 'X': X = atoi(optarg); break;
+            case 'Y': Y = atoi(optarg); break;
+            case 'Z': Z = atoi(optarg); break;
+            case 'p': preset_name = optarg; break;
+            case 't': threads = atoi(optarg); break;
+            case 'P': points = parse_points(optarg); break;
+            case 'r': options.rat = atoi(optarg); break;
+            case 'c': options.constant_buffer = atoi(optarg); break;
+            case 'g': options.gpr = atoi(optarg); break;
+            case 'n': records = atoi(optarg); break;
+            case 'o': overhead = atoi(optarg); break;
+            case 'b': buffer_path = optarg; break;
+            case 'e': emulate = true; break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    int args = argc - optind;
+    bool usage =
+        buffer_path ? emulate || args > 1 :
+        emulate ? args != 1 : args != 2;
+    if (usage) {
+        cerr << "Usage: " << argv[0] << " [-P<cf>,...] [-r<n>] [-c<n>] [-g<n>] kernel.bin instrumented.bin\n"
+            "       " << argv[0] << " -b<profile> [-n<n>] [-o<n>] [kernel.bin]\n"
+            "       " << argv[0] << " -e [-x<n>] [-y<n>] [-z<n>] [-X<n>] [-Y<n>] [-Z<n>] [-p<preset>] [-t<n>]\n"
+            "\t\t[-P<cf>,...] [-r<n>] [-c<n>] [-g<n>] [-n<n>] [-o<n>] kernel.bin\n\n"
+            "\tInstrument a kernel, decode the profiling buffer written by an instrumented\n"
+            "\tkernel, or run an instrumented kernel on the emulator and decode its buffer.\n\n"
+            "\t-P <l>\tCF indices to profile (every clause which can be)\n"
+            "\t-r <n>\tRAT id of the profiling buffer (1)\n"
+            "\t-c <n>\tconstant buffer id of the profiling layout (1)\n"
+            "\t-g <n>\tfirst of the two profiling GPRs (the first free one)\n"
+            "\t-n <n>\trecords per wavefront (64)\n"
+            "\t-o <n>\tcycles to subtract from every span (0)\n"
+            "\t-b <f>\tdecode a profiling buffer dumped as raw double words\n"
+            "\t-e\temulate with the buffers of a sample host\n"
+            "\t-x <n>\tnumber of items per group in X (1)\n"
+            "\t-y <n>\tnumber of items per group in Y (1)\n"
+            "\t-z <n>\tnumber of items per group in Z (1)\n"
+            "\t-X <n>\tnumber of groups in X (1)\n"
+            "\t-Y <n>\tnumber of groups in Y (1)\n"
+            "\t-Z <n>\tnumber of groups in Z (1)\n"
+            "\t-p <s>\tsample host: integer, timing, scheduling, vector or lds (from the kernel name)\n"
+            "\t-t <n>\thost threads of the emulator (one per processor)\n" << endl;
+        return EXIT_FAILURE;
+    }
+    const char* path = args ? argv[optind] : buffer_path;
+
+    try {
+        if (buffer_path) {
+            evergreen_program program;
+            if (args)
+                program = evergreen_program::read(argv[optind]);
+            clause_profile profile(read_buffer(buffer_path), records, overhead);
+            profile.write(cout, args ? &program : 0);
+            return EXIT_SUCCESS;
+        }
+
+        evergreen_program program = evergreen_program::read(path);
+        evergreen_program instrumented = program;
+        clause_profiler profiler(options);
+        profiler.instrument(instrumented, points);
+
+        cout << "Points";
+        for (size_t i = 0; i < profiler.points().size(); ++i)
+            cout << ' ' << profiler.points()[i];
+        cout << " using R" << profiler.gpr() << " and R" << profiler.gpr() + 1 << endl;
+
+        if (!emulate) {
+            // Start from the metadata of the kernel if there is any.
+            kernel_metadata meta;
+            string meta_path = kernel_metadata::path(path);
+            if (ifstream(meta_path.c_str()))
+                meta = kernel_metadata::read(meta_path.c_str());
+            else {
+                kernel_analysis analysis(program);
+                meta.num_gprs = analysis.num_gprs;
+                meta.temp_gprs = analysis.temp_gprs;
+                meta.stack_size = analysis.stack_entries;
+            }
+            meta.num_gprs = max(meta.num_gprs, profiler.gpr() + 2);
+            instrumented.write(argv[optind + 1]);
+            meta.write(kernel_metadata::path(argv[optind + 1]).c_str());
+            return EXIT_SUCCESS;
+        }
+
+        if (x < 1 || y < 1 || z < 1 || X < 1 || Y < 1 || Z < 1 || records == 0)
+            throw runtime_error("domain size error");
+        int size[] = { x, y, z }, groups[] = { X, Y, Z };
+        sample_host host(sample_host::find(preset_name ? preset_name : path), size, groups, 0);
+        dispatch d = host.get_dispatch();
+        if (d.rats.count(options.rat))
+            throw runtime_error("RAT " + to_string(options.rat) + " is used by the kernel");
+        if (d.constant_buffers.count(options.constant_buffer))
+            throw runtime_error("constant buffer " + to_string(options.constant_buffer) + " is used by the kernel");
+
+        vector<uint32_t> constants = clause_profiler::constants(d.group_size, d.groups, records);
+        vector<uint32_t> buffer(4 * size_t(records) * clause_profiler::wavefronts(d.group_size, d.groups), ~0u);
+        d.constant_buffers[options.constant_buffer] = &constants;
+        d.rats[options.rat] = &buffer;
+
+        evergreen_emulator emulator(instrumented, threads);
+        emulator.run(d);
+
+        clause_profile profile(buffer, records, overhead);
+        profile.write(cout, &program);
+        return EXIT_SUCCESS;
+    }
+    catch (system_error& e) {
+        cerr
+            << e.what()
+            << " : "
+            << e.code().message()
+            << endl;
+        return EXIT_FAILURE;
+    }
+    catch (runtime_error& e) {
+        cerr << path << " : " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+}
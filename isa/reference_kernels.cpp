@@ -0,0 +1,222 @@
+#include "reference_kernels.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REFERENCE_AVX2 1
+#endif
+
+using namespace std;
+
+namespace {
+
+/// The host counts in single precision, which stops at 2^24.
+const float input_limit = 16777216.0f;
+
+float dot4(float const* a, float const* b)
+{
+    return (a[0] * b[0] + a[1] * b[1]) + (a[2] * b[2] + a[3] * b[3]);
+}
+
+void input_scalar(float* in, size_t first, size_t n)
+{
+    float m = first < 16777216 ? float(first) : input_limit;
+    float s = first % 2 ? -1.0f : 1.0f;
+    for (size_t i = 0; i < n; ++i) {
+        in[i] = s * m;
+        m = m + 1;
+        s = -s;
+    }
+}
+
+void normalize_scalar(float const* in, float* out, size_t items)
+{
+    for (size_t i = 0; i < items; ++i, in += 4, out += 4) {
+        float r = 1.0f / sqrtf(dot4(in, in));
+        for (unsigned k = 0; k < 4; ++k)
+            out[k] = in[k] * r;
+    }
+}
+
+void normalize3d_scalar(float const* in, float* out, size_t items)
+{
+    for (size_t i = 0; i < items; ++i, in += 4, out += 4) {
+        float v[4] = { in[0], in[1], in[2], 1.0f }, u[4] = { in[0], in[1], in[2], in[0] };
+        float r = 1.0f / sqrtf(dot4(v, u));
+        for (unsigned k = 0; k < 3; ++k)
+            out[k] = in[k] * r;
+        out[3] = 1.0f;
+    }
+}
+
+void transform_scalar(float const* in, float* out, size_t items)
+{
+    for (size_t i = 0; i < items; ++i, in += 4, out += 4) {
+        float v[4] = { in[0], in[1], in[2], 1.0f };
+        for (unsigned k = 0; k < 4; ++k)
+            out[k] = dot4(v, vector_reference::matrix[k]);
+    }
+}
+
+#ifdef REFERENCE_AVX2
+
+// Two items per register, one in each 128-bit lane, so that the horizontal
+// additions sum each item as the scalar code does.
+
+__attribute__((target("avx2")))
+void input_avx2(float* in, size_t first, size_t n)
+{
+    size_t i = 0;
+    if (first < 16777216) {
+        const __m256 limit = _mm256_set1_ps(input_limit), step = _mm256_set1_ps(8.0f);
+        const __m256 sign = first % 2
+            ? _mm256_setr_ps(-0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f)
+            : _mm256_setr_ps(0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f);
+        __m256 m = _mm256_add_ps(_mm256_set1_ps(float(first)),
+                                 _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+        for (; i + 8 <= n && first + i < 16777216; i += 8) {
+            _mm256_storeu_ps(in + i, _mm256_xor_ps(_mm256_min_ps(m, limit), sign));
+            m = _mm256_add_ps(m, step);
+        }
+    }
+    input_scalar(in + i, first + i, n - i);
+}
+
+__attribute__((target("avx2")))
+inline __m256 inverse_length(__m256 squares)
+{
+    __m256 h = _mm256_hadd_ps(squares, squares);
+    h = _mm256_hadd_ps(h, h);
+    return _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(h));
+}
+
+__attribute__((target("avx2")))
+void normalize_avx2(float const* in, float* out, size_t items)
+{
+    size_t i = 0;
+    for (; i + 2 <= items; i += 2, in += 8, out += 8) {
+        __m256 v = _mm256_loadu_ps(in);
+        _mm256_storeu_ps(out, _mm256_mul_ps(v, inverse_length(_mm256_mul_ps(v, v))));
+    }
+    normalize_scalar(in, out, items - i);
+}
+
+__attribute__((target("avx2")))
+void normalize3d_avx2(float const* in, float* out, size_t items)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 2 <= items; i += 2, in += 8, out += 8) {
+        __m256 v = _mm256_blend_ps(_mm256_loadu_ps(in), one, 0x88);
+        __m256 u = _mm256_blend_ps(v, _mm256_permute_ps(v, 0x00), 0x88);
+        __m256 r = _mm256_mul_ps(v, inverse_length(_mm256_mul_ps(v, u)));
+        _mm256_storeu_ps(out, _mm256_blend_ps(r, one, 0x88));
+    }
+    normalize3d_scalar(in, out, items - i);
+}
+
+__attribute__((target("avx2")))
+void transform_avx2(float const* in, float* out, size_t items)
+{
+    __m256 row[4];
+    for (unsigned k = 0; k < 4; ++k)
+        row[k] = _mm256_broadcast_ps(reinterpret_cast<__m128 const*>(vector_reference::matrix[k]));
+    const __m256 one = _mm256_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 2 <= items; i += 2, in += 8, out += 8) {
+        __m256 v = _mm256_blend_ps(_mm256_loadu_ps(in), one, 0x88);
+        __m256 xy = _mm256_hadd_ps(_mm256_mul_ps(v, row[0]), _mm256_mul_ps(v, row[1]));
+        __m256 zw = _mm256_hadd_ps(_mm256_mul_ps(v, row[2]), _mm256_mul_ps(v, row[3]));
+        _mm256_storeu_ps(out, _mm256_hadd_ps(xy, zw));
+    }
+    transform_scalar(in, out, items - i);
+}
+
+#endif
+
+bool starts_with(string const& s, const char* prefix)
+{
+    return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+}
+
+alignas(16) const float vector_reference::matrix[4][4] = {
+    { 0, 0, -1, 0 },
+    { 1, 0, 0, 0 },
+    { 0, -1, 0, 0 },
+    { 0, 0, 0, 1 }
+};
+
+vector_reference::kernel vector_reference::find(string name)
+{
+    string::size_type slash = name.rfind('/');
+    if (slash != string::npos)
+        name.erase(0, slash + 1);
+
+    // The longest name first, vectornormalize is a prefix of vectornormalize3d.
+    if (starts_with(name, "vectornormalize3d"))
+        return NORMALIZE3D;
+    if (starts_with(name, "vectornormalize"))
+        return NORMALIZE;
+    if (starts_with(name, "vectortransform"))
+        return TRANSFORM;
+    throw runtime_error("no reference for " + name);
+}
+
+const char* vector_reference::name(kernel k)
+{
+    switch (k) {
+    case NORMALIZE: return "vectornormalize";
+    case NORMALIZE3D: return "vectornormalize3d";
+    case TRANSFORM: return "vectortransform";
+    }
+    return "unknown";
+}
+
+bool vector_reference::simd_supported()
+{
+#ifdef REFERENCE_AVX2
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+vector_reference::vector_reference(kernel k, bool simd)
+    : _kernel(k), _simd(simd && simd_supported())
+{
+}
+
+void vector_reference::input(float* in, size_t first, size_t items) const
+{
+#ifdef REFERENCE_AVX2
+    if (_simd) {
+        input_avx2(in, first * 4, items * 4);
+        return;
+    }
+#endif
+    input_scalar(in, first * 4, items * 4);
+}
+
+void vector_reference::run(float const* in, float* out, size_t items) const
+{
+#ifdef REFERENCE_AVX2
+    if (_simd) {
+        switch (_kernel) {
+        case NORMALIZE: normalize_avx2(in, out, items); break;
+        case NORMALIZE3D: normalize3d_avx2(in, out, items); break;
+        case TRANSFORM: transform_avx2(in, out, items); break;
+        }
+        return;
+    }
+#endif
+    switch (_kernel) {
+    case NORMALIZE: normalize_scalar(in, out, items); break;
+    case NORMALIZE3D: normalize3d_scalar(in, out, items); break;
+    case TRANSFORM: transform_scalar(in, out, items); break;
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/// This class computes on the CPU what the vector samples compute on the GPU,
+/// with the inputs of their host (samples/vector.cpp), so that the outputs
+/// of a run can be checked without a second run to compare with.
+///
+/// Item i reads the four floats 4i to 4i+3 of the input and writes four
+/// floats:
+///
+///     vectornormalize     v / sqrt(dot4(v, v))
+///     vectornormalize3d   v.xyz / sqrt(dot3(v, v) + v.w * v.x), 1
+///     vectortransform     dot4(v, row) for the rows of the matrix
+///
+/// where the last two fetch w as 1. vectornormalize3d leaves the W slot of
+/// its DOT_IEEE empty, which on the GPU still adds v.w * v.x to the sum (as
+/// in samples/outputs; the emulator adds nothing).
+///
+/// The dot products are summed pairwise, (x + y) + (z + w), and the inverse
+/// square root is taken in IEEE single precision. Where the CPU supports
+/// AVX2 two items are computed per instruction; otherwise, or on request, the
+/// same operations are done one float at a time, with identical results.
+class vector_reference {
+public:
+    /// Enumeration of the kernels.
+    typedef enum {
+        NORMALIZE,      ///< vectornormalize
+        NORMALIZE3D,    ///< vectornormalize3d
+        TRANSFORM       ///< vectortransform
+    } kernel;
+
+    /// Get the kernel from its name.
+    /// It throws std::runtime_error if the kernel has no reference.
+    /// \param name The name of the kernel or of an output of it, a directory
+    /// and a .bin, .out or .npy suffix are ignored, as is anything after the
+    /// name ("vectortransform-1024-8").
+    static kernel find(std::string name);
+    /// Get the name of a kernel.
+    static const char* name(kernel k);
+
+    /// The rows of the vectortransform matrix (constants 2 to 5).
+    static const float matrix[4][4];
+
+    /// Determine whether the CPU runs the vectorized code.
+    static bool simd_supported();
+
+    /// This constructor selects a kernel.
+    /// \param k The kernel.
+    /// \param simd Use AVX2 if the CPU supports it.
+    explicit vector_reference(kernel k, bool simd = true);
+
+    kernel get_kernel() const { return _kernel; }
+    bool simd() const { return _simd; }
+
+    /// Fill the input of a range of items as the host does: element j is j
+    /// with the sign of (-1)^j, counted in single precision (so it stops at
+    /// 2^24).
+    /// \param in The input, four floats per item.
+    /// \param first The first item.
+    /// \param items The number of items.
+    void input(float* in, std::size_t first, std::size_t items) const;
+
+    /// Compute the output of a range of items.
+    /// \param in The input, four floats per item.
+    /// \param out The output, four floats per item.
+    /// \param items The number of items.
+    void run(float const* in, float* out, std::size_t items) const;
+
+private:
+    kernel _kernel;
+    bool _simd;
+};
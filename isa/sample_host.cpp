@@ -0,0 +1,118 @@
+#include "sample_host.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+uint32_t as_uint(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+bool starts_with(string const& s, const char* prefix)
+{
+    return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+}
+
+sample_host::preset sample_host::find(string name)
+{
+    string::size_type slash = name.rfind('/');
+    if (slash != string::npos)
+        name.erase(0, slash + 1);
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".bin") == 0)
+        name.erase(name.size() - 4);
+
+    if (starts_with(name, "vector") || starts_with(name, "transform"))
+        return VECTOR;
+    if (starts_with(name, "lds"))
+        return LDS;
+    if (starts_with(name, "scheduling"))
+        return SCHEDULING;
+    if (starts_with(name, "timing"))
+        return TIMING;
+    if (name == "integer" || starts_with(name, "branches") || starts_with(name, "factorial"))
+        return INTEGER;
+    throw runtime_error("no sample host for " + name);
+}
+
+sample_host::sample_host(preset kind, int const* size, int const* groups, int guard)
+    : _kind(kind)
+{
+    const int
+        N = 16,
+        x = size[0], y = size[1], z = size[2],
+        X = groups[0], Y = groups[1], Z = groups[2],
+        g = x * y * z,
+        Dx = x * X, Dy = y * Y, Dz = z * Z,
+        items = Dx * Dy * Dz;
+
+    _output_size = items;
+    if (kind == SCHEDULING)
+        _output_size = items * 4 / 64;
+    else if (kind != INTEGER)
+        _output_size = items * 4;
+    _output.assign(_output_size, 0xffffffff);
+    _output.resize(_output_size + guard, floats() ? 0x7f800000 : 0xeaeaeaea);
+
+    uint32_t domain[] = {
+        uint32_t(x), uint32_t(y), uint32_t(z), 0,
+        uint32_t(X), uint32_t(Y), uint32_t(Z), 0
+    };
+    _constants.assign(domain, domain + 8);
+    if (kind == SCHEDULING) {
+        uint32_t strides[] = {
+            1, uint32_t(x), uint32_t(x * y), 0,
+            uint32_t(g), uint32_t(X * g), uint32_t(X * Y * g), 0,
+            1, uint32_t(Dx), uint32_t(Dx * Dy), 0,
+            uint32_t(x), uint32_t(Dx * y), uint32_t(Dx * Dy * z), 0
+        };
+        _constants.insert(_constants.end(), strides, strides + 16);
+    }
+    else if (floats()) {
+        float m[] = { 0, 0, -1, 0,  1, 0, 0, 0,  0, -1, 0, 0,  0, 0, 0, 1 };
+        for (unsigned i = 0; i < 16; ++i)
+            _constants.push_back(as_uint(m[i]));
+    }
+
+    // Alternating input: 0, -1, 2, -3 ...
+    if (floats()) {
+        _input.resize(kind == LDS ? items * 4 * N : _output_size);
+        for (size_t i = 0; i < _input.size(); ++i)
+            _input[i] = as_uint(i % 2 ? -float(i) : float(i));
+    }
+
+    for (unsigned i = 0; i < 3; ++i) {
+        _dispatch.group_size[i] = size[i];
+        _dispatch.groups[i] = groups[i];
+    }
+    _dispatch.rats[0] = &_output;
+    _dispatch.constant_buffers[0] = &_constants;
+    if (floats())
+        _dispatch.vertex_resources[1] = vertex_resource(&_input, 1, fetch_instruction::FMT_32_32_32_32_FLOAT);
+    if (kind == LDS) {
+        // The whole LDS of a SIMD.
+        _dispatch.lds_size = 8192;
+        _dispatch.loop_consts[0] = loop_const(N, 0, 1);
+        _dispatch.loop_consts[1] = loop_const(N, 0, x);
+        _dispatch.loop_consts[2] = loop_const(x * N, 0, 1);
+        _dispatch.loop_consts[3] = loop_const(x * N, 0, 4);
+    }
+}
+
+void sample_host::finish()
+{
+    if (_kind != SCHEDULING || _output_size < 4)
+        return;
+    uint32_t min_ts = 0xffffffff;
+    for (size_t i = 3; i < _output_size; i += 4)
+        min_ts = min(min_ts, _output[i]);
+    for (size_t i = 3; i < _output_size; i += 4)
+        _output[i] -= min_ts;
+}
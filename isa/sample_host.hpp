@@ -0,0 +1,61 @@
+#pragma once
+
+#include "evergreen_emulator.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// This class replicates the buffers which the host programs of the samples
+/// (samples/*.cpp) bind to their kernels, so that the kernels can be run by
+/// the emulator with the same inputs as on the GPU.
+class sample_host {
+public:
+    /// Enumeration of the host programs.
+    typedef enum {
+        INTEGER,    ///< branches, factorial: one double word per item.
+        TIMING,     ///< timing: four double words per item.
+        SCHEDULING, ///< scheduling: four double words per wavefront.
+        VECTOR,     ///< vector*, transform: four floats per item.
+        LDS         ///< lds*: four floats per item, 16 inputs per item.
+    } preset;
+
+    /// Get the host program of a kernel from its name.
+    /// It throws std::runtime_error if no host program matches.
+    /// \param name The name of the kernel or of the host program, a
+    /// directory and a .bin suffix are ignored.
+    static preset find(std::string name);
+
+    /// This constructor sets up the buffers.
+    /// \param kind The host program.
+    /// \param size Work-items per group in X, Y and Z.
+    /// \param groups Groups in X, Y and Z.
+    /// \param guard Guard double words after the output.
+    sample_host(preset kind, int const* size, int const* groups, int guard);
+
+    /// Access the dispatch, which refers to the buffers of this object.
+    dispatch const& get_dispatch() const { return _dispatch; }
+    /// Access the output buffer, guard included.
+    std::vector<std::uint32_t>& output() { return _output; }
+    /// Get the size of the output without the guard.
+    std::size_t output_size() const { return _output_size; }
+    /// Determine whether the output holds floats (or hexadecimal integers).
+    bool floats() const { return _kind == VECTOR || _kind == LDS; }
+    /// Determine whether the host prints an address column.
+    bool addresses() const { return _kind != SCHEDULING; }
+
+    /// Post-process the output as the host does after the kernel has run
+    /// (the scheduling host makes the timestamps relative).
+    void finish();
+
+private:
+    sample_host(sample_host const&);
+    sample_host& operator = (sample_host const&);
+
+    preset _kind;
+    std::size_t _output_size;
+    std::vector<std::uint32_t> _output;
+    std::vector<std::uint32_t> _constants;
+    std::vector<std::uint32_t> _input;
+    dispatch _dispatch;
+};
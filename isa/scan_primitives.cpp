@@ -0,0 +1,453 @@
+#include "scan_primitives.hpp"
+
+#include "alu_packer.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+typedef cf_instruction cf;
+typedef alu_instruction alu;
+typedef fetch_instruction fetch;
+
+/// EXPORT_RAT_INST_STORE_RAW.
+const unsigned rat_inst_store_raw = 2;
+/// The resources of the kernels.
+const unsigned input_resource = 1, offset_resource = 2, output_rat = 0;
+
+const char* const operation_names[] = { "add", "min", "max" };
+const char* const type_names[] = { "u32", "i32", "f32" };
+const char* const kind_names[] = { "inclusive", "exclusive", "reduce" };
+
+/// ALU opcodes by operation and type.
+const unsigned opcodes[3][3] = {
+    { alu::OP2_ADD_INT, alu::OP2_ADD_INT, alu::OP2_ADD },
+    { alu::OP2_MIN_UINT, alu::OP2_MIN_INT, alu::OP2_MIN },
+    { alu::OP2_MAX_UINT, alu::OP2_MAX_INT, alu::OP2_MAX }
+};
+/// Identities by operation and type.
+const uint32_t identities[3][3] = {
+    { 0, 0, 0 },
+    { 0xffffffffu, 0x7fffffffu, 0x7f800000u },
+    { 0, 0x80000000u, 0xff800000u }
+};
+
+inline float as_float(uint32_t u)
+{
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+inline uint32_t as_uint(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+alu_source source(uint32_t sel, uint32_t chan = 0)
+{
+    alu_source s = { sel, chan, false, false, false };
+    return s;
+}
+
+alu_source literal(uint32_t chan = 0)
+{
+    return source(alu::ALU_SRC_LITERAL, chan);
+}
+
+/// Make an instruction which writes GPR.<chan>.
+alu_instruction instruction(unsigned op, unsigned gpr, unsigned chan, alu_source const& a,
+                            alu_source const& b = source(alu::ALU_SRC_0),
+                            alu_source const& c = source(alu::ALU_SRC_0))
+{
+    alu_instruction inst(op);
+    inst.dst_gpr = gpr;
+    inst.dst_chan = chan;
+    inst.write_mask = true;
+    inst.src[0] = a;
+    inst.src[1] = b;
+    inst.src[2] = c;
+    return inst;
+}
+
+/// Make an LDS_IDX_OP instruction with a byte address and a value.
+alu_instruction lds(unsigned op, alu_source const& address, alu_source const& value = source(alu::ALU_SRC_0))
+{
+    alu_instruction inst(alu::OP3_LDS_IDX_OP);
+    inst.lds_op = op;
+    inst.src[0] = address;
+    inst.src[1] = value;
+    return inst;
+}
+
+/// Append a group of one instruction and its literals to a clause.
+void append(vector<alu_group>& clause, alu_instruction const& inst,
+            vector<uint32_t> const& literals = vector<uint32_t>())
+{
+    alu_group g;
+    g.slots.push_back(inst);
+    g.literals = literals;
+    clause.push_back(g);
+}
+
+/// Make a vertex fetch of raw double words, without format conversion.
+/// \param resource The resource id.
+/// \param index The GPR and channel of the index.
+/// \param dst The destination GPR.
+/// \param dst_sel The destination selects of X, Y, Z and W, 3 bits each.
+/// \param components The double words fetched, 1 or 4.
+/// \param offset The byte offset.
+fetch_instruction vertex_fetch(unsigned resource, alu_source const& index, unsigned dst, unsigned dst_sel,
+                               unsigned components, unsigned offset)
+{
+    fetch_instruction f;
+    f.words[0] = fetch::VTX_INST_FETCH | fetch::VTX_FETCH_NO_INDEX_OFFSET << 5 | resource << 8 |
+        index.sel << 16 | index.chan << 24 | (4 * components - 1) << 26;
+    // NUM_FORMAT_ALL.NUM_FORMAT_INT
+    f.words[1] = dst | dst_sel << 9 |
+        (components == 4 ? fetch::FMT_32_32_32_32 : fetch::FMT_32) << 22 | 1u << 28;
+    // MEGA_FETCH
+    f.words[2] = offset | 1u << 19;
+    return f;
+}
+
+/// Make a RAT store of GPRs from rw_gpr on, indexed by INDEX_GPR.x.
+cf_node rat_store(unsigned rw_gpr, unsigned index_gpr, unsigned elem_size, unsigned burst, unsigned comp_mask)
+{
+    cf_node store(cf_instruction(cf::CF_INST_MEM_RAT_CACHELESS));
+    store.cf.word0 = output_rat | rat_inst_store_raw << 4 | 1 << 13 | elem_size << 30;
+    store.cf.set_rw_gpr(rw_gpr);
+    store.cf.set_index_gpr(index_gpr);
+    store.cf.word1 |= comp_mask << 12 | (burst - 1) << 16;
+    return store;
+}
+
+cf_node group_barrier()
+{
+    cf_node node(cf_instruction(cf::CF_INST_ALU));
+    append(node.alu, alu_instruction(alu::OP2_GROUP_BARRIER));
+    return node;
+}
+
+}
+
+scan_operator scan_operator::find(string const& name)
+{
+    for (unsigned o = 0; o < 3; ++o)
+        for (unsigned t = 0; t < 3; ++t)
+            if (name == string(operation_names[o]) + '-' + type_names[t])
+                return scan_operator(element_type(t), operation(o));
+    throw runtime_error("unknown operator " + name);
+}
+
+string scan_operator::name() const
+{
+    return string(operation_names[op]) + '-' + type_names[type];
+}
+
+unsigned scan_operator::opcode() const
+{
+    return opcodes[op][type];
+}
+
+uint32_t scan_operator::identity() const
+{
+    return identities[op][type];
+}
+
+uint32_t scan_operator::apply(uint32_t a, uint32_t b) const
+{
+    if (type == F32) {
+        float x = as_float(a), y = as_float(b);
+        switch (op) {
+        case ADD:
+            return as_uint(x + y);
+        case MIN:
+            return as_uint(x < y ? x : y);
+        default:
+            return as_uint(x >= y ? x : y);
+        }
+    }
+    switch (op) {
+    case ADD:
+        return a + b;
+    case MIN:
+        return type == I32 ? (int32_t(a) < int32_t(b) ? a : b) : min(a, b);
+    default:
+        return type == I32 ? (int32_t(a) > int32_t(b) ? a : b) : max(a, b);
+    }
+}
+
+const unsigned scan_kernel::max_group_size;
+const unsigned scan_kernel::max_items;
+
+scan_kernel::scan_kernel(scan_operator o, kind k, unsigned items, unsigned group_size, bool offsets)
+    : _operator(o), _kind(k), _items(items), _group_size(group_size), _offsets(offsets && k != REDUCE)
+{
+    if (items == 0 || items % 4 != 0 || items > max_items)
+        throw invalid_argument("items per work-item must be a multiple of 4 up to " + to_string(max_items));
+    if (group_size == 0 || group_size > max_group_size)
+        throw invalid_argument("work groups must have 1 to " + to_string(max_group_size) + " work-items");
+}
+
+string scan_kernel::name() const
+{
+    return string(kind_names[_kind]) + '-' + _operator.name() + '-' + to_string(_items) + '-' +
+        to_string(_group_size) + (_offsets ? "-offsets" : "");
+}
+
+evergreen_program scan_kernel::program() const
+{
+    // R2 to R(items / 4 + 1) hold the elements, element e in channel e % 4
+    // of GPR 2 + e / 4, and three GPRs follow:
+    //  A.x index of the first 4-vector, A.y total, A.z prefix, A.w offset
+    //  B   temporaries
+    //  C.x LDS address of the work-item
+    const unsigned vectors = _items / 4, a = 2 + vectors, b = a + 1, c = a + 2;
+    const unsigned op = _operator.opcode();
+    const uint32_t identity = _operator.identity();
+    auto element = [](unsigned e) { return source(2 + e / 4, e % 4); };
+
+    evergreen_program program;
+    vector<cf_node>& nodes = program.nodes();
+
+    // A.x <- (R1.x * group_size + R0.x) * items / 4, C.x <- R0.x * 4
+    nodes.push_back(cf_node(cf_instruction(cf::CF_INST_ALU)));
+    append(nodes.back().alu, instruction(alu::OP3_MULADD_UINT24, a, 0, source(1), literal(), source(0)),
+           vector<uint32_t>(1, _group_size));
+    append(nodes.back().alu, instruction(alu::OP2_MUL_UINT24, a, 0, source(a), literal()),
+           vector<uint32_t>(1, vectors));
+    append(nodes.back().alu, instruction(alu::OP2_LSHL_INT, c, 0, source(0), literal()),
+           vector<uint32_t>(1, 2));
+
+    // The elements, and A.w <- the offset of the group.
+    nodes.push_back(cf_node(cf_instruction(cf::CF_INST_TC)));
+    for (unsigned v = 0; v < vectors; ++v)
+        nodes.back().fetch.push_back(vertex_fetch(input_resource, source(a), 2 + v, 0x688, 4, 16 * v));
+    if (_offsets)
+        nodes.back().fetch.push_back(vertex_fetch(offset_resource, source(1), a, 0x1ff, 1, 0));
+
+    // A.y <- the total of the work-item, elements scanned in place, then
+    // LDS[C.x] <- A.y.
+    nodes.push_back(cf_node(cf_instruction(cf::CF_INST_ALU)));
+    vector<alu_group>& local = nodes.back().alu;
+    if (_kind == REDUCE) {
+        // Fold the upper 4-vectors onto the lower ones, then the channels.
+        for (unsigned n = vectors; n > 1; ) {
+            unsigned half = n / 2;
+            for (unsigned v = 0; v < half; ++v) {
+                alu_group g;
+                for (unsigned ch = 0; ch < 4; ++ch)
+                    g.slots.push_back(instruction(op, 2 + v, ch, source(2 + v, ch), source(2 + v + n - half, ch)));
+                local.push_back(g);
+            }
+            n -= half;
+        }
+        alu_group g;
+        g.slots.push_back(instruction(op, 2, 0, source(2, 0), source(2, 1)));
+        g.slots.push_back(instruction(op, 2, 2, source(2, 2), source(2, 3)));
+        local.push_back(g);
+        append(local, instruction(op, a, 1, source(2, 0), source(2, 2)));
+    }
+    else {
+        for (unsigned e = 1; e < _items; ++e)
+            append(local, instruction(op, 2 + e / 4, e % 4, element(e - 1), element(e)));
+        append(local, instruction(alu::OP2_MOV, a, 1, element(_items - 1)));
+    }
+    append(local, lds(alu::LDS_OP_WRITE, source(c), source(a, 1)));
+
+    // Step d of the LDS scan, in buffer (step % 2):
+    //  B.x <- R0.x - d
+    //  A.y <- (B.x >= 0 ? LDS[B.x] : identity) + A.y
+    //  LDS[R0.x] of the other buffer <- A.y
+    unsigned step = 0;
+    auto read_back = [&](unsigned distance, unsigned dst, unsigned chan, vector<alu_group>& clause) {
+        append(clause, instruction(alu::OP2_ADD_INT, b, 0, source(0), literal()),
+               vector<uint32_t>(1, -distance));
+        append(clause, instruction(alu::OP2_MAX_INT, b, 1, source(b, 0), source(alu::ALU_SRC_0)));
+        vector<uint32_t> base(1, 4);
+        base.push_back(step % 2 * 4 * _group_size);
+        append(clause, instruction(alu::OP3_MULADD_UINT24, b, 1, source(b, 1), literal(0), literal(1)), base);
+        append(clause, lds(alu::LDS_OP_READ_RET, source(b, 1)));
+        append(clause, instruction(alu::OP3_CNDGE_INT, dst, chan, source(b, 0),
+                                   source(alu::ALU_SRC_LDS_OQ_A_POP), literal()),
+               vector<uint32_t>(1, identity));
+    };
+    for (unsigned d = 1; d < _group_size; d *= 2, ++step) {
+        nodes.push_back(group_barrier());
+        nodes.push_back(cf_node(cf_instruction(cf::CF_INST_ALU)));
+        vector<alu_group>& clause = nodes.back().alu;
+        read_back(d, b, 2, clause);
+        append(clause, instruction(op, a, 1, source(b, 2), source(a, 1)));
+        if (step % 2 == 0) {
+            append(clause, instruction(alu::OP2_ADD_INT, b, 3, source(c), literal()),
+                   vector<uint32_t>(1, 4 * _group_size));
+            append(clause, lds(alu::LDS_OP_WRITE, source(b, 3), source(a, 1)));
+        }
+        else
+            append(clause, lds(alu::LDS_OP_WRITE, source(c), source(a, 1)));
+    }
+
+    if (_kind == REDUCE) {
+        // RAT 0 [R1.x] <- A.y of the last work-item
+        nodes.push_back(cf_node(cf_instruction(cf::CF_INST_ALU_PUSH_BEFORE)));
+        append(nodes.back().alu, instruction(alu::OP2_MOV, b, 0, source(a, 1)));
+        alu_instruction last = instruction(alu::OP2_PREDE_INT, 0, 0, source(0), literal());
+        last.write_mask = false;
+        last.update_exec_mask = true;
+        append(nodes.back().alu, last, vector<uint32_t>(1, _group_size - 1));
+
+        cf_node jump(cf_instruction(cf::CF_INST_JUMP));
+        jump.cf.set_pop_count(1);
+        jump.cf.set_addr(nodes.size() + 3);
+        nodes.push_back(jump);
+        nodes.push_back(rat_store(b, 1, 0, 1, 1));
+        cf_node pop(cf_instruction(cf::CF_INST_POP));
+        pop.cf.set_pop_count(1);
+        nodes.push_back(pop);
+        nodes.push_back(cf_node(cf_instruction(cf::CF_INST_NOP)));
+    }
+    else {
+        // A.z <- the total of the previous work-items (plus the offset),
+        // then the elements from A.z.
+        nodes.push_back(group_barrier());
+        nodes.push_back(cf_node(cf_instruction(cf::CF_INST_ALU)));
+        vector<alu_group>& clause = nodes.back().alu;
+        read_back(1, a, 2, clause);
+        if (_offsets)
+            append(clause, instruction(op, a, 2, source(a, 3), source(a, 2)));
+        if (_kind == INCLUSIVE)
+            for (unsigned e = 0; e < _items; ++e)
+                append(clause, instruction(op, 2 + e / 4, e % 4, source(a, 2), element(e)));
+        else {
+            for (unsigned e = _items - 1; e > 0; --e)
+                append(clause, instruction(op, 2 + e / 4, e % 4, source(a, 2), element(e - 1)));
+            append(clause, instruction(alu::OP2_MOV, 2, 0, source(a, 2)));
+        }
+
+        // RAT 0 [A.x] <- R2 to R(items / 4 + 1)
+        nodes.push_back(rat_store(2, a, 3, vectors, 0xf));
+    }
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+        nodes[i].cf.set_barrier(true);
+    nodes.back().cf.set_end_of_program(true);
+
+    alu_packer packer;
+    packer.pack(program);
+    return program;
+}
+
+void scan_reference::inclusive(scan_operator o, uint32_t const* in, uint32_t* out, size_t n)
+{
+    uint32_t sum = o.identity();
+    for (size_t i = 0; i < n; ++i)
+        out[i] = sum = o.apply(sum, in[i]);
+}
+
+void scan_reference::exclusive(scan_operator o, uint32_t const* in, uint32_t* out, size_t n)
+{
+    uint32_t sum = o.identity();
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t x = in[i];
+        out[i] = sum;
+        sum = o.apply(sum, x);
+    }
+}
+
+uint32_t scan_reference::reduce(scan_operator o, uint32_t const* in, size_t n)
+{
+    uint32_t sum = o.identity();
+    for (size_t i = 0; i < n; ++i)
+        sum = o.apply(sum, in[i]);
+    return sum;
+}
+
+scan_primitive::scan_primitive(scan_operator o, unsigned items, unsigned group_size, unsigned threads)
+    : _operator(o), _items(items), _group_size(group_size), _tile(items * group_size), _dispatches()
+{
+    _reduce.reset(new evergreen_emulator(
+        scan_kernel(o, scan_kernel::REDUCE, items, group_size).program(), threads));
+    for (unsigned k = 0; k < 2; ++k)
+        for (unsigned offsets = 0; offsets < 2; ++offsets)
+            _scans[k][offsets].reset(new evergreen_emulator(
+                scan_kernel(o, scan_kernel::kind(k), items, group_size, offsets).program(), threads));
+}
+
+void scan_primitive::inclusive(vector<uint32_t> const& in, vector<uint32_t>& out)
+{
+    out.clear();
+    if (in.empty())
+        return;
+    scan(scan_kernel::INCLUSIVE, padded(in), out);
+    out.resize(in.size());
+}
+
+void scan_primitive::exclusive(vector<uint32_t> const& in, vector<uint32_t>& out)
+{
+    out.clear();
+    if (in.empty())
+        return;
+    scan(scan_kernel::EXCLUSIVE, padded(in), out);
+    out.resize(in.size());
+}
+
+uint32_t scan_primitive::reduce(vector<uint32_t> const& in)
+{
+    if (in.empty())
+        return _operator.identity();
+    vector<uint32_t> tiles = padded(in), totals;
+    for (;;) {
+        reduce_tiles(tiles, totals);
+        if (totals.size() == 1)
+            return totals[0];
+        tiles = padded(totals);
+    }
+}
+
+void scan_primitive::scan(scan_kernel::kind k, vector<uint32_t> const& in, vector<uint32_t>& out)
+{
+    if (in.size() == _tile) {
+        run(*_scans[k][0], in, 0, out, in.size());
+        return;
+    }
+    vector<uint32_t> totals, offsets;
+    reduce_tiles(in, totals);
+    scan(scan_kernel::EXCLUSIVE, padded(totals), offsets);
+    run(*_scans[k][1], in, &offsets, out, in.size());
+}
+
+void scan_primitive::reduce_tiles(vector<uint32_t> const& in, vector<uint32_t>& out)
+{
+    run(*_reduce, in, 0, out, in.size() / _tile);
+}
+
+void scan_primitive::run(evergreen_emulator& e, vector<uint32_t> const& in,
+                         vector<uint32_t> const* offsets, vector<uint32_t>& out, size_t out_size)
+{
+    dispatch d;
+    d.group_size[0] = _group_size;
+    d.groups[0] = in.size() / _tile;
+    d.lds_size = 2 * _group_size;
+    d.vertex_resources[input_resource] = vertex_resource(&in, 4, fetch::FMT_32_32_32_32);
+    if (offsets)
+        d.vertex_resources[offset_resource] = vertex_resource(offsets, 1, fetch::FMT_32);
+    out.assign(out_size, 0);
+    d.rats[output_rat] = &out;
+
+    e.run(d);
+    ++_dispatches;
+    _statistics.add(e.statistics());
+}
+
+vector<uint32_t> scan_primitive::padded(vector<uint32_t> const& in) const
+{
+    vector<uint32_t> p(in);
+    p.resize((in.size() + _tile - 1) / _tile * _tile, _operator.identity());
+    return p;
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include "evergreen_emulator.hpp"
+#include "evergreen_program.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// This structure describes the operator of a scan or of a reduction: the
+/// type of the elements and the binary operation, which is associative and
+/// commutative (float addition only up to rounding).
+struct scan_operator {
+    /// Enumeration of the element types, all of them 32-bit.
+    typedef enum {
+        U32,    ///< Unsigned integers.
+        I32,    ///< Signed integers.
+        F32     ///< Single precision floats.
+    } element_type;
+
+    /// Enumeration of the operations.
+    typedef enum {
+        ADD,
+        MIN,
+        MAX
+    } operation;
+
+    element_type type;
+    operation op;
+
+    scan_operator(element_type type = U32, operation op = ADD) : type(type), op(op) {}
+
+    /// Get an operator from its name, operation-type ("add-f32").
+    /// It throws std::runtime_error if the name is unknown.
+    static scan_operator find(std::string const& name);
+    /// Get the name of the operator, operation-type ("add-f32").
+    std::string name() const;
+
+    /// Get the ALU opcode of the operation.
+    unsigned opcode() const;
+    /// Get the identity of the operation: 0, the largest or the smallest
+    /// value of the type (infinities for floats).
+    std::uint32_t identity() const;
+    /// Apply the operation to two elements, as the GPU does.
+    std::uint32_t apply(std::uint32_t a, std::uint32_t b) const;
+};
+
+/// This class generates the kernels of the scans and reductions, as
+/// building blocks of the multi-pass scan_primitive, in the way of lds.asm.
+///
+/// Each work-item takes \c items consecutive elements, fetched as float
+/// 4-vectors, and each group a tile of \c group_size times \c items
+/// elements:
+///
+///     1. the work-item scans its elements in registers (reductions sum
+///        them pairwise instead),
+///     2. the group scans the totals of its work-items in the LDS, doubling
+///        the distance at every step (Hillis and Steele), with a
+///        GROUP_BARRIER between steps and two buffers in turn,
+///     3. a scan adds the total of the previous work-items (and the offset
+///        of the group if it has one) to its elements and stores them, a
+///        reduction stores the total of the group from its last work-item.
+///
+/// The resources are those of lds.asm without the constants:
+///
+///     VTX resource 1      input, a stride of 16 bytes
+///     VTX resource 2      offsets of the groups (scans with offsets), a
+///                         stride of 4 bytes
+///     RAT resource 0      output, 32-bit elements
+///
+/// Fetches read raw double words (FMT_32_32_32_32 as integers), so that the
+/// resources need no particular format. The input must hold whole tiles,
+/// padded with the identity of the operator. The ALU clauses are repacked
+/// by alu_packer.
+class scan_kernel {
+public:
+    /// Enumeration of the kernels.
+    typedef enum {
+        INCLUSIVE,  ///< Element i is the sum of elements 0 to i of the tile.
+        EXCLUSIVE,  ///< Element i is the sum of elements 0 to i - 1 of the tile.
+        REDUCE      ///< Element g is the sum of tile g.
+    } kind;
+
+    /// Largest work group.
+    static const unsigned max_group_size = 256;
+    /// Most elements per work-item, those of a burst of 16 float 4-vectors.
+    static const unsigned max_items = 64;
+
+    /// This constructor describes a kernel.
+    /// It throws std::invalid_argument if the items are not a multiple of 4
+    /// up to \c max_items, or if the group size is 0 or above
+    /// \c max_group_size.
+    /// \param o The operator.
+    /// \param k The kernel.
+    /// \param items Elements per work-item.
+    /// \param group_size Work-items per group.
+    /// \param offsets Whether a scan adds the offset of its group, element g
+    /// of VTX resource 2.
+    scan_kernel(scan_operator o, kind k, unsigned items = 8, unsigned group_size = 64, bool offsets = false);
+
+    scan_operator get_operator() const { return _operator; }
+    kind get_kind() const { return _kind; }
+    unsigned items() const { return _items; }
+    unsigned group_size() const { return _group_size; }
+    bool offsets() const { return _offsets; }
+
+    /// Get the elements of a tile.
+    unsigned tile() const { return _items * _group_size; }
+    /// Get the LDS double words of a group.
+    unsigned lds_size() const { return 2 * _group_size; }
+    /// Get the GPRs of a work-item.
+    unsigned gprs() const { return _items / 4 + 5; }
+
+    /// Get the name of the kernel, kind-operator-items-group ("inclusive-
+    /// add-f32-8-64"), with an "-offsets" suffix for scans with offsets.
+    std::string name() const;
+
+    /// Make the kernel.
+    evergreen_program program() const;
+
+private:
+    scan_operator _operator;
+    kind _kind;
+    unsigned _items;
+    unsigned _group_size;
+    bool _offsets;
+};
+
+/// This class computes scans and reductions on the CPU, one element after
+/// the other.
+class scan_reference {
+public:
+    /// Compute the inclusive scan of n elements.
+    static void inclusive(scan_operator o, std::uint32_t const* in, std::uint32_t* out, std::size_t n);
+    /// Compute the exclusive scan of n elements.
+    static void exclusive(scan_operator o, std::uint32_t const* in, std::uint32_t* out, std::size_t n);
+    /// Compute the reduction of n elements, the identity if there are none.
+    static std::uint32_t reduce(scan_operator o, std::uint32_t const* in, std::size_t n);
+};
+
+/// This class scans and reduces arrays with the kernels of scan_kernel, run
+/// by evergreen_emulator, with the passes that a host would dispatch on the
+/// GPU.
+///
+/// An array of one tile is scanned by one dispatch. A longer one takes
+/// three passes, reduce then scan:
+///
+///     1. a reduction gives the total of every tile,
+///     2. the totals are scanned (exclusive), recursively, into the offsets
+///        of the tiles,
+///     3. a scan with offsets scans every tile from its offset.
+///
+/// so that the input is read twice and the output written once. A
+/// reduction repeats the first pass until one total is left. Arrays are
+/// padded to whole tiles with the identity of the operator.
+class scan_primitive {
+public:
+    /// This constructor generates the kernels.
+    /// It throws std::invalid_argument if the configuration is invalid, see
+    /// scan_kernel.
+    /// \param o The operator.
+    /// \param items Elements per work-item.
+    /// \param group_size Work-items per group.
+    /// \param threads Host threads of the emulator, or 0 for one per
+    /// processor.
+    scan_primitive(scan_operator o, unsigned items = 8, unsigned group_size = 64, unsigned threads = 0);
+
+    scan_operator get_operator() const { return _operator; }
+    /// Get the elements of a tile.
+    unsigned tile() const { return _tile; }
+
+    /// Compute the inclusive scan of an array.
+    void inclusive(std::vector<std::uint32_t> const& in, std::vector<std::uint32_t>& out);
+    /// Compute the exclusive scan of an array.
+    void exclusive(std::vector<std::uint32_t> const& in, std::vector<std::uint32_t>& out);
+    /// Compute the reduction of an array.
+    std::uint32_t reduce(std::vector<std::uint32_t> const& in);
+
+    /// Get the number of dispatches run so far.
+    unsigned long dispatches() const { return _dispatches; }
+    /// Access the statistics of the dispatches run so far.
+    emulator_statistics const& statistics() const { return _statistics; }
+
+private:
+    scan_primitive(scan_primitive const&);
+    scan_primitive& operator = (scan_primitive const&);
+
+    /// Scan an array of whole tiles.
+    void scan(scan_kernel::kind k, std::vector<std::uint32_t> const& in, std::vector<std::uint32_t>& out);
+    /// Reduce every tile of an array of whole tiles.
+    void reduce_tiles(std::vector<std::uint32_t> const& in, std::vector<std::uint32_t>& out);
+    /// Run a kernel over the tiles of an input.
+    void run(evergreen_emulator& e, std::vector<std::uint32_t> const& in,
+             std::vector<std::uint32_t> const* offsets, std::vector<std::uint32_t>& out, std::size_t out_size);
+    /// Pad an array to whole tiles.
+    std::vector<std::uint32_t> padded(std::vector<std::uint32_t> const& in) const;
+
+    scan_operator _operator;
+    unsigned _items;
+    unsigned _group_size;
+    unsigned _tile;
+    /// The kernels: reduce, then inclusive and exclusive without and with
+    /// offsets.
+    std::unique_ptr<evergreen_emulator> _reduce;
+    std::unique_ptr<evergreen_emulator> _scans[2][2];
+    unsigned long _dispatches;
+    emulator_statistics _statistics;
+};
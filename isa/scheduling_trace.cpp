@@ -0,0 +1,306 @@
+#include "scheduling_trace.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <system_error>
+#include <tuple>
+
+using namespace std;
+
+namespace {
+
+const uint32_t guard = 0xeaeaeaea;
+const uint32_t unwritten = 0xffffffff;
+
+const uint64_t ones = 0x0101010101010101ull;
+const uint64_t highs = 0x8080808080808080ull;
+
+/// Parse eight hexadecimal digits at once (SWAR, little endian hosts).
+/// \returns Whether they were all hexadecimal digits.
+bool parse_hex8(char const* p, uint32_t& value)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+
+    // Every byte is checked for 0-9 and a-f or A-F without carries between
+    // the bytes, since they are ASCII.
+    uint64_t digit = (v + 0x50 * ones) & ~(v + 0x46 * ones) & highs;
+    uint64_t l = v | 0x20 * ones;
+    uint64_t alpha = (l + 0x1f * ones) & ~(l + 0x19 * ones) & highs;
+    if ((v & highs) != 0 || (digit | alpha) != highs)
+        return false;
+
+    // Nibbles, 'a' to 'f' having bit 6 set, then pairs of bytes, words and
+    // double words, the first character being the most significant.
+    v = (v & 0x0f * ones) + (v >> 6 & ones) * 9;
+    v = (v & 0x00ff00ff00ff00ffull) << 4 | (v >> 8 & 0x00ff00ff00ff00ffull);
+    v = (v & 0x0000ffff0000ffffull) << 8 | (v >> 16 & 0x0000ffff0000ffffull);
+    value = uint32_t((v & 0xffffffffull) << 16 | v >> 32);
+    return true;
+}
+
+/// Get the p-quantile of sorted values.
+uint32_t quantile(vector<uint32_t> const& sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t i = size_t(p * (sorted.size() - 1) + 0.5);
+    return sorted[min(i, sorted.size() - 1)];
+}
+
+typedef tuple<unsigned, unsigned, unsigned> slot_key;
+
+slot_key slot_of(wavefront_record const& r)
+{
+    return slot_key(r.se, r.simd, r.slot);
+}
+
+}
+
+scheduling_trace::scheduling_trace(uint32_t const* words, size_t size)
+{
+    uint32_t earliest = unwritten;
+    for (size_t i = 0; i + 4 <= size; i += 4) {
+        uint32_t const* w = words + i;
+        if (w[0] == guard && w[1] == guard && w[2] == guard && w[3] == guard)
+            continue;
+        if (w[0] == unwritten && w[1] == unwritten && w[2] == unwritten)
+            continue;
+        wavefront_record r;
+        r.row = i / 4;
+        r.group[0] = w[0] >> 24;
+        r.group[1] = w[0] >> 16 & 0xff;
+        r.group[2] = w[0] >> 8 & 0xff;
+        r.odd = w[0] & 1;
+        r.se = w[1] >> 24;
+        r.simd = w[1] >> 16 & 0xff;
+        r.slot = w[1] & 0xffff;
+        r.wave = w[2] >> 16;
+        r.hw_wave = w[2] & 0xffff;
+        r.time = w[3];
+        earliest = min(earliest, r.time);
+        _records.push_back(r);
+    }
+    for (size_t i = 0; i < _records.size(); ++i)
+        _records[i].time -= earliest;
+}
+
+size_t scheduling_trace::parse(char const* begin, char const* end, vector<uint32_t>& words)
+{
+    // A row is four fields of eight digits separated by tabs, after an
+    // optional address and colon.
+    const size_t row_size = 4 * 9 - 1;
+    size_t rows = 0;
+    for (char const* p = begin; p < end; ) {
+        char const* eol = static_cast<char const*>(memchr(p, '\n', end - p));
+        if (!eol)
+            eol = end;
+        char const* colon = static_cast<char const*>(memchr(p, ':', eol - p));
+        if (colon)
+            p = colon + 2;
+        size_t n = eol - p;
+        if (n && p[n - 1] == '\r')
+            --n;
+
+        uint32_t row[4];
+        bool ok = p < eol && n == row_size;
+        for (unsigned f = 0; ok && f < 4; ++f)
+            ok = parse_hex8(p + 9 * f, row[f]) && (f == 3 || p[9 * f + 8] == '\t');
+        if (ok) {
+            words.insert(words.end(), row, row + 4);
+            ++rows;
+        }
+        p = eol + 1;
+    }
+    return rows;
+}
+
+scheduling_trace scheduling_trace::read(const char* path)
+{
+    ifstream file(path, ios::in | ios::binary);
+    if (!file)
+        throw system_error(error_code(errno, system_category()), path);
+    vector<char> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    if (file.bad())
+        throw system_error(error_code(errno, system_category()), path);
+
+    // A hex dump has no NUL characters, a buffer of timestamps does.
+    vector<uint32_t> words;
+    if (memchr(bytes.data(), 0, bytes.size()))
+        words.assign(reinterpret_cast<uint32_t const*>(bytes.data()),
+                     reinterpret_cast<uint32_t const*>(bytes.data()) + bytes.size() / 4);
+    else {
+        words.reserve(bytes.size() / 9);
+        parse(bytes.data(), bytes.data() + bytes.size(), words);
+    }
+    return scheduling_trace(words.data(), words.size());
+}
+
+vector<scheduling_trace::simd_summary> scheduling_trace::summary(uint32_t gap) const
+{
+    map<pair<unsigned, unsigned>, vector<uint32_t> > starts;
+    map<pair<unsigned, unsigned>, unsigned> groups;
+    for (size_t i = 0; i < _records.size(); ++i) {
+        wavefront_record const& r = _records[i];
+        pair<unsigned, unsigned> key(r.se, r.simd);
+        starts[key].push_back(r.time);
+        if (r.wave == 0)
+            ++groups[key];
+    }
+
+    vector<simd_summary> simds;
+    for (map<pair<unsigned, unsigned>, vector<uint32_t> >::iterator i = starts.begin(); i != starts.end(); ++i) {
+        vector<uint32_t>& t = i->second;
+        sort(t.begin(), t.end());
+        simd_summary s = simd_summary();
+        s.se = i->first.first;
+        s.simd = i->first.second;
+        s.waves = t.size();
+        s.groups = groups[i->first];
+        s.first = t.front();
+        s.last = t.back();
+        s.gap_at = s.first;
+        for (size_t k = 1; k < t.size(); ++k) {
+            uint32_t d = t[k] - t[k - 1];
+            if (d > s.max_gap) {
+                s.max_gap = d;
+                s.gap_at = t[k - 1];
+            }
+            if (d > gap) {
+                s.idle += d;
+                ++s.idle_gaps;
+            }
+        }
+        simds.push_back(s);
+    }
+    return simds;
+}
+
+void scheduling_trace::write_chrome_trace(ostream& os, double clock_mhz) const
+{
+    // Groups by slot in order of their start, to close each one when the
+    // next starts.
+    map<slot_key, vector<size_t> > slots;
+    map<tuple<unsigned, unsigned, unsigned>, size_t> first;
+    uint32_t end = 0;
+    for (size_t i = 0; i < _records.size(); ++i) {
+        wavefront_record const& r = _records[i];
+        end = max(end, r.time);
+        tuple<unsigned, unsigned, unsigned> id(r.group[0], r.group[1], r.group[2]);
+        map<tuple<unsigned, unsigned, unsigned>, size_t>::iterator f = first.find(id);
+        if (f == first.end())
+            first.insert(make_pair(id, i));
+        else if (r.time < _records[f->second].time)
+            f->second = i;
+    }
+    for (map<tuple<unsigned, unsigned, unsigned>, size_t>::const_iterator f = first.begin(); f != first.end(); ++f)
+        slots[slot_of(_records[f->second])].push_back(f->second);
+
+    auto us = [clock_mhz](uint64_t cycles) { return cycles / clock_mhz; };
+    auto pid = [](wavefront_record const& r) { return r.se * 256 + r.simd; };
+    char const* separator = "\n";
+
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    map<unsigned, bool> named;
+    for (map<slot_key, vector<size_t> >::iterator s = slots.begin(); s != slots.end(); ++s) {
+        vector<size_t>& g = s->second;
+        sort(g.begin(), g.end(), [this](size_t a, size_t b) { return _records[a].time < _records[b].time; });
+        wavefront_record const& r0 = _records[g.front()];
+        if (!named[pid(r0)]) {
+            named[pid(r0)] = true;
+            os << separator << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid(r0)
+               << ",\"args\":{\"name\":\"SE " << r0.se << " SIMD " << r0.simd << "\"}}";
+            separator = ",\n";
+        }
+        os << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid(r0) << ",\"tid\":" << r0.slot
+           << ",\"args\":{\"name\":\"slot " << r0.slot << "\"}}";
+        for (size_t k = 0; k < g.size(); ++k) {
+            wavefront_record const& r = _records[g[k]];
+            uint32_t stop = k + 1 < g.size() ? _records[g[k + 1]].time : end;
+            os << ",\n{\"name\":\"group " << r.group[0] << ',' << r.group[1] << ',' << r.group[2]
+               << "\",\"cat\":\"group\",\"ph\":\"X\",\"ts\":" << us(r.time) << ",\"dur\":" << us(stop - r.time)
+               << ",\"pid\":" << pid(r) << ",\"tid\":" << r.slot << '}';
+        }
+    }
+    for (size_t i = 0; i < _records.size(); ++i) {
+        wavefront_record const& r = _records[i];
+        os << separator << "{\"name\":\"wave " << r.row << "\",\"cat\":\"wavefront\",\"ph\":\"i\",\"s\":\"t\",\"ts\":" << us(r.time)
+           << ",\"pid\":" << pid(r) << ",\"tid\":" << r.slot
+           << ",\"args\":{\"group\":\"" << r.group[0] << ',' << r.group[1] << ',' << r.group[2]
+           << "\",\"wave\":" << r.wave << ",\"hw_wave\":" << r.hw_wave << ",\"odd\":" << r.odd
+           << ",\"cycles\":" << r.time << "}}";
+        separator = ",\n";
+    }
+    os << "\n]}\n";
+}
+
+void scheduling_trace::write_summary(ostream& os, uint32_t gap) const
+{
+    vector<simd_summary> simds = summary(gap);
+    vector<uint32_t> starts;
+    map<tuple<unsigned, unsigned, unsigned>, pair<uint32_t, uint32_t> > groups;
+    map<tuple<unsigned, unsigned, unsigned>, pair<unsigned, unsigned> > placement;
+    unsigned split = 0;
+    for (size_t i = 0; i < _records.size(); ++i) {
+        wavefront_record const& r = _records[i];
+        starts.push_back(r.time);
+        tuple<unsigned, unsigned, unsigned> id(r.group[0], r.group[1], r.group[2]);
+        pair<unsigned, unsigned> where(r.se, r.simd);
+        if (!groups.count(id)) {
+            groups[id] = make_pair(r.time, r.time);
+            placement[id] = where;
+        }
+        else {
+            groups[id].first = min(groups[id].first, r.time);
+            groups[id].second = max(groups[id].second, r.time);
+            if (placement[id] != where && placement[id].first != ~0u) {
+                placement[id].first = ~0u;
+                ++split;
+            }
+        }
+    }
+    sort(starts.begin(), starts.end());
+    vector<uint32_t> spread;
+    for (map<tuple<unsigned, unsigned, unsigned>, pair<uint32_t, uint32_t> >::const_iterator g = groups.begin(); g != groups.end(); ++g)
+        spread.push_back(g->second.second - g->second.first);
+    sort(spread.begin(), spread.end());
+
+    double sum = 0, squares = 0;
+    unsigned least = ~0u, most = 0;
+    for (size_t i = 0; i < simds.size(); ++i) {
+        sum += simds[i].waves;
+        squares += double(simds[i].waves) * simds[i].waves;
+        least = min(least, simds[i].waves);
+        most = max(most, simds[i].waves);
+    }
+
+    os << "Wavefronts " << _records.size() << " groups " << groups.size()
+       << " SIMDs " << simds.size() << " last start " << (starts.empty() ? 0 : starts.back()) << " cycles\n";
+    if (simds.empty())
+        return;
+    os << "Fairness: Jain index " << (sum * sum / (simds.size() * squares))
+       << " wavefronts per SIMD " << least << " to " << most
+       << ", groups split over SIMDs " << split << '\n';
+
+    os << "\n  SE SIMD  waves groups  share      first       last    max gap  gap start  idle gaps       idle\n";
+    for (size_t i = 0; i < simds.size(); ++i) {
+        simd_summary const& s = simds[i];
+        char line[160];
+        snprintf(line, sizeof(line), "%4u %4u %6u %6u %5.1f%% %10u %10u %10u %10u %10u %10llu\n",
+                 s.se, s.simd, s.waves, s.groups, 100 * s.waves / sum, s.first, s.last,
+                 s.max_gap, s.gap_at, s.idle_gaps, (unsigned long long)s.idle);
+        os << line;
+    }
+    os << "Idle gaps are longer than " << gap << " cycles between wavefront starts on a SIMD.\n";
+
+    os << "\nWavefront start: p50 " << quantile(starts, 0.5) << " p90 " << quantile(starts, 0.9)
+       << " p99 " << quantile(starts, 0.99) << " max " << starts.back()
+       << ", tail after p99 " << (starts.back() - quantile(starts, 0.99)) << " cycles\n"
+       << "Group launch spread (last minus first wavefront start): p50 " << quantile(spread, 0.5)
+       << " p99 " << quantile(spread, 0.99) << " max " << spread.back() << " cycles\n";
+}
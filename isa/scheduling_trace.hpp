@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+/// This structure holds the record which scheduling.asm writes for a
+/// wavefront, decoded.
+struct wavefront_record {
+    unsigned row;           ///< Row of the record in the output (the wavefront id).
+    unsigned group[3];      ///< Id of the work group.
+    bool odd;               ///< HW_ALU_ODD.
+    unsigned se;            ///< Shader engine (bits 24 and up of the SIMD word).
+    unsigned simd;          ///< SIMD_ID.
+    unsigned slot;          ///< HW_THREADGRP_ID, the group slot in the SIMD.
+    unsigned wave;          ///< WAVE_ID_IN_GRP.
+    unsigned hw_wave;       ///< HW_WAVE_ID.
+    std::uint32_t time;     ///< TIME_LO, relative to the earliest record.
+};
+
+/// This class holds the wavefront records of a run of the scheduling sample
+/// and lays them out as a timeline per SIMD.
+///
+/// The sample writes four double words per wavefront:
+///
+///     x: group id x << 24 | y << 16 | z << 8 | HW_ALU_ODD
+///     y: SE_ID << 24 | SIMD_ID << 16 | HW_THREADGRP_ID
+///     z: WAVE_ID_IN_GRP << 16 | HW_WAVE_ID
+///     w: TIME_LO
+///
+/// They can be read from the raw RAT buffer or from the hex dump the host
+/// prints (samples/outputs/scheduling-*.out), with or without the address
+/// column. Rows the kernel did not write (guard or unwritten double words)
+/// are skipped. Only the start of a wavefront is recorded; a group is taken
+/// to hold its slot from the start of its first wavefront until the next
+/// group in the slot starts.
+class scheduling_trace {
+public:
+    /// This structure holds the statistics of a SIMD.
+    struct simd_summary {
+        unsigned se;
+        unsigned simd;
+        unsigned waves;         ///< Wavefronts started.
+        unsigned groups;        ///< Groups started.
+        std::uint32_t first;    ///< First wavefront start.
+        std::uint32_t last;     ///< Last wavefront start.
+        std::uint32_t max_gap;  ///< Longest time between two wavefront starts.
+        std::uint32_t gap_at;   ///< Start of the longest gap.
+        std::uint64_t idle;     ///< Sum of the gaps longer than the threshold.
+        unsigned idle_gaps;     ///< Number of gaps longer than the threshold.
+    };
+
+    /// This constructor decodes records from a buffer.
+    /// \param words The buffer, four double words per wavefront.
+    /// \param size The size of the buffer in double words.
+    scheduling_trace(std::uint32_t const* words, std::size_t size);
+
+    /// Read the records from a file, either a raw buffer or a hex dump.
+    /// It may throw a std::system_error exception if the file cannot be read.
+    static scheduling_trace read(const char* path);
+
+    /// Parse the rows of four hexadecimal double words of a hex dump. Other
+    /// lines are skipped.
+    /// \returns The number of rows appended to \c words.
+    static std::size_t parse(char const* begin, char const* end, std::vector<std::uint32_t>& words);
+
+    /// Access the records in row order.
+    std::vector<wavefront_record> const& records() const { return _records; }
+
+    /// Get the statistics of every SIMD with records, ordered by SE and SIMD.
+    /// \param gap Threshold in cycles above which a gap counts as idle.
+    std::vector<simd_summary> summary(std::uint32_t gap) const;
+
+    /// Write the timeline in the Chrome trace event format (JSON): a process
+    /// per SIMD, a thread per group slot, a complete event per group and an
+    /// instant event per wavefront.
+    /// \param clock_mhz Clock used to convert cycles to microseconds.
+    void write_chrome_trace(std::ostream& os, double clock_mhz) const;
+    /// Write the dispatch fairness, idle gaps and tail latency.
+    /// \param gap Threshold in cycles above which a gap counts as idle.
+    void write_summary(std::ostream& os, std::uint32_t gap) const;
+
+private:
+    std::vector<wavefront_record> _records;
+};
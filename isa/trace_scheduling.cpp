@@ -0,0 +1,79 @@
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include "performance_model.hpp"
+#include "scheduling_trace.hpp"
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    const char* json_path = 0;
+    string device_name = "redwood";
+    double clock_mhz = 0;
+    unsigned gap = 64;
+
+    for (int opt = 0; (opt = getopt(argc, argv, "j:d:f:g:")) != -1; )
+        switch (opt) {
+            case 'j': json_path = optarg; break;
+            case 'd': device_name = optarg; break;
+            case 'f': clock_mhz = atof(optarg); break;
+            case 'g': gap = atoi(optarg); break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    if (optind != argc - 1) {
+        cerr << "Usage: " << argv[0] << " [-j<trace.json>] [-d<device>] [-f<MHz>] [-g<n>] scheduling.out\n\n"
+            "\tSummarize the wavefront records of the scheduling sample, read from its\n"
+            "\toutput or from the raw buffer, and export them as a Chrome trace.\n\n"
+            "\t-j <f>\twrite the timeline in the Chrome trace format\n"
+            "\t-d <s>\tdevice family, for its clock (redwood)\n"
+            "\t-f <n>\tclock in MHz, instead of the device clock\n"
+            "\t-g <n>\tgaps between wavefront starts on a SIMD above which it is idle (64)\n" << endl;
+        return EXIT_FAILURE;
+    }
+    const char* path = argv[optind];
+
+    try {
+        if (clock_mhz <= 0)
+            clock_mhz = device_profile::find(device_name).clock_mhz;
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        scheduling_trace trace = scheduling_trace::read(path);
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        cerr << "Read " << trace.records().size() << " records in " << elapsed.count() << " ms" << endl;
+
+        trace.write_summary(cout, gap);
+
+        if (json_path) {
+            ofstream json(json_path);
+            if (!json)
+                throw system_error(error_code(errno, system_category()), json_path);
+            trace.write_chrome_trace(json, clock_mhz);
+            json.close();
+            if (!json)
+                throw system_error(error_code(errno, system_category()), json_path);
+        }
+        return EXIT_SUCCESS;
+    }
+    catch (system_error& e) {
+        cerr
+            << e.what()
+            << " : "
+            << e.code().message()
+            << endl;
+        return EXIT_FAILURE;
+    }
+    catch (runtime_error& e) {
+        cerr << path << " : " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,207 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "evergreen_emulator.hpp"
+#include "evergreen_program.hpp"
+#include "kernel_analysis.hpp"
+#include "kernel_metadata.hpp"
+#include "kernel_tuner.hpp"
+#include "performance_model.hpp"
+#include "sample_host.hpp"
+
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace {
+
+/// Parse a list of numbers separated by a character ("32x32", "4,8,16").
+vector<unsigned> parse_list(const char* s, char separator)
+{
+    vector<unsigned> v;
+    istringstream is(s);
+    for (string field; getline(is, field, separator); ) {
+        char* end;
+        unsigned long n = strtoul(field.c_str(), &end, 0);
+        if (field.empty() || *end != 0)
+            throw runtime_error(string("invalid list ") + s);
+        v.push_back(n);
+    }
+    return v;
+}
+
+bool exists(string const& path)
+{
+    struct stat s;
+    return stat(path.c_str(), &s) == 0;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    const char* domain_arg = "64";
+    const char* preset_name = 0;
+    const char* gprs_arg = 0;
+    const char* lds_arg = 0;
+    const char* database_arg = 0;
+    string device_name = "redwood";
+    unsigned threads = 0;
+    double min_occupancy = 0.5;
+    bool save = true, replace = false;
+
+    for (int opt = 0; (opt = getopt(argc, argv, "D:p:t:d:g:l:o:f:nr")) != -1; )
+        switch (opt) {
+            case 'D': domain_arg = optarg; break;
+            case 'p': preset_name = optarg; break;
+            case 't': threads = atoi(optarg); break;
+            case 'd': device_name = optarg; break;
+            case 'g': gprs_arg = optarg; break;
+            case 'l': lds_arg = optarg; break;
+            case 'o': min_occupancy = atof(optarg); break;
+            case 'f': database_arg = optarg; break;
+            case 'n': save = false; break;
+            case 'r': replace = true; break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    if (optind != argc - 1) {
+        cerr << "Usage: " << argv[0] << " [-D<x>[x<y>[x<z>]]] [-p<preset>] [-t<n>] [-d<device>] [-g<n>,...] [-l<n>,...]\n"
+            "\t[-o<fraction>] [-f<file>] [-n] [-r] kernel.bin\n\n"
+            "\tSearch the group shapes, GPR counts and LDS allocations of a kernel over\n"
+            "\ta domain for the fastest, as estimated by the performance model from a\n"
+            "\trun on the emulator, and record it in the tuning database, from which the\n"
+            "\tsample hosts take the group shape of their launches.\n\n"
+            "\t-D <s>\twork-items of the domain in X, Y and Z (64)\n"
+            "\t-p <s>\tsample host: integer, timing, scheduling, vector or lds (from the kernel name)\n"
+            "\t-t <n>\thost threads of the emulator (one per processor)\n"
+            "\t-d <s>\tdevice family:";
+        for (size_t i = 0; i < device_profile::profiles().size(); ++i)
+            cerr << ' ' << device_profile::profiles()[i].name;
+        cerr << " (redwood)\n"
+            "\t-g <n>\tGPR counts to try (the kernel's)\n"
+            "\t-l <n>\tLDS allocations to try, in double words per group (the kernel's)\n"
+            "\t-o <f>\tprune below this fraction of the best occupancy (0.5)\n"
+            "\t-f <s>\ttuning database (tuning.txt next to the kernel)\n"
+            "\t-n\tdo not record the result\n"
+            "\t-r\treplace the recorded configuration even if it was faster\n" << endl;
+        return EXIT_FAILURE;
+    }
+    const char* path = argv[optind];
+
+    try {
+        vector<unsigned> domain = parse_list(domain_arg, 'x');
+        if (domain.empty() || domain.size() > 3)
+            throw runtime_error("domain size error");
+        domain.resize(3, 1);
+
+        device_profile const& device = device_profile::find(device_name);
+        sample_host::preset preset = sample_host::find(preset_name ? preset_name : path);
+        evergreen_program program = evergreen_program::read(path);
+
+        // The resources the kernel needs: its metadata if it has been
+        // allocated, otherwise what it uses.
+        kernel_metadata needs;
+        string meta = kernel_metadata::path(path);
+        if (exists(meta))
+            needs = kernel_metadata::read(meta.c_str());
+        else {
+            kernel_analysis analysis(program);
+            needs.num_gprs = analysis.num_gprs;
+            needs.temp_gprs = analysis.temp_gprs;
+        }
+        {
+            int size[] = { 1, 1, 1 }, groups[] = { 1, 1, 1 };
+            sample_host host(preset, size, groups, 0);
+            needs.lds_alloc = max(needs.lds_alloc, host.get_dispatch().lds_size);
+        }
+
+        kernel_tuner tuner(&domain[0], needs, device.wave_slots);
+        if (gprs_arg)
+            tuner.set_gprs(parse_list(gprs_arg, ','));
+        if (lds_arg)
+            tuner.set_lds(parse_list(lds_arg, ','));
+        tuner.set_min_occupancy(min_occupancy);
+        tuner.search();
+
+        cout << "Kernel needs " << needs.num_gprs << " GPRs, " << needs.temp_gprs
+             << " clause temporaries, " << needs.lds_alloc << " LDS double words\n"
+             << tuner.candidates().size() << " candidates, " << tuner.infeasible() << " cannot run, "
+             << tuner.pruned() << " pruned for occupancy" << endl;
+
+        evergreen_emulator emulator(program, threads);
+        emulator.set_tracing(true);
+        size_t best = tuner.tune([&](kernel_tuner::candidate const& c) -> double {
+            int size[3], groups[3];
+            for (unsigned i = 0; i < 3; ++i) {
+                size[i] = c.config.group_size[i];
+                groups[i] = domain[i] / c.config.group_size[i];
+            }
+            sample_host host(preset, size, groups, 0);
+            dispatch d = host.get_dispatch();
+            d.lds_size = max(d.lds_size, c.config.lds_alloc);
+            emulator.run(d);
+
+            // The model keeps as many wavefronts resident as the
+            // configuration allows.
+            device_profile limited = device;
+            limited.wave_slots = c.waves;
+            return double(performance_model(program, limited).estimate(emulator.traces()).cycles);
+        });
+
+        cout << setw(12) << "group" << setw(6) << "GPRs" << setw(7) << "LDS"
+             << setw(7) << "waves" << setw(11) << "occupancy" << setw(12) << "cycles" << '\n';
+        for (size_t i = 0; i < tuner.candidates().size(); ++i) {
+            kernel_tuner::candidate const& c = tuner.candidates()[i];
+            ostringstream shape;
+            shape << c.config.group_size[0] << 'x' << c.config.group_size[1] << 'x' << c.config.group_size[2];
+            cout << setw(12) << shape.str() << setw(6) << c.config.num_gprs << setw(7) << c.config.lds_alloc
+                 << setw(7) << c.waves << setw(11) << fixed << setprecision(2) << c.occupancy;
+            if (c.cycles < 0)
+                cout << setw(12) << "failed";
+            else
+                cout << setw(12) << setprecision(0) << c.cycles;
+            cout << (i == best ? " *" : "") << '\n';
+        }
+
+        tuning_database::entry e;
+        e.kernel = tuning_database::kernel_name(path);
+        e.family = device.name;
+        e.size_class = tuning_database::size_class(uint64_t(domain[0]) * domain[1] * domain[2]);
+        e.config = tuner.candidates()[best].config;
+        e.cycles = tuner.candidates()[best].cycles;
+        if (save) {
+            string database = database_arg ? database_arg : tuning_database::path(path);
+            tuning_database db = tuning_database::read(database.c_str());
+            if (db.update(e, replace)) {
+                db.write(database.c_str());
+                cout << "Recorded in " << database << endl;
+            }
+            else
+                cout << "A faster configuration is recorded in " << database << endl;
+        }
+        return EXIT_SUCCESS;
+    }
+    catch (system_error& e) {
+        cerr
+            << e.what()
+            << " : "
+            << e.code().message()
+            << endl;
+        return EXIT_FAILURE;
+    }
+    catch (runtime_error& e) {
+        cerr << path << " : " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,267 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "output_verifier.hpp"
+#include "reference_kernels.hpp"
+
+using namespace std;
+
+namespace {
+
+/// Items computed at a time, so that the input, the reference and the block
+/// of the output stay in the cache.
+const size_t block_items = 4096;
+
+bool ends_with(string const& s, const char* suffix)
+{
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+/// This class reads the floats of an output in blocks: a raw buffer, a .npy
+/// file of 32-bit floats or the text a sample host prints (*.out, *.txt).
+class output_reader {
+public:
+    explicit output_reader(string const& path)
+        : _path(path), _text(ends_with(path, ".out") || ends_with(path, ".txt")), _next(0)
+    {
+        ios_base::openmode mode = _text ? ios::in : ios::in | ios::binary;
+        _file.open(path.c_str(), mode);
+        if (!_file)
+            throw system_error(error_code(errno, system_category()), path);
+        if (_text)
+            read_text();
+        else
+            read_header();
+    }
+
+    /// Determine whether the values were printed, with 6 significant digits.
+    bool text() const { return _text; }
+    /// Get the number of floats.
+    size_t size() const { return _size; }
+
+    /// Read the next n floats.
+    void read(float* values, size_t n)
+    {
+        if (_text)
+            copy(_values.begin() + _next, _values.begin() + _next + n, values);
+        else if (!_file.read(reinterpret_cast<char*>(values), n * sizeof(float)))
+            throw system_error(error_code(errno, system_category()), _path);
+        _next += n;
+    }
+
+private:
+    /// Read the values of the text, skipping the lines which are not output
+    /// (driver messages) and the address column.
+    void read_text()
+    {
+        for (string line; getline(_file, line); ) {
+            istringstream fields(line);
+            vector<float> row;
+            bool valid = true;
+            for (string field; fields >> field; ) {
+                if (field[field.size() - 1] == ':')
+                    continue;
+                char* end;
+                row.push_back(strtof(field.c_str(), &end));
+                if (*end != 0) {
+                    valid = false;
+                    break;
+                }
+            }
+            if (valid)
+                _values.insert(_values.end(), row.begin(), row.end());
+        }
+        _size = _values.size();
+    }
+
+    /// Skip the header of a .npy file and get the size of the data.
+    void read_header()
+    {
+        _file.seekg(0, ios::end);
+        size_t bytes = _file.tellg();
+        _file.seekg(0);
+
+        // Version 1 has a 16-bit header length, later versions a 32-bit one.
+        unsigned char m[12] = {};
+        char* magic = reinterpret_cast<char*>(m);
+        size_t header = 0;
+        if (bytes >= 10 && _file.read(magic, 10) && memcmp(magic, "\x93NUMPY", 6) == 0) {
+            size_t length = m[8] | m[9] << 8;
+            header = 10;
+            if (m[6] != 1 && _file.read(magic + 10, 2)) {
+                length |= size_t(m[10]) << 16 | size_t(m[11]) << 24;
+                header = 12;
+            }
+            header += length;
+            string dict(length, ' ');
+            if (!_file.read(&dict[0], dict.size()))
+                throw runtime_error("truncated .npy header");
+            if (dict.find("'<f4'") == string::npos || dict.find("'fortran_order': False") == string::npos)
+                throw runtime_error("not a C ordered .npy array of little endian floats");
+        }
+        else
+            _file.seekg(0);
+        if (!_file)
+            throw system_error(error_code(errno, system_category()), _path);
+        _size = (bytes - header) / sizeof(float);
+    }
+
+    string _path;
+    bool _text;
+    ifstream _file;
+    vector<float> _values;
+    size_t _size;
+    size_t _next;
+};
+
+/// Round floats as the sample hosts print them.
+void round_as_printed(float* values, size_t n)
+{
+    char text[32];
+    for (size_t i = 0; i < n; ++i) {
+        snprintf(text, sizeof(text), "%g", values[i]);
+        values[i] = strtof(text, 0);
+    }
+}
+
+float as_float(uint32_t u)
+{
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int x = 0, X = 1, guard = -1;
+    int tolerance = -1;
+    size_t reported = 8;
+    bool simd = true;
+    const char* kernel_name = 0;
+
+    for (int opt = 0; (opt = getopt(argc, argv, "k:x:X:G:u:n:s")) != -1; )
+        switch (opt) {
+            case 'k': kernel_name = optarg; break;
+            case 'x': x = atoi(optarg); break;
+            case 'X': X = atoi(optarg); break;
+            case 'G': guard = atoi(optarg); break;
+            case 'u': tolerance = atoi(optarg); break;
+            case 'n': reported = strtoul(optarg, 0, 0); break;
+            case 's': simd = false; break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    if (optind + 1 != argc) {
+        cerr << "Usage: " << argv[0] << " [-k<kernel>] [-x<n>] [-X<n>] [-G<n>] [-u<n>] [-n<n>] [-s] <output>\n\n"
+            "\tCompare the output of a vector sample with its reference computed on\n"
+            "\tthe CPU and check the guard after it. The output is a raw buffer, a .npy\n"
+            "\tfile or the text the host prints (.out, .txt), whose values have been\n"
+            "\trounded to 6 digits and are compared with the reference rounded alike.\n\n"
+            "\t-k <s>\tkernel: vectornormalize, vectornormalize3d or vectortransform (from the output name)\n"
+            "\t-x <n>\tnumber of items per group in X (what precedes the guard)\n"
+            "\t-X <n>\tnumber of groups in X (1)\n"
+            "\t-G <n>\tbuffer guard size, without -x (16 for text, 0 otherwise)\n"
+            "\t-u <n>\tlargest distance of a match in units in the last place (4, 256 for text)\n"
+            "\t-n <n>\tnumber of mismatches printed (8)\n"
+            "\t-s\tdo not use AVX2\n" << endl;
+        return EXIT_FAILURE;
+    }
+    const char* path = argv[optind];
+
+    try {
+        if (x < 0 || X < 1)
+            throw runtime_error("domain size error");
+
+        vector_reference reference(vector_reference::find(kernel_name ? kernel_name : path), simd);
+        output_reader reader(path);
+
+        size_t total = reader.size(), items;
+        if (x != 0) {
+            items = size_t(x) * X;
+            if (items * 4 > total)
+                throw runtime_error("the output is smaller than the domain");
+            if (guard >= 0 && items * 4 + guard != total)
+                throw runtime_error("the output is not the size of the domain and the guard");
+        }
+        else {
+            size_t g = guard >= 0 ? guard : reader.text() ? 16 : 0;
+            if (g > total || (total - g) % 4 != 0)
+                throw runtime_error("the output is not a whole number of items and the guard");
+            items = (total - g) / 4;
+        }
+        size_t outsize = items * 4, guard_size = total - outsize;
+
+        // A unit in the sixth digit of the text is up to 134 ulps, so values
+        // within a few ulps may be printed one unit apart.
+        if (tolerance < 0)
+            tolerance = reader.text() ? 256 : 4;
+        output_verifier verifier(tolerance, reported, simd);
+        vector<float> input(block_items * 4), expected(block_items * 4), values(block_items * 4);
+
+        auto start = chrono::steady_clock::now();
+        for (size_t first = 0; first < items; first += block_items) {
+            size_t n = min(block_items, items - first);
+            reference.input(&input[0], first, n);
+            reference.run(&input[0], &expected[0], n);
+            if (reader.text())
+                round_as_printed(&expected[0], n * 4);
+            reader.read(&values[0], n * 4);
+            verifier.compare(&values[0], &expected[0], n * 4);
+        }
+        for (size_t done = 0; done < guard_size; ) {
+            size_t n = min(values.size(), guard_size - done);
+            reader.read(&values[0], n);
+            verifier.check_guard(reinterpret_cast<uint32_t const*>(&values[0]), n, 0x7f800000);
+            done += n;
+        }
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        for (size_t i = 0; i < verifier.first().size(); ++i) {
+            output_verifier::mismatch const& m = verifier.first()[i];
+            cerr << (m.index < outsize ? "Mismatch at " : "Guard overwritten at ") << m.index
+                 << ": " << as_float(m.value) << " (" << hex << m.value << ") expected "
+                 << as_float(m.expected) << " (" << m.expected << dec << ")";
+            if (m.ulps != ~uint64_t(0))
+                cerr << ", " << m.ulps << " ulps";
+            cerr << '\n';
+        }
+        cerr << verifier.mismatches() << " of " << outsize << " values differ from "
+             << vector_reference::name(reference.get_kernel()) << " by more than " << tolerance
+             << " ulps (at most " << verifier.max_ulps() << "), "
+             << verifier.guard_errors() << " of " << guard_size << " guard values overwritten\n"
+             << "Verified " << total * sizeof(float) << " bytes in " << (elapsed * 1e3) << " ms ("
+             << (total * sizeof(float) / elapsed / 1e9) << " GB/s"
+             << (reference.simd() ? ", AVX2" : "") << ")" << endl;
+
+        return verifier.passed() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    catch (system_error& e) {
+        cerr
+            << e.what()
+            << " : "
+            << e.code().message()
+            << endl;
+        return EXIT_FAILURE;
+    }
+    catch (runtime_error& e) {
+        cerr << path << " : " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,92 @@
+// vim: set et sw=4 sts=4 ts=8:
+// This CS is meant for a 1-D domain.
+// It measures the bandwidth of vertex fetches: each work-item fetches 64
+// bytes and writes their exclusive or, 4 bytes.
+// It expects the following resources to be set up:
+//  constant buffer 0:
+//      items per group x, 1, 1, 0
+//      number of groups X, 1, 1, 0
+//
+//  RAT resource 0 (output buffer) with one dword per work-item.
+//  VTX resource 1 (input buffer) with 16 dwords per work-item, stride 1.
+ALU: KCACHE_BANK0(0) KCACHE_MODE0.CF_KCACHE_LOCK_1 BARRIER;
+    // R0.x <- R0.x + R1.x * Kcache_bank0(0)
+    MULADD_UINT24: DST_GPR(0) DST_CHAN.CHAN_X
+        SRC0_SEL.GPR(1) SRC0_CHAN.CHAN_X
+        SRC1_SEL.Kcache_bank0(0) SRC1_CHAN.CHAN_X
+        SRC2_SEL.GPR(0) SRC2_CHAN.CHAN_X LAST;
+    // R1.x <- R0.x << 4
+    LSHL_INT: DST_GPR(1) DST_CHAN.CHAN_X WRITE_MASK
+        SRC0_SEL.GPR(0) SRC0_CHAN.CHAN_X
+        SRC1_SEL.ALU_SRC_LITERAL SRC1_CHAN.CHAN_X LAST;
+    0x00000004 0x00000000;
+// R2..R5 <- vtx1[R1.x], +16, +32, +48 bytes
+TC: BARRIER;
+    FETCH: FETCH_TYPE.VTX_FETCH_NO_INDEX_OFFSET BUFFER_ID(1) SRC_GPR(1) SRC_SEL_X.SEL_X MEGA_FETCH_COUNT(15);
+        DST_GPR(2) DST_SEL_X.SEL_X DST_SEL_Y.SEL_Y DST_SEL_Z.SEL_Z DST_SEL_W.SEL_W USE_CONST_FIELDS;
+        MEGA_FETCH;
+    FETCH: FETCH_TYPE.VTX_FETCH_NO_INDEX_OFFSET BUFFER_ID(1) SRC_GPR(1) SRC_SEL_X.SEL_X MEGA_FETCH_COUNT(15);
+        DST_GPR(3) DST_SEL_X.SEL_X DST_SEL_Y.SEL_Y DST_SEL_Z.SEL_Z DST_SEL_W.SEL_W USE_CONST_FIELDS;
+        OFFSET(16) MEGA_FETCH;
+    FETCH: FETCH_TYPE.VTX_FETCH_NO_INDEX_OFFSET BUFFER_ID(1) SRC_GPR(1) SRC_SEL_X.SEL_X MEGA_FETCH_COUNT(15);
+        DST_GPR(4) DST_SEL_X.SEL_X DST_SEL_Y.SEL_Y DST_SEL_Z.SEL_Z DST_SEL_W.SEL_W USE_CONST_FIELDS;
+        OFFSET(32) MEGA_FETCH;
+    FETCH: FETCH_TYPE.VTX_FETCH_NO_INDEX_OFFSET BUFFER_ID(1) SRC_GPR(1) SRC_SEL_X.SEL_X MEGA_FETCH_COUNT(15);
+        DST_GPR(5) DST_SEL_X.SEL_X DST_SEL_Y.SEL_Y DST_SEL_Z.SEL_Z DST_SEL_W.SEL_W USE_CONST_FIELDS;
+        OFFSET(48) MEGA_FETCH;
+ALU: BARRIER;
+    // PV <- R2 ^ R3
+    XOR_INT: DST_CHAN.CHAN_X
+        SRC0_SEL.GPR(2) SRC0_CHAN.CHAN_X
+        SRC1_SEL.GPR(3) SRC1_CHAN.CHAN_X;
+    XOR_INT: DST_CHAN.CHAN_Y
+        SRC0_SEL.GPR(2) SRC0_CHAN.CHAN_Y
+        SRC1_SEL.GPR(3) SRC1_CHAN.CHAN_Y;
+    XOR_INT: DST_CHAN.CHAN_Z
+        SRC0_SEL.GPR(2) SRC0_CHAN.CHAN_Z
+        SRC1_SEL.GPR(3) SRC1_CHAN.CHAN_Z;
+    XOR_INT: DST_CHAN.CHAN_W
+        SRC0_SEL.GPR(2) SRC0_CHAN.CHAN_W
+        SRC1_SEL.GPR(3) SRC1_CHAN.CHAN_W LAST;
+    // PV <- PV ^ R4
+    XOR_INT: DST_CHAN.CHAN_X
+        SRC0_SEL.ALU_SRC_PV SRC0_CHAN.CHAN_X
+        SRC1_SEL.GPR(4) SRC1_CHAN.CHAN_X;
+    XOR_INT: DST_CHAN.CHAN_Y
+        SRC0_SEL.ALU_SRC_PV SRC0_CHAN.CHAN_Y
+        SRC1_SEL.GPR(4) SRC1_CHAN.CHAN_Y;
+    XOR_INT: DST_CHAN.CHAN_Z
+        SRC0_SEL.ALU_SRC_PV SRC0_CHAN.CHAN_Z
+        SRC1_SEL.GPR(4) SRC1_CHAN.CHAN_Z;
+    XOR_INT: DST_CHAN.CHAN_W
+        SRC0_SEL.ALU_SRC_PV SRC0_CHAN.CHAN_W
+        SRC1_SEL.GPR(4) SRC1_CHAN.CHAN_W LAST;
+    // PV <- PV ^ R5
+    XOR_INT: DST_CHAN.CHAN_X
+        SRC0_SEL.ALU_SRC_PV SRC0_CHAN.CHAN_X
+        SRC1_SEL.GPR(5) SRC1_CHAN.CHAN_X;
+    XOR_INT: DST_CHAN.CHAN_Y
+        SRC0_SEL.ALU_SRC_PV SRC0_CHAN.CHAN_Y
+        SRC1_SEL.GPR(5) SRC1_CHAN.CHAN_Y;
+    XOR_INT: DST_CHAN.CHAN_Z
+        SRC0_SEL.ALU_SRC_PV SRC0_CHAN.CHAN_Z
+        SRC1_SEL.GPR(5) SRC1_CHAN.CHAN_Z;
+    XOR_INT: DST_CHAN.CHAN_W
+        SRC0_SEL.ALU_SRC_PV SRC0_CHAN.CHAN_W
+        SRC1_SEL.GPR(5) SRC1_CHAN.CHAN_W LAST;
+    // PV.x <- PV.x ^ PV.y, PV.y <- PV.z ^ PV.w
+    XOR_INT: DST_CHAN.CHAN_X
+        SRC0_SEL.ALU_SRC_PV SRC0_CHAN.CHAN_X
+        SRC1_SEL.ALU_SRC_PV SRC1_CHAN.CHAN_Y;
+    XOR_INT: DST_CHAN.CHAN_Y
+        SRC0_SEL.ALU_SRC_PV SRC0_CHAN.CHAN_Z
+        SRC1_SEL.ALU_SRC_PV SRC1_CHAN.CHAN_W LAST;
+    // R2.x <- PV.x ^ PV.y
+    XOR_INT: DST_GPR(2) DST_CHAN.CHAN_X
+        SRC0_SEL.ALU_SRC_PV SRC0_CHAN.CHAN_X
+        SRC1_SEL.ALU_SRC_PV SRC1_CHAN.CHAN_Y WRITE_MASK LAST;
+// rat0[R0.x] <- R2.x
+MEM_RAT_CACHELESS:
+    RAT_ID(0) RAT_INST.EXPORT_RAT_INST_STORE_RAW TYPE(1) RW_GPR(2) INDEX_GPR(0) ELEM_SIZE(0)
+    COMP_MASK(1) BARRIER END_OF_PROGRAM;
+end;
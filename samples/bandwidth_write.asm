@@ -0,0 +1,21 @@
+// vim: set et sw=4 sts=4 ts=8:
+// This CS is meant for a 1-D domain.
+// It measures the bandwidth of RAT writes: each work-item writes 16 bytes
+// and does nothing else.
+// It expects the following resources to be set up:
+//  constant buffer 0:
+//      items per group x, 1, 1, 0
+//      number of groups X, 1, 1, 0
+//
+//  RAT resource 0 (output buffer) with 4 dwords per work-item.
+ALU: KCACHE_BANK0(0) KCACHE_MODE0.CF_KCACHE_LOCK_1 BARRIER;
+    // R0.x <- R0.x + R1.x * Kcache_bank0(0)
+    MULADD_UINT24: DST_GPR(0) DST_CHAN.CHAN_X
+        SRC0_SEL.GPR(1) SRC0_CHAN.CHAN_X
+        SRC1_SEL.Kcache_bank0(0) SRC1_CHAN.CHAN_X
+        SRC2_SEL.GPR(0) SRC2_CHAN.CHAN_X LAST;
+// rat0[R0.x] <- R0
+MEM_RAT_CACHELESS:
+    RAT_ID(0) RAT_INST.EXPORT_RAT_INST_STORE_RAW TYPE(1) RW_GPR(0) INDEX_GPR(0) ELEM_SIZE(3)
+    COMP_MASK(15) BARRIER END_OF_PROGRAM;
+end;
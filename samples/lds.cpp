@@ -180,40 +180,16 @@ void load(r800_state& state, string const& shader, int x, int y, int z, int X, i
         radeon_bo_map(vbo, 0);
         {
             float const* p = static_cast<float*>(vbo->ptr);
-            for (std::size_t i = 0; i != outsize; ++i, ++p)
-            {
-                if (i % cols == 0) {
-                    if (i != 0) cout << '\n';
-                    if (addr != 0) {
-                        cout.width(addr);
-                        cout << i << ':' << '\t' << flush;
-                    }
-                }
-                else cout << '\t';
-                cout.width(8);
-                cout << *p;
-            }
-            cout << endl;
+            cout << float_dump<float>(p, outsize, cols, addr) << endl;
         }
         radeon_bo_unmap(vbo);  
 #endif
         radeon_bo_map(outbo, 0);
         {
             float const* p = static_cast<float*>(outbo->ptr);
-            for (std::size_t i = 0; i != outsafe; ++i, ++p)
-            {
-                if (i % cols == 0) {
-                    if (i != 0) cout << '\n';
-                    if (addr != 0) {
-                        cout.width(addr);
-                        cout << i << ':' << '\t' << flush;
-                    }
-                }
-                else cout << '\t';
-                cout.width(8);
-                cout << *p;
-            }
-            cout << endl;
+            cout << float_dump<float>(p, outsafe, cols, addr) << endl;
+            if (output_path)
+                write_dump(output_path, p, outsize, cols);
 #if 0
             cout << hex_dump<uint32_t>(static_cast<uint32_t*>(outbo->ptr), outsafe, cols, addr)
                  << endl;
@@ -8,16 +8,58 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <system_error>
 #include <string>
 
+#include <algorithm>
+#include <cctype>
+
+#include <radeon_device.hpp>
 #include <r800_state.h>
 #include <cs_image.h>
 #include <evergreen_reg.h>
 
 using namespace std;
 
+/// Pathname of a binary copy of the kernel output (-o), or 0.
+const char* output_path = 0;
+
+/// Look up the group shape which isa/tune_kernel recorded for a kernel, a
+/// device family and the size class of a domain (floor(log2(items))).
+/// \param path Pathname of the tuning database.
+/// \param kernel Name of the kernel.
+/// \param family Device family.
+/// \param domain Work-items in X, Y and Z.
+/// \param size Set to the work-items per group in X, Y and Z.
+/// \returns Whether a shape which divides the domain was found.
+bool find_tuned_group(const char* path, string const& kernel, string const& family, int const* domain, int* size)
+{
+    ifstream file(path);
+    unsigned long items = (unsigned long)domain[0] * domain[1] * domain[2];
+    unsigned size_class = 0;
+    while (items >>= 1)
+        ++size_class;
+
+    for (string line; getline(file, line); ) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        istringstream s(line);
+        string k, f;
+        unsigned c;
+        int g[3];
+        if (s >> k >> f >> c >> g[0] >> g[1] >> g[2] && k == kernel && f == family && c == size_class &&
+            g[0] > 0 && g[1] > 0 && g[2] > 0 &&
+            domain[0] % g[0] == 0 && domain[1] % g[1] == 0 && domain[2] % g[2] == 0) {
+            size[0] = g[0], size[1] = g[1], size[2] = g[2];
+            return true;
+        }
+    }
+    return false;
+}
+
 void load(r800_state& state, string const& shader, int x, int y, int z, int X, int Y, int Z, int guard, int cols, int addr);
 
 int main(int argc, char* argv[])
@@ -27,9 +69,11 @@ int main(int argc, char* argv[])
     int x = 1, y = 1, z = 1;
     int X = 1, Y = 1, Z = 1;
     int guard = 16, columns = 4, address = 6;
-    bool reset = false;
+    bool reset = false, shaped = false;
+    const char* tuning = 0;
+    const char* family = 0;
 
-    for (int opt = 0; (opt = getopt(argc, argv, "rc:s:x:y:z:X:Y:Z:G:w:a:")) != -1; )
+    for (int opt = 0; (opt = getopt(argc, argv, "rc:s:x:y:z:X:Y:Z:G:w:a:o:t:f:")) != -1; )
         switch (opt) {
             case 'r':
                 reset = true;
@@ -42,12 +86,15 @@ int main(int argc, char* argv[])
                 break;
             case 'x':
                 x = atoi(optarg);
+                shaped = true;
                 break;
             case 'y':
                 y = atoi(optarg);
+                shaped = true;
                 break;
             case 'z':
                 z = atoi(optarg);
+                shaped = true;
                 break;
             case 'X':
                 X = atoi(optarg);
@@ -67,8 +114,17 @@ int main(int argc, char* argv[])
             case 'a':
                 address = atoi(optarg);
                 break;
+            case 'o':
+                output_path = optarg;
+                break;
+            case 't':
+                tuning = optarg;
+                break;
+            case 'f':
+                family = optarg;
+                break;
             default:
-                cerr << "Usage: " << argv[0] << " [-r] [-c<card>] [-s<s>] [-x<n>] [-y<n>] [-z<n>] [-X<n>] [-Y<n>] [-Z<n>] [-G<n>] [-w<n>] [-a<n>]\n\n"
+                cerr << "Usage: " << argv[0] << " [-r] [-c<card>] [-s<s>] [-x<n>] [-y<n>] [-z<n>] [-X<n>] [-Y<n>] [-Z<n>] [-G<n>] [-w<n>] [-a<n>] [-o<file>] [-t<file>] [-f<family>]\n\n"
                     "\t-c/dev/dri/card<n> use alternate card\n"
                     "\t-r\treset GPU before starting\n"
                     "\t-s <s>\tshader variant suffix\n"
@@ -80,7 +136,11 @@ int main(int argc, char* argv[])
                     "\t-Z <n>\tnumber of groups in Z (1)\n"
                     "\t-G <n>\tbuffer guard size (16)\n"
                     "\t-w <n>\tcolumns in the output (4)\n"
-                    "\t-a <n>\taddress columns (6)\n" << endl;
+                    "\t-a <n>\taddress columns (6)\n"
+                    "\t-o <f>\talso write the output without guard to a file, .npy or raw\n"
+                    "\t-t <f>\ttuning database (tuning.txt next to the kernel): without -x, -y and -z, -X, -Y and -Z\n"
+                    "\t\tare the work-items of the domain, grouped as tuned for it if it is there\n"
+                    "\t-f <s>\tdevice family of the tuning (that of the card)\n" << endl;
                 return EXIT_FAILURE;
         }
 
@@ -90,6 +150,25 @@ int main(int argc, char* argv[])
         shader += suffix;
         shader += ".bin";
 
+        // The tunings are those of the family of the card, unless -f names
+        // another; the database names families in lower case.
+        radeon_device dev(card, false);
+        string device_family = family ? family : dev.family_name();
+        transform(device_family.begin(), device_family.end(), device_family.begin(), ::tolower);
+
+        // Launch with the tuned group shape, if there is one.
+        if (!shaped) {
+            string::size_type slash = shader.rfind('/');
+            string kernel = shader.substr(slash + 1, shader.size() - slash - 5);
+            string database = tuning ? tuning : shader.substr(0, slash + 1) + "tuning.txt";
+            int domain[] = { X, Y, Z }, size[3];
+            if (find_tuned_group(database.c_str(), kernel, device_family, domain, size)) {
+                x = size[0], y = size[1], z = size[2];
+                X /= x, Y /= y, Z /= z;
+                cerr << "Tuned groups of " << x << "x" << y << "x" << z << " from " << database << endl;
+            }
+        }
+
         int fd = open(card, O_RDWR, 0);
         if (fd == -1) throw system_error(error_code(errno, system_category()), card);
 
@@ -139,6 +139,8 @@ void load(r800_state& state, string const& shader, int x, int y, int z, int X, i
         radeon_bo_map(outbo, 0);
         cout << hex_dump<uint32_t>(static_cast<uint32_t*>(outbo->ptr), outsafe, cols, addr)
              << endl;
+        if (output_path)
+            write_dump(output_path, static_cast<uint32_t*>(outbo->ptr), outsize, cols);
         radeon_bo_unmap(outbo);  
     }
   